@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/time.h>
 #include "esp_err.h"
 
@@ -39,6 +40,9 @@ typedef struct {
 
 /**
  * @brief type of callback function when host opens the UVC device
+ *
+ * Runs in the task that calls fb_get_cb, once TinyUSB is done with the
+ * frame it was transmitting: every frame handed out has been returned.
  */
 typedef esp_err_t (*uvc_input_start_cb_t)(uvc_format_t format, int width, int height, int rate, void *cb_ctx);
 
@@ -49,11 +53,21 @@ typedef uvc_fb_t* (*uvc_input_fb_get_cb_t)(void *cb_ctx);
 
 /**
  * @brief type of callback function when the frame buffer is no longer used
+ *
+ * With CONFIG_UVC_ZERO_COPY, DMA-capable frames are transmitted straight from
+ * fb->buf, so this is only called once the USB transfer has completed.
+ *
+ * Up to CONFIG_UVC_XFER_BUFFER_COUNT frames may be outstanding at once (one
+ * on the wire, the rest staged). They are always returned in the order
+ * fb_get_cb handed them out.
  */
 typedef void (*uvc_input_fb_return_cb_t)(uvc_fb_t *fb, void *cb_ctx);
 
 /**
  * @brief type of callback function when host closes the UVC device
+ *
+ * Like start_cb, runs once every frame handed out has been returned (at
+ * uvc_device_deinit(), in its caller's task).
  */
 typedef void (*uvc_input_stop_cb_t)(void *cb_ctx);
 
@@ -61,8 +75,9 @@ typedef void (*uvc_input_stop_cb_t)(void *cb_ctx);
  * @brief Configuration for the UVC device
  */
 typedef struct {
-    uint8_t *uvc_buffer;                   /*!< UVC transfer buffer */
-    uint32_t uvc_buffer_size;              /*!< UVC transfer buffer size, should bigger than one frame size */
+    uint8_t *uvc_buffer;                   /*!< UVC transfer buffer (copy path; optional with CONFIG_UVC_ZERO_COPY) */
+    uint32_t uvc_buffer_size;              /*!< Size of one transfer buffer slot, should bigger than one frame size */
+    uint32_t uvc_buffer_count;             /*!< Slots of uvc_buffer_size laid out back to back in uvc_buffer (0 = 1, max CONFIG_UVC_XFER_BUFFER_COUNT) */
     uvc_input_start_cb_t start_cb;         /*!< callback function of host open the UVC device with the specific format and resolution */
     uvc_input_fb_get_cb_t fb_get_cb;       /*!< callback function of host request a new frame buffer */
     uvc_input_fb_return_cb_t fb_return_cb; /*!< callback function of the frame buffer is no longer used */
@@ -70,6 +85,28 @@ typedef struct {
     void *cb_ctx;                          /*!< callback context, for user specific usage */
 } uvc_device_config_t;
 
+/**
+ * @brief Upper bounds (us) of the frame pacing jitter histogram buckets
+ *
+ * Jitter is the absolute difference between the measured time from one
+ * frame submission to the next and the committed frame interval. The last
+ * bucket collects everything above the last bound.
+ */
+#define UVC_JITTER_BUCKET_LIMITS_US { 50, 100, 250, 500, 1000, 2000, 5000, 10000 }
+#define UVC_JITTER_BUCKETS          9
+
+/**
+ * @brief Frame pacing statistics of one UVC stream
+ */
+typedef struct {
+    uint32_t interval_us;                  /*!< Committed frame interval */
+    uint32_t frames;                       /*!< Frames submitted */
+    uint32_t late;                         /*!< Frame deadlines missed by more than one interval */
+    uint32_t jitter_max_us;                /*!< Largest jitter seen */
+    uint64_t jitter_sum_us;                /*!< Sum of jitter over all inter-arrival samples */
+    uint32_t hist[UVC_JITTER_BUCKETS];     /*!< Inter-arrival jitter histogram */
+} uvc_pacing_stats_t;
+
 /**
  * @brief Configure the UVC device
  *
@@ -93,6 +130,16 @@ esp_err_t uvc_device_init(void);
  */
 esp_err_t uvc_device_deinit(void);
 
+/**
+ * @brief Read the frame pacing statistics of a stream
+ *
+ * @param index  UVC device index number (0)
+ * @param stats  Filled with the statistics accumulated since the last reset
+ * @param reset  Clear the statistics after reading
+ * @return ESP_OK on success
+ */
+esp_err_t uvc_device_get_pacing_stats(int index, uvc_pacing_stats_t *stats, bool reset);
+
 /**
  * @brief Set the default value for an XU control (cur and def fields).
  *
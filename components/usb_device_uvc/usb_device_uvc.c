@@ -14,6 +14,7 @@
 #include "freertos/event_groups.h"
 #include "esp_timer.h"
 #include "esp_check.h"
+#include "esp_memory_utils.h"
 #if CONFIG_TINYUSB_RHPORT_HS
 #include "soc/hp_sys_clkrst_reg.h"
 #include "soc/hp_system_reg.h"
@@ -31,6 +32,55 @@ static const char *TAG = "usbd_uvc";
 #define TUSB_EVENT_EXIT_DONE    (1<<1)
 #define UVC1_EVENT_EXIT         (1<<2)
 #define UVC1_EVENT_EXIT_DONE    (1<<3)
+#define UVC1_EVENT_PENDING_DONE (1<<4)
+
+/* Video task notification bits */
+#define UVC_NOTIFY_FRAME_TICK   (1<<0)  /* Frame clock reached the next deadline */
+#define UVC_NOTIFY_XFER_DONE    (1<<1)  /* TinyUSB finished the frame transfer */
+#define UVC_NOTIFY_PENDING      (1<<2)  /* A pipeline start/stop is waiting to run */
+
+/* dwFrameInterval is in 100 ns units */
+#define UVC_DEFAULT_INTERVAL_100NS  333333  /* 30 fps */
+
+/* Longest the video task sleeps without re-checking streaming state */
+#define UVC_IDLE_WAIT_TICKS     pdMS_TO_TICKS(10)
+
+/* Frames in the transfer queue: one on the wire, the rest staged */
+#define UVC_XFER_DEPTH          CONFIG_UVC_XFER_BUFFER_COUNT
+#define UVC_COPY_BUF_NONE       (-1)
+
+typedef struct {
+    uvc_fb_t *fb;               /* Frame still held (zero-copy, or not copied yet), or NULL */
+    uint8_t *buf;               /* Data handed to TinyUSB; NULL until copied */
+    uint32_t len;
+    int copy_idx;               /* uvc_buffer slot holding the copy, or UVC_COPY_BUF_NONE */
+} uvc_xfer_t;
+
+/* Pipeline start/stop requested by the host, run by the video task */
+typedef enum {
+    UVC_PENDING_NONE,
+    UVC_PENDING_START,          /* Commit: (re)start with the committed format */
+    UVC_PENDING_STOP,           /* Suspend: stop the pipeline */
+} uvc_pending_t;
+
+/*
+ * FIFO of frames owned by the component. The head is the frame on the
+ * wire while a transfer is running; the frames behind it were fetched at
+ * their own deadlines and go out as soon as the wire is free.
+ */
+typedef struct {
+    uvc_xfer_t slot[UVC_XFER_DEPTH];
+    uint32_t head;
+    uint32_t count;
+    uint32_t copy_busy;         /* Bitmask of uvc_buffer slots in use */
+    uint32_t epoch;             /* Bumped by every flush */
+    bool on_wire;               /* Head handed to TinyUSB, XFER_DONE not handled yet */
+    uvc_pending_t pending;      /* Waits until nothing is on the wire */
+    uvc_format_t pending_format;
+    const uvc_frame_info_t *pending_fi;
+    bool pending_wait;          /* Requester waits for UVC1_EVENT_PENDING_DONE */
+    esp_err_t pending_ret;
+} uvc_xfer_queue_t;
 
 typedef struct {
     usb_phy_handle_t phy_hdl;
@@ -39,11 +89,17 @@ typedef struct {
     uvc_device_config_t user_config[UVC_CAM_NUM];
     TaskHandle_t uvc_task_hdl[UVC_CAM_NUM];
     TaskHandle_t tusb_task_hdl;
-    uint32_t interval_ms[UVC_CAM_NUM];
+    uint32_t interval_100ns[UVC_CAM_NUM];       /* Committed dwFrameInterval */
+    esp_timer_handle_t frame_timer[UVC_CAM_NUM];
+    uvc_pacing_stats_t pacing[UVC_CAM_NUM];
+    uvc_xfer_queue_t xfer_q[UVC_CAM_NUM];
     EventGroupHandle_t event_group;
 } uvc_device_t;
 
 static uvc_device_t s_uvc_device;
+static portMUX_TYPE s_xfer_lock = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE s_pacing_lock = portMUX_INITIALIZER_UNLOCKED;
+static const uint32_t s_jitter_limits_us[UVC_JITTER_BUCKETS - 1] = UVC_JITTER_BUCKET_LIMITS_US;
 
 static void usb_phy_init(void)
 {
@@ -60,11 +116,6 @@ static void usb_phy_init(void)
     usb_new_phy(&phy_conf, &s_uvc_device.phy_hdl);
 }
 
-static inline uint32_t get_time_millis(void)
-{
-    return (uint32_t)(esp_timer_get_time() / 1000);
-}
-
 static void tusb_device_task(void *arg)
 {
     while (1) {
@@ -89,13 +140,14 @@ void tud_umount_cb(void)
     ESP_LOGI(TAG, "UN-Mount");
 }
 
+static esp_err_t uvc_request(int index, uvc_pending_t action, uvc_format_t format,
+                             const uvc_frame_info_t *fi);
+
 void tud_suspend_cb(bool remote_wakeup_en)
 {
     (void)remote_wakeup_en;
-    if (s_uvc_device.user_config[0].stop_cb) {
-        s_uvc_device.user_config[0].stop_cb(s_uvc_device.user_config[0].cb_ctx);
-    }
     ESP_LOGI(TAG, "Suspend");
+    uvc_request(0, UVC_PENDING_STOP, s_uvc_device.format[0], NULL);
 }
 
 void tud_resume_cb(void)
@@ -104,18 +156,464 @@ void tud_resume_cb(void)
 }
 
 /*
- * Video streaming task: polls TinyUSB streaming state, captures frames,
- * copies into the UVC transfer buffer, and submits via tud_video_n_frame_xfer.
+ * A frame can be submitted in place when its buffer is DMA-reachable and
+ * word-aligned (camera MMAP, encoder capture and heap_caps PSRAM buffers
+ * all are).  Anything else goes through the uvc_buffer copy path.
+ */
+static bool uvc_fb_can_zero_copy(const uvc_fb_t *fb)
+{
+#if CONFIG_UVC_ZERO_COPY
+    if (((uintptr_t)fb->buf & 3) != 0) {
+        return false;
+    }
+    return esp_ptr_dma_capable(fb->buf) || esp_ptr_dma_ext_capable(fb->buf);
+#else
+    (void)fb;
+    return false;
+#endif
+}
+
+/*
+ * Hand the frames the component owns back to the application.  With
+ * keep_wire the frame TinyUSB is transmitting stays queued until its
+ * XFER_DONE, and only the staged frames behind it go back.  Without it
+ * every frame goes, which is only safe once TinyUSB has closed the stream
+ * or never took the head.  Whoever empties the queue first performs the
+ * returns.
+ */
+static void uvc_release_xfer_fb(int index, bool keep_wire)
+{
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+    uvc_fb_t *fbs[UVC_XFER_DEPTH];
+    uint32_t n = 0;
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    uint32_t keep = keep_wire && q->on_wire && q->count > 0 ? 1 : 0;
+    for (uint32_t i = keep; i < q->count; i++) {
+        uvc_xfer_t *x = &q->slot[(q->head + i) % UVC_XFER_DEPTH];
+        if (x->fb) {
+            fbs[n++] = x->fb;
+        }
+    }
+    if (keep) {
+        int copy_idx = q->slot[q->head].copy_idx;
+        q->copy_busy = copy_idx != UVC_COPY_BUF_NONE ? 1u << copy_idx : 0;
+    } else {
+        q->head = 0;
+        q->copy_busy = 0;
+        q->on_wire = false;
+    }
+    q->count = keep;
+    q->epoch++;
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    for (uint32_t i = 0; i < n; i++) {
+        s_uvc_device.user_config[index].fb_return_cb(fbs[i], s_uvc_device.user_config[index].cb_ctx);
+    }
+}
+
+/* Claim a free uvc_buffer slot. Caller holds s_xfer_lock. */
+static int uvc_copy_buf_claim(int index)
+{
+    uint32_t count = s_uvc_device.user_config[index].uvc_buffer_count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!(s_uvc_device.xfer_q[index].copy_busy & (1u << i))) {
+            s_uvc_device.xfer_q[index].copy_busy |= 1u << i;
+            return (int)i;
+        }
+    }
+    return UVC_COPY_BUF_NONE;
+}
+
+/*
+ * Copy a frame into a claimed uvc_buffer slot and return it to the
+ * application. Returns false (frame returned, slot freed) if the queue was
+ * flushed meanwhile or the frame does not fit.
+ */
+static bool uvc_copy_frame(int index, uvc_xfer_t *x, uint32_t epoch)
+{
+    uvc_device_config_t *cfg = &s_uvc_device.user_config[index];
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+    uvc_fb_t *fb = x->fb;
+    bool ok = fb->len <= cfg->uvc_buffer_size;
+
+    uint8_t *dst = cfg->uvc_buffer + (size_t)x->copy_idx * cfg->uvc_buffer_size;
+    if (ok) {
+        memcpy(dst, fb->buf, fb->len);
+    } else {
+        ESP_LOGW(TAG, "frame size %" PRIu32 " > buffer %" PRIu32 ", dropping",
+                 (uint32_t)fb->len, cfg->uvc_buffer_size);
+    }
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    if (q->epoch != epoch) {
+        ok = false;     /* Flushed: the slot bitmask was already reset */
+    } else if (!ok) {
+        q->copy_busy &= ~(1u << x->copy_idx);
+    }
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    x->fb = NULL;
+    x->buf = ok ? dst : NULL;
+    cfg->fb_return_cb(fb, cfg->cb_ctx);
+    return ok;
+}
+
+/*
+ * Queue a frame fetched from the application. Zero-copy frames are kept
+ * as-is; others are copied right away if a uvc_buffer slot is free, or
+ * later by uvc_xfer_submit() once the frame on the wire releases its slot.
+ * Returns false if the frame was dropped.
+ */
+static bool uvc_xfer_stage(int index, uvc_fb_t *fb)
+{
+    uvc_device_config_t *cfg = &s_uvc_device.user_config[index];
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+    uvc_xfer_t x = {
+        .fb = fb,
+        .buf = NULL,
+        .len = fb->len,
+        .copy_idx = UVC_COPY_BUF_NONE,
+    };
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    uint32_t epoch = q->epoch;
+    if (uvc_fb_can_zero_copy(fb)) {
+        /* TinyUSB reads straight from the producer's buffer */
+        x.buf = fb->buf;
+    } else {
+        x.copy_idx = uvc_copy_buf_claim(index);
+    }
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    if (!x.buf && x.copy_idx == UVC_COPY_BUF_NONE && !cfg->uvc_buffer) {
+        ESP_LOGW(TAG, "no uvc_buffer for a non-DMA frame, dropping");
+        cfg->fb_return_cb(fb, cfg->cb_ctx);
+        return false;
+    }
+    if (x.copy_idx != UVC_COPY_BUF_NONE && !uvc_copy_frame(index, &x, epoch)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    bool queued = q->epoch == epoch && q->count < UVC_XFER_DEPTH;
+    if (queued) {
+        q->slot[(q->head + q->count) % UVC_XFER_DEPTH] = x;
+        q->count++;
+    } else if (x.copy_idx != UVC_COPY_BUF_NONE && q->epoch == epoch) {
+        q->copy_busy &= ~(1u << x.copy_idx);
+    }
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    if (!queued && x.fb) {
+        cfg->fb_return_cb(x.fb, cfg->cb_ctx);
+    }
+    return queued;
+}
+
+static uint32_t uvc_xfer_pending(int index)
+{
+    portENTER_CRITICAL(&s_xfer_lock);
+    uint32_t count = s_uvc_device.xfer_q[index].count;
+    portEXIT_CRITICAL(&s_xfer_lock);
+    return count;
+}
+
+/*
+ * Hand the head of the queue to TinyUSB, copying it first if it is still
+ * waiting for a uvc_buffer slot. Returns false if nothing was submitted
+ * (queue empty, frame dropped, or host stopped streaming).
+ */
+static bool uvc_xfer_submit(int index)
+{
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+    uvc_xfer_t *x;
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    if (q->count == 0) {
+        portEXIT_CRITICAL(&s_xfer_lock);
+        return false;
+    }
+    uint32_t epoch = q->epoch;
+    x = &q->slot[q->head];
+    uvc_xfer_t head = *x;
+    if (!head.buf) {
+        /* The copy below owns the frame from here on */
+        x->fb = NULL;
+        head.copy_idx = uvc_copy_buf_claim(index);
+    }
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    if (!head.buf) {
+        bool copied = head.copy_idx != UVC_COPY_BUF_NONE && uvc_copy_frame(index, &head, epoch);
+
+        portENTER_CRITICAL(&s_xfer_lock);
+        if (q->epoch == epoch) {
+            if (copied) {
+                *x = head;
+            } else {
+                q->head = (q->head + 1) % UVC_XFER_DEPTH;
+                q->count--;
+            }
+        }
+        portEXIT_CRITICAL(&s_xfer_lock);
+
+        if (!copied) {
+            /* uvc_copy_frame returns the frame itself; without a slot it is still ours */
+            if (head.copy_idx == UVC_COPY_BUF_NONE) {
+                ESP_LOGW(TAG, "no free uvc_buffer slot, dropping frame");
+                s_uvc_device.user_config[index].fb_return_cb(head.fb, s_uvc_device.user_config[index].cb_ctx);
+            }
+            return false;
+        }
+    }
+
+    /* A flush took the frame back meanwhile, or a pipeline start/stop
+     * waits for the wire to be free */
+    portENTER_CRITICAL(&s_xfer_lock);
+    bool send = q->epoch == epoch && q->pending == UVC_PENDING_NONE;
+    q->on_wire = send;
+    portEXIT_CRITICAL(&s_xfer_lock);
+    if (!send) {
+        return false;
+    }
+
+    if (!tud_video_n_frame_xfer(index, 0, (void *)head.buf, head.len)) {
+        /* Host stopped streaming between the check and now */
+        uvc_release_xfer_fb(index, false);
+        return false;
+    }
+    return true;
+}
+
+/* The head transfer completed: release its frame or uvc_buffer slot */
+static void uvc_xfer_complete(int index)
+{
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+    uvc_fb_t *fb = NULL;
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    if (q->on_wire && q->count > 0) {
+        uvc_xfer_t *x = &q->slot[q->head];
+        fb = x->fb;
+        if (x->copy_idx != UVC_COPY_BUF_NONE) {
+            q->copy_busy &= ~(1u << x->copy_idx);
+        }
+        q->head = (q->head + 1) % UVC_XFER_DEPTH;
+        q->count--;
+    }
+    q->on_wire = false;
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    if (fb) {
+        s_uvc_device.user_config[index].fb_return_cb(fb, s_uvc_device.user_config[index].cb_ctx);
+    }
+}
+
+/*
+ * Have the video task start or stop the pipeline.  Staged frames go back
+ * right away.  A frame TinyUSB is still transmitting points into the
+ * pipeline's buffers, so the request then runs after its XFER_DONE, or
+ * once the stream closes; the caller, in the TinyUSB task, cannot wait for
+ * that and gets ESP_OK.  Otherwise waits for the callback's result.
+ */
+static esp_err_t uvc_request(int index, uvc_pending_t action, uvc_format_t format,
+                             const uvc_frame_info_t *fi)
+{
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+
+    xEventGroupClearBits(s_uvc_device.event_group, UVC1_EVENT_PENDING_DONE);
+    uvc_release_xfer_fb(index, true);
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    bool wait = !q->on_wire;
+    q->pending = action;
+    q->pending_format = format;
+    q->pending_fi = fi;
+    q->pending_wait = wait;
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    if (!wait) {
+        ESP_LOGI(TAG, "Frame still on the wire, %s after its transfer",
+                 action == UVC_PENDING_START ? "starting" : "stopping");
+        return ESP_OK;
+    }
+    if (xEventGroupGetBits(s_uvc_device.event_group) & UVC1_EVENT_EXIT) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xTaskNotify(s_uvc_device.uvc_task_hdl[index], UVC_NOTIFY_PENDING, eSetBits);
+    xEventGroupWaitBits(s_uvc_device.event_group, UVC1_EVENT_PENDING_DONE,
+                        pdTRUE, pdTRUE, portMAX_DELAY);
+    return q->pending_ret;
+}
+
+static bool uvc_has_pending(int index)
+{
+    portENTER_CRITICAL(&s_xfer_lock);
+    bool pending = s_uvc_device.xfer_q[index].pending != UVC_PENDING_NONE;
+    portEXIT_CRITICAL(&s_xfer_lock);
+    return pending;
+}
+
+/*
+ * Video task, with nothing on the wire: run the requested start/stop.
+ * Every frame still queued goes back first, since stopping the pipeline
+ * frees their buffers.  With cancel, only answers a waiting requester.
+ * Returns true if a request was taken.
+ */
+static bool uvc_run_pending(int index, bool cancel)
+{
+    uvc_device_config_t *cfg = &s_uvc_device.user_config[index];
+    uvc_xfer_queue_t *q = &s_uvc_device.xfer_q[index];
+
+    portENTER_CRITICAL(&s_xfer_lock);
+    uvc_pending_t action = q->pending;
+    uvc_format_t format = q->pending_format;
+    const uvc_frame_info_t *fi = q->pending_fi;
+    bool wait = q->pending_wait;
+    q->pending = UVC_PENDING_NONE;
+    q->pending_wait = false;
+    portEXIT_CRITICAL(&s_xfer_lock);
+
+    if (action == UVC_PENDING_NONE) {
+        return false;
+    }
+
+    esp_err_t ret = ESP_ERR_INVALID_STATE;
+    if (!cancel) {
+        uvc_release_xfer_fb(index, false);
+        if (action == UVC_PENDING_START) {
+            ESP_LOGI(TAG, "Starting: %ux%u @%ufps format=%d",
+                     fi->width, fi->height, fi->max_fps, format);
+            ret = cfg->start_cb(format, fi->width, fi->height, fi->max_fps, cfg->cb_ctx);
+            if (ret != ESP_OK && !wait) {
+                ESP_LOGE(TAG, "start_cb failed: %s", esp_err_to_name(ret));
+            }
+        } else {
+            cfg->stop_cb(cfg->cb_ctx);
+            ret = ESP_OK;
+        }
+    }
+    if (wait) {
+        q->pending_ret = ret;
+        xEventGroupSetBits(s_uvc_device.event_group, UVC1_EVENT_PENDING_DONE);
+    }
+    return true;
+}
+
+/*
+ * ---- Frame clock ----
+ *
+ * A one-shot esp_timer is armed for every frame deadline and wakes the
+ * video task through a task notification. Deadlines are derived from the
+ * stream start plus a running sum of dwFrameInterval in 100 ns units, so
+ * rounding never accumulates (333333 x 100 ns stays 30.000 fps instead of
+ * drifting to 33 ms / 30.3 fps) and a late wakeup does not push the
+ * following frames back.
+ */
+typedef struct {
+    int64_t epoch_us;           /* Time of deadline 0 */
+    uint64_t elapsed_100ns;     /* Offset of the current deadline from epoch */
+    uint32_t interval_100ns;
+    int64_t deadline_us;
+} uvc_frame_clock_t;
+
+static void uvc_frame_timer_cb(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    xTaskNotify(s_uvc_device.uvc_task_hdl[index], UVC_NOTIFY_FRAME_TICK, eSetBits);
+}
+
+static void uvc_frame_clock_start(uvc_frame_clock_t *clk, uint32_t interval_100ns)
+{
+    clk->interval_100ns = interval_100ns;
+    clk->epoch_us = esp_timer_get_time();
+    clk->elapsed_100ns = 0;
+    clk->deadline_us = clk->epoch_us;
+}
+
+/*
+ * Move to the next deadline and arm the timer for it. Returns true if the
+ * deadline has already passed and the frame is due now. If the task fell
+ * more than a whole interval behind, the clock restarts from now instead of
+ * sending a burst of frames to catch up.
+ */
+static bool uvc_frame_clock_advance(int index, uvc_frame_clock_t *clk, int64_t now_us)
+{
+    int64_t interval_us = clk->interval_100ns / 10;
+
+    if (now_us - clk->deadline_us > interval_us) {
+        portENTER_CRITICAL(&s_pacing_lock);
+        s_uvc_device.pacing[index].late++;
+        portEXIT_CRITICAL(&s_pacing_lock);
+        clk->epoch_us = now_us;
+        clk->elapsed_100ns = 0;
+    }
+    clk->elapsed_100ns += clk->interval_100ns;
+    clk->deadline_us = clk->epoch_us + (int64_t)(clk->elapsed_100ns / 10);
+
+    int64_t wait_us = clk->deadline_us - now_us;
+    if (wait_us <= 0) {
+        return true;
+    }
+    esp_timer_handle_t timer = s_uvc_device.frame_timer[index];
+    if (esp_timer_is_active(timer)) {
+        esp_timer_stop(timer);
+    }
+    esp_timer_start_once(timer, (uint64_t)wait_us);
+    return false;
+}
+
+/* Record the jitter of one frame submission against the previous one */
+static void uvc_pacing_record(int index, int64_t prev_us, int64_t now_us, uint32_t interval_100ns)
+{
+    uvc_pacing_stats_t *st = &s_uvc_device.pacing[index];
+    int64_t delta_us = now_us - prev_us;
+    int64_t dev_us = delta_us - (int64_t)(interval_100ns / 10);
+    uint32_t jitter_us = (uint32_t)(dev_us < 0 ? -dev_us : dev_us);
+
+    int b = 0;
+    while (b < UVC_JITTER_BUCKETS - 1 && jitter_us > s_jitter_limits_us[b]) {
+        b++;
+    }
+
+    portENTER_CRITICAL(&s_pacing_lock);
+    st->frames++;
+    if (prev_us != 0) {
+        st->hist[b]++;
+        st->jitter_sum_us += jitter_us;
+        if (jitter_us > st->jitter_max_us) {
+            st->jitter_max_us = jitter_us;
+        }
+    }
+    portEXIT_CRITICAL(&s_pacing_lock);
+}
+
+/*
+ * Video streaming task: sleeps until the frame clock fires, captures a
+ * frame and submits it via tud_video_n_frame_xfer.
+ *
+ * Zero-copy: DMA-capable frame buffers are handed to TinyUSB directly and
+ * fb_return_cb is deferred until tud_video_frame_xfer_complete_cb fires.
+ * Other buffers are copied into a uvc_buffer slot and returned immediately.
+ *
+ * With more than one transfer buffer, a deadline that arrives while the
+ * previous frame is still on the wire fetches and stages the next frame
+ * right away, so it goes out the moment the transfer completes. Once the
+ * queue is full the deadline is kept pending until a slot frees up.
+ *
+ * Pipeline starts and stops the host asks for (commit, suspend) run here
+ * too, once TinyUSB is done with the frame on the wire, so the pipeline
+ * never frees a buffer that is still being transmitted.
  */
 static void video_task(void *arg)
 {
-    uint32_t start_ms = 0;
     uint32_t frame_num = 0;
-    uint32_t frame_len = 0;
     uint32_t already_start = 0;
     uint32_t tx_busy = 0;
-    uint8_t *uvc_buffer = s_uvc_device.user_config[0].uvc_buffer;
-    uint32_t uvc_buffer_size = s_uvc_device.user_config[0].uvc_buffer_size;
+    bool frame_due = false;
+    int64_t last_xfer_us = 0;
+    uvc_frame_clock_t clk = {0};
     uvc_fb_t *pic = NULL;
 
     while (1) {
@@ -126,53 +624,78 @@ static void video_task(void *arg)
         }
 
         if (!tud_video_n_streaming(0, 0)) {
+            if (already_start) {
+                esp_timer_stop(s_uvc_device.frame_timer[0]);
+            }
             already_start = 0;
             frame_num = 0;
             tx_busy = 0;
-            vTaskDelay(1);
+            frame_due = false;
+            /* TinyUSB closed the stream: it reads no frame any more */
+            uvc_release_xfer_fb(0, false);
+            uvc_run_pending(0, false);
+            /* Also discards notifications left over from the last session */
+            xTaskNotifyWait(0, UINT32_MAX, NULL, 1);
+            continue;
+        }
+
+        /* A start/stop from the host runs once nothing is on the wire */
+        if (!tx_busy && uvc_run_pending(0, false)) {
+            esp_timer_stop(s_uvc_device.frame_timer[0]);
+            already_start = 0;
+            frame_due = false;
             continue;
         }
 
         if (!already_start) {
             already_start = 1;
-            start_ms = get_time_millis();
+            uvc_frame_clock_start(&clk, s_uvc_device.interval_100ns[0]);
+            last_xfer_us = 0;
+            frame_due = true;
+            portENTER_CRITICAL(&s_pacing_lock);
+            s_uvc_device.pacing[0].interval_us = clk.interval_100ns / 10;
+            portEXIT_CRITICAL(&s_pacing_lock);
         }
 
-        uint32_t cur = get_time_millis();
-        if (cur - start_ms < s_uvc_device.interval_ms[0]) {
-            vTaskDelay(1);
+        /* Wire is free and a frame is staged: send it now */
+        if (!tx_busy && uvc_xfer_pending(0) > 0) {
+            int64_t now_us = esp_timer_get_time();
+            if (uvc_xfer_submit(0)) {
+                tx_busy = 1;
+                uvc_pacing_record(0, last_xfer_us, now_us, clk.interval_100ns);
+                last_xfer_us = now_us;
+            }
             continue;
         }
 
-        if (tx_busy) {
-            uint32_t xfer_done = ulTaskNotifyTake(pdTRUE, 1);
-            if (xfer_done == 0) {
-                continue;
+        if (!frame_due || uvc_xfer_pending(0) >= UVC_XFER_DEPTH || uvc_has_pending(0)) {
+            uint32_t bits = 0;
+            xTaskNotifyWait(0, UINT32_MAX, &bits, UVC_IDLE_WAIT_TICKS);
+            if ((bits & UVC_NOTIFY_XFER_DONE) && tx_busy) {
+                ++frame_num;
+                tx_busy = 0;
+                uvc_xfer_complete(0);
             }
-            ++frame_num;
-            tx_busy = 0;
+            if (bits & UVC_NOTIFY_FRAME_TICK) {
+                frame_due = true;
+            }
+            continue;
         }
 
-        start_ms += s_uvc_device.interval_ms[0];
+        /* Arm the next deadline before fb_get_cb so capture time is not added to it */
+        frame_due = uvc_frame_clock_advance(0, &clk, esp_timer_get_time());
+
         pic = s_uvc_device.user_config[0].fb_get_cb(s_uvc_device.user_config[0].cb_ctx);
         if (!pic) {
             ESP_LOGE(TAG, "Failed to capture picture");
             continue;
         }
-
-        if (pic->len > uvc_buffer_size) {
-            ESP_LOGW(TAG, "frame size %" PRIu32 " > buffer %" PRIu32 ", dropping",
-                     (uint32_t)pic->len, uvc_buffer_size);
-            s_uvc_device.user_config[0].fb_return_cb(pic, s_uvc_device.user_config[0].cb_ctx);
-            continue;
-        }
-        frame_len = pic->len;
-        memcpy(uvc_buffer, pic->buf, frame_len);
-        s_uvc_device.user_config[0].fb_return_cb(pic, s_uvc_device.user_config[0].cb_ctx);
-        tx_busy = 1;
-        tud_video_n_frame_xfer(0, 0, (void *)uvc_buffer, frame_len);
+        uvc_xfer_stage(0, pic);
     }
 
+    esp_timer_stop(s_uvc_device.frame_timer[0]);
+    /* Nothing runs requests from here on; don't leave the TinyUSB task waiting */
+    uvc_run_pending(0, true);
     xEventGroupSetBits(s_uvc_device.event_group, UVC1_EVENT_EXIT_DONE);
     vTaskDelete(NULL);
 }
@@ -180,7 +703,7 @@ static void video_task(void *arg)
 void tud_video_frame_xfer_complete_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx)
 {
     (void)stm_idx;
-    xTaskNotifyGive(s_uvc_device.uvc_task_hdl[ctl_idx]);
+    xTaskNotify(s_uvc_device.uvc_task_hdl[ctl_idx], UVC_NOTIFY_XFER_DONE, eSetBits);
 }
 
 /*
@@ -217,15 +740,12 @@ int tud_video_commit_cb(uint_fast8_t ctl_idx, uint_fast8_t stm_idx,
     }
 
     s_uvc_device.format[ctl_idx] = format;
-    s_uvc_device.interval_ms[ctl_idx] = parameters->dwFrameInterval / 10000;
-
-    ESP_LOGI(TAG, "Starting: %ux%u @%ufps format=%d",
-             fi->width, fi->height, fi->max_fps, format);
-
-    esp_err_t ret = s_uvc_device.user_config[ctl_idx].start_cb(
-        format, fi->width, fi->height, fi->max_fps,
-        s_uvc_device.user_config[ctl_idx].cb_ctx);
+    s_uvc_device.interval_100ns[ctl_idx] = parameters->dwFrameInterval ?
+                                           parameters->dwFrameInterval : UVC_DEFAULT_INTERVAL_100NS;
 
+    /* Frames may still be queued from the previous session; one still on
+     * the wire delays the restart until TinyUSB is done with it */
+    esp_err_t ret = uvc_request(ctl_idx, UVC_PENDING_START, format, fi);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "start_cb failed: %s", esp_err_to_name(ret));
         return VIDEO_ERROR_OUT_OF_RANGE;
@@ -460,15 +980,40 @@ esp_err_t uvc_device_config(int index, uvc_device_config_t *config)
     ESP_RETURN_ON_FALSE(config->fb_get_cb != NULL, ESP_ERR_INVALID_ARG, TAG, "fb_get_cb is NULL");
     ESP_RETURN_ON_FALSE(config->fb_return_cb != NULL, ESP_ERR_INVALID_ARG, TAG, "fb_return_cb is NULL");
     ESP_RETURN_ON_FALSE(config->stop_cb != NULL, ESP_ERR_INVALID_ARG, TAG, "stop_cb is NULL");
+#if !CONFIG_UVC_ZERO_COPY
     ESP_RETURN_ON_FALSE(config->uvc_buffer != NULL, ESP_ERR_INVALID_ARG, TAG, "uvc_buffer is NULL");
     ESP_RETURN_ON_FALSE(config->uvc_buffer_size > 0, ESP_ERR_INVALID_ARG, TAG, "uvc_buffer_size is 0");
+#endif
 
     s_uvc_device.user_config[index] = *config;
-    s_uvc_device.interval_ms[index] = 33; /* default 30fps, updated by commit_cb */
+    if (config->uvc_buffer == NULL) {
+        s_uvc_device.user_config[index].uvc_buffer_count = 0;
+    } else if (config->uvc_buffer_count == 0) {
+        s_uvc_device.user_config[index].uvc_buffer_count = 1;
+    } else if (config->uvc_buffer_count > UVC_XFER_DEPTH) {
+        s_uvc_device.user_config[index].uvc_buffer_count = UVC_XFER_DEPTH;
+    }
+    s_uvc_device.interval_100ns[index] = UVC_DEFAULT_INTERVAL_100NS; /* updated by commit_cb */
     s_uvc_device.uvc_init[index] = true;
     return ESP_OK;
 }
 
+esp_err_t uvc_device_get_pacing_stats(int index, uvc_pacing_stats_t *stats, bool reset)
+{
+    ESP_RETURN_ON_FALSE(index < UVC_CAM_NUM, ESP_ERR_INVALID_ARG, TAG, "index is invalid");
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "stats is NULL");
+
+    portENTER_CRITICAL(&s_pacing_lock);
+    *stats = s_uvc_device.pacing[index];
+    if (reset) {
+        uint32_t interval_us = s_uvc_device.pacing[index].interval_us;
+        memset(&s_uvc_device.pacing[index], 0, sizeof(uvc_pacing_stats_t));
+        s_uvc_device.pacing[index].interval_us = interval_us;
+    }
+    portEXIT_CRITICAL(&s_pacing_lock);
+    return ESP_OK;
+}
+
 esp_err_t uvc_device_init(void)
 {
     ESP_RETURN_ON_FALSE(s_uvc_device.uvc_init[0], ESP_ERR_INVALID_STATE, TAG, "uvc device not configured");
@@ -479,23 +1024,39 @@ esp_err_t uvc_device_init(void)
         return ESP_FAIL;
     }
 
+    const esp_timer_create_args_t timer_args = {
+        .callback = uvc_frame_timer_cb,
+        .arg = (void *)(intptr_t)0,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "uvc_frame",
+    };
+    if (esp_timer_create(&timer_args, &s_uvc_device.frame_timer[0]) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create frame timer");
+        vEventGroupDelete(s_uvc_device.event_group);
+        s_uvc_device.event_group = NULL;
+        return ESP_FAIL;
+    }
+
     usb_phy_init();
     bool usb_init = tusb_init();
     if (!usb_init) {
         ESP_LOGE(TAG, "USB Device Stack Init Fail");
+        esp_timer_delete(s_uvc_device.frame_timer[0]);
+        s_uvc_device.frame_timer[0] = NULL;
         vEventGroupDelete(s_uvc_device.event_group);
         s_uvc_device.event_group = NULL;
         return ESP_FAIL;
     }
 
-    BaseType_t core_id = (CONFIG_UVC_TINYUSB_TASK_CORE < 0) ? tskNO_AFFINITY : CONFIG_UVC_TINYUSB_TASK_CORE;
-    xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", 4096, NULL,
-                            CONFIG_UVC_TINYUSB_TASK_PRIORITY, &s_uvc_device.tusb_task_hdl, core_id);
-
-    core_id = (CONFIG_UVC_CAM1_TASK_CORE < 0) ? tskNO_AFFINITY : CONFIG_UVC_CAM1_TASK_CORE;
+    /* Video task first: TinyUSB callbacks hand it pipeline starts/stops */
+    BaseType_t core_id = (CONFIG_UVC_CAM1_TASK_CORE < 0) ? tskNO_AFFINITY : CONFIG_UVC_CAM1_TASK_CORE;
     xTaskCreatePinnedToCore(video_task, "UVC", 4096, NULL,
                             CONFIG_UVC_CAM1_TASK_PRIORITY, &s_uvc_device.uvc_task_hdl[0], core_id);
 
+    core_id = (CONFIG_UVC_TINYUSB_TASK_CORE < 0) ? tskNO_AFFINITY : CONFIG_UVC_TINYUSB_TASK_CORE;
+    xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", 4096, NULL,
+                            CONFIG_UVC_TINYUSB_TASK_PRIORITY, &s_uvc_device.tusb_task_hdl, core_id);
+
     ESP_LOGI(TAG, "UVC Device Start (Multi-format: YUY2+MJPEG+H264)");
     return ESP_OK;
 }
@@ -507,10 +1068,8 @@ esp_err_t uvc_device_deinit(void)
 
     xEventGroupSetBits(s_uvc_device.event_group, UVC1_EVENT_EXIT);
     xEventGroupWaitBits(s_uvc_device.event_group, UVC1_EVENT_EXIT_DONE, pdTRUE, pdTRUE, portMAX_DELAY);
-
-    if (s_uvc_device.user_config[0].stop_cb) {
-        s_uvc_device.user_config[0].stop_cb(s_uvc_device.user_config[0].cb_ctx);
-    }
+    esp_timer_delete(s_uvc_device.frame_timer[0]);
+    s_uvc_device.frame_timer[0] = NULL;
 
     xEventGroupSetBits(s_uvc_device.event_group, TUSB_EVENT_EXIT);
     EventBits_t bits = xEventGroupWaitBits(s_uvc_device.event_group, TUSB_EVENT_EXIT_DONE,
@@ -532,6 +1091,10 @@ esp_err_t uvc_device_deinit(void)
         s_uvc_device.phy_hdl = NULL;
     }
 
+    /* TinyUSB is gone, so nothing reads the queued frames any more */
+    uvc_release_xfer_fb(0, false);
+    s_uvc_device.user_config[0].stop_cb(s_uvc_device.user_config[0].cb_ctx);
+
     memset(s_uvc_device.uvc_init, 0, sizeof(s_uvc_device.uvc_init));
     ESP_LOGI(TAG, "UVC Device Deinit");
     return ESP_OK;
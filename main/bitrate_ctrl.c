@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Congestion-adaptive bitrate controller (AIMD with hysteresis).
+ *
+ * Per control interval the inputs fall into three bands:
+ *   congested  new send errors, new TCP drops, send queue drops, or
+ *              RTCP loss > ~5%
+ *              -> target *= 0.85, no increase for BC_HOLD_INTERVALS
+ *   clear      none of the above and RTCP loss <= ~1% (or no report)
+ *              -> after BC_CLEAR_INTERVALS in a row, target += step
+ *   between    loss in the 1-5% band: keep the target, restart the count
+ * The gap between the loss thresholds and the clear-interval count keep
+ * the target from oscillating around a marginal link's capacity.
+ */
+
+#include "bitrate_ctrl.h"
+
+#define BC_LOSS_HIGH_256        13      /* ~5% */
+#define BC_LOSS_LOW_256         3       /* ~1% */
+#define BC_DECREASE_NUM         85      /* x0.85 per congested interval */
+#define BC_DECREASE_DEN         100
+#define BC_HOLD_INTERVALS       3
+#define BC_CLEAR_INTERVALS      3
+#define BC_STEP_MIN_BPS         100000
+#define BC_STEP_DIV             20      /* Increase step: 5% of the ceiling */
+
+static int clamp_bps(const bitrate_ctrl_t *bc, int64_t bps)
+{
+    if (bps < bc->cfg.min_bps) {
+        return bc->cfg.min_bps;
+    }
+    if (bps > bc->cfg.max_bps) {
+        return bc->cfg.max_bps;
+    }
+    return (int)bps;
+}
+
+void bitrate_ctrl_init(bitrate_ctrl_t *bc, const bitrate_ctrl_config_t *cfg)
+{
+    *bc = (bitrate_ctrl_t) {
+        .cfg = *cfg,
+        .target_bps = cfg->max_bps,
+    };
+    if (bc->cfg.min_bps > bc->cfg.max_bps) {
+        bc->cfg.min_bps = bc->cfg.max_bps;
+    }
+}
+
+bool bitrate_ctrl_update(bitrate_ctrl_t *bc, const bitrate_ctrl_input_t *in)
+{
+    /* Counters are cumulative; a reset (new session) reads as no events */
+    uint32_t new_errors = in->send_errors >= bc->last_send_errors ?
+                          in->send_errors - bc->last_send_errors : 0;
+    uint32_t new_drops = in->tcp_drops >= bc->last_tcp_drops ?
+                         in->tcp_drops - bc->last_tcp_drops : 0;
+    bc->last_send_errors = in->send_errors;
+    bc->last_tcp_drops = in->tcp_drops;
+
+    int old = bc->target_bps;
+
+    if (new_errors > 0 || new_drops > 0 || in->queue_drops > 0 ||
+        in->loss_256 > BC_LOSS_HIGH_256) {
+        bc->target_bps = clamp_bps(bc, (int64_t)bc->target_bps * BC_DECREASE_NUM / BC_DECREASE_DEN);
+        bc->hold_intervals = BC_HOLD_INTERVALS;
+        bc->clear_intervals = 0;
+    } else if (in->loss_256 > BC_LOSS_LOW_256) {
+        bc->clear_intervals = 0;
+    } else if (bc->hold_intervals > 0) {
+        bc->hold_intervals--;
+    } else if (++bc->clear_intervals >= BC_CLEAR_INTERVALS) {
+        int step = bc->cfg.max_bps / BC_STEP_DIV;
+        if (step < BC_STEP_MIN_BPS) {
+            step = BC_STEP_MIN_BPS;
+        }
+        bc->target_bps = clamp_bps(bc, (int64_t)bc->target_bps + step);
+        bc->clear_intervals = 0;
+    }
+
+    if (bc->target_bps < old) {
+        bc->decreases++;
+    } else if (bc->target_bps > old) {
+        bc->increases++;
+    }
+    return bc->target_bps != old;
+}
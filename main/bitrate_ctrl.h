@@ -0,0 +1,63 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Congestion-adaptive bitrate controller for the RTSP H.264 stream.
+ *
+ * AIMD with hysteresis: any sign of congestion in a control interval cuts
+ * the target multiplicatively; only several clean intervals in a row,
+ * after a hold-off following the last cut, raise it by a fixed step.
+ * Pure arithmetic on counters, no I/O, so it runs unchanged on the host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int min_bps;                /* Floor of the target */
+    int max_bps;                /* Ceiling and starting point */
+} bitrate_ctrl_config_t;
+
+/* Network state at the end of one control interval */
+typedef struct {
+    uint32_t send_errors;       /* Cumulative UDP send failures (lwIP out of buffers) */
+    uint32_t tcp_drops;         /* Cumulative congestion drops on interleaved clients */
+    uint32_t queue_drops;       /* Frames the send queue dropped in this interval */
+    int loss_256;               /* Worst recent RTCP fraction lost (1/256), -1 if none */
+} bitrate_ctrl_input_t;
+
+typedef struct {
+    bitrate_ctrl_config_t cfg;
+    int target_bps;
+
+    uint32_t last_send_errors;
+    uint32_t last_tcp_drops;
+    int clear_intervals;        /* Consecutive intervals without congestion */
+    int hold_intervals;         /* Intervals left before increases resume */
+
+    uint32_t decreases;
+    uint32_t increases;
+} bitrate_ctrl_t;
+
+/**
+ * @brief Initialize the controller at cfg->max_bps
+ */
+void bitrate_ctrl_init(bitrate_ctrl_t *bc, const bitrate_ctrl_config_t *cfg);
+
+/**
+ * @brief Run one control interval
+ *
+ * @return true if target_bps changed and should be applied to the encoder
+ */
+bool bitrate_ctrl_update(bitrate_ctrl_t *bc, const bitrate_ctrl_input_t *in);
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,6 +11,7 @@
 #include <sys/mman.h>
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "linux/videodev2.h"
@@ -469,7 +470,11 @@ esp_err_t camera_stop(camera_ctx_t *ctx)
     return ESP_OK;
 }
 
-esp_err_t camera_dequeue(camera_ctx_t *ctx, uint32_t *buf_index, uint32_t *bytesused)
+/* A V4L2 timestamp further than this from esp_timer is on another clock */
+#define CAM_TIMESTAMP_MAX_SKEW_US   (1000 * 1000)
+
+esp_err_t camera_dequeue(camera_ctx_t *ctx, uint32_t *buf_index, uint32_t *bytesused,
+                         int64_t *capture_us)
 {
     struct v4l2_buffer buf = {
         .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
@@ -481,6 +486,13 @@ esp_err_t camera_dequeue(camera_ctx_t *ctx, uint32_t *buf_index, uint32_t *bytes
 
     *buf_index = buf.index;
     *bytesused = buf.bytesused;
+
+    if (capture_us) {
+        int64_t now_us = esp_timer_get_time();
+        int64_t ts_us = (int64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+        bool usable = ts_us > 0 && ts_us <= now_us && now_us - ts_us < CAM_TIMESTAMP_MAX_SKEW_US;
+        *capture_us = usable ? ts_us : now_us;
+    }
     return ESP_OK;
 }
 
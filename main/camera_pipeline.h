@@ -52,8 +52,13 @@ esp_err_t camera_stop(camera_ctx_t *ctx);
 
 /**
  * @brief Dequeue a captured frame. Returns buffer index.
+ *
+ * @param capture_us  Capture time on the esp_timer clock: the V4L2 buffer
+ *                    timestamp if the driver sets one on that clock, else
+ *                    the dequeue time.  May be NULL.
  */
-esp_err_t camera_dequeue(camera_ctx_t *ctx, uint32_t *buf_index, uint32_t *bytesused);
+esp_err_t camera_dequeue(camera_ctx_t *ctx, uint32_t *buf_index, uint32_t *bytesused,
+                         int64_t *capture_us);
 
 /**
  * @brief Re-queue a buffer after processing
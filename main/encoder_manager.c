@@ -15,9 +15,18 @@
 #include "linux/v4l2-controls.h"
 #include "esp_video_device.h"
 #include "encoder_manager.h"
+#include "nal_scanner.h"
 
 static const char *TAG = "encoder";
 
+/* SPS/PPS precede the first slice; only this much of a frame is searched */
+#define H264_PARAM_SCAN_BYTES   256
+
+#define H264_NAL_SEI            6
+#define H264_NAL_SPS            7
+#define H264_NAL_PPS            8
+#define H264_NAL_AUD            9
+
 esp_err_t encoder_open(encoder_ctx_t *ctx, encoder_type_t type)
 {
     const char *devpath;
@@ -25,6 +34,8 @@ esp_err_t encoder_open(encoder_ctx_t *ctx, encoder_type_t type)
 
     memset(ctx, 0, sizeof(*ctx));
     ctx->type = type;
+    portMUX_INITIALIZE(&ctx->param_lock);
+    atomic_init(&ctx->h264_bitrate_pending, 0);
 
     if (type == ENCODER_TYPE_JPEG) {
         devpath = ESP_VIDEO_JPEG_DEVICE_NAME;
@@ -43,6 +54,51 @@ esp_err_t encoder_open(encoder_ctx_t *ctx, encoder_type_t type)
     return ESP_OK;
 }
 
+/* Unmap every CAPTURE buffer mapped so far (streaming must be off) */
+static void unmap_capture_buffers(encoder_ctx_t *ctx)
+{
+    for (uint32_t i = 0; i < ENCODER_MAX_CAPTURE_BUFS; i++) {
+        if (ctx->capture_buffer[i] && ctx->capture_buffer[i] != MAP_FAILED) {
+            munmap(ctx->capture_buffer[i], ctx->capture_buf_size[i]);
+        }
+        ctx->capture_buffer[i] = NULL;
+        ctx->capture_buf_state[i] = ENCODER_BUF_UNUSED;
+    }
+    ctx->capture_buf_count = 0;
+}
+
+/* MMAP and queue every granted CAPTURE buffer, then start both queues */
+static esp_err_t start_capture_buffers(encoder_ctx_t *ctx)
+{
+    for (uint32_t i = 0; i < ctx->capture_buf_count; i++) {
+        struct v4l2_buffer buf = {
+            .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .memory = V4L2_MEMORY_MMAP,
+            .index  = i,
+        };
+        ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_QUERYBUF, &buf) == 0,
+                            ESP_FAIL, TAG, "QUERYBUF capture %lu failed", (unsigned long)i);
+
+        ctx->capture_buffer[i] = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, ctx->m2m_fd, buf.m.offset);
+        ESP_RETURN_ON_FALSE(ctx->capture_buffer[i] != MAP_FAILED,
+                            ESP_FAIL, TAG, "mmap capture %lu failed", (unsigned long)i);
+        ctx->capture_buf_size[i] = buf.length;
+
+        ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_QBUF, &buf) == 0,
+                            ESP_FAIL, TAG, "QBUF capture %lu failed", (unsigned long)i);
+        ctx->capture_buf_state[i] = ENCODER_BUF_QUEUED;
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_STREAMON, &type) == 0,
+                        ESP_FAIL, TAG, "STREAMON capture failed");
+    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_STREAMON, &type) == 0,
+                        ESP_FAIL, TAG, "STREAMON output failed");
+    return ESP_OK;
+}
+
 /*
  * The M2M (mem2mem) device has two sides:
  *   OUTPUT  = raw frames we feed IN to the encoder
@@ -78,18 +134,51 @@ esp_err_t encoder_start(encoder_ctx_t *ctx, uint32_t width, uint32_t height, uin
     ctx->height = height;
     ctx->input_pixfmt = input_fmt;
 
+    /* A new session's first SPS/PPS must reach consumers even if unchanged */
+    portENTER_CRITICAL(&ctx->param_lock);
+    ctx->param_seen = false;
+    portEXIT_CRITICAL(&ctx->param_lock);
+
     /* Configure M2M output (raw input to encoder) */
     struct v4l2_format fmt = {
         .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
         .fmt.pix = {
-            .width       = width,
-            .height      = height,
-            .pixelformat = input_fmt,
+            .width        = width,
+            .height       = height,
+            .pixelformat  = input_fmt,
+            .bytesperline = ctx->input_bytesperline,
         },
     };
     ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_S_FMT, &fmt) == 0,
                         ESP_FAIL, TAG, "S_FMT output failed");
 
+    /*
+     * A driver without strided input silently replaces bytesperline with
+     * the packed row size.  Read the format back and let the caller fall
+     * back to a packed copy if the stride did not stick.
+     */
+    if (ctx->input_bytesperline) {
+        memset(&fmt, 0, sizeof(fmt));
+        fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (ioctl(ctx->m2m_fd, VIDIOC_G_FMT, &fmt) != 0 ||
+            fmt.fmt.pix.bytesperline != ctx->input_bytesperline) {
+            ESP_LOGI(TAG, "Input stride %lu not supported (driver uses %lu), packed input",
+                     (unsigned long)ctx->input_bytesperline,
+                     (unsigned long)fmt.fmt.pix.bytesperline);
+            ctx->input_bytesperline = 0;
+            memset(&fmt, 0, sizeof(fmt));
+            fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            fmt.fmt.pix.width = width;
+            fmt.fmt.pix.height = height;
+            fmt.fmt.pix.pixelformat = input_fmt;
+            ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_S_FMT, &fmt) == 0,
+                                ESP_FAIL, TAG, "S_FMT output failed");
+        } else {
+            ESP_LOGI(TAG, "Strided input: %lu bytes per line",
+                     (unsigned long)ctx->input_bytesperline);
+        }
+    }
+
     struct v4l2_requestbuffers req = {
         .count  = 1,
         .type   = V4L2_BUF_TYPE_VIDEO_OUTPUT,
@@ -136,42 +225,46 @@ esp_err_t encoder_start(encoder_ctx_t *ctx, uint32_t width, uint32_t height, uin
     ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_S_FMT, &fmt) == 0,
                         ESP_FAIL, TAG, "S_FMT capture failed");
 
+    /*
+     * Several capture buffers let the encoder start frame N+1 while frame N
+     * is still being sent over USB or RTP.  The driver may grant fewer than
+     * requested; req.count holds the actual number on return.
+     */
     memset(&req, 0, sizeof(req));
-    req.count  = 1;
+    req.count  = ENCODER_MAX_CAPTURE_BUFS;
     req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
     ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_REQBUFS, &req) == 0,
                         ESP_FAIL, TAG, "REQBUFS capture failed");
+    ESP_RETURN_ON_FALSE(req.count > 0, ESP_FAIL, TAG, "REQBUFS capture granted no buffers");
+    ctx->capture_buf_count = (req.count < ENCODER_MAX_CAPTURE_BUFS) ?
+                              req.count : ENCODER_MAX_CAPTURE_BUFS;
 
-    /* MMAP the capture buffer */
-    struct v4l2_buffer buf = {
-        .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-        .memory = V4L2_MEMORY_MMAP,
-        .index  = 0,
-    };
-    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_QUERYBUF, &buf) == 0,
-                        ESP_FAIL, TAG, "QUERYBUF capture failed");
-
-    ctx->capture_buffer = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
-                               MAP_SHARED, ctx->m2m_fd, buf.m.offset);
-    ESP_RETURN_ON_FALSE(ctx->capture_buffer != MAP_FAILED,
-                        ESP_FAIL, TAG, "mmap capture failed");
-    ctx->capture_buf_size = buf.length;
+    esp_err_t ret = start_capture_buffers(ctx);
+    if (ret != ESP_OK) {
+        /* Undo whatever part of the setup went through */
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        ioctl(ctx->m2m_fd, VIDIOC_STREAMOFF, &type);
+        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        ioctl(ctx->m2m_fd, VIDIOC_STREAMOFF, &type);
+        unmap_capture_buffers(ctx);
+        return ret;
+    }
 
-    /* Queue capture buffer and start both streams */
-    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_QBUF, &buf) == 0,
-                        ESP_FAIL, TAG, "QBUF capture failed");
+    ESP_LOGI(TAG, "%s encoder started: %lux%lu (%lu capture buffers)",
+             ctx->type == ENCODER_TYPE_JPEG ? "JPEG" : "H.264",
+             (unsigned long)width, (unsigned long)height,
+             (unsigned long)ctx->capture_buf_count);
+    return ESP_OK;
+}
 
-    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_STREAMON, &type) == 0,
-                        ESP_FAIL, TAG, "STREAMON capture failed");
-    type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_STREAMON, &type) == 0,
-                        ESP_FAIL, TAG, "STREAMON output failed");
+esp_err_t encoder_set_h264_bitrate(encoder_ctx_t *ctx, int bitrate)
+{
+    ESP_RETURN_ON_FALSE(ctx->type == ENCODER_TYPE_H264, ESP_ERR_INVALID_ARG, TAG,
+                        "Not an H.264 encoder");
+    ESP_RETURN_ON_FALSE(bitrate > 0, ESP_ERR_INVALID_ARG, TAG, "Invalid bitrate %d", bitrate);
 
-    ESP_LOGI(TAG, "%s encoder started: %lux%lu",
-             ctx->type == ENCODER_TYPE_JPEG ? "JPEG" : "H.264",
-             (unsigned long)width, (unsigned long)height);
+    atomic_store(&ctx->h264_bitrate_pending, bitrate);
     return ESP_OK;
 }
 
@@ -182,18 +275,164 @@ esp_err_t encoder_stop(encoder_ctx_t *ctx)
     type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     ioctl(ctx->m2m_fd, VIDIOC_STREAMOFF, &type);
 
-    if (ctx->capture_buffer && ctx->capture_buffer != MAP_FAILED) {
-        munmap(ctx->capture_buffer, ctx->capture_buf_size);
-        ctx->capture_buffer = NULL;
-    }
+    unmap_capture_buffers(ctx);
+    ctx->input_bytesperline = 0;
+    atomic_store(&ctx->h264_bitrate_pending, 0);   /* The next start sets its own */
+    ctx->generation++;
 
     ESP_LOGI(TAG, "Encoder stopped");
     return ESP_OK;
 }
 
+/* Store one parameter set; returns true if it differs from the cached one */
+static bool store_param_set(uint8_t *dst, uint8_t *dst_len, const uint8_t *nal, size_t len)
+{
+    if (len > ENCODER_H264_PARAM_MAX) {
+        return false;
+    }
+    if (*dst_len == len && memcmp(dst, nal, len) == 0) {
+        return false;
+    }
+    memcpy(dst, nal, len);
+    *dst_len = (uint8_t)len;
+    return true;
+}
+
+/*
+ * Cache the SPS/PPS at the head of an encoded frame.  Only IDR frames carry
+ * them, and they sit ahead of the slice data, so a short prefix is enough.
+ */
+static void cache_param_sets(encoder_ctx_t *ctx, const uint8_t *frame, size_t len)
+{
+    size_t scan_len = len < H264_PARAM_SCAN_BYTES ? len : H264_PARAM_SCAN_BYTES;
+    size_t sc = nal_find_start_code(frame, 0, scan_len);
+
+    while (sc < scan_len) {
+        size_t start = sc + 3;
+        size_t next = nal_find_start_code(frame, start, scan_len);
+        if (start >= scan_len) {
+            break;
+        }
+        uint8_t type = frame[start] & 0x1F;
+        if (next >= scan_len) {
+            break;              /* Last NAL, or cut off by the scan window */
+        }
+        if (type == H264_NAL_SEI || type == H264_NAL_AUD) {
+            sc = next;
+            continue;
+        }
+        if (type != H264_NAL_SPS && type != H264_NAL_PPS) {
+            break;              /* Parameter sets precede the slices */
+        }
+        size_t end = next;
+        while (end > start && frame[end - 1] == 0) {
+            end--;
+        }
+
+        portENTER_CRITICAL(&ctx->param_lock);
+        bool changed = (type == H264_NAL_SPS) ?
+                       store_param_set(ctx->h264_sps, &ctx->h264_sps_len, frame + start, end - start) :
+                       store_param_set(ctx->h264_pps, &ctx->h264_pps_len, frame + start, end - start);
+        if (changed || !ctx->param_seen) {
+            ctx->param_gen++;
+            ctx->param_seen = true;
+        }
+        portEXIT_CRITICAL(&ctx->param_lock);
+        sc = next;
+    }
+}
+
+bool encoder_get_h264_param_sets(encoder_ctx_t *ctx, uint8_t *sps, size_t *sps_len,
+                                 uint8_t *pps, size_t *pps_len, uint32_t *gen)
+{
+    portENTER_CRITICAL(&ctx->param_lock);
+    bool ok = ctx->h264_sps_len > 0 && ctx->h264_pps_len > 0;
+    if (ok) {
+        memcpy(sps, ctx->h264_sps, ctx->h264_sps_len);
+        memcpy(pps, ctx->h264_pps, ctx->h264_pps_len);
+        *sps_len = ctx->h264_sps_len;
+        *pps_len = ctx->h264_pps_len;
+    }
+    if (gen) {
+        *gen = ctx->param_gen;
+    }
+    portEXIT_CRITICAL(&ctx->param_lock);
+    return ok;
+}
+
+/*
+ * Queue the buffers consumers have returned since the last encode.  Only
+ * the encoding task touches the fd, so QBUF never races its DQBUF.
+ */
+static void requeue_returned(encoder_ctx_t *ctx)
+{
+    for (uint32_t i = 0; i < ctx->capture_buf_count; i++) {
+        if (ctx->capture_buf_state[i] != ENCODER_BUF_RETURNED) {
+            continue;
+        }
+        struct v4l2_buffer buf = {
+            .index  = i,
+            .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+            .memory = V4L2_MEMORY_MMAP,
+        };
+        if (ioctl(ctx->m2m_fd, VIDIOC_QBUF, &buf) != 0) {
+            ESP_LOGE(TAG, "QBUF capture %lu failed", (unsigned long)i);
+            continue;           /* Retried on the next encode */
+        }
+        ctx->capture_buf_state[i] = ENCODER_BUF_QUEUED;
+    }
+}
+
+/*
+ * Apply a bitrate set by encoder_set_h264_bitrate() since the last encode,
+ * from the encoding task for the same reason as requeue_returned().
+ */
+static void apply_pending_bitrate(encoder_ctx_t *ctx)
+{
+    int bitrate = atomic_exchange(&ctx->h264_bitrate_pending, 0);
+    if (bitrate == 0) {
+        return;
+    }
+    struct v4l2_ext_control ctrl = {
+        .id = V4L2_CID_MPEG_VIDEO_BITRATE,
+        .value = bitrate,
+    };
+    struct v4l2_ext_controls ctrls = {
+        .ctrl_class = V4L2_CID_CODEC_CLASS,
+        .count      = 1,
+        .controls   = &ctrl,
+    };
+    if (ioctl(ctx->m2m_fd, VIDIOC_S_EXT_CTRLS, &ctrls) != 0) {
+        ESP_LOGW(TAG, "H.264 bitrate set to %d failed", bitrate);
+        return;
+    }
+    ctx->h264_bitrate = bitrate;
+}
+
 esp_err_t encoder_encode(encoder_ctx_t *ctx, uint8_t *raw_buf, uint32_t raw_len,
-                         uint8_t **enc_buf, uint32_t *enc_len)
+                         uint8_t **enc_buf, uint32_t *enc_len, uint32_t *enc_index)
 {
+    requeue_returned(ctx);
+    apply_pending_bitrate(ctx);
+
+    /*
+     * The M2M job only runs once a CAPTURE buffer is queued.  If every
+     * buffer is still held by a consumer, DQBUF below would block forever,
+     * so refuse the frame instead and let the caller drop it.
+     */
+    bool have_queued = false;
+    for (uint32_t i = 0; i < ctx->capture_buf_count; i++) {
+        if (ctx->capture_buf_state[i] == ENCODER_BUF_QUEUED) {
+            have_queued = true;
+            break;
+        }
+    }
+    if (!have_queued) {
+        ESP_LOGD(TAG, "All %lu capture buffers held, skipping encode",
+                 (unsigned long)ctx->capture_buf_count);
+        return ESP_ERR_INVALID_STATE;
+    }
+
     /* Feed raw frame into encoder (USERPTR - zero-copy) */
     struct v4l2_buffer out_buf = {
         .index     = 0,
@@ -212,10 +451,17 @@ esp_err_t encoder_encode(encoder_ctx_t *ctx, uint8_t *raw_buf, uint32_t raw_len,
     };
     ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_DQBUF, &cap_buf) == 0,
                         ESP_FAIL, TAG, "DQBUF capture failed");
+    ESP_RETURN_ON_FALSE(cap_buf.index < ctx->capture_buf_count,
+                        ESP_FAIL, TAG, "DQBUF capture returned bad index %lu",
+                        (unsigned long)cap_buf.index);
+    ctx->capture_buf_state[cap_buf.index] = ENCODER_BUF_HELD;
 
     /* Reclaim the output buffer */
-    ESP_RETURN_ON_FALSE(ioctl(ctx->m2m_fd, VIDIOC_DQBUF, &out_buf) == 0,
-                        ESP_FAIL, TAG, "DQBUF output failed");
+    if (ioctl(ctx->m2m_fd, VIDIOC_DQBUF, &out_buf) != 0) {
+        ESP_LOGE(TAG, "DQBUF output failed");
+        encoder_release(ctx, cap_buf.index);
+        return ESP_FAIL;
+    }
 
     /*
      * No application-level cache sync needed — both encoder drivers handle
@@ -233,8 +479,26 @@ esp_err_t encoder_encode(encoder_ctx_t *ctx, uint8_t *raw_buf, uint32_t raw_len,
      *   buffer (M2C) and re-patches the slice start code with a final C2M.
      */
 
-    *enc_buf = ctx->capture_buffer;
+    *enc_buf = ctx->capture_buffer[cap_buf.index];
     *enc_len = cap_buf.bytesused;
+    *enc_index = cap_buf.index;
+
+    if (ctx->type == ENCODER_TYPE_H264) {
+        cache_param_sets(ctx, *enc_buf, *enc_len);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t encoder_release(encoder_ctx_t *ctx, uint32_t index)
+{
+    ESP_RETURN_ON_FALSE(index < ctx->capture_buf_count, ESP_ERR_INVALID_ARG, TAG,
+                        "release of bad capture index %lu", (unsigned long)index);
+    ESP_RETURN_ON_FALSE(ctx->capture_buf_state[index] == ENCODER_BUF_HELD,
+                        ESP_ERR_INVALID_STATE, TAG,
+                        "capture buffer %lu released but not held", (unsigned long)index);
 
+    /* Handed to the encoding task, which queues it before its next job */
+    ctx->capture_buf_state[index] = ENCODER_BUF_RETURNED;
     return ESP_OK;
 }
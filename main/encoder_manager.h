@@ -7,32 +7,79 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Depth of the encoded-output (CAPTURE) buffer ring */
+#define ENCODER_MAX_CAPTURE_BUFS    CONFIG_ENCODER_CAPTURE_BUFFER_COUNT
+
+/* Largest SPS / PPS NAL unit cached from the H.264 output */
+#define ENCODER_H264_PARAM_MAX      64
+
 typedef enum {
     ENCODER_TYPE_JPEG,
     ENCODER_TYPE_H264,
 } encoder_type_t;
 
+/* Ownership of one CAPTURE buffer */
+typedef enum {
+    ENCODER_BUF_UNUSED,         /* Not granted by REQBUFS / not mapped */
+    ENCODER_BUF_QUEUED,         /* Owned by the driver, ready to receive a frame */
+    ENCODER_BUF_HELD,           /* Dequeued, encoded data owned by the application */
+    ENCODER_BUF_RETURNED,       /* Released, waiting for the encoding task to queue it */
+} encoder_buf_state_t;
+
 typedef struct {
     int m2m_fd;                 /* V4L2 M2M device fd */
     encoder_type_t type;
-    uint8_t *capture_buffer;    /* MMAP'd encoded output buffer */
-    uint32_t capture_buf_size;
+
+    /* Encoded output ring: each buffer is either queued in the driver or
+     * held by a consumer (USB, RTP) until encoder_release() is called.
+     * Only the task calling encoder_encode() issues ioctls on m2m_fd;
+     * released buffers are queued again at the start of its next encode. */
+    uint8_t *capture_buffer[ENCODER_MAX_CAPTURE_BUFS];     /* MMAP'd encoded output */
+    uint32_t capture_buf_size[ENCODER_MAX_CAPTURE_BUFS];
+    volatile uint8_t capture_buf_state[ENCODER_MAX_CAPTURE_BUFS];  /* encoder_buf_state_t */
+    uint32_t capture_buf_count;  /* Buffers granted by the driver */
+    volatile uint32_t generation;   /* Bumped by encoder_stop(); stale frame_bus
+                                     * references compare against it */
+
     uint32_t width;
     uint32_t height;
     uint32_t input_pixfmt;      /* Pixel format fed into encoder */
 
+    /* Strided input: set before encoder_start() to feed a width x height
+     * window of a larger frame whose rows are this many bytes apart
+     * (V4L2 bytesperline).  0 = tightly packed.  encoder_start() resets it
+     * to 0 if the driver does not keep the stride; encoder_stop() clears it. */
+    uint32_t input_bytesperline;
+
     /* H.264 params (0 = use defaults in encoder_start).
      * Set these before calling encoder_start() to override. */
     int h264_i_period;          /* IDR interval (default: 1 = all IDR) */
     int h264_bitrate;           /* Target bitrate in bps (default: auto) */
     int h264_min_qp;            /* Min QP (default: 20) */
     int h264_max_qp;            /* Max QP (default: 40) */
+    atomic_int h264_bitrate_pending;    /* From encoder_set_h264_bitrate(), applied
+                                         * by the next encode; 0 = none */
+
+    /* Latest SPS/PPS seen in the H.264 output (read by RTSP for the SDP) */
+    portMUX_TYPE param_lock;
+    uint8_t h264_sps[ENCODER_H264_PARAM_MAX];
+    uint8_t h264_pps[ENCODER_H264_PARAM_MAX];
+    uint8_t h264_sps_len;       /* 0 = none seen yet */
+    uint8_t h264_pps_len;
+    volatile uint32_t param_gen;    /* Bumped when the cached sets change, and
+                                     * on the first sets after each start */
+    bool param_seen;            /* Sets cached since the last encoder_start() */
 } encoder_ctx_t;
 
 /**
@@ -53,6 +100,27 @@ esp_err_t encoder_open(encoder_ctx_t *ctx, encoder_type_t type);
  */
 esp_err_t encoder_start(encoder_ctx_t *ctx, uint32_t width, uint32_t height, uint32_t input_fmt);
 
+/**
+ * @brief Change the H.264 target bitrate of a running encoder
+ *
+ * May be called from any task: the bitrate is only recorded here, and the
+ * next encoder_encode() applies it with VIDIOC_S_EXT_CTRLS before queuing
+ * the frame, without restarting the stream.  A later call before that
+ * encode replaces it.
+ */
+esp_err_t encoder_set_h264_bitrate(encoder_ctx_t *ctx, int bitrate);
+
+/**
+ * @brief Copy the cached H.264 SPS and PPS (without start codes)
+ *
+ * @param sps      Buffer of ENCODER_H264_PARAM_MAX bytes
+ * @param pps      Buffer of ENCODER_H264_PARAM_MAX bytes
+ * @param gen      Optional: param_gen matching the copied sets
+ * @return false if no parameter sets have been encoded yet
+ */
+bool encoder_get_h264_param_sets(encoder_ctx_t *ctx, uint8_t *sps, size_t *sps_len,
+                                 uint8_t *pps, size_t *pps_len, uint32_t *gen);
+
 /**
  * @brief Stop encoder streaming and release buffers
  */
@@ -61,14 +129,32 @@ esp_err_t encoder_stop(encoder_ctx_t *ctx);
 /**
  * @brief Encode a single frame
  *
- * @param ctx           Encoder context
- * @param raw_buf       Raw frame data (from camera)
- * @param raw_len       Raw frame size in bytes
- * @param[out] enc_buf  Pointer to encoded output (valid until next call)
- * @param[out] enc_len  Size of encoded output
+ * The encoded output lands in the next queued CAPTURE buffer, which is then
+ * held by the caller until encoder_release(). Fails with
+ * ESP_ERR_INVALID_STATE if every CAPTURE buffer is currently held.
+ *
+ * @param ctx            Encoder context
+ * @param raw_buf        Raw frame data (from camera); with input_bytesperline
+ *                       set, the first pixel of the window
+ * @param raw_len        Raw frame size in bytes (bytes readable from raw_buf)
+ * @param[out] enc_buf   Pointer to encoded output (valid until released)
+ * @param[out] enc_len   Size of encoded output
+ * @param[out] enc_index CAPTURE buffer index to pass to encoder_release()
  */
 esp_err_t encoder_encode(encoder_ctx_t *ctx, uint8_t *raw_buf, uint32_t raw_len,
-                         uint8_t **enc_buf, uint32_t *enc_len);
+                         uint8_t **enc_buf, uint32_t *enc_len, uint32_t *enc_index);
+
+/**
+ * @brief Return a held CAPTURE buffer to the driver for the next encode
+ *
+ * May be called from a different task than encoder_encode(): the buffer
+ * is only marked returned here, and the next encoder_encode() queues it,
+ * so the two never issue ioctls on the fd concurrently.
+ *
+ * @param ctx       Encoder context
+ * @param index     Index returned by encoder_encode()
+ */
+esp_err_t encoder_release(encoder_ctx_t *ctx, uint32_t index);
 
 #ifdef __cplusplus
 }
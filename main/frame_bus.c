@@ -0,0 +1,181 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Reference-counted encoded-frame bus.
+ *
+ * Descriptors come from a static pool; a slot is claimed with a CAS on
+ * in_use and returned after the release callback has run, so a slot is
+ * never reused while its owner is still handing the buffer back.
+ * Subscribers are FreeRTOS queues of descriptor pointers.
+ */
+
+#include "frame_bus.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include <string.h>
+
+static const char *TAG = "frame_bus";
+
+static frame_buf_t     s_pool[FRAME_BUS_POOL_SIZE];
+static frame_bus_sub_t s_subs[FRAME_BUS_MAX_SUBS];
+static uint32_t        s_sub_count;
+static portMUX_TYPE    s_sub_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t frame_bus_init(void)
+{
+    for (int i = 0; i < FRAME_BUS_POOL_SIZE; i++) {
+        atomic_init(&s_pool[i].refcnt, 0);
+        atomic_init(&s_pool[i].in_use, false);
+    }
+    ESP_LOGI(TAG, "Frame bus: %d descriptors, up to %d subscribers",
+             FRAME_BUS_POOL_SIZE, FRAME_BUS_MAX_SUBS);
+    return ESP_OK;
+}
+
+frame_buf_t *frame_buf_wrap(const uint8_t *data, size_t len, int64_t capture_us,
+                            frame_buf_release_cb_t release_cb, void *owner,
+                            uint32_t index, uint32_t generation)
+{
+    for (int i = 0; i < FRAME_BUS_POOL_SIZE; i++) {
+        frame_buf_t *fb = &s_pool[i];
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&fb->in_use, &expected, true)) {
+            fb->data       = data;
+            fb->len        = len;
+            fb->capture_us = capture_us;
+            fb->release_cb = release_cb;
+            fb->owner      = owner;
+            fb->index      = index;
+            fb->generation = generation;
+            atomic_store(&fb->refcnt, 1);
+            return fb;
+        }
+    }
+    ESP_LOGW(TAG, "Descriptor pool exhausted");
+    return NULL;
+}
+
+void frame_buf_release_encoder(frame_buf_t *fb)
+{
+    encoder_ctx_t *enc = (encoder_ctx_t *)fb->owner;
+    if (fb->generation == enc->generation) {
+        encoder_release(enc, fb->index);
+    }
+}
+
+void frame_buf_ref(frame_buf_t *fb)
+{
+    atomic_fetch_add_explicit(&fb->refcnt, 1, memory_order_relaxed);
+}
+
+void frame_buf_unref(frame_buf_t *fb)
+{
+    if (atomic_fetch_sub_explicit(&fb->refcnt, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (fb->release_cb) {
+        fb->release_cb(fb);
+    }
+    fb->data = NULL;
+    atomic_store_explicit(&fb->in_use, false, memory_order_release);
+}
+
+frame_bus_sub_t *frame_bus_subscribe(uint32_t depth)
+{
+    QueueHandle_t q = xQueueCreate(depth, sizeof(frame_buf_t *));
+    ESP_RETURN_ON_FALSE(q, NULL, TAG, "Subscriber queue create failed");
+
+    frame_bus_sub_t *sub = NULL;
+    portENTER_CRITICAL(&s_sub_lock);
+    if (s_sub_count < FRAME_BUS_MAX_SUBS) {
+        sub = &s_subs[s_sub_count];
+        sub->queue = q;
+        sub->enabled = false;
+        sub->delivered = 0;
+        sub->dropped = 0;
+        sub->flush_cb = NULL;
+        sub->flush_arg = NULL;
+        s_sub_count++;
+    }
+    portEXIT_CRITICAL(&s_sub_lock);
+
+    if (!sub) {
+        vQueueDelete(q);
+        ESP_LOGE(TAG, "Too many subscribers (max %d)", FRAME_BUS_MAX_SUBS);
+    }
+    return sub;
+}
+
+static void drain_sub(frame_bus_sub_t *sub)
+{
+    frame_buf_t *fb;
+    while (xQueueReceive(sub->queue, &fb, 0) == pdTRUE) {
+        frame_buf_unref(fb);
+    }
+}
+
+void frame_bus_sub_set_flush_cb(frame_bus_sub_t *sub, frame_bus_flush_cb_t cb, void *arg)
+{
+    sub->flush_arg = arg;
+    sub->flush_cb = cb;
+}
+
+void frame_bus_sub_enable(frame_bus_sub_t *sub, bool enable)
+{
+    if (sub->enabled == enable) {
+        return;
+    }
+    sub->enabled = enable;
+    if (!enable) {
+        drain_sub(sub);
+    }
+}
+
+bool frame_bus_has_subscribers(void)
+{
+    for (uint32_t i = 0; i < s_sub_count; i++) {
+        if (s_subs[i].enabled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void frame_bus_publish(frame_buf_t *fb)
+{
+    for (uint32_t i = 0; i < s_sub_count; i++) {
+        frame_bus_sub_t *sub = &s_subs[i];
+        if (!sub->enabled) {
+            continue;
+        }
+        frame_buf_ref(fb);
+        if (xQueueSend(sub->queue, &fb, 0) == pdTRUE) {
+            sub->delivered++;
+        } else {
+            /* Subscriber is behind: it keeps its older frames */
+            frame_buf_unref(fb);
+            sub->dropped++;
+        }
+    }
+}
+
+frame_buf_t *frame_bus_receive(frame_bus_sub_t *sub, TickType_t timeout)
+{
+    frame_buf_t *fb;
+    if (xQueueReceive(sub->queue, &fb, timeout) != pdTRUE) {
+        return NULL;
+    }
+    return fb;
+}
+
+void frame_bus_flush(void)
+{
+    for (uint32_t i = 0; i < s_sub_count; i++) {
+        drain_sub(&s_subs[i]);
+        if (s_subs[i].flush_cb) {
+            s_subs[i].flush_cb(s_subs[i].flush_arg);
+        }
+    }
+}
@@ -0,0 +1,165 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Reference-counted encoded-frame bus.
+ *
+ * An encoded frame stays in the encoder's CAPTURE buffer and is wrapped in
+ * a frame_buf_t descriptor.  The producer publishes it to every enabled
+ * subscriber (RTP sender, future recorders), each of which takes a
+ * reference; the UVC path keeps its own.  When the last reference is
+ * dropped, the release callback hands the buffer back to its owner.
+ * No frame data is copied.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "encoder_manager.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Descriptor pool: one per CAPTURE buffer of each encoder */
+#define FRAME_BUS_POOL_SIZE     (2 * ENCODER_MAX_CAPTURE_BUFS)
+#define FRAME_BUS_MAX_SUBS      4
+
+typedef struct frame_buf frame_buf_t;
+
+/* Called once when the last reference to a frame is dropped */
+typedef void (*frame_buf_release_cb_t)(frame_buf_t *fb);
+
+/* Drops the frames a subscriber took off its queue but still holds, and
+ * returns only once none is being read any more */
+typedef void (*frame_bus_flush_cb_t)(void *arg);
+
+struct frame_buf {
+    const uint8_t *data;
+    size_t len;
+    int64_t capture_us;         /* esp_timer time the raw frame was dequeued */
+
+    /* Owner bookkeeping for the release callback */
+    frame_buf_release_cb_t release_cb;
+    void *owner;                /* e.g. encoder_ctx_t */
+    uint32_t index;             /* e.g. CAPTURE buffer index */
+    uint32_t generation;        /* Owner generation when the frame was wrapped */
+
+    atomic_uint refcnt;
+    atomic_bool in_use;         /* Pool slot allocated */
+};
+
+typedef struct {
+    QueueHandle_t queue;        /* frame_buf_t *, one reference each */
+    volatile bool enabled;
+    volatile uint32_t delivered;
+    volatile uint32_t dropped;  /* Queue full at publish time */
+    frame_bus_flush_cb_t flush_cb;
+    void *flush_arg;
+} frame_bus_sub_t;
+
+/**
+ * @brief Initialize the descriptor pool (call once at startup)
+ */
+esp_err_t frame_bus_init(void);
+
+/**
+ * @brief Wrap an encoded buffer in a descriptor holding one reference
+ *
+ * @param data        Encoded frame data (not copied)
+ * @param len         Frame length in bytes
+ * @param capture_us  Capture timestamp
+ * @param release_cb  Called when the last reference is dropped
+ * @param owner       Stored in the descriptor for release_cb
+ * @param index       Stored in the descriptor for release_cb
+ * @param generation  Stored in the descriptor for release_cb
+ * @return Descriptor, or NULL if the pool is exhausted
+ */
+frame_buf_t *frame_buf_wrap(const uint8_t *data, size_t len, int64_t capture_us,
+                            frame_buf_release_cb_t release_cb, void *owner,
+                            uint32_t index, uint32_t generation);
+
+/**
+ * @brief Release callback for a frame in an encoder CAPTURE buffer
+ *
+ * Wrap with owner = encoder_ctx_t, index = buffer index and generation =
+ * the encoder's generation.  Hands the buffer back with encoder_release(),
+ * unless the encoder has been stopped since.
+ */
+void frame_buf_release_encoder(frame_buf_t *fb);
+
+/**
+ * @brief Take an additional reference
+ */
+void frame_buf_ref(frame_buf_t *fb);
+
+/**
+ * @brief Drop a reference; the last one releases the buffer
+ */
+void frame_buf_unref(frame_buf_t *fb);
+
+/**
+ * @brief Register a subscriber (disabled until frame_bus_sub_enable())
+ *
+ * @param depth  Frames the subscriber may have queued; each one holds an
+ *               encoder buffer, so keep this small.
+ */
+frame_bus_sub_t *frame_bus_subscribe(uint32_t depth);
+
+/**
+ * @brief Have frame_bus_flush() also drop the frames sub holds elsewhere
+ *
+ * For a subscriber that moves frames on into its own queue, so that those
+ * references are dropped too before the producer unmaps its buffers.
+ */
+void frame_bus_sub_set_flush_cb(frame_bus_sub_t *sub, frame_bus_flush_cb_t cb, void *arg);
+
+/**
+ * @brief Enable or disable delivery to a subscriber
+ *
+ * Disabling drops every frame still queued for it.
+ */
+void frame_bus_sub_enable(frame_bus_sub_t *sub, bool enable);
+
+/**
+ * @brief True if at least one subscriber is enabled
+ *
+ * Lets a producer skip work whose only consumer is the bus.
+ */
+bool frame_bus_has_subscribers(void);
+
+/**
+ * @brief Offer a frame to every enabled subscriber (non-blocking)
+ *
+ * Each subscriber that accepts the frame gets its own reference. The
+ * caller's reference is not consumed.
+ */
+void frame_bus_publish(frame_buf_t *fb);
+
+/**
+ * @brief Wait for the next frame on a subscription
+ *
+ * @return Frame holding one reference (caller must frame_buf_unref()),
+ *         or NULL on timeout
+ */
+frame_buf_t *frame_bus_receive(frame_bus_sub_t *sub, TickType_t timeout);
+
+/**
+ * @brief Drop every frame queued on all subscribers
+ *
+ * Runs each subscriber's flush callback as well, which blocks until the
+ * subscriber no longer reads any frame.  Call with the producer stopped,
+ * before unmapping the buffers frames point to.
+ */
+void frame_bus_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,146 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Lock-free SPSC frame ring.
+ *
+ * head and tail are free-running 32-bit counters; head - tail is the
+ * occupancy and wraps correctly with unsigned arithmetic.  The slot count
+ * is a power of two, so counter & slot_mask stays continuous across the
+ * wrap (counter % capacity would not, for a capacity like 3).  The producer
+ * publishes a slot with a release store on head after writing it, the
+ * consumer frees a slot with a release store on tail after reading it.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "frame_ring.h"
+
+static const char *TAG = "frame_ring";
+
+static inline uint8_t *slot_ptr(frame_ring_t *ring, uint32_t counter)
+{
+    return ring->slots + (size_t)(counter & ring->slot_mask) * ring->item_size;
+}
+
+static inline void release_item(frame_ring_t *ring, void *item)
+{
+    if (ring->release_cb) {
+        ring->release_cb(item, ring->cb_ctx);
+    }
+}
+
+esp_err_t frame_ring_init(frame_ring_t *ring, uint32_t capacity, uint32_t item_size,
+                          frame_ring_policy_t policy,
+                          frame_ring_release_cb_t release_cb, void *cb_ctx)
+{
+    ESP_RETURN_ON_FALSE(capacity > 0 && capacity <= (1u << 31) && item_size > 0,
+                        ESP_ERR_INVALID_ARG, TAG, "capacity and item_size must be non-zero");
+
+    uint32_t slot_count = 1;
+    while (slot_count < capacity) {
+        slot_count <<= 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->slots = heap_caps_calloc(slot_count, item_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(ring->slots, ESP_ERR_NO_MEM, TAG, "slot alloc failed");
+
+    ring->capacity   = capacity;
+    ring->slot_mask  = slot_count - 1;
+    ring->item_size  = item_size;
+    ring->policy     = policy;
+    ring->release_cb = release_cb;
+    ring->cb_ctx     = cb_ctx;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return ESP_OK;
+}
+
+void frame_ring_deinit(frame_ring_t *ring)
+{
+    if (ring->slots) {
+        heap_caps_free(ring->slots);
+        ring->slots = NULL;
+    }
+    ring->capacity = 0;
+}
+
+bool frame_ring_push(frame_ring_t *ring, const void *item)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= ring->capacity) {
+        /* Full: the consumer owns the queued slots, so drop the newcomer */
+        ring->dropped_full++;
+        release_item(ring, (void *)item);
+        return false;
+    }
+
+    memcpy(slot_ptr(ring, head), item, ring->item_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    ring->pushed++;
+
+    uint32_t occ = head + 1 - tail;
+    if (occ > ring->peak_occupancy) {
+        ring->peak_occupancy = occ;
+    }
+    return true;
+}
+
+bool frame_ring_pop(frame_ring_t *ring, void *item)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail) {
+        return false;
+    }
+
+    if (ring->policy == FRAME_RING_POLICY_LATEST) {
+        /* Release everything older than the newest entry */
+        while (head - tail > 1) {
+            release_item(ring, slot_ptr(ring, tail));
+            ring->dropped_stale++;
+            tail++;
+        }
+    }
+
+    memcpy(item, slot_ptr(ring, tail), ring->item_size);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    ring->popped++;
+    return true;
+}
+
+void frame_ring_flush(frame_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail != head) {
+        release_item(ring, slot_ptr(ring, tail));
+        tail++;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+}
+
+uint32_t frame_ring_count(const frame_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
+
+void frame_ring_get_stats(const frame_ring_t *ring, frame_ring_stats_t *stats)
+{
+    stats->pushed         = ring->pushed;
+    stats->popped         = ring->popped;
+    stats->dropped_full   = ring->dropped_full;
+    stats->dropped_stale  = ring->dropped_stale;
+    stats->occupancy      = frame_ring_count(ring);
+    stats->peak_occupancy = ring->peak_occupancy;
+}
@@ -0,0 +1,121 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Lock-free single-producer / single-consumer ring of fixed-size frame
+ * descriptors.  The producer (capture/encode task) pushes, the consumer
+ * (UVC fb_get) pops.  Entries own hardware buffers, so every entry that is
+ * dropped instead of consumed is handed to a release callback.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    FRAME_RING_POLICY_FIFO,     /* Consumer takes frames in order */
+    FRAME_RING_POLICY_LATEST,   /* Consumer skips to the newest frame, releasing older ones */
+} frame_ring_policy_t;
+
+/* Called for every entry dropped by the ring (never for popped entries) */
+typedef void (*frame_ring_release_cb_t)(void *item, void *cb_ctx);
+
+typedef struct {
+    uint32_t pushed;            /* Entries accepted from the producer */
+    uint32_t popped;            /* Entries handed to the consumer */
+    uint32_t dropped_full;      /* Producer-side drops: ring was full */
+    uint32_t dropped_stale;     /* Consumer-side drops: superseded by a newer frame */
+    uint32_t occupancy;         /* Entries queued right now */
+    uint32_t peak_occupancy;    /* High-water mark since init/reset */
+} frame_ring_stats_t;
+
+typedef struct {
+    uint8_t *slots;             /* (slot_mask + 1) * item_size bytes */
+    uint32_t capacity;
+    uint32_t slot_mask;         /* Slot count, capacity rounded up to a power of two, - 1 */
+    uint32_t item_size;
+    frame_ring_policy_t policy;
+    frame_ring_release_cb_t release_cb;
+    void *cb_ctx;
+
+    /* Free-running counters: head is written only by the producer,
+     * tail only by the consumer.  index = counter & slot_mask. */
+    atomic_uint_fast32_t head;
+    atomic_uint_fast32_t tail;
+
+    /* Statistics (each written by one side only) */
+    volatile uint32_t pushed;
+    volatile uint32_t popped;
+    volatile uint32_t dropped_full;
+    volatile uint32_t dropped_stale;
+    volatile uint32_t peak_occupancy;
+} frame_ring_t;
+
+/**
+ * @brief Allocate ring storage and reset counters
+ *
+ * @param ring        Ring to initialize
+ * @param capacity    Maximum number of queued entries
+ * @param item_size   Size of one entry in bytes
+ * @param policy      FIFO or latest-frame-wins
+ * @param release_cb  Called for entries the ring drops (may be NULL)
+ * @param cb_ctx      Passed to release_cb
+ */
+esp_err_t frame_ring_init(frame_ring_t *ring, uint32_t capacity, uint32_t item_size,
+                          frame_ring_policy_t policy,
+                          frame_ring_release_cb_t release_cb, void *cb_ctx);
+
+/**
+ * @brief Free ring storage (entries still queued must be flushed first)
+ */
+void frame_ring_deinit(frame_ring_t *ring);
+
+/**
+ * @brief Producer: queue a copy of *item
+ *
+ * If the ring is full the item is passed to release_cb and counted as a
+ * drop.
+ *
+ * @return true if queued, false if dropped
+ */
+bool frame_ring_push(frame_ring_t *ring, const void *item);
+
+/**
+ * @brief Consumer: take the next entry into *item
+ *
+ * With FRAME_RING_POLICY_LATEST, all but the newest queued entry are
+ * released and only the newest is returned.
+ *
+ * @return true if an entry was returned, false if the ring was empty
+ */
+bool frame_ring_pop(frame_ring_t *ring, void *item);
+
+/**
+ * @brief Consumer: release every queued entry
+ *
+ * Like frame_ring_pop(), only from the consumer task (or once it no longer
+ * pops): a flush racing a pop would hand out or release an entry twice.
+ */
+void frame_ring_flush(frame_ring_t *ring);
+
+/**
+ * @brief Number of entries currently queued
+ */
+uint32_t frame_ring_count(const frame_ring_t *ring);
+
+/**
+ * @brief Snapshot the drop/occupancy counters
+ */
+void frame_ring_get_stats(const frame_ring_t *ring, frame_ring_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
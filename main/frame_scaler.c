@@ -0,0 +1,445 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Software crop / scale / format conversion.
+ *
+ * Every layout is handled as three planes (Y, U, V) described by a base
+ * pointer, a row stride and a sample step, so one resampler serves packed
+ * UYVY (step 2 for Y, 4 for U/V) and planar I420 (step 1), and YUV420 ->
+ * UYVY conversion is just a plane-to-plane resample with different steps
+ * and chroma heights.
+ *
+ * Large reductions (>= 2:1 in both directions) first halve the ROI into a
+ * scratch frame with a SWAR kernel that averages four bytes per 32-bit
+ * word, then resample the (much smaller) scratch frame to the output.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "linux/videodev2.h"
+#include "sdkconfig.h"
+#include "frame_scaler.h"
+
+static const char *TAG = "frame_scaler";
+
+typedef struct {
+    const uint8_t *src;
+    uint32_t src_stride;        /* Bytes between rows */
+    uint32_t src_step;          /* Bytes between samples in a row */
+    uint32_t src_w, src_h;      /* Samples */
+    uint8_t *dst;
+    uint32_t dst_stride;
+    uint32_t dst_step;
+    uint32_t dst_w, dst_h;
+} plane_t;
+
+/* ---- Same-format center crop (memcpy per row) -------------------------- */
+
+/*
+ * Crop a UYVY frame (2 bytes/pixel, packed YUV422).
+ * Each 4-byte macro-pixel covers 2 horizontal pixels (U0 Y0 V0 Y1),
+ * so roi_x must be even to avoid splitting a macro-pixel.
+ */
+static void crop_uyvy(const uint8_t *src, uint32_t src_w, uint32_t roi_x, uint32_t roi_y,
+                      uint8_t *dst, uint32_t dst_w, uint32_t dst_h)
+{
+    uint32_t src_stride = src_w * 2;
+    uint32_t dst_stride = dst_w * 2;
+
+    const uint8_t *src_row = src + (roi_y * src_stride) + (roi_x * 2);
+    for (uint32_t y = 0; y < dst_h; y++) {
+        memcpy(dst + y * dst_stride, src_row + y * src_stride, dst_stride);
+    }
+}
+
+/*
+ * Crop a YUV420 planar (I420) frame.
+ * Y plane: full resolution, U and V planes: half in each dimension.
+ * roi_x/roi_y must be even to align with chroma subsampling.
+ */
+static void crop_yuv420(const uint8_t *src, uint32_t src_w, uint32_t src_h,
+                        uint32_t roi_x, uint32_t roi_y,
+                        uint8_t *dst, uint32_t dst_w, uint32_t dst_h)
+{
+    /* Y plane */
+    const uint8_t *src_y = src + roi_y * src_w + roi_x;
+    for (uint32_t y = 0; y < dst_h; y++) {
+        memcpy(dst + y * dst_w, src_y + y * src_w, dst_w);
+    }
+
+    /* U and V planes (quarter resolution) */
+    uint32_t src_uv_stride = src_w / 2;
+    uint32_t src_uv_size = src_uv_stride * (src_h / 2);
+    uint32_t dst_uv_w = dst_w / 2;
+    uint32_t dst_uv_h = dst_h / 2;
+    uint32_t uv_off = (roi_y / 2) * src_uv_stride + roi_x / 2;
+
+    const uint8_t *src_u = src + (src_w * src_h) + uv_off;
+    const uint8_t *src_v = src_u + src_uv_size;
+    uint8_t *dst_u = dst + (dst_w * dst_h);
+    uint8_t *dst_v = dst_u + (dst_uv_w * dst_uv_h);
+    for (uint32_t y = 0; y < dst_uv_h; y++) {
+        memcpy(dst_u + y * dst_uv_w, src_u + y * src_uv_stride, dst_uv_w);
+        memcpy(dst_v + y * dst_uv_w, src_v + y * src_uv_stride, dst_uv_w);
+    }
+}
+
+/* ---- SWAR 2:1 reduction ------------------------------------------------- */
+
+/* Per-byte floor((a + b) / 2) of two words without carries between bytes */
+static inline uint32_t swar_avg_u8x4(uint32_t a, uint32_t b)
+{
+    return (a & b) + (((a ^ b) & 0xFEFEFEFEu) >> 1);
+}
+
+static inline uint32_t load_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * Halve one 8-bit plane (I420 Y/U/V) in both directions.  One 32-bit word
+ * from each of two rows yields two output samples.
+ */
+static void halve_plane_swar(const uint8_t *src, uint32_t src_stride, uint32_t w, uint32_t h,
+                             uint8_t *dst, uint32_t dst_stride)
+{
+    uint32_t dst_w = w / 2;
+    uint32_t words = w / 4;
+
+    for (uint32_t y = 0; y < h / 2; y++) {
+        const uint8_t *r0 = src + (2 * y) * src_stride;
+        const uint8_t *r1 = r0 + src_stride;
+        uint8_t *d = dst + y * dst_stride;
+
+        for (uint32_t i = 0; i < words; i++) {
+            uint32_t v = swar_avg_u8x4(load_u32(r0 + 4 * i), load_u32(r1 + 4 * i));
+            /* Horizontal pairs summed in two 16-bit lanes */
+            uint32_t s = ((v & 0x00FF00FFu) + ((v >> 8) & 0x00FF00FFu)) >> 1;
+            d[2 * i]     = (uint8_t)s;
+            d[2 * i + 1] = (uint8_t)(s >> 16);
+        }
+        for (uint32_t x = 2 * words; x < dst_w; x++) {
+            d[x] = (uint8_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+        }
+    }
+}
+
+/*
+ * Halve a UYVY frame.  Two macro-pixels (U Y0 V Y1, one word each) of two
+ * rows become one macro-pixel: U/V average across the two words, each
+ * output Y averages the two Y samples of one input word.
+ */
+static void halve_uyvy_swar(const uint8_t *src, uint32_t src_stride, uint32_t w, uint32_t h,
+                            uint8_t *dst, uint32_t dst_stride)
+{
+    uint32_t pairs = w / 4;
+
+    for (uint32_t y = 0; y < h / 2; y++) {
+        const uint8_t *r0 = src + (2 * y) * src_stride;
+        const uint8_t *r1 = r0 + src_stride;
+        uint8_t *d = dst + y * dst_stride;
+
+        for (uint32_t i = 0; i < pairs; i++) {
+            uint32_t a = swar_avg_u8x4(load_u32(r0 + 8 * i), load_u32(r1 + 8 * i));
+            uint32_t b = swar_avg_u8x4(load_u32(r0 + 8 * i + 4), load_u32(r1 + 8 * i + 4));
+            uint32_t uv = (((a & 0x00FF00FFu) + (b & 0x00FF00FFu)) >> 1) & 0x00FF00FFu;
+            uint32_t ya = (((a >> 8) & 0xFF) + (a >> 24)) >> 1;
+            uint32_t yb = (((b >> 8) & 0xFF) + (b >> 24)) >> 1;
+            uint32_t out = uv | (ya << 8) | (yb << 24);
+            memcpy(d + 4 * i, &out, sizeof(out));
+        }
+    }
+}
+
+/* ---- Scalar resamplers (reference) -------------------------------------- */
+
+/*
+ * Area average: each output sample is the mean of the input samples its
+ * footprint covers.  Footprints never shrink below one input sample, so
+ * this degrades to nearest-neighbour when upsampling (chroma in
+ * YUV420 -> UYVY).
+ */
+static void scale_plane_box(const plane_t *p)
+{
+    for (uint32_t y = 0; y < p->dst_h; y++) {
+        uint32_t y0 = (y * p->src_h) / p->dst_h;
+        uint32_t y1 = ((y + 1) * p->src_h) / p->dst_h;
+        if (y1 <= y0) {
+            y1 = y0 + 1;
+        }
+        uint8_t *d = p->dst + y * p->dst_stride;
+
+        for (uint32_t x = 0; x < p->dst_w; x++) {
+            uint32_t x0 = (x * p->src_w) / p->dst_w;
+            uint32_t x1 = ((x + 1) * p->src_w) / p->dst_w;
+            if (x1 <= x0) {
+                x1 = x0 + 1;
+            }
+
+            uint32_t sum = 0;
+            for (uint32_t sy = y0; sy < y1; sy++) {
+                const uint8_t *s = p->src + sy * p->src_stride + x0 * p->src_step;
+                for (uint32_t sx = x0; sx < x1; sx++) {
+                    sum += *s;
+                    s += p->src_step;
+                }
+            }
+            uint32_t n = (y1 - y0) * (x1 - x0);
+            d[x * p->dst_step] = (uint8_t)((sum + n / 2) / n);
+        }
+    }
+}
+
+/* Center-aligned source position in 16.16 fixed point, clamped to the edge */
+static inline uint32_t src_pos_q16(uint32_t i, uint32_t step_q16, uint32_t src_len)
+{
+    int32_t pos = (int32_t)(i * step_q16 + step_q16 / 2) - 0x8000;
+    if (pos < 0) {
+        pos = 0;
+    }
+    if ((uint32_t)pos > ((src_len - 1) << 16)) {
+        pos = (int32_t)((src_len - 1) << 16);
+    }
+    return (uint32_t)pos;
+}
+
+static void scale_plane_bilinear(const plane_t *p)
+{
+    uint32_t step_x = (p->src_w << 16) / p->dst_w;
+    uint32_t step_y = (p->src_h << 16) / p->dst_h;
+
+    for (uint32_t y = 0; y < p->dst_h; y++) {
+        uint32_t py = src_pos_q16(y, step_y, p->src_h);
+        uint32_t y0 = py >> 16;
+        uint32_t y1 = (y0 + 1 < p->src_h) ? y0 + 1 : y0;
+        uint32_t fy = (py >> 8) & 0xFF;
+        const uint8_t *r0 = p->src + y0 * p->src_stride;
+        const uint8_t *r1 = p->src + y1 * p->src_stride;
+        uint8_t *d = p->dst + y * p->dst_stride;
+
+        for (uint32_t x = 0; x < p->dst_w; x++) {
+            uint32_t px = src_pos_q16(x, step_x, p->src_w);
+            uint32_t x0 = px >> 16;
+            uint32_t x1 = (x0 + 1 < p->src_w) ? x0 + 1 : x0;
+            uint32_t fx = (px >> 8) & 0xFF;
+            x0 *= p->src_step;
+            x1 *= p->src_step;
+
+            uint32_t top = r0[x0] * (256 - fx) + r0[x1] * fx;
+            uint32_t bot = r1[x0] * (256 - fx) + r1[x1] * fx;
+            d[x * p->dst_step] = (uint8_t)((top * (256 - fy) + bot * fy + 0x8000) >> 16);
+        }
+    }
+}
+
+/* ---- Plane setup -------------------------------------------------------- */
+
+/*
+ * Describe the Y/U/V planes of a region of a frame (or of a full output
+ * frame with x = y = 0, w = frame_w, h = frame_h).
+ */
+static void src_planes(plane_t planes[3], uint32_t fmt, const uint8_t *base,
+                       uint32_t frame_w, uint32_t frame_h,
+                       uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    if (fmt == V4L2_PIX_FMT_UYVY) {
+        uint32_t stride = frame_w * 2;
+        const uint8_t *row = base + y * stride + x * 2;
+        planes[0] = (plane_t){ .src = row + 1, .src_stride = stride, .src_step = 2,
+                               .src_w = w, .src_h = h };
+        planes[1] = (plane_t){ .src = row + 0, .src_stride = stride, .src_step = 4,
+                               .src_w = w / 2, .src_h = h };
+        planes[2] = (plane_t){ .src = row + 2, .src_stride = stride, .src_step = 4,
+                               .src_w = w / 2, .src_h = h };
+    } else {
+        uint32_t uv_stride = frame_w / 2;
+        const uint8_t *u = base + frame_w * frame_h;
+        const uint8_t *v = u + uv_stride * (frame_h / 2);
+        uint32_t uv_off = (y / 2) * uv_stride + x / 2;
+        planes[0] = (plane_t){ .src = base + y * frame_w + x, .src_stride = frame_w,
+                               .src_step = 1, .src_w = w, .src_h = h };
+        planes[1] = (plane_t){ .src = u + uv_off, .src_stride = uv_stride, .src_step = 1,
+                               .src_w = w / 2, .src_h = h / 2 };
+        planes[2] = (plane_t){ .src = v + uv_off, .src_stride = uv_stride, .src_step = 1,
+                               .src_w = w / 2, .src_h = h / 2 };
+    }
+}
+
+static void dst_planes(plane_t planes[3], uint32_t fmt, uint8_t *dst, uint32_t w, uint32_t h)
+{
+    if (fmt == V4L2_PIX_FMT_UYVY) {
+        uint32_t stride = w * 2;
+        planes[0].dst = dst + 1;
+        planes[1].dst = dst + 0;
+        planes[2].dst = dst + 2;
+        for (int i = 0; i < 3; i++) {
+            planes[i].dst_stride = stride;
+            planes[i].dst_step = (i == 0) ? 2 : 4;
+            planes[i].dst_w = (i == 0) ? w : w / 2;
+            planes[i].dst_h = h;
+        }
+    } else {
+        planes[0].dst = dst;
+        planes[1].dst = dst + w * h;
+        planes[2].dst = planes[1].dst + (w / 2) * (h / 2);
+        for (int i = 0; i < 3; i++) {
+            planes[i].dst_stride = (i == 0) ? w : w / 2;
+            planes[i].dst_step = 1;
+            planes[i].dst_w = (i == 0) ? w : w / 2;
+            planes[i].dst_h = (i == 0) ? h : h / 2;
+        }
+    }
+}
+
+static uint32_t frame_size(uint32_t fmt, uint32_t w, uint32_t h)
+{
+    return (fmt == V4L2_PIX_FMT_UYVY) ? w * h * 2 : w * h * 3 / 2;
+}
+
+/* ---- Public API --------------------------------------------------------- */
+
+const char *frame_fit_name(frame_fit_t fit)
+{
+    switch (fit) {
+    case FRAME_FIT_NONE:       return "none";
+    case FRAME_FIT_CROP:       return "crop";
+    case FRAME_FIT_SCALE:      return "scale";
+    case FRAME_FIT_CROP_SCALE: return "crop+scale";
+    }
+    return "?";
+}
+
+esp_err_t frame_scaler_init(frame_scaler_t *s, uint32_t in_fmt, uint32_t src_w, uint32_t src_h,
+                            uint32_t out_fmt, uint32_t dst_w, uint32_t dst_h,
+                            bool keep_fov, frame_scale_filter_t filter)
+{
+    ESP_RETURN_ON_FALSE(dst_w <= src_w && dst_h <= src_h, ESP_ERR_INVALID_ARG, TAG,
+                        "output %lux%lu larger than capture", (unsigned long)dst_w,
+                        (unsigned long)dst_h);
+    ESP_RETURN_ON_FALSE(in_fmt == out_fmt || (in_fmt == V4L2_PIX_FMT_YUV420 &&
+                                              out_fmt == V4L2_PIX_FMT_UYVY),
+                        ESP_ERR_NOT_SUPPORTED, TAG, "unsupported conversion");
+
+    memset(s, 0, sizeof(*s));
+    s->in_fmt  = in_fmt;
+    s->out_fmt = out_fmt;
+    s->filter  = filter;
+    s->src_w   = src_w;
+    s->src_h   = src_h;
+    s->dst_w   = dst_w;
+    s->dst_h   = dst_h;
+
+    if (keep_fov) {
+        /* Largest centered region with the output aspect ratio */
+        if ((uint64_t)dst_w * src_h >= (uint64_t)src_w * dst_h) {
+            s->roi_w = src_w;
+            s->roi_h = (uint32_t)((uint64_t)src_w * dst_h / dst_w);
+        } else {
+            s->roi_h = src_h;
+            s->roi_w = (uint32_t)((uint64_t)src_h * dst_w / dst_h);
+        }
+        /* Multiples of 4 keep macro-pixels, chroma and the SWAR kernels aligned */
+        s->roi_w &= ~3u;
+        s->roi_h &= ~1u;
+    } else {
+        s->roi_w = dst_w;
+        s->roi_h = dst_h;
+    }
+    s->roi_x = ((src_w - s->roi_w) / 2) & ~1u;
+    s->roi_y = ((src_h - s->roi_h) / 2) & ~1u;
+
+    if (s->roi_w == dst_w && s->roi_h == dst_h) {
+        s->fit = (s->roi_w == src_w && s->roi_h == src_h) ? FRAME_FIT_NONE : FRAME_FIT_CROP;
+    } else {
+        s->fit = (s->roi_w == src_w && s->roi_h == src_h) ? FRAME_FIT_SCALE : FRAME_FIT_CROP_SCALE;
+    }
+
+#if CONFIG_UVC_SCALE_SWAR
+    if ((s->fit == FRAME_FIT_SCALE || s->fit == FRAME_FIT_CROP_SCALE) &&
+            s->roi_w >= 2 * dst_w && s->roi_h >= 2 * dst_h) {
+        s->scratch_w = s->roi_w / 2;
+        s->scratch_h = s->roi_h / 2;
+        s->scratch = heap_caps_aligned_alloc(64, frame_size(in_fmt, s->scratch_w, s->scratch_h),
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        ESP_RETURN_ON_FALSE(s->scratch, ESP_ERR_NO_MEM, TAG, "scratch alloc failed");
+    }
+#endif
+
+    ESP_LOGI(TAG, "%s: %lux%lu+%lu+%lu -> %lux%lu%s%s",
+             frame_fit_name(s->fit),
+             (unsigned long)s->roi_w, (unsigned long)s->roi_h,
+             (unsigned long)s->roi_x, (unsigned long)s->roi_y,
+             (unsigned long)dst_w, (unsigned long)dst_h,
+             (s->fit >= FRAME_FIT_SCALE) ? (filter == FRAME_SCALE_BOX ? " box" : " bilinear") : "",
+             s->scratch ? " (2:1 SWAR pre-pass)" : "");
+    return ESP_OK;
+}
+
+void frame_scaler_deinit(frame_scaler_t *s)
+{
+    if (s->scratch) {
+        heap_caps_free(s->scratch);
+        s->scratch = NULL;
+    }
+}
+
+uint32_t frame_scaler_out_size(const frame_scaler_t *s)
+{
+    return frame_size(s->out_fmt, s->dst_w, s->dst_h);
+}
+
+void frame_scaler_run(const frame_scaler_t *s, const uint8_t *src, uint8_t *dst)
+{
+    /* Same-format crop: plain row copies */
+    if (s->in_fmt == s->out_fmt && (s->fit == FRAME_FIT_CROP || s->fit == FRAME_FIT_NONE)) {
+        if (s->in_fmt == V4L2_PIX_FMT_UYVY) {
+            crop_uyvy(src, s->src_w, s->roi_x, s->roi_y, dst, s->dst_w, s->dst_h);
+        } else {
+            crop_yuv420(src, s->src_w, s->src_h, s->roi_x, s->roi_y, dst, s->dst_w, s->dst_h);
+        }
+        return;
+    }
+
+    plane_t planes[3];
+
+    if (s->scratch) {
+        /* Halve the ROI first; the resampler then only covers the rest */
+        if (s->in_fmt == V4L2_PIX_FMT_UYVY) {
+            const uint8_t *roi = src + s->roi_y * s->src_w * 2 + s->roi_x * 2;
+            halve_uyvy_swar(roi, s->src_w * 2, s->roi_w, s->roi_h,
+                            s->scratch, s->scratch_w * 2);
+        } else {
+            src_planes(planes, s->in_fmt, src, s->src_w, s->src_h,
+                       s->roi_x, s->roi_y, s->roi_w, s->roi_h);
+            uint8_t *sd = s->scratch;
+            for (int i = 0; i < 3; i++) {
+                uint32_t sw = (i == 0) ? s->scratch_w : s->scratch_w / 2;
+                uint32_t sh = (i == 0) ? s->scratch_h : s->scratch_h / 2;
+                halve_plane_swar(planes[i].src, planes[i].src_stride,
+                                 planes[i].src_w, planes[i].src_h, sd, sw);
+                sd += sw * sh;
+            }
+        }
+        src_planes(planes, s->in_fmt, s->scratch, s->scratch_w, s->scratch_h,
+                   0, 0, s->scratch_w, s->scratch_h);
+    } else {
+        src_planes(planes, s->in_fmt, src, s->src_w, s->src_h,
+                   s->roi_x, s->roi_y, s->roi_w, s->roi_h);
+    }
+    dst_planes(planes, s->out_fmt, dst, s->dst_w, s->dst_h);
+
+    for (int i = 0; i < 3; i++) {
+        if (s->filter == FRAME_SCALE_BOX) {
+            scale_plane_box(&planes[i]);
+        } else {
+            scale_plane_bilinear(&planes[i]);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Software crop / scale / format conversion from the fixed sensor capture
+ * to the resolution negotiated by the host.
+ *
+ * Supported input -> output layouts:
+ *   UYVY   -> UYVY
+ *   YUV420 -> YUV420 (I420 planar)
+ *   YUV420 -> UYVY   (concurrent RTSP mode, raw USB session)
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* How the capture frame is fitted to the output frame */
+typedef enum {
+    FRAME_FIT_NONE,             /* Same size: used as-is (or format-converted) */
+    FRAME_FIT_CROP,             /* Center crop only (narrow field of view) */
+    FRAME_FIT_SCALE,            /* Same aspect ratio: scale the whole frame */
+    FRAME_FIT_CROP_SCALE,       /* Crop to the output aspect ratio, then scale */
+} frame_fit_t;
+
+typedef enum {
+    FRAME_SCALE_BOX,            /* Area average: sharpest aliasing-free downscale */
+    FRAME_SCALE_BILINEAR,       /* 2x2 interpolation: cheaper per output pixel */
+} frame_scale_filter_t;
+
+typedef struct {
+    frame_fit_t fit;
+    frame_scale_filter_t filter;
+    uint32_t in_fmt;            /* V4L2_PIX_FMT_UYVY or V4L2_PIX_FMT_YUV420 */
+    uint32_t out_fmt;
+    uint32_t src_w, src_h;      /* Full capture frame */
+    uint32_t roi_x, roi_y;      /* Region of the capture frame that is kept */
+    uint32_t roi_w, roi_h;
+    uint32_t dst_w, dst_h;
+
+    /* 2:1 pre-reduction of the ROI (SWAR fast path), or NULL */
+    uint8_t *scratch;
+    uint32_t scratch_w, scratch_h;
+} frame_scaler_t;
+
+/**
+ * @brief Plan the crop/scale for one stream and allocate scratch memory
+ *
+ * @param s         Scaler to initialize
+ * @param in_fmt    Capture pixel format
+ * @param src_w     Capture width
+ * @param src_h     Capture height
+ * @param out_fmt   Output pixel format
+ * @param dst_w     Output width (<= src_w)
+ * @param dst_h     Output height (<= src_h)
+ * @param keep_fov  Scale (after cropping to the output aspect ratio) instead
+ *                  of center-cropping at 1:1
+ * @param filter    Resampling filter used when scaling
+ */
+esp_err_t frame_scaler_init(frame_scaler_t *s, uint32_t in_fmt, uint32_t src_w, uint32_t src_h,
+                            uint32_t out_fmt, uint32_t dst_w, uint32_t dst_h,
+                            bool keep_fov, frame_scale_filter_t filter);
+
+/**
+ * @brief Free scratch memory
+ */
+void frame_scaler_deinit(frame_scaler_t *s);
+
+/**
+ * @brief True if capture frames can be used without any processing
+ */
+static inline bool frame_scaler_is_passthrough(const frame_scaler_t *s)
+{
+    return s->fit == FRAME_FIT_NONE && s->in_fmt == s->out_fmt;
+}
+
+/**
+ * @brief Size in bytes of one output frame
+ */
+uint32_t frame_scaler_out_size(const frame_scaler_t *s);
+
+/**
+ * @brief Produce one output frame from one capture frame
+ */
+void frame_scaler_run(const frame_scaler_t *s, const uint8_t *src, uint8_t *dst);
+
+/**
+ * @brief Short name of a fit mode for logging
+ */
+const char *frame_fit_name(frame_fit_t fit);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,119 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * H.264 Annex-B start-code scanner.
+ *
+ * Every start code 00 00 01 has a zero as its middle byte, and emulation
+ * prevention keeps 00 00 0x (x <= 3) out of NAL payloads, so zero bytes are
+ * rare in coded slice data.  The scanner loads one aligned 32-bit word per
+ * step and only looks at individual bytes when the word contains a zero
+ * (the classic "has zero byte" bit trick), which skips most of a frame four
+ * bytes at a time.
+ */
+
+#include "nal_scanner.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAL_INDEX_INITIAL   32
+
+/* Non-zero if any byte of v is zero */
+#define HAS_ZERO_BYTE(v)    (((v) - 0x01010101u) & ~(v) & 0x80808080u)
+
+static inline bool is_start_code(const uint8_t *p)
+{
+    return p[0] == 0 && p[1] == 0 && p[2] == 1;
+}
+
+size_t nal_find_start_code(const uint8_t *data, size_t pos, size_t len)
+{
+    if (len < 3) {
+        return len;
+    }
+    const size_t last = len - 3;        /* Last offset a start code can begin at */
+    size_t i = pos;
+
+    /* Byte by byte until the middle byte of candidate i is word aligned */
+    while (i <= last && ((uintptr_t)(data + i + 1) & 3) != 0) {
+        if (is_start_code(data + i)) {
+            return i;
+        }
+        i++;
+    }
+
+    /*
+     * The word at data + i + 1 holds the middle byte of candidates
+     * i .. i + 3, so a word without a zero byte rules all four out.
+     */
+    while (i + 3 <= last) {
+        uint32_t w;
+        memcpy(&w, data + i + 1, sizeof(w));    /* Aligned: a single lw */
+        if (HAS_ZERO_BYTE(w)) {
+            for (int k = 0; k < 4; k++) {
+                if (is_start_code(data + i + k)) {
+                    return i + k;
+                }
+            }
+        }
+        i += 4;
+    }
+
+    for (; i <= last; i++) {
+        if (is_start_code(data + i)) {
+            return i;
+        }
+    }
+    return len;
+}
+
+static esp_err_t index_append(nal_index_t *idx, const uint8_t *ptr, size_t len)
+{
+    if (idx->count == idx->capacity) {
+        size_t cap = idx->capacity ? idx->capacity * 2 : NAL_INDEX_INITIAL;
+        nal_unit_t *nals = realloc(idx->nals, cap * sizeof(*nals));
+        if (!nals) {
+            return ESP_ERR_NO_MEM;
+        }
+        idx->nals = nals;
+        idx->capacity = cap;
+    }
+    idx->nals[idx->count].ptr = ptr;
+    idx->nals[idx->count].len = len;
+    idx->count++;
+    return ESP_OK;
+}
+
+esp_err_t nal_index_build(nal_index_t *idx, const uint8_t *data, size_t len)
+{
+    idx->count = 0;
+
+    /* Each start code found ends the previous NAL and begins the next */
+    size_t sc = nal_find_start_code(data, 0, len);
+    while (sc < len) {
+        size_t start = sc + 3;
+        size_t next = nal_find_start_code(data, start, len);
+
+        /* Drop trailing zeros: trailing_zero_8bits and the leading zero
+         * of a 4-byte start code */
+        size_t end = next;
+        while (end > start && data[end - 1] == 0) {
+            end--;
+        }
+        if (end > start && index_append(idx, data + start, end - start) != ESP_OK) {
+            return ESP_ERR_NO_MEM;
+        }
+        sc = next;
+    }
+    return ESP_OK;
+}
+
+void nal_index_free(nal_index_t *idx)
+{
+    free(idx->nals);
+    idx->nals = NULL;
+    idx->count = 0;
+    idx->capacity = 0;
+}
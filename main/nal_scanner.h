@@ -0,0 +1,63 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * H.264 Annex-B start-code scanner.  Splits an encoded frame into its NAL
+ * units in one pass, testing four bytes per step for the zero byte every
+ * start code contains.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const uint8_t *ptr;         /* NAL header byte (start code stripped) */
+    size_t len;                 /* NAL length without trailing zero bytes */
+} nal_unit_t;
+
+/*
+ * NAL units of one frame.  The array grows as needed and is kept between
+ * frames, so steady-state indexing does not allocate.
+ */
+typedef struct {
+    nal_unit_t *nals;
+    size_t count;
+    size_t capacity;
+} nal_index_t;
+
+/**
+ * @brief Offset of the first 00 00 01 start code at or after pos
+ *
+ * A 4-byte start code (00 00 00 01) is found one byte in, at its 00 00 01.
+ *
+ * @return Offset of the first start code byte, or len if there is none
+ */
+size_t nal_find_start_code(const uint8_t *data, size_t pos, size_t len);
+
+/**
+ * @brief Index every NAL unit of an Annex-B buffer
+ *
+ * Bytes before the first start code and empty NAL units are ignored.
+ * The index points into data, which must outlive it.
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the index could not grow (the NAL
+ *         units found so far are still indexed)
+ */
+esp_err_t nal_index_build(nal_index_t *idx, const uint8_t *data, size_t len);
+
+/**
+ * @brief Free the index array
+ */
+void nal_index_free(nal_index_t *idx);
+
+#ifdef __cplusplus
+}
+#endif
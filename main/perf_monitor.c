@@ -9,6 +9,7 @@
  *   - Per-core CPU usage (derived from IDLE task runtime deltas)
  *   - Heap memory: internal SRAM and PSRAM (free / total / min-ever-free)
  *   - USB streaming: fps, MB/s, total frames
+ *   - USB frame pacing: inter-frame jitter histogram
  *
  * CPU usage method: FreeRTOS runtime stats track cumulative execution time
  * per task. IDLE0 and IDLE1 are pinned to core 0 and core 1 respectively.
@@ -20,6 +21,7 @@
 #include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "usb_device_uvc.h"
 #include "perf_monitor.h"
 
 static const char *TAG = "perf_mon";
@@ -95,6 +97,29 @@ static void log_memory_usage(void)
              (unsigned long)(spiram.total_free_bytes + spiram.total_allocated_bytes));
 }
 
+static void log_pacing_stats(void)
+{
+    uvc_pacing_stats_t ps;
+    if (uvc_device_get_pacing_stats(0, &ps, true) != ESP_OK || ps.frames < 2) {
+        return;
+    }
+
+    /* One inter-arrival sample per frame after the first of the interval */
+    uint32_t samples = 0;
+    for (int i = 0; i < UVC_JITTER_BUCKETS; i++) {
+        samples += ps.hist[i];
+    }
+    ESP_LOGI(TAG, "Pacing: %lu us interval, jitter avg %lu us max %lu us, %lu late",
+             (unsigned long)ps.interval_us,
+             (unsigned long)(samples ? ps.jitter_sum_us / samples : 0),
+             (unsigned long)ps.jitter_max_us, (unsigned long)ps.late);
+    ESP_LOGI(TAG, "Jitter: <=50us %lu | <=100 %lu | <=250 %lu | <=500 %lu | <=1ms %lu | "
+             "<=2ms %lu | <=5ms %lu | <=10ms %lu | >10ms %lu",
+             (unsigned long)ps.hist[0], (unsigned long)ps.hist[1], (unsigned long)ps.hist[2],
+             (unsigned long)ps.hist[3], (unsigned long)ps.hist[4], (unsigned long)ps.hist[5],
+             (unsigned long)ps.hist[6], (unsigned long)ps.hist[7], (unsigned long)ps.hist[8]);
+}
+
 static void log_stream_stats(void)
 {
     if (!s_stream_ctx) return;
@@ -119,6 +144,15 @@ static void log_stream_stats(void)
                  s_stream_ctx->negotiated_width, s_stream_ctx->negotiated_height,
                  s_stream_ctx->active_format,
                  (unsigned long)frames);
+#if CONFIG_UVC_PRODUCER_TASK
+        frame_ring_stats_t rs;
+        frame_ring_get_stats(&s_stream_ctx->ring, &rs);
+        ESP_LOGI(TAG, "Ring: occ %lu/%lu (peak %lu), drops full=%lu stale=%lu",
+                 (unsigned long)rs.occupancy, (unsigned long)s_stream_ctx->ring.capacity,
+                 (unsigned long)rs.peak_occupancy,
+                 (unsigned long)rs.dropped_full, (unsigned long)rs.dropped_stale);
+#endif
+        log_pacing_stats();
     } else {
         ESP_LOGI(TAG, "Stream: idle (no active stream)");
     }
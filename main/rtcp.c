@@ -0,0 +1,183 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * RTCP Sender Report / Receiver Report handling (RFC 3550 section 6.4).
+ *
+ * SR packets let receivers map RTP timestamps to wallclock time (A/V and
+ * multi-camera sync).  RR packets carry each receiver's loss and jitter,
+ * and echo our last SR so the round-trip time can be computed:
+ *   RTT = arrival - LSR - DLSR   (all in 1/65536 s)
+ */
+
+#include "rtcp.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <sys/time.h>
+
+/* Seconds from 1900-01-01 (NTP epoch) to 1970-01-01 (Unix epoch) */
+#define NTP_UNIX_OFFSET     2208988800UL
+
+#define RTCP_VERSION        2
+#define RTCP_SDES_CNAME     1
+
+static inline void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+rtcp_ntp_t rtcp_ntp_now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    rtcp_ntp_t t = {
+        .sec = (uint32_t)tv.tv_sec + NTP_UNIX_OFFSET,
+        .frac = (uint32_t)(((uint64_t)tv.tv_usec << 32) / 1000000),
+    };
+    return t;
+}
+
+size_t rtcp_build_sr(uint8_t *buf, size_t buflen, const rtcp_sr_info_t *info)
+{
+    size_t cname_len = info->cname ? strlen(info->cname) : 0;
+    if (cname_len > 31) {
+        cname_len = 31;
+    }
+    /* SDES chunk: SSRC, CNAME item (type, len, text), end item, pad to 32 bits */
+    size_t sdes_len = 4 + 4 + ((2 + cname_len + 1 + 3) & ~3u);
+    size_t total = 28 + sdes_len;
+    if (buflen < total) {
+        return 0;
+    }
+
+    /* SR, no report blocks (we receive nothing) */
+    buf[0] = RTCP_VERSION << 6;
+    buf[1] = RTCP_PT_SR;
+    put_be16(buf + 2, 28 / 4 - 1);
+    put_be32(buf + 4, info->ssrc);
+    put_be32(buf + 8, info->ntp.sec);
+    put_be32(buf + 12, info->ntp.frac);
+    put_be32(buf + 16, info->rtp_ts);
+    put_be32(buf + 20, info->packets);
+    put_be32(buf + 24, info->octets);
+
+    uint8_t *p = buf + 28;
+    memset(p, 0, sdes_len);
+    p[0] = (RTCP_VERSION << 6) | 1;             /* One chunk */
+    p[1] = RTCP_PT_SDES;
+    put_be16(p + 2, sdes_len / 4 - 1);
+    put_be32(p + 4, info->ssrc);
+    p[8] = RTCP_SDES_CNAME;
+    p[9] = (uint8_t)cname_len;
+    memcpy(p + 10, info->cname, cname_len);
+    /* END item and padding are the zeros already there */
+
+    return total;
+}
+
+/* Apply one report block (24 bytes) about our SSRC */
+static void apply_report_block(const uint8_t *rb, rtcp_ntp_t now, rtcp_rr_stats_t *st)
+{
+    uint32_t lost = get_be32(rb + 4);
+    st->fraction_lost = lost >> 24;
+    /* 24-bit two's complement */
+    st->cumulative_lost = (int32_t)(lost << 8) >> 8;
+    st->highest_seq = get_be32(rb + 8);
+    st->jitter = get_be32(rb + 12);
+
+    uint32_t lsr = get_be32(rb + 16);
+    uint32_t dlsr = get_be32(rb + 20);
+    if (lsr != 0) {
+        uint32_t rtt = rtcp_ntp_compact(now) - lsr - dlsr;
+        /* Ignore reports whose clock math went backwards */
+        if ((int32_t)rtt >= 0) {
+            st->rtt_us = (uint32_t)(((uint64_t)rtt * 1000000) >> 16);
+        }
+    }
+    st->reports++;
+    st->last_rr_us = esp_timer_get_time();
+}
+
+bool rtcp_parse_rr(const uint8_t *pkt, size_t len, uint32_t media_ssrc,
+                   rtcp_ntp_t now, rtcp_rr_stats_t *st)
+{
+    bool updated = false;
+
+    /* Walk the compound packet; only SR and RR carry report blocks */
+    while (len >= 4) {
+        if ((pkt[0] >> 6) != RTCP_VERSION) {
+            break;
+        }
+        size_t plen = ((size_t)((pkt[2] << 8) | pkt[3]) + 1) * 4;
+        if (plen > len) {
+            break;
+        }
+        int rc = pkt[0] & 0x1F;
+        size_t blocks_at = 0;
+        if (pkt[1] == RTCP_PT_RR) {
+            blocks_at = 8;
+        } else if (pkt[1] == RTCP_PT_SR) {
+            blocks_at = 28;
+        }
+        for (int i = 0; blocks_at && i < rc; i++) {
+            const uint8_t *rb = pkt + blocks_at + 24 * i;
+            if (rb + 24 > pkt + plen) {
+                break;
+            }
+            if (get_be32(rb) == media_ssrc) {
+                apply_report_block(rb, now, st);
+                updated = true;
+            }
+        }
+        pkt += plen;
+        len -= plen;
+    }
+    return updated;
+}
+
+size_t rtcp_parse_nack(const uint8_t *pkt, size_t len, uint32_t media_ssrc,
+                       uint16_t *seqs, size_t max)
+{
+    size_t count = 0;
+
+    while (len >= 4) {
+        if ((pkt[0] >> 6) != RTCP_VERSION) {
+            break;
+        }
+        size_t plen = ((size_t)((pkt[2] << 8) | pkt[3]) + 1) * 4;
+        if (plen > len) {
+            break;
+        }
+        /* RTPFB header, sender SSRC, media SSRC, then PID/BLP pairs */
+        if (pkt[1] == RTCP_PT_RTPFB && (pkt[0] & 0x1F) == RTCP_FMT_NACK &&
+            plen >= 12 && get_be32(pkt + 8) == media_ssrc) {
+            for (const uint8_t *fci = pkt + 12; fci + 4 <= pkt + plen; fci += 4) {
+                uint16_t pid = (fci[0] << 8) | fci[1];
+                uint16_t blp = (fci[2] << 8) | fci[3];
+                for (int bit = -1; bit < 16 && count < max; bit++) {
+                    if (bit < 0 || (blp & (1u << bit))) {
+                        seqs[count++] = (uint16_t)(pid + bit + 1);
+                    }
+                }
+            }
+        }
+        pkt += plen;
+        len -= plen;
+    }
+    return count;
+}
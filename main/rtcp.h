@@ -0,0 +1,101 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * RTCP (RFC 3550 section 6) packet building and parsing for the RTP
+ * sender: Sender Reports out, Receiver Reports and generic NACKs
+ * (RFC 4585 section 6.2.1) in.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTCP_PT_SR      200
+#define RTCP_PT_RR      201
+#define RTCP_PT_SDES    202
+#define RTCP_PT_BYE     203
+#define RTCP_PT_RTPFB   205
+
+#define RTCP_FMT_NACK   1           /* Generic NACK (in RTPFB) */
+
+/* Largest packet rtcp_build_sr() produces (SR + SDES CNAME) */
+#define RTCP_SR_MAX_SIZE    (28 + 8 + 36)
+
+/* 64-bit NTP timestamp (seconds since 1900 + 32-bit fraction) */
+typedef struct {
+    uint32_t sec;
+    uint32_t frac;
+} rtcp_ntp_t;
+
+/* Sender state carried in an SR */
+typedef struct {
+    uint32_t ssrc;
+    rtcp_ntp_t ntp;             /* Wallclock time of the report */
+    uint32_t rtp_ts;            /* RTP timestamp of the same instant */
+    uint32_t packets;           /* RTP packets sent since the start */
+    uint32_t octets;            /* RTP payload octets sent since the start */
+    const char *cname;          /* SDES CNAME (<= 31 chars) */
+} rtcp_sr_info_t;
+
+/* What one receiver last reported about our stream */
+typedef struct {
+    uint32_t reports;           /* RR blocks received */
+    uint8_t  fraction_lost;     /* Since its previous report, in 1/256 */
+    int32_t  cumulative_lost;   /* Packets lost since the start (24-bit signed) */
+    uint32_t highest_seq;       /* Extended highest sequence number received */
+    uint32_t jitter;            /* Interarrival jitter, 90 kHz units */
+    uint32_t rtt_us;            /* Round trip from LSR/DLSR, 0 until known */
+    int64_t  last_rr_us;        /* esp_timer time of the last report */
+} rtcp_rr_stats_t;
+
+/**
+ * @brief Current wallclock as an NTP timestamp
+ */
+rtcp_ntp_t rtcp_ntp_now(void);
+
+/**
+ * @brief Middle 32 bits of an NTP timestamp (LSR/DLSR units, 1/65536 s)
+ */
+static inline uint32_t rtcp_ntp_compact(rtcp_ntp_t t)
+{
+    return (t.sec << 16) | (t.frac >> 16);
+}
+
+/**
+ * @brief Build a compound SR + SDES (CNAME) packet
+ *
+ * @return Packet length, or 0 if buf is too small
+ */
+size_t rtcp_build_sr(uint8_t *buf, size_t buflen, const rtcp_sr_info_t *info);
+
+/**
+ * @brief Parse a compound RTCP packet and apply the report block about
+ *        media_ssrc, if any, to st
+ *
+ * @param now  Arrival time, for the round-trip computation
+ * @return true if st was updated
+ */
+bool rtcp_parse_rr(const uint8_t *pkt, size_t len, uint32_t media_ssrc,
+                   rtcp_ntp_t now, rtcp_rr_stats_t *st);
+
+/**
+ * @brief Collect the sequence numbers that the generic NACKs about
+ *        media_ssrc in a compound RTCP packet ask for
+ *
+ * @param seqs  Filled with up to max sequence numbers, in request order
+ * @return Number of sequence numbers stored
+ */
+size_t rtcp_parse_nack(const uint8_t *pkt, size_t len, uint32_t media_ssrc,
+                       uint16_t *seqs, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * STAP-A aggregation (RFC 6184 section 5.7.1).
+ *
+ * STAP-A packet format:
+ *   [RTP Header (12)] [STAP-A NAL header (1)] { [Size (2)] [NAL (Size)] } ...
+ */
+
+#include "rtp_h264.h"
+#include <string.h>
+
+size_t rtp_h264_stap_a_span(const nal_unit_t *nals, size_t count, size_t mtu)
+{
+    size_t len = 1;
+    size_t n = 0;
+    while (n < count && len + 2 + nals[n].len <= mtu) {
+        len += 2 + nals[n].len;
+        n++;
+    }
+    return n;
+}
+
+size_t rtp_h264_stap_a_build(uint8_t *buf, const nal_unit_t *nals, size_t count)
+{
+    uint8_t *out = buf + 1;
+    uint8_t f = 0, nri = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        f |= nals[i].ptr[0] & 0x80;
+        if ((nals[i].ptr[0] & 0x60) > nri) {
+            nri = nals[i].ptr[0] & 0x60;
+        }
+        out[0] = (nals[i].len >> 8) & 0xFF;
+        out[1] = nals[i].len & 0xFF;
+        memcpy(out + 2, nals[i].ptr, nals[i].len);
+        out += 2 + nals[i].len;
+    }
+    buf[0] = f | nri | RTP_H264_STAP_A;
+    return out - buf;
+}
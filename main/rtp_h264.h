@@ -0,0 +1,47 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * STAP-A aggregation for the H.264 RTP payload format (RFC 6184 section
+ * 5.7.1).  Neighbouring small NAL units (SPS, PPS, SEI, small slices) are
+ * sent in one packet: a STAP-A header byte, then a 16-bit size ahead of
+ * each NAL unit.  Pure byte handling, no I/O, so it runs unchanged on the
+ * host.
+ */
+
+#pragma once
+
+#include "nal_scanner.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_H264_STAP_A     24      /* NAL unit type of a STAP-A */
+
+/**
+ * @brief Number of NAL units from nals[0] that fit in one STAP-A payload
+ *        of at most mtu bytes
+ *
+ * Below 2 nothing is gained by aggregating: send nals[0] on its own
+ * (as a single NAL unit packet, or FU-A fragments if it exceeds mtu).
+ */
+size_t rtp_h264_stap_a_span(const nal_unit_t *nals, size_t count, size_t mtu);
+
+/**
+ * @brief Write the STAP-A payload of nals[0..count) to buf
+ *
+ * The header's F bit is the OR of the units' F bits and its NRI the
+ * highest of their NRIs.  buf must hold the size rtp_h264_stap_a_span()
+ * accepted.
+ *
+ * @return Payload length
+ */
+size_t rtp_h264_stap_a_build(uint8_t *buf, const nal_unit_t *nals, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * RTP packet history ring.
+ *
+ * Positions are absolute byte counts, so "still in the arena" is just
+ * write_pos - pos <= arena_size.  A packet that
+ * would straddle the end of the arena starts at the beginning instead,
+ * and the skipped tail counts as written.
+ */
+
+#include "rtp_history.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+static const char *TAG = "rtp_history";
+
+esp_err_t rtp_history_init(rtp_history_t *h, uint32_t arena_size, uint32_t slots)
+{
+    memset(h, 0, sizeof(*h));
+    ESP_RETURN_ON_FALSE(slots > 0 && (slots & (slots - 1)) == 0, ESP_ERR_INVALID_ARG,
+                        TAG, "Slot count must be a power of two");
+
+    h->arena = heap_caps_malloc(arena_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    h->slots = heap_caps_calloc(slots, sizeof(rtp_history_slot_t),
+                                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!h->arena || !h->slots) {
+        rtp_history_deinit(h);
+        ESP_LOGE(TAG, "Failed to allocate %lu bytes of RTP history", (unsigned long)arena_size);
+        return ESP_ERR_NO_MEM;
+    }
+    h->arena_size = arena_size;
+    h->slot_mask = slots - 1;
+    return ESP_OK;
+}
+
+void rtp_history_deinit(rtp_history_t *h)
+{
+    heap_caps_free(h->arena);
+    heap_caps_free(h->slots);
+    memset(h, 0, sizeof(*h));
+}
+
+void rtp_history_put(rtp_history_t *h, uint16_t seq,
+                     const uint8_t *hdr, size_t hdr_len,
+                     const uint8_t *payload, size_t payload_len)
+{
+    size_t len = hdr_len + payload_len;
+    if (!h->arena || len > h->arena_size || len > UINT16_MAX) {
+        return;
+    }
+
+    uint32_t off = (uint32_t)(h->write_pos % h->arena_size);
+    if (off + len > h->arena_size) {
+        h->write_pos += h->arena_size - off;
+        off = 0;
+    }
+    memcpy(h->arena + off, hdr, hdr_len);
+    if (payload_len > 0) {
+        memcpy(h->arena + off + hdr_len, payload, payload_len);
+    }
+
+    rtp_history_slot_t *slot = &h->slots[seq & h->slot_mask];
+    slot->pos = h->write_pos;
+    slot->seq = seq;
+    slot->len = (uint16_t)len;
+    h->write_pos += len;
+}
+
+const uint8_t *rtp_history_get(const rtp_history_t *h, uint16_t seq, size_t *len)
+{
+    if (!h->arena) {
+        return NULL;
+    }
+    const rtp_history_slot_t *slot = &h->slots[seq & h->slot_mask];
+    if (slot->len == 0 || slot->seq != seq ||
+        h->write_pos - slot->pos > h->arena_size) {
+        return NULL;
+    }
+    *len = slot->len;
+    return h->arena + slot->pos % h->arena_size;
+}
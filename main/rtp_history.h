@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * History of recently sent RTP packets for retransmission (RFC 4588).
+ *
+ * Packets are stored back to back in a byte arena used as a ring, and
+ * looked up by sequence number through a power-of-two slot table.  The
+ * oldest packets are overwritten as the arena wraps; a lookup that finds
+ * its bytes overwritten (or its slot reused) is a miss.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint64_t pos;               /* Absolute arena position of the packet */
+    uint16_t seq;
+    uint16_t len;               /* 0 = empty */
+} rtp_history_slot_t;
+
+typedef struct {
+    uint8_t *arena;             /* NULL = history disabled */
+    uint32_t arena_size;
+    uint64_t write_pos;         /* Bytes written since init */
+    rtp_history_slot_t *slots;
+    uint32_t slot_mask;
+} rtp_history_t;
+
+/**
+ * @brief Allocate the arena (PSRAM) and slot table
+ *
+ * @param arena_size  Bytes of packet history
+ * @param slots       Packets indexed at most; power of two
+ */
+esp_err_t rtp_history_init(rtp_history_t *h, uint32_t arena_size, uint32_t slots);
+
+/**
+ * @brief Free the history
+ */
+void rtp_history_deinit(rtp_history_t *h);
+
+/**
+ * @brief Store one RTP packet given as header and payload pieces
+ */
+void rtp_history_put(rtp_history_t *h, uint16_t seq,
+                     const uint8_t *hdr, size_t hdr_len,
+                     const uint8_t *payload, size_t payload_len);
+
+/**
+ * @brief Find a stored RTP packet
+ *
+ * @return The packet (RTP header first), or NULL if it is no longer kept
+ */
+const uint8_t *rtp_history_get(const rtp_history_t *h, uint16_t seq, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
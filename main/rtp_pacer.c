@@ -0,0 +1,102 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Token-bucket RTP pacer.
+ *
+ * Per frame:
+ *   budget = min(interval * spread_pct / 100, max_delay_us)
+ *   rate   = max(min_rate_bps, frame size / budget)
+ * so the last packet of any frame leaves about one budget after the
+ * first.  The bucket refills at that rate up to burst_bytes; a packet
+ * the bucket cannot cover waits for the deficit, unless that would pass
+ * the frame's deadline.  Debt left when a frame ends is forgiven, so one
+ * late frame does not delay the next.
+ */
+
+#include "rtp_pacer.h"
+
+static void refill(rtp_pacer_t *p, int64_t now_us)
+{
+    if (now_us > p->last_us) {
+        p->tokens += (int64_t)((uint64_t)(now_us - p->last_us) * p->rate_Bps / 1000000);
+        if (p->tokens > (int64_t)p->cfg.burst_bytes) {
+            p->tokens = p->cfg.burst_bytes;
+        }
+    }
+    p->last_us = now_us;
+}
+
+void rtp_pacer_init(rtp_pacer_t *p, const rtp_pacer_config_t *cfg)
+{
+    *p = (rtp_pacer_t) {
+        .cfg = *cfg,
+        .rate_Bps = cfg->min_rate_bps / 8,
+        .tokens = cfg->burst_bytes,
+    };
+    if (p->cfg.spread_pct == 0 || p->cfg.spread_pct > 100) {
+        p->cfg.spread_pct = 100;
+    }
+    if (p->rate_Bps == 0) {
+        p->rate_Bps = 1;
+    }
+}
+
+void rtp_pacer_begin_frame(rtp_pacer_t *p, size_t frame_bytes, uint32_t interval_us,
+                           int64_t now_us)
+{
+    /* Refill at the previous frame's rate for the time since it ended */
+    if (p->last_us == 0) {
+        p->last_us = now_us;
+    }
+    refill(p, now_us);
+    if (p->tokens < 0) {
+        p->tokens = 0;
+    }
+
+    uint32_t budget_us = (uint64_t)interval_us * p->cfg.spread_pct / 100;
+    if (budget_us > p->cfg.max_delay_us) {
+        budget_us = p->cfg.max_delay_us;
+    }
+    if (budget_us == 0) {
+        budget_us = 1;
+    }
+
+    uint64_t rate = (uint64_t)frame_bytes * 1000000 / budget_us;
+    if (rate < p->cfg.min_rate_bps / 8) {
+        rate = p->cfg.min_rate_bps / 8;
+    }
+    p->rate_Bps = rate ? rate : 1;
+    p->frame_start_us = now_us;
+    p->deadline_us = now_us + budget_us;
+    p->frame_late = 0;
+}
+
+uint32_t rtp_pacer_consume(rtp_pacer_t *p, size_t bytes, int64_t now_us)
+{
+    refill(p, now_us);
+    p->tokens -= bytes;
+    if (p->tokens >= 0) {
+        return 0;
+    }
+
+    int64_t wait_us = (-p->tokens) * 1000000 / (int64_t)p->rate_Bps;
+    if (now_us + wait_us > p->deadline_us) {
+        p->frame_late = 1;
+        wait_us = p->deadline_us > now_us ? p->deadline_us - now_us : 0;
+    }
+    return (uint32_t)wait_us;
+}
+
+void rtp_pacer_end_frame(rtp_pacer_t *p, int64_t now_us)
+{
+    uint32_t delay_us = now_us > p->frame_start_us ? (uint32_t)(now_us - p->frame_start_us) : 0;
+
+    p->frames++;
+    p->late_frames += p->frame_late;
+    p->delay_sum_us += delay_us;
+    if (delay_us > p->delay_max_us) {
+        p->delay_max_us = delay_us;
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Token-bucket pacer for RTP frames.
+ *
+ * Each frame is spread over a share of the frame interval instead of
+ * leaving in one burst: the rate is whatever fits the frame into that
+ * share (never below a configured floor), and a frame is never held back
+ * past its latency budget.  Pure arithmetic on caller-supplied times, no
+ * I/O or sleeping, so it runs unchanged on the host.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t min_rate_bps;      /* Floor of the pacing rate */
+    uint32_t spread_pct;        /* Share of the frame interval a frame is spread over */
+    uint32_t max_delay_us;      /* Latency budget of one frame */
+    uint32_t burst_bytes;       /* Bucket depth: sent back to back without waiting */
+} rtp_pacer_config_t;
+
+typedef struct {
+    rtp_pacer_config_t cfg;
+
+    uint64_t rate_Bps;          /* Pacing rate of the current frame (bytes/s) */
+    int64_t tokens;             /* Bytes that may be sent now; negative = debt */
+    int64_t last_us;            /* Time of the last refill */
+    int64_t frame_start_us;
+    int64_t deadline_us;        /* Past this, the rest of the frame goes unpaced */
+    uint8_t frame_late;
+
+    /* Statistics since the last report (read and cleared by the caller) */
+    uint32_t frames;
+    uint32_t late_frames;       /* Frames that hit their latency budget */
+    uint64_t delay_sum_us;      /* Frame start to last packet released */
+    uint32_t delay_max_us;
+} rtp_pacer_t;
+
+/**
+ * @brief Initialize the pacer with a full bucket
+ */
+void rtp_pacer_init(rtp_pacer_t *p, const rtp_pacer_config_t *cfg);
+
+/**
+ * @brief Start pacing a frame
+ *
+ * @param frame_bytes  Bytes the frame will send
+ * @param interval_us  Current frame interval
+ * @param now_us       Current time
+ */
+void rtp_pacer_begin_frame(rtp_pacer_t *p, size_t frame_bytes, uint32_t interval_us,
+                           int64_t now_us);
+
+/**
+ * @brief Take tokens for one packet
+ *
+ * @return Time to wait before sending the packet (0 = send now).  The
+ *         wait never reaches past the frame's latency budget; a caller
+ *         that cannot sleep that briefly may send early, the debt is
+ *         carried to the next packet.
+ */
+uint32_t rtp_pacer_consume(rtp_pacer_t *p, size_t bytes, int64_t now_us);
+
+/**
+ * @brief Finish the frame and record its queueing delay
+ */
+void rtp_pacer_end_frame(rtp_pacer_t *p, int64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -6,25 +6,134 @@
  * RTP H.264 packetization per RFC 6184.
  *
  * Supports:
+ *   - STAP-A aggregation (neighbouring small NALs)
  *   - Single NAL Unit packets (NAL size <= MTU)
  *   - FU-A fragmentation (NAL size > MTU)
  *
- * Timestamp clock: 90kHz (standard for H.264 RTP).
+ * Timestamp clock: 90kHz (standard for H.264 RTP), derived from each
+ * frame's capture time.
+ *
+ * Zero-copy: payloads are sent in place from the frame's buffer with
+ * sendmsg(); only headers are written by the CPU.
+ *
+ * Fan-out: a frame is packetized once; every packet goes to each RTSP
+ * client that was playing when the frame started, over UDP or
+ * interleaved on the client's RTSP connection (RFC 2326 section 10.12).
+ *
+ * TCP backpressure: interleaved packets are written without blocking.  If
+ * the connection cannot take a packet, the rest of the frame and every
+ * following frame up to the next IDR are dropped for that client only, so
+ * a slow viewer neither stalls the encoder nor sees broken references.
+ * The UDP socket is non-blocking too.  A frame that has started goes out
+ * whole: a packet lwIP has no buffer for is retried until it goes.  After
+ * such a wait no new frame starts for RTP_UDP_BACKOFF_MS (see
+ * rtp_session_tx_ready()), so the caller holds frames back whole instead.
+ * Only if lwIP stays out of buffers for RTP_UDP_STALL_MS (link down) do UDP
+ * destinations skip ahead to the next IDR the way TCP clients do.
  */
 
 #include "rtp_sender.h"
+#include "rtp_h264.h"
 #include "esp_log.h"
+#include "esp_check.h"
 #include "esp_random.h"
+#include "esp_timer.h"
+#include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 
 static const char *TAG = "rtp";
 
-/* Ethernet MTU=1500, IP=20, UDP=8, RTP=12 → max payload ~1400 */
-#define RTP_MTU             1400
 #define RTP_HEADER_SIZE     12
 
-/* 90kHz clock ticks per frame at 30fps */
-#define TICKS_PER_FRAME_30FPS  3000
+/* H.264 RTP clock */
+#define RTP_CLOCK_HZ        90000
+
+#define NAL_TYPE_IDR        5
+#define NAL_TYPE_SPS        7
+#define NAL_TYPE_PPS        8
+
+/* RTP/RTCP server port pair: first free even port from here */
+#define RTP_SERVER_PORT_BASE    6970
+#define RTP_SERVER_PORT_TRIES   16
+
+/* Sender Report period while streaming */
+#define RTCP_SR_INTERVAL_US     (1000 * 1000)
+
+/* History slots: one per this many arena bytes (rounded up to a power of 2) */
+#define RTP_HISTORY_BYTES_PER_SLOT  512
+/* Retransmission statistics log period */
+#define RTP_RTX_REPORT_US           (10 * 1000 * 1000)
+
+/* Pacer: bucket depth, frame interval before two frames were seen, and
+ * how often the queueing delay is logged */
+#define RTP_PACER_BURST_BYTES       (4 * (RTP_MTU + RTP_HEADER_SIZE))
+#define RTP_PACER_DEFAULT_INTERVAL  33333
+#define RTP_PACER_REPORT_US         (10 * 1000 * 1000)
+
+/* Interleaved framing: '$', channel, 16-bit big-endian length */
+#define RTP_TCP_FRAMING_SIZE    4
+
+/* Waiting for the RTSP task to finish a reply on the same connection */
+#define RTP_TCP_LOCK_MS         20
+/* Completing a packet the connection took only part of */
+#define RTP_TCP_FINISH_MS       200
+
+/* Retrying a UDP packet lwIP has no buffer for, before giving up the frame;
+ * below the 200 ms stop paths wait for frames to be released */
+#define RTP_UDP_STALL_MS        100
+/* No new frame starts this soon after lwIP was out of UDP buffers */
+#define RTP_UDP_BACKOFF_MS      10
+
+typedef enum {
+    RTP_TCP_OK,
+    RTP_TCP_CONGESTED,          /* Packet not (or only just) sent: drop to next IDR */
+    RTP_TCP_FAILED,             /* Stream out of sync or connection broken */
+    RTP_TCP_GONE,               /* Client closed since the frame started */
+} rtp_tcp_result_t;
+
+typedef struct {
+    int id;                     /* Index in session->dests, -1 for multicast */
+    struct sockaddr_in addr;
+    int tcp_fd;
+    uint8_t channel;
+    SemaphoreHandle_t tx_lock;
+#if CONFIG_RTSP_FEC
+    uint16_t fec_port;          /* FEC session port, 0 = none */
+#endif
+    bool skip;                  /* Dropped for the rest of this frame */
+} rtp_fanout_dest_t;
+
+/*
+ * Packets are built as scatter-gather lists: the bytes the packetizer
+ * writes (interleaved framing, RTP header, FU indicator/header) go to a
+ * small per-packet header slot, the payload is referenced in place in the
+ * encoder's buffer.  Packets are queued in batches so an interleaved
+ * destination gets a whole batch per write.
+ */
+#define RTP_BATCH_PKTS      16
+#define RTP_PKT_HDR_MAX     (RTP_TCP_FRAMING_SIZE + RTP_HEADER_SIZE + 2)
+
+typedef struct {
+    uint8_t hdr[RTP_PKT_HDR_MAX];   /* [framing][RTP header][FU bytes] */
+    uint8_t hdr_len;                /* RTP header + FU bytes */
+    const uint8_t *payload;
+    size_t payload_len;
+} rtp_pkt_t;
+
+typedef struct {
+    rtp_pkt_t pkt[RTP_BATCH_PKTS];  /* Header arena + payload references */
+    int count;
+    bool rtcp;                      /* Send to the RTCP port / odd channel */
+    bool fec;                       /* Send to the FEC session port (UDP only) */
+} rtp_batch_t;
+
+/* Destinations a frame is sent to, snapshotted once per frame */
+typedef struct {
+    rtp_fanout_dest_t dest[RTP_MAX_DESTS + 1];    /* + multicast group */
+    int count;
+} rtp_fanout_t;
 
 /*
  * Build an RTP header (12 bytes) into buf.
@@ -46,72 +155,516 @@ static void rtp_build_header(uint8_t *buf, rtp_session_t *s, bool marker)
     buf[11] = s->ssrc & 0xFF;
 }
 
+/* Drop the first n bytes of an iovec array; returns the new start */
+static struct iovec *iov_advance(struct iovec *iov, int *iovcnt, size_t n)
+{
+    while (*iovcnt > 0 && n >= iov->iov_len) {
+        n -= iov->iov_len;
+        iov++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        iov->iov_base = (uint8_t *)iov->iov_base + n;
+        iov->iov_len -= n;
+    }
+    return iov;
+}
+
+/* Wire size of one interleaved packet */
+static inline size_t pkt_tcp_len(const rtp_pkt_t *p)
+{
+    return RTP_TCP_FRAMING_SIZE + p->hdr_len + p->payload_len;
+}
+
 /*
- * Find the next NAL unit in an Annex-B stream.
- * Looks for 00 00 00 01 or 00 00 01 start codes.
- * Returns pointer to first byte after start code, sets *nal_len.
+ * Write a batch of interleaved packets in one scatter-gather write: each
+ * packet is its framing + RTP header from the header arena and its
+ * payload straight from the encoder buffer.  Never blocks on a full
+ * connection, except to finish a packet that was already partly written
+ * (the stream would be out of sync otherwise).
  */
-static const uint8_t *find_next_nal(const uint8_t *data, size_t len,
-                                     size_t *nal_len)
+static rtp_tcp_result_t send_interleaved(rtp_session_t *s, const rtp_fanout_dest_t *d,
+                                         rtp_batch_t *b)
 {
-    const uint8_t *p = data;
-    const uint8_t *end = data + len;
+    struct iovec iov_buf[2 * RTP_BATCH_PKTS];
+    size_t total = 0;
+    for (int i = 0; i < b->count; i++) {
+        rtp_pkt_t *p = &b->pkt[i];
+        p->hdr[1] = d->channel + (b->rtcp ? 1 : 0);
+        iov_buf[2 * i].iov_base = p->hdr;
+        iov_buf[2 * i].iov_len = RTP_TCP_FRAMING_SIZE + p->hdr_len;
+        iov_buf[2 * i + 1].iov_base = (void *)p->payload;
+        iov_buf[2 * i + 1].iov_len = p->payload_len;
+        total += pkt_tcp_len(p);
+    }
+    struct iovec *iov = iov_buf;
+    int iovcnt = 2 * b->count;
+
+    /* The RTSP task may be writing a reply; don't wait long for it */
+    if (xSemaphoreTake(d->tx_lock, pdMS_TO_TICKS(RTP_TCP_LOCK_MS)) != pdTRUE) {
+        return RTP_TCP_CONGESTED;
+    }
+    /* The RTSP task removes the destination under tx_lock before closing
+     * the fd, so a still-listed destination means the fd is still ours */
+    if (!s->dests[d->id].used || s->dests[d->id].tcp_fd != d->tcp_fd) {
+        xSemaphoreGive(d->tx_lock);
+        return RTP_TCP_GONE;
+    }
 
-    /* Skip to start code */
-    while (p + 3 < end) {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
-            p += 3;
-            goto found;
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+    ssize_t n = sendmsg(d->tcp_fd, &msg, MSG_DONTWAIT);
+    rtp_tcp_result_t result = RTP_TCP_OK;
+
+    if (n < 0) {
+        result = (errno == EAGAIN || errno == EWOULDBLOCK) ? RTP_TCP_CONGESTED : RTP_TCP_FAILED;
+    } else if ((size_t)n < total) {
+        /* Only finish the packet the write stopped in, then treat the
+         * client as congested */
+        size_t end = 0;
+        int k = 0;
+        while (end < (size_t)n) {
+            end += pkt_tcp_len(&b->pkt[k++]);
+        }
+        size_t left = end - (size_t)n;
+        iovcnt = 2 * k;
+        iov = iov_advance(iov, &iovcnt, (size_t)n);
+        TickType_t start = xTaskGetTickCount();
+        while (left > 0) {
+            if (xTaskGetTickCount() - start > pdMS_TO_TICKS(RTP_TCP_FINISH_MS)) {
+                result = RTP_TCP_FAILED;
+                break;
+            }
+            fd_set wfds;
+            FD_ZERO(&wfds);
+            FD_SET(d->tcp_fd, &wfds);
+            struct timeval tv = { .tv_sec = 0, .tv_usec = 10000 };
+            if (select(d->tcp_fd + 1, NULL, &wfds, NULL, &tv) <= 0) {
+                continue;
+            }
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            n = sendmsg(d->tcp_fd, &msg, MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    continue;
+                }
+                result = RTP_TCP_FAILED;
+                break;
+            }
+            left -= (size_t)n;
+            iov = iov_advance(iov, &iovcnt, (size_t)n);
         }
-        if (p[0] == 0 && p[1] == 0 && p[2] == 0 && p + 3 < end && p[3] == 1) {
-            p += 4;
-            goto found;
+        if (result == RTP_TCP_OK) {
+            result = RTP_TCP_CONGESTED;
         }
-        p++;
     }
-    return NULL;
 
-found:;
-    /* Find end of this NAL (next start code or end of data) */
-    const uint8_t *nal_start = p;
-    const uint8_t *q = p;
-    while (q + 2 < end) {
-        if (q[0] == 0 && q[1] == 0 && (q[2] == 1 || (q[2] == 0 && q + 3 < end && q[3] == 1))) {
+    xSemaphoreGive(d->tx_lock);
+    return result;
+}
+
+/* One UDP datagram per packet: header from the arena, payload in place */
+static esp_err_t send_udp(rtp_session_t *s, const rtp_fanout_dest_t *d, const rtp_batch_t *b)
+{
+    esp_err_t ret = ESP_OK;
+    struct sockaddr_in addr = d->addr;
+    int fd = s->sock_fd;
+    if (b->rtcp) {
+        /* RTCP goes from our odd port to the receiver's odd port */
+        addr.sin_port = htons(ntohs(addr.sin_port) + 1);
+        fd = s->rtcp_fd;
+    }
+#if CONFIG_RTSP_FEC
+    if (b->fec) {
+        addr.sin_port = htons(d->fec_port);
+    }
+#endif
+    for (int i = 0; i < b->count; i++) {
+        const rtp_pkt_t *p = &b->pkt[i];
+        struct iovec iov[2] = {
+            { .iov_base = (void *)(p->hdr + RTP_TCP_FRAMING_SIZE), .iov_len = p->hdr_len },
+            { .iov_base = (void *)p->payload,                       .iov_len = p->payload_len },
+        };
+        struct msghdr msg = {
+            .msg_name = &addr,
+            .msg_namelen = sizeof(addr),
+            .msg_iov = iov,
+            .msg_iovlen = 2,
+        };
+        int waited_ms = 0;
+        while (sendmsg(fd, &msg, 0) < 0) {
+            if (s->abort) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            /* Out of buffers: let lwIP drain rather than cut the frame short.
+             * The wait counts as a send error for rate control. */
+            if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOMEM) &&
+                waited_ms < RTP_UDP_STALL_MS) {
+                if (waited_ms == 0) {
+                    s->send_errors++;
+                }
+                s->udp_busy_us = esp_timer_get_time();
+                vTaskDelay(1);
+                waited_ms += portTICK_PERIOD_MS;
+                continue;
+            }
+            ESP_LOGD(TAG, "sendmsg dest %d failed: errno %d", d->id, errno);
+            if (waited_ms >= RTP_UDP_STALL_MS) {
+                return ESP_ERR_TIMEOUT;
+            }
+            s->send_errors++;
+            ret = ESP_FAIL;
             break;
         }
-        q++;
     }
-    if (q + 2 >= end) {
-        q = end;
+    return ret;
+}
+
+/*
+ * The UDP socket stayed out of buffers for RTP_UDP_STALL_MS: the stall is
+ * lwIP's, not one client's, so every UDP destination drops the rest of the
+ * frame and waits for the next IDR.  Only the sender task writes these
+ * flags.
+ */
+static void udp_stalled(rtp_session_t *s, rtp_fanout_t *fo)
+{
+    ESP_LOGW(TAG, "RTP UDP send stalled, waiting for IDR");
+    for (int i = 0; i < fo->count; i++) {
+        rtp_fanout_dest_t *d = &fo->dest[i];
+        if (d->tcp_fd >= 0 || d->skip) {
+            continue;
+        }
+        d->skip = true;
+        if (d->id < 0) {
+            s->mcast_wait_idr = true;
+        } else {
+            s->dests[d->id].wait_idr = true;
+            s->dests[d->id].frames_dropped++;
+        }
+    }
+}
+
+/*
+ * Send the batched packets to every destination of the frame and empty
+ * the batch.  A failing destination does not stop delivery to the others.
+ */
+static esp_err_t batch_flush(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b)
+{
+    esp_err_t ret = ESP_OK;
+    if (b->count == 0) {
+        return ESP_OK;
     }
-    /* Trim trailing zeros before next start code */
-    while (q > nal_start && q[-1] == 0) {
-        q--;
+    if (s->abort) {
+        b->count = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < fo->count; i++) {
+        rtp_fanout_dest_t *d = &fo->dest[i];
+        if (d->skip) {
+            continue;
+        }
+#if CONFIG_RTSP_FEC
+        if (b->fec && d->fec_port == 0) {
+            continue;
+        }
+#endif
+        if (d->tcp_fd < 0) {
+            esp_err_t err = send_udp(s, d, b);
+            if (err == ESP_ERR_TIMEOUT) {
+                udp_stalled(s, fo);
+            }
+            if (err != ESP_OK) {
+                ret = ESP_FAIL;
+            }
+            continue;
+        }
+
+        rtp_tcp_result_t r = send_interleaved(s, d, b);
+        if (r == RTP_TCP_OK) {
+            continue;
+        }
+        /* Drop this client for the rest of the frame; only the sender
+         * task writes these flags */
+        d->skip = true;
+        if (r == RTP_TCP_GONE) {
+            continue;
+        }
+        rtp_dest_t *dest = &s->dests[d->id];
+        if (r == RTP_TCP_FAILED) {
+            ESP_LOGW(TAG, "RTP dest %d: TCP stream broken", d->id);
+            dest->failed = true;
+        } else {
+            ESP_LOGD(TAG, "RTP dest %d: TCP congested, waiting for IDR", d->id);
+            dest->wait_idr = true;
+            dest->frames_dropped++;
+            s->tcp_drops++;
+        }
+        ret = ESP_FAIL;
     }
-    *nal_len = q - nal_start;
-    return nal_start;
+    b->count = 0;
+    return ret;
 }
 
+#if CONFIG_RTSP_FEC
 /*
- * Send a single NAL unit that fits in one RTP packet.
- * RTP payload = NAL header + NAL body (the NAL byte is part of the data).
+ * dst ^= src, a 32-bit word at a time once dst is word aligned.  src
+ * points into the encoder's buffer at any offset; aligned sources are
+ * loaded directly.
+ */
+static void xor_words(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    while (len > 0 && ((uintptr_t)dst & 3) != 0) {
+        *dst++ ^= *src++;
+        len--;
+    }
+
+    uint32_t *d = (uint32_t *)dst;
+    size_t words = len / 4;
+    if (((uintptr_t)src & 3) == 0) {
+        const uint32_t *w = (const uint32_t *)src;
+        for (size_t i = 0; i < words; i++) {
+            d[i] ^= w[i];
+        }
+    } else {
+        for (size_t i = 0; i < words; i++) {
+            uint32_t w;
+            memcpy(&w, src + 4 * i, sizeof(w));
+            d[i] ^= w;
+        }
+    }
+
+    dst += 4 * words;
+    src += 4 * words;
+    for (len &= 3; len > 0; len--) {
+        *dst++ ^= *src++;
+    }
+}
+
+/*
+ * Fold one media packet into the group's parity (RFC 5109 section 7.3):
+ * header fields into the recovery fields, everything after the RTP header
+ * into the payload, zero padded to the longest packet.  Reads the packet
+ * where it lies; nothing is copied.  Returns false, leaving the group as
+ * it was, for a packet too long to protect.
  */
-static esp_err_t send_single_nal(rtp_session_t *s, const uint8_t *nal,
-                                  size_t nal_len, bool last_nal)
+static bool fec_add(rtp_fec_t *f, uint16_t seq, const uint8_t *rtp, size_t hdr_len,
+                    const uint8_t *payload, size_t payload_len)
 {
-    uint8_t pkt[RTP_HEADER_SIZE + RTP_MTU];
-    rtp_build_header(pkt, s, last_nal);
+    uint8_t *parity = (uint8_t *)f->buf + RTP_FEC_PARITY_OFFSET;
+    size_t prefix_len = hdr_len - RTP_HEADER_SIZE;
+    size_t len = prefix_len + payload_len;
+    if (len > RTP_FEC_PROT_MAX) {
+        return false;
+    }
+
+    if (f->count == 0) {
+        f->seq_base = seq;
+        f->prot_len = 0;
+        f->rec[0] = f->rec[1] = 0;
+        f->ts_rec = 0;
+        f->len_rec = 0;
+    }
+    f->rec[0] ^= rtp[0];
+    f->rec[1] ^= rtp[1];
+    f->ts_rec ^= ((uint32_t)rtp[4] << 24) | ((uint32_t)rtp[5] << 16) |
+                 ((uint32_t)rtp[6] << 8) | rtp[7];
+    f->len_rec ^= (uint16_t)len;
+    if (len > f->prot_len) {
+        memset(parity + f->prot_len, 0, len - f->prot_len);
+        f->prot_len = (uint16_t)len;
+    }
+    xor_words(parity, rtp + RTP_HEADER_SIZE, prefix_len);
+    xor_words(parity + prefix_len, payload, payload_len);
+    f->count++;
+    return true;
+}
+
+/*
+ * Close the group: send the media batched so far, then the FEC packet to
+ * the FEC session of every destination that has one.  That is a separate
+ * RTP session (RFC 5109 section 14.1), so the packet carries its own SSRC
+ * and sequence.  The parity buffer is reused by the next group, so the
+ * FEC packet goes out before returning.
+ */
+static void fec_send(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b)
+{
+    rtp_fec_t *f = &s->fec;
+    uint8_t *fec = (uint8_t *)f->buf + RTP_FEC_HDR_OFFSET;
+    uint16_t mask = (uint16_t)(0xFFFF << (16 - f->count));
+
+    batch_flush(s, fo, b);
+
+    fec[0] = f->rec[0] & 0x3F;          /* E=0, L=0 (16-bit mask), P/X/CC */
+    fec[1] = f->rec[1];                 /* M/PT recovery */
+    fec[2] = f->seq_base >> 8;
+    fec[3] = f->seq_base & 0xFF;
+    fec[4] = (f->ts_rec >> 24) & 0xFF;
+    fec[5] = (f->ts_rec >> 16) & 0xFF;
+    fec[6] = (f->ts_rec >>  8) & 0xFF;
+    fec[7] = f->ts_rec & 0xFF;
+    fec[8] = f->len_rec >> 8;
+    fec[9] = f->len_rec & 0xFF;
+    fec[10] = f->prot_len >> 8;         /* Level 0: protection length, mask */
+    fec[11] = f->prot_len & 0xFF;
+    fec[12] = mask >> 8;
+    fec[13] = mask & 0xFF;
+
+    rtp_batch_t fb = { .count = 1, .fec = true };
+    rtp_pkt_t *p = &fb.pkt[0];
+    uint8_t *rtp = p->hdr + RTP_TCP_FRAMING_SIZE;
+    rtp[0] = 0x80;
+    rtp[1] = RTP_FEC_PT;
+    rtp[2] = f->seq >> 8;
+    rtp[3] = f->seq & 0xFF;
+    rtp[4] = (s->timestamp >> 24) & 0xFF;
+    rtp[5] = (s->timestamp >> 16) & 0xFF;
+    rtp[6] = (s->timestamp >>  8) & 0xFF;
+    rtp[7] = s->timestamp & 0xFF;
+    rtp[8]  = (f->ssrc >> 24) & 0xFF;
+    rtp[9]  = (f->ssrc >> 16) & 0xFF;
+    rtp[10] = (f->ssrc >>  8) & 0xFF;
+    rtp[11] = f->ssrc & 0xFF;
+    p->hdr_len = RTP_HEADER_SIZE;
+    p->payload = fec;
+    p->payload_len = (RTP_FEC_PARITY_OFFSET - RTP_FEC_HDR_OFFSET) + f->prot_len;
+    batch_flush(s, fo, &fb);
+
+    f->seq++;
+    f->packets++;
+    f->count = 0;
+}
+#endif
+
+/*
+ * Append one packet to the batch: RTP header and prefix bytes (FU
+ * indicator/header) are written to the packet's header slot, the payload
+ * is only referenced.  Sends the batch when it is full.
+ */
+static void batch_add(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b, bool marker,
+                      const uint8_t *prefix, size_t prefix_len,
+                      const uint8_t *payload, size_t payload_len)
+{
+    if (s->abort) {
+        return;
+    }
+#if CONFIG_RTSP_PACER
+    /*
+     * Sleep in whole ticks: send what is batched, then wait.  A shorter
+     * deficit is carried as debt until it adds up to a tick.
+     */
+    uint32_t wait_us = rtp_pacer_consume(&s->pacer, RTP_HEADER_SIZE + prefix_len + payload_len,
+                                         esp_timer_get_time());
+    if (wait_us >= portTICK_PERIOD_MS * 1000) {
+        batch_flush(s, fo, b);
+        vTaskDelay(wait_us / (portTICK_PERIOD_MS * 1000));
+    }
+#endif
+
+    rtp_pkt_t *p = &b->pkt[b->count++];
+    uint8_t *rtp = p->hdr + RTP_TCP_FRAMING_SIZE;
+
+    rtp_build_header(rtp, s, marker);
+    if (prefix_len > 0) {
+        memcpy(rtp + RTP_HEADER_SIZE, prefix, prefix_len);
+    }
+    p->hdr_len = RTP_HEADER_SIZE + prefix_len;
+    p->payload = payload;
+    p->payload_len = payload_len;
+#if CONFIG_RTSP_RTX
+    if (s->rtx_lock) {
+        xSemaphoreTake(s->rtx_lock, portMAX_DELAY);
+        rtp_history_put(&s->history, s->seq, rtp, p->hdr_len, payload, payload_len);
+        xSemaphoreGive(s->rtx_lock);
+    }
+#endif
+#if CONFIG_RTSP_FEC
+    bool fec_protected = fec_add(&s->fec, s->seq, rtp, p->hdr_len, payload, payload_len);
+#endif
     s->seq++;
+    s->packets_sent++;
+    s->octets_sent += prefix_len + payload_len;
 
-    memcpy(pkt + RTP_HEADER_SIZE, nal, nal_len);
+    /* Interleaved framing; the channel is filled in per destination */
+    size_t rtp_len = p->hdr_len + payload_len;
+    p->hdr[0] = '$';
+    p->hdr[2] = (uint8_t)(rtp_len >> 8);
+    p->hdr[3] = (uint8_t)rtp_len;
 
-    int ret = sendto(s->sock_fd, pkt, RTP_HEADER_SIZE + nal_len, 0,
-                     (struct sockaddr *)&s->dest, sizeof(s->dest));
-    if (ret < 0) {
-        ESP_LOGD(TAG, "sendto failed: errno %d", errno);
-        return ESP_FAIL;
+    if (b->count == RTP_BATCH_PKTS) {
+        batch_flush(s, fo, b);
     }
-    return ESP_OK;
+
+#if CONFIG_RTSP_FEC
+    /*
+     * Groups end with the frame so parity never waits for the next one.
+     * The mask covers consecutive sequence numbers from seq_base, so a
+     * packet too long to protect also ends the group before it; the next
+     * group starts after it.
+     */
+    if (s->fec.count > 0 &&
+        (s->fec.count == CONFIG_RTSP_FEC_GROUP || marker || !fec_protected)) {
+        fec_send(s, fo, b);
+    }
+#endif
+}
+
+/*
+ * Send a Sender Report to every destination of the frame once per
+ * RTCP_SR_INTERVAL_US.  Sent from the sender task right after a frame, so
+ * every write to a destination (UDP or interleaved) comes from one task.
+ */
+static void send_sender_report(rtp_session_t *s, rtp_fanout_t *fo)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - s->last_sr_us < RTCP_SR_INTERVAL_US) {
+        return;
+    }
+    s->last_sr_us = now_us;
+
+    uint8_t sr[RTCP_SR_MAX_SIZE];
+    rtcp_sr_info_t info = {
+        .ssrc = s->ssrc,
+        .ntp = rtcp_ntp_now(),
+        /* Last frame's timestamp carried forward to now on the 90 kHz clock */
+        .rtp_ts = s->timestamp + (uint32_t)((now_us - s->frame_us) * RTP_CLOCK_HZ / 1000000),
+        .packets = s->packets_sent,
+        .octets = s->octets_sent,
+        .cname = s->cname,
+    };
+    size_t len = rtcp_build_sr(sr, sizeof(sr), &info);
+
+    rtp_batch_t b = { .count = 1, .rtcp = true };
+    rtp_pkt_t *p = &b.pkt[0];
+    p->hdr[0] = '$';
+    p->hdr[2] = (uint8_t)(len >> 8);
+    p->hdr[3] = (uint8_t)len;
+    p->hdr_len = 0;
+    p->payload = sr;
+    p->payload_len = len;
+    batch_flush(s, fo, &b);
+}
+
+/*
+ * Send a single NAL unit that fits in one RTP packet.
+ * RTP payload = NAL header + NAL body (the NAL byte is part of the data).
+ */
+static void send_single_nal(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b,
+                            const uint8_t *nal, size_t nal_len, bool last_nal)
+{
+    batch_add(s, fo, b, last_nal, NULL, 0, nal, nal_len);
+}
+
+/*
+ * Send several small NAL units in one STAP-A packet.  The NAL units are
+ * copied to s->stap_buf, which the next STAP-A reuses, so the batch is
+ * sent before returning.
+ */
+static void send_stap_a(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b,
+                        const nal_unit_t *nals, size_t count, bool last_nal)
+{
+    size_t len = rtp_h264_stap_a_build(s->stap_buf, nals, count);
+    batch_add(s, fo, b, last_nal, NULL, 0, s->stap_buf, len);
+    batch_flush(s, fo, b);
 }
 
 /*
@@ -123,10 +676,9 @@ static esp_err_t send_single_nal(rtp_session_t *s, const uint8_t *nal,
  * FU Indicator: (nal[0] & 0xE0) | 28  (type=28 for FU-A)
  * FU Header:    S|E|R|Type  (S=start, E=end, R=0, Type=nal[0]&0x1F)
  */
-static esp_err_t send_fua_nal(rtp_session_t *s, const uint8_t *nal,
-                               size_t nal_len, bool last_nal)
+static void send_fua_nal(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b,
+                         const uint8_t *nal, size_t nal_len, bool last_nal)
 {
-    uint8_t pkt[RTP_HEADER_SIZE + 2 + RTP_MTU];
     uint8_t fu_indicator = (nal[0] & 0xE0) | 28;  /* NRI + FU-A type */
     uint8_t nal_type = nal[0] & 0x1F;
 
@@ -140,34 +692,200 @@ static esp_err_t send_fua_nal(rtp_session_t *s, const uint8_t *nal,
         size_t frag_len = (remaining > max_frag) ? max_frag : remaining;
         bool last_frag = (frag_len == remaining);
 
-        /* Marker bit set on last fragment of last NAL in frame */
-        rtp_build_header(pkt, s, last_nal && last_frag);
-        s->seq++;
-
-        /* FU Indicator */
-        pkt[RTP_HEADER_SIZE] = fu_indicator;
-
         /* FU Header: S=start, E=end, R=0, Type */
-        uint8_t fu_header = nal_type;
-        if (first) fu_header |= 0x80;      /* S bit */
-        if (last_frag) fu_header |= 0x40;  /* E bit */
-        pkt[RTP_HEADER_SIZE + 1] = fu_header;
-
-        memcpy(pkt + RTP_HEADER_SIZE + 2, payload, frag_len);
-
-        int ret = sendto(s->sock_fd, pkt, RTP_HEADER_SIZE + 2 + frag_len, 0,
-                         (struct sockaddr *)&s->dest, sizeof(s->dest));
-        if (ret < 0) {
-            ESP_LOGD(TAG, "FU-A sendto failed: errno %d", errno);
-            return ESP_FAIL;
-        }
+        uint8_t fu[2] = { fu_indicator, nal_type };
+        if (first) fu[1] |= 0x80;      /* S bit */
+        if (last_frag) fu[1] |= 0x40;  /* E bit */
+
+        /* Marker bit set on last fragment of last NAL in frame */
+        batch_add(s, fo, b, last_nal && last_frag, fu, sizeof(fu), payload, frag_len);
 
         payload += frag_len;
         remaining -= frag_len;
         first = false;
     }
+}
 
-    return ESP_OK;
+#if CONFIG_RTSP_RTX
+/* Largest RTX packet: OSN ahead of an original packet's payload */
+#define RTP_RTX_PKT_MAX     (RTP_HEADER_SIZE + 2 + RTP_MTU)
+
+/*
+ * Build the RFC 4588 RTX packet for one packet of the history into pkt:
+ * own SSRC and sequence, original timestamp and marker, the original
+ * sequence number (OSN) ahead of the original payload.  Called under
+ * rtx_lock; returns its length, or 0 if the packet is no longer kept.
+ */
+static size_t build_rtx(rtp_session_t *s, uint16_t seq, uint8_t *pkt)
+{
+    size_t len;
+    const uint8_t *orig = rtp_history_get(&s->history, seq, &len);
+    if (!orig || len < RTP_HEADER_SIZE || len + 2 > RTP_RTX_PKT_MAX) {
+        s->rtx.missed++;
+        return 0;
+    }
+
+    pkt[0] = 0x80;
+    pkt[1] = (orig[1] & 0x80) | RTP_RTX_PT;
+    pkt[2] = (s->rtx_seq >> 8) & 0xFF;
+    pkt[3] = s->rtx_seq & 0xFF;
+    memcpy(pkt + 4, orig + 4, 4);
+    pkt[8]  = (s->rtx_ssrc >> 24) & 0xFF;
+    pkt[9]  = (s->rtx_ssrc >> 16) & 0xFF;
+    pkt[10] = (s->rtx_ssrc >>  8) & 0xFF;
+    pkt[11] = s->rtx_ssrc & 0xFF;
+    pkt[12] = orig[2];
+    pkt[13] = orig[3];
+    memcpy(pkt + RTP_HEADER_SIZE + 2, orig + RTP_HEADER_SIZE, len - RTP_HEADER_SIZE);
+    s->rtx_seq++;
+    return len + 2;
+}
+
+/*
+ * Answer the queued NACKs.  Runs in the RTSP task as soon as a NACK
+ * arrives, and in the sender task ahead of each frame.  Each packet is
+ * copied out of the history under rtx_lock and sent after releasing it,
+ * so the sender task's history writes never wait on a send.
+ */
+static void send_retransmissions(rtp_session_t *s)
+{
+    uint16_t seqs[RTP_NACK_QUEUE];
+    uint8_t pkt[RTP_RTX_PKT_MAX];
+    uint32_t requested = 0, overflow = 0, resent = 0, rtx_octets = 0, send_errors = 0;
+
+    if (!s->rtx_lock) {
+        return;
+    }
+
+    for (int i = 0; i < RTP_MAX_DESTS; i++) {
+        rtp_dest_t *d = &s->dests[i];
+        int count = 0;
+        struct sockaddr_in addr;
+
+        portENTER_CRITICAL(&s->lock);
+        if (d->used && d->playing && d->nack_count > 0) {
+            count = d->nack_count;
+            memcpy(seqs, d->nack_seq, count * sizeof(seqs[0]));
+            addr = d->addr;
+        }
+        d->nack_count = 0;
+        overflow += d->nack_overflow;
+        d->nack_overflow = 0;
+        portEXIT_CRITICAL(&s->lock);
+
+        requested += count;
+        for (int n = 0; n < count; n++) {
+            xSemaphoreTake(s->rtx_lock, portMAX_DELAY);
+            size_t len = build_rtx(s, seqs[n], pkt);
+            xSemaphoreGive(s->rtx_lock);
+            if (len == 0) {
+                continue;
+            }
+            if (sendto(s->sock_fd, pkt, len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                send_errors++;
+                continue;
+            }
+            resent++;
+            rtx_octets += len - RTP_HEADER_SIZE;
+        }
+    }
+
+    xSemaphoreTake(s->rtx_lock, portMAX_DELAY);
+    s->rtx.requested += requested;
+    s->rtx.overflow += overflow;
+    s->rtx.resent += resent;
+    s->rtx.rtx_octets += rtx_octets;
+    s->rtx_send_errors += send_errors;
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - s->rtx_report_us < RTP_RTX_REPORT_US) {
+        xSemaphoreGive(s->rtx_lock);
+        return;
+    }
+    if (s->rtx.requested > 0) {
+        uint32_t octets = s->octets_sent - s->rtx_report_octets;
+        uint32_t permille = octets ? (uint32_t)((uint64_t)s->rtx.rtx_octets * 1000 / octets) : 0;
+        ESP_LOGI(TAG, "RTX: %lu requested, %lu resent, %lu missed, %lu overflow, "
+                 "retransmit rate %lu.%lu%%",
+                 (unsigned long)s->rtx.requested, (unsigned long)s->rtx.resent,
+                 (unsigned long)s->rtx.missed, (unsigned long)s->rtx.overflow,
+                 (unsigned long)(permille / 10), (unsigned long)(permille % 10));
+    }
+    memset(&s->rtx, 0, sizeof(s->rtx));
+    s->rtx_report_octets = s->octets_sent;
+    s->rtx_report_us = now_us;
+    xSemaphoreGive(s->rtx_lock);
+}
+
+/* Queue the packets a UDP destination NACKed (RTSP task) */
+static void queue_nacks(rtp_session_t *s, int dest_id, const uint8_t *pkt, size_t len)
+{
+    uint16_t seqs[RTP_NACK_QUEUE];
+    size_t n = rtcp_parse_nack(pkt, len, s->ssrc, seqs, RTP_NACK_QUEUE);
+    if (n == 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s->lock);
+    rtp_dest_t *d = &s->dests[dest_id];
+    if (d->used && d->tcp_fd < 0) {
+        size_t room = RTP_NACK_QUEUE - d->nack_count;
+        size_t take = n < room ? n : room;
+        memcpy(&d->nack_seq[d->nack_count], seqs, take * sizeof(seqs[0]));
+        d->nack_count += take;
+        d->nack_overflow += n - take;
+    }
+    portEXIT_CRITICAL(&s->lock);
+
+    ESP_LOGD(TAG, "NACK dest %d: %u packet(s)", dest_id, (unsigned)n);
+}
+#endif
+
+/*
+ * Packetize a run of NAL units of one frame: neighbours that fit in one
+ * packet together go out as a STAP-A, the rest one per packet or as FU-A
+ * fragments.  The marker goes on the last packet if the run ends the frame.
+ */
+static void send_nal_list(rtp_session_t *s, rtp_fanout_t *fo, rtp_batch_t *b,
+                          const nal_unit_t *nals, size_t count, bool ends_frame)
+{
+    size_t i = 0;
+    while (i < count && !s->abort) {
+        size_t n = rtp_h264_stap_a_span(nals + i, count - i, RTP_MTU);
+        if (n >= 2) {
+            send_stap_a(s, fo, b, nals + i, n, ends_frame && i + n == count);
+            i += n;
+            continue;
+        }
+
+        bool last = ends_frame && i == count - 1;
+        if (nals[i].len <= RTP_MTU) {
+            send_single_nal(s, fo, b, nals[i].ptr, nals[i].len, last);
+        } else {
+            send_fua_nal(s, fo, b, nals[i].ptr, nals[i].len, last);
+        }
+        i++;
+    }
+}
+
+/* UDP socket bound to port on all interfaces, or -1 */
+static int bind_udp_socket(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "UDP socket create failed: errno %d", errno);
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_port = htons(port),
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
 esp_err_t rtp_session_init(rtp_session_t *session)
@@ -175,102 +893,630 @@ esp_err_t rtp_session_init(rtp_session_t *session)
     memset(session, 0, sizeof(*session));
     session->ssrc = esp_random();
     session->seq = (uint16_t)(esp_random() & 0xFFFF);
+    session->timestamp = esp_random();
     session->active = false;
+    portMUX_INITIALIZE(&session->lock);
+    snprintf(session->cname, sizeof(session->cname), "esp32p4-%08lx",
+             (unsigned long)session->ssrc);
 
-    session->sock_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    /* RTP on an even port, RTCP on the next one (RFC 3550 section 11) */
+    session->sock_fd = -1;
+    session->rtcp_fd = -1;
+    for (int i = 0; i < RTP_SERVER_PORT_TRIES && session->rtcp_fd < 0; i++) {
+        uint16_t port = RTP_SERVER_PORT_BASE + 2 * i;
+        session->sock_fd = bind_udp_socket(port);
+        if (session->sock_fd < 0) {
+            continue;
+        }
+        session->rtcp_fd = bind_udp_socket(port + 1);
+        if (session->rtcp_fd < 0) {
+            close(session->sock_fd);
+            session->sock_fd = -1;
+        }
+    }
     if (session->sock_fd < 0) {
-        ESP_LOGE(TAG, "UDP socket create failed: errno %d", errno);
+        ESP_LOGE(TAG, "No free RTP/RTCP port pair from %d", RTP_SERVER_PORT_BASE);
         return ESP_FAIL;
     }
 
     /* Set send buffer and make non-blocking to avoid stalling the pipeline */
     int sndbuf = 65536;
     setsockopt(session->sock_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    int flags = fcntl(session->sock_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(session->sock_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ESP_LOGW(TAG, "RTP socket left blocking: errno %d", errno);
+    }
+
+#if CONFIG_RTSP_RTX
+    uint32_t history_bytes = CONFIG_RTSP_RTX_HISTORY_KB * 1024;
+    uint32_t slots = 1;
+    while (slots < history_bytes / RTP_HISTORY_BYTES_PER_SLOT) {
+        slots <<= 1;
+    }
+    session->rtx_lock = xSemaphoreCreateMutex();
+    if (!session->rtx_lock ||
+        rtp_history_init(&session->history, history_bytes, slots) != ESP_OK) {
+        ESP_LOGW(TAG, "No RTP history, retransmission disabled");
+    }
+    session->rtx_ssrc = esp_random();
+    session->rtx_seq = (uint16_t)(esp_random() & 0xFFFF);
+#endif
+
+#if CONFIG_RTSP_FEC
+    session->fec.ssrc = esp_random();
+    session->fec.seq = (uint16_t)(esp_random() & 0xFFFF);
+    ESP_LOGI(TAG, "RTP FEC: 1 parity packet per %d media packets (PT %d, own session)",
+             CONFIG_RTSP_FEC_GROUP, RTP_FEC_PT);
+#endif
+
+#if CONFIG_RTSP_PACER
+    rtp_pacer_config_t pacer_cfg = {
+        .min_rate_bps = CONFIG_RTSP_PACER_MIN_RATE_KBPS * 1000,
+        .spread_pct = CONFIG_RTSP_PACER_SPREAD_PERCENT,
+        .max_delay_us = CONFIG_RTSP_PACER_MAX_DELAY_MS * 1000,
+        .burst_bytes = RTP_PACER_BURST_BYTES,
+    };
+    rtp_pacer_init(&session->pacer, &pacer_cfg);
+    session->frame_interval_us = RTP_PACER_DEFAULT_INTERVAL;
+    ESP_LOGI(TAG, "RTP pacer: frames spread over %d%% of the interval, <= %d ms, >= %d kbps",
+             CONFIG_RTSP_PACER_SPREAD_PERCENT, CONFIG_RTSP_PACER_MAX_DELAY_MS,
+             CONFIG_RTSP_PACER_MIN_RATE_KBPS);
+#endif
+
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    getsockname(session->sock_fd, (struct sockaddr *)&local, &local_len);
+    ESP_LOGI(TAG, "RTP session initialized (SSRC=0x%08lx, ports %d-%d)",
+             (unsigned long)session->ssrc, ntohs(local.sin_port), ntohs(local.sin_port) + 1);
+    return ESP_OK;
+}
+
+/* Recompute session->active. Caller holds session->lock. */
+static void update_active(rtp_session_t *session)
+{
+    bool active = session->mcast_viewers > 0;
+    for (int i = 0; i < RTP_MAX_DESTS; i++) {
+        active |= session->dests[i].used && session->dests[i].playing;
+    }
+    session->active = active;
+}
+
+esp_err_t rtp_session_set_multicast(rtp_session_t *session, uint32_t group,
+                                    uint16_t port, uint8_t ttl, bool loop)
+{
+    ESP_RETURN_ON_FALSE(port != 0 && (port & 1) == 0, ESP_ERR_INVALID_ARG, TAG,
+                        "Multicast RTP port must be even");
+    ESP_RETURN_ON_FALSE(IN_MULTICAST(ntohl(group)), ESP_ERR_INVALID_ARG, TAG,
+                        "Not a multicast address");
+
+    uint8_t loop_opt = loop;
+    ESP_RETURN_ON_FALSE(setsockopt(session->sock_fd, IPPROTO_IP, IP_MULTICAST_TTL,
+                                   &ttl, sizeof(ttl)) == 0,
+                        ESP_FAIL, TAG, "IP_MULTICAST_TTL failed: errno %d", errno);
+    ESP_RETURN_ON_FALSE(setsockopt(session->sock_fd, IPPROTO_IP, IP_MULTICAST_LOOP,
+                                   &loop_opt, sizeof(loop_opt)) == 0,
+                        ESP_FAIL, TAG, "IP_MULTICAST_LOOP failed: errno %d", errno);
+
+    portENTER_CRITICAL(&session->lock);
+    session->mcast_addr.sin_family = AF_INET;
+    session->mcast_addr.sin_addr.s_addr = group;
+    session->mcast_addr.sin_port = htons(port);
+    portEXIT_CRITICAL(&session->lock);
 
-    ESP_LOGI(TAG, "RTP session initialized (SSRC=0x%08lx)", (unsigned long)session->ssrc);
+    ESP_LOGI(TAG, "RTP multicast %d.%d.%d.%d:%u (ttl %u%s)",
+             ((uint8_t *)&group)[0], ((uint8_t *)&group)[1],
+             ((uint8_t *)&group)[2], ((uint8_t *)&group)[3],
+             port, ttl, loop ? ", loop" : "");
     return ESP_OK;
 }
 
-void rtp_session_set_dest(rtp_session_t *session,
-                           uint32_t client_ip, uint16_t client_port)
+void rtp_session_play_multicast(rtp_session_t *session, bool playing)
 {
-    memset(&session->dest, 0, sizeof(session->dest));
-    session->dest.sin_family = AF_INET;
-    session->dest.sin_addr.s_addr = client_ip;
-    session->dest.sin_port = htons(client_port);
+    uint16_t viewers;
 
-    ESP_LOGI(TAG, "RTP dest: %d.%d.%d.%d:%d",
+    portENTER_CRITICAL(&session->lock);
+    if (playing) {
+        session->mcast_viewers++;
+    } else if (session->mcast_viewers > 0) {
+        session->mcast_viewers--;
+    }
+    viewers = session->mcast_viewers;
+    update_active(session);
+    portEXIT_CRITICAL(&session->lock);
+
+    if (playing) {
+        session->params_pending = true;
+    }
+    ESP_LOGI(TAG, "RTP multicast: %u viewer(s)", viewers);
+}
+
+int rtp_session_add_dest(rtp_session_t *session,
+                         uint32_t client_ip, uint16_t client_port)
+{
+    int id = -1;
+
+    portENTER_CRITICAL(&session->lock);
+    for (int i = 0; i < RTP_MAX_DESTS; i++) {
+        if (!session->dests[i].used) {
+            rtp_dest_t *d = &session->dests[i];
+            memset(&d->addr, 0, sizeof(d->addr));
+            d->addr.sin_family = AF_INET;
+            d->addr.sin_addr.s_addr = client_ip;
+            d->addr.sin_port = htons(client_port);
+            d->tcp_fd = -1;
+            d->tx_lock = NULL;
+            d->playing = false;
+            d->wait_idr = false;
+            d->failed = false;
+            d->frames_dropped = 0;
+            memset(&d->rr, 0, sizeof(d->rr));
+#if CONFIG_RTSP_RTX
+            d->nack_count = 0;
+            d->nack_overflow = 0;
+#endif
+#if CONFIG_RTSP_FEC
+            d->fec_port = 0;
+#endif
+            d->used = true;
+            id = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&session->lock);
+
+    if (id < 0) {
+        ESP_LOGW(TAG, "RTP destination table full (%d)", RTP_MAX_DESTS);
+        return -1;
+    }
+    session->params_pending = true;
+    ESP_LOGI(TAG, "RTP dest %d: %d.%d.%d.%d:%d", id,
              (client_ip) & 0xFF, (client_ip >> 8) & 0xFF,
              (client_ip >> 16) & 0xFF, (client_ip >> 24) & 0xFF,
              client_port);
+    return id;
 }
 
-void rtp_session_start(rtp_session_t *session)
+int rtp_session_add_tcp_dest(rtp_session_t *session, int tcp_fd, uint8_t channel,
+                             SemaphoreHandle_t tx_lock)
 {
-    session->active = true;
-    ESP_LOGI(TAG, "RTP streaming started");
+    int id = -1;
+
+    portENTER_CRITICAL(&session->lock);
+    for (int i = 0; i < RTP_MAX_DESTS; i++) {
+        if (!session->dests[i].used) {
+            rtp_dest_t *d = &session->dests[i];
+            memset(d, 0, sizeof(*d));
+            d->tcp_fd = tcp_fd;
+            d->channel = channel;
+            d->tx_lock = tx_lock;
+            d->used = true;
+            id = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&session->lock);
+
+    if (id < 0) {
+        ESP_LOGW(TAG, "RTP destination table full (%d)", RTP_MAX_DESTS);
+        return -1;
+    }
+    session->params_pending = true;
+    ESP_LOGI(TAG, "RTP dest %d: interleaved on fd %d, channel %u", id, tcp_fd, channel);
+    return id;
 }
 
-void rtp_session_stop(rtp_session_t *session)
+#if CONFIG_RTSP_FEC
+esp_err_t rtp_session_set_fec_port(rtp_session_t *session, int dest_id, uint16_t client_port)
 {
-    session->active = false;
-    ESP_LOGI(TAG, "RTP streaming stopped");
+    ESP_RETURN_ON_FALSE(dest_id >= 0 && dest_id < RTP_MAX_DESTS, ESP_ERR_INVALID_ARG,
+                        TAG, "Invalid destination %d", dest_id);
+    esp_err_t ret = ESP_OK;
+    portENTER_CRITICAL(&session->lock);
+    rtp_dest_t *d = &session->dests[dest_id];
+    if (d->used && d->tcp_fd < 0) {
+        d->fec_port = client_port;
+    } else {
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    portEXIT_CRITICAL(&session->lock);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "RTP dest %d: FEC to port %u", dest_id, client_port);
+    }
+    return ret;
+}
+#endif
+
+bool rtp_session_dest_failed(rtp_session_t *session, int dest_id)
+{
+    if (dest_id < 0 || dest_id >= RTP_MAX_DESTS) {
+        return false;
+    }
+    return session->dests[dest_id].used && session->dests[dest_id].failed;
+}
+
+void rtp_session_rtcp_input(rtp_session_t *session, int dest_id,
+                            const uint8_t *pkt, size_t len)
+{
+    if (dest_id >= RTP_MAX_DESTS) {
+        return;
+    }
+    rtcp_ntp_t now = rtcp_ntp_now();
+
+    /* Parse outside the spinlock; only this (RTSP) task writes rr */
+    rtcp_rr_stats_t st;
+    bool known;
+    portENTER_CRITICAL(&session->lock);
+    if (dest_id >= 0) {
+        known = session->dests[dest_id].used;
+        st = session->dests[dest_id].rr;
+    } else {
+        known = session->mcast_viewers > 0;
+        st = session->mcast_rr;
+    }
+    portEXIT_CRITICAL(&session->lock);
+
+    if (!known) {
+        return;
+    }
+#if CONFIG_RTSP_RTX
+    if (dest_id >= 0) {
+        queue_nacks(session, dest_id, pkt, len);
+        send_retransmissions(session);
+    }
+#endif
+    if (!rtcp_parse_rr(pkt, len, session->ssrc, now, &st)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&session->lock);
+    if (dest_id < 0) {
+        session->mcast_rr = st;
+    } else if (session->dests[dest_id].used) {
+        session->dests[dest_id].rr = st;
+    }
+    portEXIT_CRITICAL(&session->lock);
+
+    ESP_LOGI(TAG, "RR %s %d: lost %u/256 (total %ld), jitter %lu, rtt %lu us",
+             dest_id < 0 ? "multicast" : "dest", dest_id, st.fraction_lost,
+             (long)st.cumulative_lost, (unsigned long)st.jitter, (unsigned long)st.rtt_us);
+}
+
+void rtp_session_rtcp_receive(rtp_session_t *session)
+{
+    uint8_t buf[512];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int n = recvfrom(session->rtcp_fd, buf, sizeof(buf), MSG_DONTWAIT,
+                     (struct sockaddr *)&from, &from_len);
+    if (n <= 0) {
+        return;
+    }
+
+    /* The destination whose RTCP port sent it, else any from that host */
+    int id = -1;
+    portENTER_CRITICAL(&session->lock);
+    for (int i = 0; i < RTP_MAX_DESTS; i++) {
+        const rtp_dest_t *d = &session->dests[i];
+        if (!d->used || d->tcp_fd >= 0 || d->addr.sin_addr.s_addr != from.sin_addr.s_addr) {
+            continue;
+        }
+        if (ntohs(d->addr.sin_port) + 1 == ntohs(from.sin_port)) {
+            id = i;
+            break;
+        }
+        if (id < 0) {
+            id = i;
+        }
+    }
+    portEXIT_CRITICAL(&session->lock);
+
+    rtp_session_rtcp_input(session, id, buf, n);
+}
+
+esp_err_t rtp_session_get_rr_stats(rtp_session_t *session, int dest_id,
+                                   rtcp_rr_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(dest_id >= -1 && dest_id < RTP_MAX_DESTS, ESP_ERR_INVALID_ARG,
+                        TAG, "Invalid destination %d", dest_id);
+    esp_err_t ret = ESP_OK;
+    portENTER_CRITICAL(&session->lock);
+    if (dest_id < 0) {
+        *stats = session->mcast_rr;
+    } else if (session->dests[dest_id].used) {
+        *stats = session->dests[dest_id].rr;
+    } else {
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    portEXIT_CRITICAL(&session->lock);
+    return ret;
+}
+
+void rtp_session_get_congestion(rtp_session_t *session, int64_t max_age_us,
+                                rtp_congestion_t *out)
+{
+    int64_t now_us = esp_timer_get_time();
+    int worst = -1;
+
+    portENTER_CRITICAL(&session->lock);
+    for (int i = 0; i <= RTP_MAX_DESTS; i++) {
+        const rtcp_rr_stats_t *rr;
+        if (i == RTP_MAX_DESTS) {
+            if (session->mcast_viewers == 0) {
+                continue;
+            }
+            rr = &session->mcast_rr;
+        } else {
+            if (!session->dests[i].used || !session->dests[i].playing) {
+                continue;
+            }
+            rr = &session->dests[i].rr;
+        }
+        if (rr->reports > 0 && now_us - rr->last_rr_us <= max_age_us &&
+            rr->fraction_lost > worst) {
+            worst = rr->fraction_lost;
+        }
+    }
+    out->send_errors = session->send_errors;
+#if CONFIG_RTSP_RTX
+    out->send_errors += session->rtx_send_errors;
+#endif
+    out->tcp_drops = session->tcp_drops;
+    portEXIT_CRITICAL(&session->lock);
+
+    out->worst_loss_256 = worst;
+}
+
+void rtp_session_play_dest(rtp_session_t *session, int dest_id, bool playing)
+{
+    if (dest_id < 0 || dest_id >= RTP_MAX_DESTS) {
+        return;
+    }
+    portENTER_CRITICAL(&session->lock);
+    if (session->dests[dest_id].used) {
+        session->dests[dest_id].playing = playing;
+    }
+    update_active(session);
+    portEXIT_CRITICAL(&session->lock);
+
+    ESP_LOGI(TAG, "RTP dest %d %s", dest_id, playing ? "streaming" : "paused");
+}
+
+void rtp_session_remove_dest(rtp_session_t *session, int dest_id)
+{
+    if (dest_id < 0 || dest_id >= RTP_MAX_DESTS) {
+        return;
+    }
+    portENTER_CRITICAL(&session->lock);
+    session->dests[dest_id].used = false;
+    session->dests[dest_id].playing = false;
+    update_active(session);
+    portEXIT_CRITICAL(&session->lock);
+
+    ESP_LOGI(TAG, "RTP dest %d removed", dest_id);
+}
+
+#if CONFIG_RTSP_PACER
+/* Close the frame's pacing and log the queueing delay now and then */
+static void report_pacer(rtp_session_t *s)
+{
+    rtp_pacer_t *p = &s->pacer;
+    int64_t now_us = esp_timer_get_time();
+
+    rtp_pacer_end_frame(p, now_us);
+    if (now_us - s->pacer_report_us < RTP_PACER_REPORT_US) {
+        return;
+    }
+    s->pacer_report_us = now_us;
+    ESP_LOGI(TAG, "RTP pacer: %lu frames, queueing delay avg %lu us, max %lu us, %lu over budget",
+             (unsigned long)p->frames, (unsigned long)(p->delay_sum_us / p->frames),
+             (unsigned long)p->delay_max_us, (unsigned long)p->late_frames);
+    p->frames = 0;
+    p->late_frames = 0;
+    p->delay_sum_us = 0;
+    p->delay_max_us = 0;
+}
+#endif
+
+/*
+ * RTP timestamp of a frame captured at capture_us.  Timestamps are taken
+ * from one origin, not accumulated per frame, so they do not drift and
+ * dropped frames simply leave a gap.  Each frame gets a later timestamp
+ * than the one before; a capture time that goes backwards (another clock
+ * after a pipeline restart) re-anchors the origin.
+ */
+static uint32_t rtp_timestamp_for(rtp_session_t *s, int64_t capture_us)
+{
+    if (capture_us <= 0) {
+        capture_us = esp_timer_get_time();
+    }
+    if (s->ts_origin_us == 0 || capture_us <= s->frame_us) {
+        s->ts_origin = s->timestamp + (s->ts_origin_us ? 1 : 0);
+        s->ts_origin_us = capture_us;
+    }
+    s->frame_us = capture_us;
+    int64_t ticks = (capture_us - s->ts_origin_us) * RTP_CLOCK_HZ / 1000000;
+    uint32_t ts = s->ts_origin + (uint32_t)ticks;
+    /* Two captures within one 90 kHz tick */
+    if (ts == s->timestamp && s->ts_origin_us != capture_us) {
+        ts++;
+    }
+    return ts;
+}
+
+esp_err_t rtp_session_set_param_sets(rtp_session_t *session,
+                                     const uint8_t *sps, size_t sps_len,
+                                     const uint8_t *pps, size_t pps_len)
+{
+    ESP_RETURN_ON_FALSE(sps_len > 0 && sps_len <= RTP_PARAM_SET_MAX &&
+                        pps_len > 0 && pps_len <= RTP_PARAM_SET_MAX,
+                        ESP_ERR_INVALID_SIZE, TAG, "Parameter sets too large");
+    memcpy(session->sps, sps, sps_len);
+    memcpy(session->pps, pps, pps_len);
+    session->sps_len = (uint8_t)sps_len;
+    session->pps_len = (uint8_t)pps_len;
+    session->params_pending = true;
+    return ESP_OK;
+}
+
+void rtp_session_abort_frame(rtp_session_t *session, bool abort)
+{
+    session->abort = abort;
+}
+
+bool rtp_session_tx_ready(rtp_session_t *session)
+{
+    return esp_timer_get_time() - session->udp_busy_us >= RTP_UDP_BACKOFF_MS * 1000;
 }
 
 esp_err_t rtp_send_h264_frame(rtp_session_t *session,
-                               const uint8_t *frame, size_t len)
+                               const uint8_t *frame, size_t len, int64_t capture_us)
 {
-    if (!session->active) {
+    if (!session->active || session->abort) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    /* Advance timestamp by one frame period (90kHz / 30fps = 3000 ticks) */
-    session->timestamp += TICKS_PER_FRAME_30FPS;
+#if CONFIG_RTSP_RTX
+    send_retransmissions(session);
+#endif
 
     /*
-     * Parse Annex-B stream into individual NAL units.
-     * A typical H.264 frame contains: SPS, PPS, then one or more slice NALs.
+     * Parse Annex-B stream into individual NAL units, all of them up front
+     * to know which is last.  A typical H.264 frame contains: SPS, PPS,
+     * then one or more slice NALs.
      */
-    const uint8_t *p = frame;
-    size_t remaining = len;
-    const uint8_t *nal;
-    size_t nal_len;
-
-    /* Collect all NAL start positions first to know which is last */
-    typedef struct { const uint8_t *ptr; size_t len; } nal_info_t;
-    nal_info_t nals[16];  /* Enough for SPS+PPS+slices */
-    int nal_count = 0;
-
-    while (remaining > 0 && nal_count < 16) {
-        nal = find_next_nal(p, remaining, &nal_len);
-        if (!nal || nal_len == 0) break;
-        nals[nal_count].ptr = nal;
-        nals[nal_count].len = nal_len;
-        nal_count++;
-        size_t consumed = (nal + nal_len) - p;
-        p += consumed;
-        remaining -= consumed;
-    }
-
-    /* Send each NAL */
-    for (int i = 0; i < nal_count; i++) {
-        bool last = (i == nal_count - 1);
-        if (nals[i].len <= RTP_MTU) {
-            send_single_nal(session, nals[i].ptr, nals[i].len, last);
-        } else {
-            send_fua_nal(session, nals[i].ptr, nals[i].len, last);
+    if (nal_index_build(&session->nal_idx, frame, len) != ESP_OK) {
+        ESP_LOGW(TAG, "NAL index full at %u units, frame truncated",
+                 (unsigned)session->nal_idx.count);
+    }
+    const nal_unit_t *nals = session->nal_idx.nals;
+    size_t nal_count = session->nal_idx.count;
+    bool idr = false;
+    bool inband_sps = false, inband_pps = false;
+    for (size_t i = 0; i < nal_count; i++) {
+        uint8_t type = nals[i].ptr[0] & 0x1F;
+        idr |= type == NAL_TYPE_IDR;
+        inband_sps |= type == NAL_TYPE_SPS;
+        inband_pps |= type == NAL_TYPE_PPS;
+    }
+
+    /*
+     * Destinations joining or leaving mid-frame take effect on the next
+     * one.  Congested TCP clients rejoin at an IDR frame.
+     */
+    rtp_fanout_t fo = { .count = 0 };
+    portENTER_CRITICAL(&session->lock);
+    for (int i = 0; i < RTP_MAX_DESTS; i++) {
+        rtp_dest_t *d = &session->dests[i];
+        if (!d->used || !d->playing || d->failed) {
+            continue;
+        }
+        if (d->wait_idr) {
+            if (!idr) {
+                d->frames_dropped++;
+                continue;
+            }
+            d->wait_idr = false;
+        }
+        rtp_fanout_dest_t *fd = &fo.dest[fo.count++];
+        fd->id = i;
+        fd->addr = d->addr;
+        fd->tcp_fd = d->tcp_fd;
+        fd->channel = d->channel;
+        fd->tx_lock = d->tx_lock;
+#if CONFIG_RTSP_FEC
+        fd->fec_port = d->fec_port;
+#endif
+        fd->skip = false;
+    }
+    if (session->mcast_wait_idr && idr) {
+        session->mcast_wait_idr = false;
+    }
+    if (session->mcast_viewers > 0 && session->mcast_addr.sin_port != 0 &&
+        !session->mcast_wait_idr) {
+        rtp_fanout_dest_t *fd = &fo.dest[fo.count++];
+        fd->id = -1;
+        fd->addr = session->mcast_addr;
+        fd->tcp_fd = -1;
+#if CONFIG_RTSP_FEC
+        fd->fec_port = ntohs(session->mcast_addr.sin_port) + RTP_FEC_MCAST_PORT_OFFSET;
+#endif
+        fd->skip = false;
+    }
+    portEXIT_CRITICAL(&session->lock);
+
+#if CONFIG_RTSP_PACER
+    /* Smoothed capture interval: the pacing budget is a share of it */
+    int64_t prev_us = session->frame_us;
+#endif
+    session->timestamp = rtp_timestamp_for(session, capture_us);
+#if CONFIG_RTSP_PACER
+    int64_t interval_us = session->frame_us - prev_us;
+    if (prev_us > 0 && interval_us > 0 && interval_us < 1000000) {
+        session->frame_interval_us = (3 * session->frame_interval_us + interval_us) / 4;
+    }
+#endif
+
+    if (fo.count == 0) {
+        return ESP_OK;
+    }
+
+#if CONFIG_RTSP_PACER
+    /* Frame size on the wire: payload plus one header per MTU-sized piece */
+    size_t wire_bytes = len + (len / RTP_MTU + nal_count + 2) * (RTP_HEADER_SIZE + 2);
+    rtp_pacer_begin_frame(&session->pacer, wire_bytes, session->frame_interval_us,
+                          esp_timer_get_time());
+#endif
+
+    rtp_batch_t batch = { .count = 0 };
+    nal_unit_t params[2] = {
+        { .ptr = session->sps, .len = session->sps_len },
+        { .ptr = session->pps, .len = session->pps_len },
+    };
+
+    /*
+     * A client that joined, or a restarted encoder, gets the parameter sets
+     * ahead of the first IDR so decoding starts there.  They go to every
+     * destination to keep one sequence space; a repeat is harmless.
+     */
+    if (idr && session->params_pending) {
+        session->params_pending = false;
+        if (!(inband_sps && inband_pps) && session->sps_len > 0) {
+            send_nal_list(session, &fo, &batch, params, 2, false);
         }
     }
 
+    send_nal_list(session, &fo, &batch, nals, nal_count, true);
+    batch_flush(session, &fo, &batch);
+
+#if CONFIG_RTSP_PACER
+    report_pacer(session);
+#endif
+    send_sender_report(session, &fo);
+
     return ESP_OK;
 }
 
 void rtp_session_close(rtp_session_t *session)
 {
+    portENTER_CRITICAL(&session->lock);
+    memset(session->dests, 0, sizeof(session->dests));
     session->active = false;
+    portEXIT_CRITICAL(&session->lock);
     if (session->sock_fd >= 0) {
         close(session->sock_fd);
         session->sock_fd = -1;
     }
+    if (session->rtcp_fd >= 0) {
+        close(session->rtcp_fd);
+        session->rtcp_fd = -1;
+    }
+    nal_index_free(&session->nal_idx);
+#if CONFIG_RTSP_RTX
+    rtp_history_deinit(&session->history);
+    if (session->rtx_lock) {
+        vSemaphoreDelete(session->rtx_lock);
+        session->rtx_lock = NULL;
+    }
+#endif
     ESP_LOGI(TAG, "RTP session closed");
 }
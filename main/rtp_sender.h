@@ -10,60 +10,363 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nal_scanner.h"
+#include "rtcp.h"
+#include "rtp_pacer.h"
+#include "rtp_history.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* One destination per RTSP client */
+#define RTP_MAX_DESTS       CONFIG_RTSP_MAX_CLIENTS
+
+/* Ethernet MTU=1500, IP=20, UDP=8, RTP=12 → max payload ~1400 */
+#define RTP_MTU             1400
+
+/* Largest SPS / PPS re-sent ahead of IDR frames */
+#define RTP_PARAM_SET_MAX   64
+
+/* RFC 4588 retransmission stream (SDP: rtx/90000, apt=96) */
+#define RTP_RTX_PT          97
+
+/* RFC 5109 ULPFEC stream, an RTP session of its own (SDP: second m-line,
+ * ulpfec/90000, grouped with the video by "a=group:FEC") */
+#define RTP_FEC_PT          98
+
+/* Multicast FEC session: the port pair after the video's */
+#define RTP_FEC_MCAST_PORT_OFFSET   2
+
+/* Longest media payload a FEC packet protects */
+#define RTP_FEC_PROT_MAX    RTP_MTU
+
+/* NACKed sequence numbers queued per destination between frames */
+#define RTP_NACK_QUEUE      64
+
+typedef struct {
+    struct sockaddr_in addr;      /* Client RTP destination (from RTSP SETUP), UDP */
+    int tcp_fd;                   /* RTSP connection for interleaved RTP, or -1 for UDP */
+    uint8_t channel;              /* Interleaved RTP channel ($ framing) */
+    SemaphoreHandle_t tx_lock;    /* Serializes RTP and RTSP replies on tcp_fd */
+    bool used;                    /* Slot allocated by SETUP */
+    bool playing;                 /* PLAY received, packets are sent here */
+
+    /* Written by the sender task only */
+    bool wait_idr;                /* TCP congested: drop frames until the next IDR */
+    bool failed;                  /* TCP stream broken mid-packet: close the client */
+    uint32_t frames_dropped;
+
+    rtcp_rr_stats_t rr;           /* Receiver reports (RTSP task, under lock) */
+
+#if CONFIG_RTSP_RTX
+    /* NACKed packets to retransmit (RTSP task fills, emptied as answered; under lock) */
+    uint16_t nack_seq[RTP_NACK_QUEUE];
+    uint8_t nack_count;
+    uint32_t nack_overflow;       /* Requests dropped on a full queue */
+#endif
+
+#if CONFIG_RTSP_FEC
+    uint16_t fec_port;            /* Client port of the FEC session, 0 = not set up */
+#endif
+} rtp_dest_t;
+
+/*
+ * XOR parity of the media packets of one FEC group, accumulated as they
+ * are sent.  buf holds the FEC packet after its RTP header: 2 pad bytes,
+ * FEC header (10), level 0 header (4), then the parity payload, which
+ * starts word aligned.
+ */
+#define RTP_FEC_HDR_OFFSET      2
+#define RTP_FEC_PARITY_OFFSET   16
+
+typedef struct {
+    uint32_t buf[(RTP_FEC_PARITY_OFFSET + RTP_FEC_PROT_MAX + 3) / 4];
+    uint16_t seq_base;          /* First media packet of the group */
+    uint8_t count;              /* Media packets in the group so far */
+    uint16_t prot_len;          /* Longest protected payload so far */
+    uint8_t rec[2];             /* P/X/CC and M/PT recovery */
+    uint32_t ts_rec;
+    uint16_t len_rec;
+    uint32_t ssrc;              /* FEC stream: own SSRC and sequence */
+    uint16_t seq;
+    uint32_t packets;
+} rtp_fec_t;
+
+/* Retransmission counters (sender task) */
 typedef struct {
-    int sock_fd;                  /* UDP socket */
-    struct sockaddr_in dest;      /* Client RTP destination (from RTSP SETUP) */
+    uint32_t requested;           /* Sequence numbers NACKed */
+    uint32_t resent;              /* Found in the history and retransmitted */
+    uint32_t missed;              /* Already overwritten in the history */
+    uint32_t overflow;            /* Not queued: too many NACKs between frames */
+    uint32_t rtx_octets;          /* RTX payload octets sent */
+} rtp_rtx_stats_t;
+
+/*
+ * One RTP stream (single SSRC, sequence and clock) fanned out to every
+ * playing destination: each packet is built once and sent to all of them.
+ */
+typedef struct {
+    int sock_fd;                  /* UDP socket, bound to an even port */
+    int rtcp_fd;                  /* RTCP socket, bound to sock_fd's port + 1 */
+    rtp_dest_t dests[RTP_MAX_DESTS];
+    portMUX_TYPE lock;            /* Guards dests (RTSP task vs sender task) */
     uint16_t seq;                 /* RTP sequence number */
     uint32_t ssrc;                /* Random SSRC identifier */
-    uint32_t timestamp;           /* 90kHz RTP clock */
-    bool active;                  /* True when PLAY is active */
+    uint32_t timestamp;           /* 90kHz RTP clock, of the last frame sent */
+    volatile bool active;         /* True while any destination is playing */
+    volatile bool abort;          /* Stop the frame being sent at its next batch */
+
+    /* Multicast: one shared destination, however many viewers joined */
+    struct sockaddr_in mcast_addr;  /* sin_port 0 = multicast not configured */
+    uint16_t mcast_viewers;         /* Multicast clients in PLAY */
+    bool mcast_wait_idr;            /* UDP stalled: group skips to the next IDR (sender task) */
+
+    nal_index_t nal_idx;            /* NAL units of the frame being sent (sender task) */
+    uint8_t stap_buf[RTP_MTU];      /* STAP-A payload being sent (sender task) */
+
+    /* Congestion signals for rate control (sender task) */
+    uint32_t send_errors;           /* UDP sends lwIP refused (out of buffers) */
+    uint32_t tcp_drops;             /* Interleaved clients cut off mid-frame */
+    int64_t udp_busy_us;            /* Last time lwIP had no buffer for a UDP send */
+
+    /* Sender Report state (sender task) */
+    uint32_t packets_sent;
+    uint32_t octets_sent;           /* RTP payload octets */
+    int64_t frame_us;               /* Capture time of the last frame (esp_timer) */
+
+    /* Capture time -> RTP timestamp mapping (sender task) */
+    uint32_t ts_origin;             /* RTP timestamp at ts_origin_us */
+    int64_t ts_origin_us;           /* 0 until the first frame */
+    int64_t last_sr_us;
+    char cname[20];
+
+    rtcp_rr_stats_t mcast_rr;       /* Latest report of any multicast receiver */
+
+#if CONFIG_RTSP_PACER
+    rtp_pacer_t pacer;              /* Spreads each frame over its interval (sender task) */
+    uint32_t frame_interval_us;     /* Smoothed capture interval */
+    int64_t pacer_report_us;
+#endif
+
+#if CONFIG_RTSP_RTX
+    /* Sent packets kept for retransmission: written by the sender task,
+     * copied out by whichever task answers a NACK, both under rtx_lock,
+     * which is never held across a send */
+    SemaphoreHandle_t rtx_lock;
+    rtp_history_t history;
+    uint32_t rtx_ssrc;              /* RTX stream: own SSRC and sequence */
+    uint16_t rtx_seq;
+    rtp_rtx_stats_t rtx;
+    uint32_t rtx_send_errors;       /* Retransmissions lwIP refused */
+    uint32_t rtx_report_octets;     /* octets_sent at the last report */
+    int64_t rtx_report_us;
+#endif
+
+#if CONFIG_RTSP_FEC
+    rtp_fec_t fec;                  /* Parity of the current group (sender task) */
+#endif
+
+    /* Cached SPS/PPS, re-sent ahead of the next IDR without in-band sets */
+    uint8_t sps[RTP_PARAM_SET_MAX];
+    uint8_t pps[RTP_PARAM_SET_MAX];
+    uint8_t sps_len;                /* 0 = nothing cached (sender task) */
+    uint8_t pps_len;
+    volatile bool params_pending;   /* Set on client join / new encoder sets */
 } rtp_session_t;
 
 /**
  * @brief Initialize an RTP session
  *
- * Creates a UDP socket and generates a random SSRC.
- * Does NOT start sending — call rtp_session_set_dest() then rtp_session_start().
+ * Creates the RTP and RTCP UDP sockets on an even/odd port pair and
+ * generates a random SSRC.  While any destination is playing, a Sender
+ * Report is sent to every destination's RTCP port (or interleaved
+ * channel) about once a second.  With CONFIG_RTSP_RTX, sent packets are
+ * kept in a history ring and resent on RTX_PT to UDP clients that NACK
+ * them.  With CONFIG_RTSP_FEC, an XOR parity packet (RTP_FEC_PT) per
+ * CONFIG_RTSP_FEC_GROUP media packets goes to the FEC session of each UDP
+ * client that set one up, and of the multicast group.
+ * Does NOT start sending — add a destination with rtp_session_add_dest(),
+ * then enable it with rtp_session_play_dest().
  */
 esp_err_t rtp_session_init(rtp_session_t *session);
 
 /**
- * @brief Set the RTP destination (client IP + port from RTSP SETUP)
+ * @brief Add a destination (client IP + port from RTSP SETUP)
+ *
+ * @return Destination id, or -1 if the table is full
+ */
+int rtp_session_add_dest(rtp_session_t *session,
+                         uint32_t client_ip, uint16_t client_port);
+
+/**
+ * @brief Add an interleaved destination (RTP/AVP/TCP, RTSP "$" framing)
+ *
+ * Packets are written to the RTSP connection as '$', channel, 16-bit
+ * length, packet.  The sender never blocks on a congested connection: a
+ * frame that does not fit is dropped and the destination resumes at the
+ * next IDR frame.
+ *
+ * @param tcp_fd   RTSP control connection
+ * @param channel  RTP channel from "interleaved=" (RTCP uses channel + 1)
+ * @param tx_lock  Mutex the RTSP task also holds while writing replies
+ * @return Destination id, or -1 if the table is full
+ */
+int rtp_session_add_tcp_dest(rtp_session_t *session, int tcp_fd, uint8_t channel,
+                             SemaphoreHandle_t tx_lock);
+
+#if CONFIG_RTSP_FEC
+/**
+ * @brief Send a UDP destination's FEC session to client_port (SETUP of the
+ *        FEC m-line)
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for an unknown or interleaved
+ *         destination
+ */
+esp_err_t rtp_session_set_fec_port(rtp_session_t *session, int dest_id, uint16_t client_port);
+#endif
+
+/**
+ * @brief True if an interleaved destination's connection broke mid-packet
+ *
+ * The RTSP stream is then out of sync and the client must be closed.
+ */
+bool rtp_session_dest_failed(rtp_session_t *session, int dest_id);
+
+/**
+ * @brief Configure the multicast destination
+ *
+ * Sets the multicast TTL and loopback on the RTP socket.  Nothing is sent
+ * to the group until a viewer calls rtp_session_play_multicast().
+ *
+ * @param group  Group address in network byte order
+ * @param port   RTP port (even)
+ * @param ttl    IP_MULTICAST_TTL
+ * @param loop   IP_MULTICAST_LOOP (deliver to receivers on this device)
+ */
+esp_err_t rtp_session_set_multicast(rtp_session_t *session, uint32_t group,
+                                    uint16_t port, uint8_t ttl, bool loop);
+
+/**
+ * @brief Add or remove one multicast viewer (PLAY / TEARDOWN)
+ *
+ * The group is sent to while at least one viewer is playing; its cost
+ * does not depend on the viewer count.
+ */
+void rtp_session_play_multicast(rtp_session_t *session, bool playing);
+
+/**
+ * @brief Start or stop sending to a destination (PLAY / PAUSE)
  */
-void rtp_session_set_dest(rtp_session_t *session,
-                           uint32_t client_ip, uint16_t client_port);
+void rtp_session_play_dest(rtp_session_t *session, int dest_id, bool playing);
 
 /**
- * @brief Mark session as active (PLAY received)
+ * @brief Remove a destination (TEARDOWN or client disconnect)
  */
-void rtp_session_start(rtp_session_t *session);
+void rtp_session_remove_dest(rtp_session_t *session, int dest_id);
 
 /**
- * @brief Mark session as inactive (TEARDOWN/PAUSE received)
+ * @brief Read one RTCP packet from the RTCP socket and apply its reports
+ *
+ * Call when sock rtcp_fd is readable.  The report is matched to a UDP
+ * destination by source address; reports from other hosts are credited
+ * to the multicast group while it has viewers.
+ */
+void rtp_session_rtcp_receive(rtp_session_t *session);
+
+/**
+ * @brief Apply an RTCP packet received on an interleaved channel
+ *
+ * With CONFIG_RTSP_RTX, the packets a UDP destination NACKs are resent
+ * from here, without waiting for the next frame.
  */
-void rtp_session_stop(rtp_session_t *session);
+void rtp_session_rtcp_input(rtp_session_t *session, int dest_id,
+                            const uint8_t *pkt, size_t len);
 
 /**
- * @brief Send an H.264 Annex-B frame over RTP
+ * @brief Read a destination's receiver report statistics
+ *
+ * @param dest_id  Destination id, or -1 for the multicast group
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for an unknown destination
+ */
+esp_err_t rtp_session_get_rr_stats(rtp_session_t *session, int dest_id,
+                                   rtcp_rr_stats_t *stats);
+
+/* Congestion signals, for bitrate control */
+typedef struct {
+    uint32_t send_errors;         /* Cumulative UDP send failures */
+    uint32_t tcp_drops;           /* Cumulative interleaved congestion drops */
+    int worst_loss_256;           /* Highest fraction lost in a recent RR, -1 if none */
+} rtp_congestion_t;
+
+/**
+ * @brief Read the session's congestion signals
+ *
+ * @param max_age_us  Receiver reports older than this are ignored
+ */
+void rtp_session_get_congestion(rtp_session_t *session, int64_t max_age_us,
+                                rtp_congestion_t *out);
+
+/**
+ * @brief Cache the H.264 parameter sets of the stream being sent
+ *
+ * The sets are sent ahead of the next IDR frame that does not carry its
+ * own, and again after every client join.  Call from the sending task.
+ *
+ * @param sps  SPS NAL unit without start code (at most RTP_PARAM_SET_MAX)
+ * @param pps  PPS NAL unit without start code (at most RTP_PARAM_SET_MAX)
+ */
+esp_err_t rtp_session_set_param_sets(rtp_session_t *session,
+                                     const uint8_t *sps, size_t sps_len,
+                                     const uint8_t *pps, size_t pps_len);
+
+/**
+ * @brief Send an H.264 Annex-B frame over RTP to every playing destination
  *
  * Parses the frame into NAL units and sends each as:
+ *   - STAP-A packet, together with its neighbours, if they fit in one MTU
  *   - Single NAL Unit packet if NAL <= MTU
  *   - FU-A fragmented packets if NAL > MTU
  *
- * Per RFC 6184 (RTP Payload Format for H.264 Video).
+ * Per RFC 6184 (RTP Payload Format for H.264 Video).  Each packet is built
+ * once and sent to all destinations that were playing when the frame
+ * started.  With CONFIG_RTSP_PACER the packets are spread over part of
+ * the frame interval, so the call takes up to the pacer's latency budget.
+ *
+ * The RTP timestamp is the capture time on the 90 kHz clock, so frame
+ * rate changes and dropped frames keep real timing.
  *
- * @param session   Active RTP session
- * @param frame     H.264 Annex-B frame (with 00 00 00 01 start codes)
- * @param len       Frame length in bytes
- * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not active
+ * @param session     Active RTP session
+ * @param frame       H.264 Annex-B frame (with 00 00 00 01 start codes)
+ * @param len         Frame length in bytes
+ * @param capture_us  esp_timer time the raw frame was captured
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not active or aborting
  */
 esp_err_t rtp_send_h264_frame(rtp_session_t *session,
-                               const uint8_t *frame, size_t len);
+                               const uint8_t *frame, size_t len, int64_t capture_us);
+
+/**
+ * @brief True if a new frame can start now (sender task)
+ *
+ * lwIP does not report free UDP buffer space, so the check is that no UDP
+ * send had to wait for a buffer within the last few milliseconds.  While
+ * false, keep the next frame queued: a frame that starts is sent whole,
+ * waiting out lwIP, so starting one into a full stack only delays it.
+ */
+bool rtp_session_tx_ready(rtp_session_t *session);
+
+/**
+ * @brief Stop sending the current frame, and any new one, while set
+ *
+ * Checked before every batch, so rtp_send_h264_frame() returns within one
+ * batch's sends (an interleaved client still finishes a partly written
+ * packet).  For a producer that needs its frame back before unmapping it.
+ */
+void rtp_session_abort_frame(rtp_session_t *session, bool abort);
 
 /**
  * @brief Close the RTP session and release the socket
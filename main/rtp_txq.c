@@ -0,0 +1,255 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * RTP send queue.
+ *
+ * A ring of frame descriptors under a spinlock.  Dropping a reference can
+ * run a release callback, so frames leaving the queue are collected under
+ * the lock and unreferenced after it.
+ */
+
+#include "rtp_txq.h"
+#include "nal_scanner.h"
+#include "esp_check.h"
+#include <string.h>
+
+static const char *TAG = "rtp_txq";
+
+#define NAL_TYPE_SLICE      1
+#define NAL_TYPE_IDR        5
+
+/* Scan the frame's NAL headers: IDR, and whether any slice is a reference */
+static void classify(const uint8_t *frame, size_t len, bool *idr, bool *ref)
+{
+    *idr = false;
+    *ref = false;
+    for (size_t sc = nal_find_start_code(frame, 0, len); sc + 3 < len;
+         sc = nal_find_start_code(frame, sc + 3, len)) {
+        uint8_t hdr = frame[sc + 3];
+        uint8_t type = hdr & 0x1F;
+        if (type == NAL_TYPE_IDR) {
+            *idr = true;
+            *ref = true;
+            return;
+        }
+        if (type == NAL_TYPE_SLICE) {
+            /* Slices come last; one header says it all */
+            *ref = (hdr & 0x60) != 0;
+            return;
+        }
+    }
+}
+
+static void unref_all(frame_buf_t **fbs, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        frame_buf_unref(fbs[i]);
+    }
+}
+
+esp_err_t rtp_txq_init(rtp_txq_t *q, uint32_t max_bytes, uint32_t max_frames)
+{
+    ESP_RETURN_ON_FALSE(max_frames > 0 && max_frames <= RTP_TXQ_MAX_FRAMES,
+                        ESP_ERR_INVALID_ARG, TAG, "Queue depth %lu out of range",
+                        (unsigned long)max_frames);
+    memset(q, 0, sizeof(*q));
+    portMUX_INITIALIZE(&q->lock);
+
+    q->ready = xSemaphoreCreateBinary();
+    q->popped = xSemaphoreCreateBinary();
+    if (!q->ready || !q->popped) {
+        rtp_txq_deinit(q);
+        ESP_LOGE(TAG, "Send queue semaphore create failed");
+        return ESP_ERR_NO_MEM;
+    }
+    q->max_bytes = max_bytes;
+    q->max_frames = max_frames;
+    q->limit = max_frames;
+    return ESP_OK;
+}
+
+void rtp_txq_deinit(rtp_txq_t *q)
+{
+    frame_buf_t *drop[RTP_TXQ_MAX_FRAMES];
+    uint32_t n = 0;
+
+    portENTER_CRITICAL(&q->lock);
+    for (uint32_t i = 0; i < q->count; i++) {
+        drop[n++] = q->frames[(q->first + i) % q->max_frames].fb;
+    }
+    q->count = 0;
+    portEXIT_CRITICAL(&q->lock);
+    unref_all(drop, n);
+
+    if (q->ready) {
+        vSemaphoreDelete(q->ready);
+    }
+    if (q->popped) {
+        vSemaphoreDelete(q->popped);
+    }
+    memset(q, 0, sizeof(*q));
+}
+
+/*
+ * Take the frames not handed to the consumer out of the queue, into drop.
+ * Caller holds the lock.
+ */
+static uint32_t take_waiting(rtp_txq_t *q, frame_buf_t **drop)
+{
+    uint32_t keep = q->in_flight ? 1 : 0;
+    uint32_t n = 0;
+
+    for (uint32_t i = keep; i < q->count; i++) {
+        rtp_txq_frame_t *f = &q->frames[(q->first + i) % q->max_frames];
+        q->bytes -= f->fb->len;
+        drop[n++] = f->fb;
+    }
+    q->count = keep;
+    return n;
+}
+
+static bool has_room(const rtp_txq_t *q, size_t len)
+{
+    return q->count < q->limit && q->bytes + len <= q->max_bytes;
+}
+
+bool rtp_txq_push(rtp_txq_t *q, frame_buf_t *fb)
+{
+    bool idr, ref;
+    classify(fb->data, fb->len, &idr, &ref);
+
+    frame_buf_t *drop[RTP_TXQ_MAX_FRAMES];
+    uint32_t n = 0;
+
+    portENTER_CRITICAL(&q->lock);
+    if (q->wait_idr && !idr) {
+        q->stats.dropped_gop++;
+        portEXIT_CRITICAL(&q->lock);
+        return false;
+    }
+
+    bool room = has_room(q, fb->len);
+    if (!room && idr) {
+        n = take_waiting(q, drop);
+        q->stats.evicted += n;
+        room = has_room(q, fb->len);
+    }
+    if (!room) {
+        if (idr) {
+            q->stats.dropped_idr++;
+            q->wait_idr = true;
+        } else if (ref) {
+            q->stats.dropped_ref++;
+            q->wait_idr = true;
+        } else {
+            q->stats.dropped_nonref++;
+        }
+        portEXIT_CRITICAL(&q->lock);
+        unref_all(drop, n);
+        return false;
+    }
+    if (idr) {
+        q->wait_idr = false;
+    }
+
+    frame_buf_ref(fb);
+    q->frames[(q->first + q->count) % q->max_frames] = (rtp_txq_frame_t) {
+        .fb = fb,
+        .idr = idr,
+    };
+    q->count++;
+    q->bytes += fb->len;
+    q->stats.queued++;
+    if (q->count > q->stats.depth_max) {
+        q->stats.depth_max = q->count;
+    }
+    portEXIT_CRITICAL(&q->lock);
+
+    unref_all(drop, n);
+    xSemaphoreGive(q->ready);
+    return true;
+}
+
+const rtp_txq_frame_t *rtp_txq_peek(rtp_txq_t *q, TickType_t timeout)
+{
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const rtp_txq_frame_t *f = NULL;
+        portENTER_CRITICAL(&q->lock);
+        if (q->count > 0) {
+            q->in_flight = true;
+            f = &q->frames[q->first];
+        }
+        portEXIT_CRITICAL(&q->lock);
+        if (f || attempt > 0) {
+            return f;
+        }
+        xSemaphoreTake(q->ready, timeout);
+    }
+    return NULL;
+}
+
+void rtp_txq_pop(rtp_txq_t *q)
+{
+    frame_buf_t *fb = NULL;
+
+    portENTER_CRITICAL(&q->lock);
+    if (q->in_flight && q->count > 0) {
+        fb = q->frames[q->first].fb;
+        q->bytes -= fb->len;
+        q->first = (q->first + 1) % q->max_frames;
+        q->count--;
+    }
+    q->in_flight = false;
+    bool wake = q->flush_wait;
+    q->flush_wait = false;
+    portEXIT_CRITICAL(&q->lock);
+
+    if (fb) {
+        frame_buf_unref(fb);
+    }
+    /* After the unref: the flushing producer may unmap the buffer now */
+    if (wake) {
+        xSemaphoreGive(q->popped);
+    }
+}
+
+void rtp_txq_set_limit(rtp_txq_t *q, uint32_t frames)
+{
+    if (frames < 1) {
+        frames = 1;
+    }
+    portENTER_CRITICAL(&q->lock);
+    q->limit = frames < q->max_frames ? frames : q->max_frames;
+    portEXIT_CRITICAL(&q->lock);
+}
+
+void rtp_txq_flush(rtp_txq_t *q)
+{
+    frame_buf_t *drop[RTP_TXQ_MAX_FRAMES];
+
+    portENTER_CRITICAL(&q->lock);
+    uint32_t n = take_waiting(q, drop);
+    bool wait = q->in_flight;
+    q->flush_wait = wait;
+    portEXIT_CRITICAL(&q->lock);
+    unref_all(drop, n);
+
+    if (wait) {
+        xSemaphoreTake(q->popped, portMAX_DELAY);
+    }
+}
+
+void rtp_txq_get_stats(rtp_txq_t *q, rtp_txq_stats_t *stats, bool reset)
+{
+    portENTER_CRITICAL(&q->lock);
+    *stats = q->stats;
+    stats->depth = q->count;
+    stats->bytes = q->bytes;
+    if (reset) {
+        memset(&q->stats, 0, sizeof(q->stats));
+        q->stats.depth_max = q->count;
+    }
+    portEXIT_CRITICAL(&q->lock);
+}
@@ -0,0 +1,138 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Bounded RTP send queue of whole H.264 frames, between the task that
+ * produces frames (self-capture loop or frame bus) and the task that
+ * packetizes and sends them.  Frames are queued by reference: each one
+ * holds a frame_buf_t reference, and so its encoder CAPTURE buffer, until
+ * it is sent or dropped.  No frame data is copied.
+ *
+ * When the queue is full, frames are dropped whole, by type:
+ *   non-reference   dropped alone, nothing depends on it
+ *   reference (P)   dropped, and every frame after it until the next IDR
+ *   IDR             evicts the queued frames not yet being sent, since it
+ *                   supersedes them; dropped only if it still does not fit
+ * so the sender never puts half a frame, or a frame whose reference was
+ * dropped, on the wire.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "frame_bus.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Frames held at most (RTSP_TX_QUEUE_FRAMES is limited to this) */
+#define RTP_TXQ_MAX_FRAMES      16
+
+typedef struct {
+    frame_buf_t *fb;            /* One reference, dropped on pop or eviction */
+    bool idr;
+} rtp_txq_frame_t;
+
+typedef struct {
+    uint32_t depth;             /* Frames queued now, including one being sent */
+    uint32_t depth_max;         /* High-water mark since the last reset */
+    uint32_t bytes;             /* Bytes queued now */
+    uint32_t queued;            /* Frames accepted */
+    uint32_t dropped_nonref;    /* Non-reference frames dropped on a full queue */
+    uint32_t dropped_ref;       /* Reference frames dropped on a full queue */
+    uint32_t dropped_gop;       /* Frames dropped waiting for the next IDR */
+    uint32_t evicted;           /* Queued frames superseded by an IDR */
+    uint32_t dropped_idr;       /* IDR frames that did not fit at all */
+} rtp_txq_stats_t;
+
+typedef struct {
+    rtp_txq_frame_t frames[RTP_TXQ_MAX_FRAMES];     /* Ring */
+    uint32_t max_frames;
+    uint32_t limit;             /* Frames accepted now, up to max_frames */
+    uint32_t max_bytes;
+    uint32_t first;             /* Index of the oldest frame */
+    uint32_t count;
+    uint32_t bytes;             /* Frame bytes queued */
+    bool in_flight;             /* Oldest frame handed to the consumer */
+    bool wait_idr;              /* A reference frame was dropped */
+    bool flush_wait;            /* rtp_txq_flush() waits for the in-flight pop */
+
+    portMUX_TYPE lock;
+    SemaphoreHandle_t ready;    /* Given on every push */
+    SemaphoreHandle_t popped;   /* Given by the pop rtp_txq_flush() waits for */
+    rtp_txq_stats_t stats;
+} rtp_txq_t;
+
+/**
+ * @brief Initialize the queue
+ *
+ * @param max_bytes   Frame bytes queued at most (bounds the network backlog)
+ * @param max_frames  Frames queued at most, up to RTP_TXQ_MAX_FRAMES
+ */
+esp_err_t rtp_txq_init(rtp_txq_t *q, uint32_t max_bytes, uint32_t max_frames);
+
+/**
+ * @brief Drop every queued frame and free the queue
+ */
+void rtp_txq_deinit(rtp_txq_t *q);
+
+/**
+ * @brief Queue an Annex-B frame, or drop it (producer)
+ *
+ * The queue takes its own reference; the caller's is not consumed.
+ *
+ * @return true if queued, false if dropped by the policy above
+ */
+bool rtp_txq_push(rtp_txq_t *q, frame_buf_t *fb);
+
+/**
+ * @brief Oldest frame, waiting up to timeout for one (consumer)
+ *
+ * The frame stays queued, and is never evicted, until rtp_txq_pop().
+ */
+const rtp_txq_frame_t *rtp_txq_peek(rtp_txq_t *q, TickType_t timeout);
+
+/**
+ * @brief Release the frame returned by rtp_txq_peek() (consumer)
+ */
+void rtp_txq_pop(rtp_txq_t *q);
+
+/**
+ * @brief Drop every queued frame (producer)
+ *
+ * For a producer about to stop its encoder: frames not handed to the
+ * consumer are dropped now, and the call blocks, without a timeout, until
+ * the consumer pops the frame it is sending.  Abort that frame first
+ * (rtp_session_abort_frame()) to keep the wait short, and push nothing
+ * meanwhile.
+ */
+void rtp_txq_flush(rtp_txq_t *q);
+
+/**
+ * @brief Queue fewer frames than max_frames, or max_frames again (producer)
+ *
+ * For a producer whose frames pin buffers it has fewer of than the queue
+ * would hold.  Frames already queued stay; pushes find the queue full
+ * until it is below the new depth.
+ *
+ * @param frames  Clamped to 1..max_frames
+ */
+void rtp_txq_set_limit(rtp_txq_t *q, uint32_t frames);
+
+/**
+ * @brief Read the queue depth and drop counters
+ *
+ * @param reset  Clear the counters and high-water mark after reading
+ */
+void rtp_txq_get_stats(rtp_txq_t *q, rtp_txq_stats_t *stats, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,230 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "rtsp_parser.h"
+
+#include <string.h>
+#include <ctype.h>
+
+/* Larger bodies are rejected: nothing the server accepts carries one */
+#define RTSP_MAX_CONTENT_LENGTH     65535
+
+static bool str_ieq(rtsp_str_t s, const char *lit)
+{
+    size_t n = strlen(lit);
+    if (s.len != n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)s.ptr[i]) != tolower((unsigned char)lit[i])) return false;
+    }
+    return true;
+}
+
+static rtsp_str_t str_trim(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    return (rtsp_str_t){ p, (size_t)(end - p) };
+}
+
+/* Decimal digits of s, or -1 if s is empty, not all digits or too large */
+static long str_to_num(rtsp_str_t s)
+{
+    if (s.len == 0 || s.len > 9) return -1;
+    long v = 0;
+    for (size_t i = 0; i < s.len; i++) {
+        if (s.ptr[i] < '0' || s.ptr[i] > '9') return -1;
+        v = v * 10 + (s.ptr[i] - '0');
+    }
+    return v;
+}
+
+/*
+ * Find the empty line ending the headers, looking at line ends from offset
+ * from on.  Returns the offset just past it, or 0, and in *eol the offset
+ * of the last line end looked at, or len if there was none (where a later
+ * search resumes).
+ */
+static size_t find_header_end(const char *buf, size_t from, size_t len, size_t *eol)
+{
+    const char *p = buf + from;
+    const char *end = buf + len;
+
+    *eol = len;
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        *eol = p - buf;
+        p++;
+        if (p < end && *p == '\n') {
+            return p + 1 - buf;
+        }
+        if (end - p >= 2 && p[0] == '\r' && p[1] == '\n') {
+            return p + 2 - buf;
+        }
+    }
+    return 0;
+}
+
+/* Line [line, next) without its terminator; *next is past the '\n' */
+static const char *line_end(const char *line, const char *end, const char **next)
+{
+    const char *nl = memchr(line, '\n', end - line);
+    if (!nl) nl = end;
+    *next = nl < end ? nl + 1 : end;
+    if (nl > line && nl[-1] == '\r') nl--;
+    return nl;
+}
+
+static bool parse_request_line(const char *line, const char *end, rtsp_request_t *req)
+{
+    const char *sp1 = memchr(line, ' ', end - line);
+    if (!sp1 || sp1 == line) return false;
+    const char *uri = sp1 + 1;
+    const char *sp2 = memchr(uri, ' ', end - uri);
+    if (!sp2 || sp2 == uri) return false;
+
+    req->method = (rtsp_str_t){ line, (size_t)(sp1 - line) };
+    req->uri = (rtsp_str_t){ uri, (size_t)(sp2 - uri) };
+    req->version = (rtsp_str_t){ sp2 + 1, (size_t)(end - sp2 - 1) };
+    return req->version.len >= 5 && memcmp(req->version.ptr, "RTSP/", 5) == 0;
+}
+
+/* Request line and headers in [buf + start, buf + hdr_end) */
+static bool parse_headers(const char *buf, size_t start, size_t hdr_end,
+                          rtsp_request_t *req, long *content_length)
+{
+    const char *end = buf + hdr_end;
+    const char *next;
+    const char *eol = line_end(buf + start, end, &next);
+
+    if (!parse_request_line(buf + start, eol, req)) return false;
+
+    req->header_count = 0;
+    req->cseq = 0;
+    *content_length = 0;
+
+    for (const char *line = next; line < end; line = next) {
+        eol = line_end(line, end, &next);
+        if (eol == line) break;                     /* Empty line */
+        if (*line == ' ' || *line == '\t') continue; /* Obsolete line folding */
+
+        const char *colon = memchr(line, ':', eol - line);
+        if (!colon) return false;
+        rtsp_header_t h = {
+            .name = str_trim(line, colon),
+            .value = str_trim(colon + 1, eol),
+        };
+
+        if (str_ieq(h.name, "CSeq")) {
+            long v = str_to_num(h.value);
+            req->cseq = v > 0 ? (int)v : 0;
+        } else if (str_ieq(h.name, "Content-Length")) {
+            *content_length = str_to_num(h.value);
+            if (*content_length < 0 || *content_length > RTSP_MAX_CONTENT_LENGTH) return false;
+        }
+        if (req->header_count < RTSP_MAX_HEADERS) {
+            req->headers[req->header_count++] = h;
+        }
+    }
+    return true;
+}
+
+rtsp_parse_result_t rtsp_parse(rtsp_parser_t *p, const char *buf, size_t len,
+                               rtsp_request_t *req, rtsp_frame_t *frame, size_t *consumed)
+{
+    /* Size already known from an earlier call: wait until it is all here */
+    if (p->needed > len) {
+        return RTSP_PARSE_NEED_MORE;
+    }
+
+    /* Stray line ends between messages are allowed (and used as keepalive) */
+    size_t start = 0;
+    while (start < len && (buf[start] == '\r' || buf[start] == '\n')) start++;
+    p->start = start;
+    if (start == len) {
+        return RTSP_PARSE_NEED_MORE;
+    }
+
+    if (buf[start] == '$') {
+        if (len - start < 4) {
+            return RTSP_PARSE_NEED_MORE;
+        }
+        size_t frame_len = ((uint8_t)buf[start + 2] << 8) | (uint8_t)buf[start + 3];
+        p->needed = start + 4 + frame_len;
+        if (len < p->needed) {
+            return RTSP_PARSE_NEED_MORE;
+        }
+        frame->channel = (uint8_t)buf[start + 1];
+        frame->data = (const uint8_t *)buf + start + 4;
+        frame->len = frame_len;
+        *consumed = p->needed;
+        rtsp_parser_reset(p);
+        return RTSP_PARSE_FRAME;
+    }
+
+    /* Only the bytes received since the last call need searching */
+    size_t eol = p->scanned > start ? p->scanned : start;
+    size_t hdr_end = find_header_end(buf, eol, len, &eol);
+    if (hdr_end == 0) {
+        p->scanned = eol;
+        return RTSP_PARSE_NEED_MORE;
+    }
+    p->scanned = eol;
+
+    long content_length;
+    if (!parse_headers(buf, start, hdr_end, req, &content_length)) {
+        return RTSP_PARSE_ERROR;
+    }
+
+    p->needed = hdr_end + (size_t)content_length;
+    if (len < p->needed) {
+        return RTSP_PARSE_NEED_MORE;
+    }
+    req->body = (rtsp_str_t){ buf + hdr_end, (size_t)content_length };
+    *consumed = p->needed;
+    rtsp_parser_reset(p);
+    return RTSP_PARSE_REQUEST;
+}
+
+rtsp_str_t rtsp_request_header(const rtsp_request_t *req, const char *name)
+{
+    for (size_t i = 0; i < req->header_count; i++) {
+        if (str_ieq(req->headers[i].name, name)) {
+            return req->headers[i].value;
+        }
+    }
+    return (rtsp_str_t){ NULL, 0 };
+}
+
+bool rtsp_str_eq(rtsp_str_t s, const char *lit)
+{
+    size_t n = strlen(lit);
+    return s.len == n && memcmp(s.ptr, lit, n) == 0;
+}
+
+const char *rtsp_str_find(rtsp_str_t s, const char *needle)
+{
+    size_t n = strlen(needle);
+    if (n == 0 || s.len < n) return NULL;
+
+    const char *p = s.ptr;
+    const char *last = s.ptr + s.len - n;
+    while (p <= last && (p = memchr(p, needle[0], last - p + 1)) != NULL) {
+        if (memcmp(p, needle, n) == 0) return p;
+        p++;
+    }
+    return NULL;
+}
+
+long rtsp_str_param(rtsp_str_t s, const char *key)
+{
+    const char *p = rtsp_str_find(s, key);
+    if (!p) return -1;
+    p += strlen(key);
+
+    const char *end = s.ptr + s.len;
+    const char *digits = p;
+    while (p < end && p < digits + 9 && *p >= '0' && *p <= '9') p++;
+    return str_to_num((rtsp_str_t){ digits, (size_t)(p - digits) });
+}
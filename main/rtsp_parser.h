@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Incremental RTSP 1.0 message parser for the control connection.
+ *
+ * The caller appends whatever recv() returned to a per-connection buffer
+ * and calls rtsp_parse() until it asks for more data.  Each call takes one
+ * message off the front of the buffer: either an interleaved "$" frame
+ * (RFC 2326 section 10.12) or a request line, its headers and a
+ * Content-Length body.  Requests may arrive split across reads or several
+ * to a read (pipelining).  Nothing is copied or allocated: every string in
+ * the result points into the caller's buffer and is valid until the
+ * caller moves or overwrites the consumed bytes.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Headers kept per request; further ones are skipped (CSeq and
+ * Content-Length are still recognized) */
+#define RTSP_MAX_HEADERS    16
+
+/* Byte range in the receive buffer (not NUL-terminated) */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} rtsp_str_t;
+
+typedef struct {
+    rtsp_str_t name;
+    rtsp_str_t value;           /* Leading and trailing whitespace removed */
+} rtsp_header_t;
+
+typedef struct {
+    rtsp_str_t method;
+    rtsp_str_t uri;
+    rtsp_str_t version;
+    rtsp_header_t headers[RTSP_MAX_HEADERS];
+    size_t header_count;
+    int cseq;                   /* 0 if the request has none */
+    rtsp_str_t body;            /* Content-Length bytes after the headers */
+} rtsp_request_t;
+
+/* Interleaved binary frame ("$", channel, 16-bit length, payload) */
+typedef struct {
+    uint8_t channel;
+    const uint8_t *data;
+    size_t len;
+} rtsp_frame_t;
+
+typedef enum {
+    RTSP_PARSE_NEED_MORE,       /* No complete message at the front yet */
+    RTSP_PARSE_REQUEST,         /* *req holds a request */
+    RTSP_PARSE_FRAME,           /* *frame holds an interleaved frame */
+    RTSP_PARSE_ERROR,           /* Malformed; the connection cannot resync */
+} rtsp_parse_result_t;
+
+/* State carried between calls for the message at the front of the buffer */
+typedef struct {
+    size_t scanned;             /* Bytes already searched for the end of the headers */
+    size_t needed;              /* Size of the pending message, once known (else 0) */
+    size_t start;               /* Offset of the pending message, past stray line ends */
+} rtsp_parser_t;
+
+/**
+ * @brief Reset the parser for a new connection
+ */
+static inline void rtsp_parser_reset(rtsp_parser_t *p)
+{
+    p->scanned = 0;
+    p->needed = 0;
+    p->start = 0;
+}
+
+/**
+ * @brief Take the next message off the front of buf
+ *
+ * On RTSP_PARSE_NEED_MORE nothing is consumed; call again with the same
+ * bytes at the front of buf plus newly received ones.  p->needed then
+ * tells the full message size when it is already known (the header of a
+ * "$" frame, or request headers with a Content-Length), so the caller can
+ * reject messages that will never fit its buffer.  It counts from the
+ * front of buf, and p->start tells where the message itself begins (its
+ * first byte, e.g. '$'), after any stray line ends.
+ *
+ * @param consumed  Bytes of buf taken by the message (REQUEST and FRAME)
+ */
+rtsp_parse_result_t rtsp_parse(rtsp_parser_t *p, const char *buf, size_t len,
+                               rtsp_request_t *req, rtsp_frame_t *frame, size_t *consumed);
+
+/**
+ * @brief Value of a request header (case-insensitive name)
+ *
+ * @return The value, or an empty string (ptr NULL) if absent
+ */
+rtsp_str_t rtsp_request_header(const rtsp_request_t *req, const char *name);
+
+/**
+ * @brief True if s is exactly the string lit
+ */
+bool rtsp_str_eq(rtsp_str_t s, const char *lit);
+
+/**
+ * @brief Find needle in s
+ *
+ * @return Pointer to the first match in s, or NULL
+ */
+const char *rtsp_str_find(rtsp_str_t s, const char *needle);
+
+/**
+ * @brief Decimal number following the first key in s ("client_port=")
+ *
+ * @return The number, or -1 if key is absent or not followed by a digit
+ */
+long rtsp_str_param(rtsp_str_t s, const char *key);
+
+#ifdef __cplusplus
+}
+#endif
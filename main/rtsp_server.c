@@ -5,27 +5,40 @@
  *
  * Minimal RTSP 1.0 server (RFC 2326) for H.264 streaming over RTP.
  *
- * Supports one client at a time with UDP unicast RTP transport.
+ * Serves up to CONFIG_RTSP_MAX_CLIENTS clients from one select() loop
+ * over all control connections.  RTP goes over UDP unicast or, for
+ * clients behind NAT/firewalls, interleaved on the RTSP connection
+ * (RTP/AVP/TCP, "$" framing).  With CONFIG_RTSP_MULTICAST, clients may
+ * instead join a fixed multicast group that is sent to once for all of
+ * them.  All clients share one RTP stream: each frame is packetized once
+ * and sent to every playing client.
  * Methods: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN.
  *
  * Self-capture mode: when no UVC stream is active, the RTSP server
  * drives the camera and H.264 encoder directly. When UVC starts,
- * RTSP yields the hardware and relies on feed_h264() from UVC.
+ * RTSP yields the hardware and takes UVC's H.264 frames from the
+ * frame bus (by reference, no copy).
  */
 
 #include "rtsp_server.h"
 #include "rtp_sender.h"
 #include "uvc_streaming.h"
 #include "uvc_frame_config.h"
+#include "frame_bus.h"
+#include "bitrate_ctrl.h"
+#include "rtp_txq.h"
+#include "rtsp_parser.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "lwip/sockets.h"
 #include "esp_netif.h"
 #include "linux/videodev2.h"
+#include "mbedtls/base64.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -40,9 +53,31 @@ static const char *TAG = "rtsp";
 #define RTSP_BUF_SIZE       2048
 #define RTSP_STACK_SIZE     8192
 #define RTSP_TASK_PRIO      10
+#define RTSP_MAX_CLIENTS    CONFIG_RTSP_MAX_CLIENTS
 
-/* Max H.264 frame size for RTSP copy buffer (256KB covers 1080p IDR frames) */
-#define RTSP_FRAME_BUF_SIZE (256 * 1024)
+/* A control connection silent for this long is dropped (RTSP session timeout) */
+#define RTSP_CLIENT_TIMEOUT_MS  60000
+
+/* Replies wait this long for an interleaved RTP packet in flight */
+#define RTSP_TX_LOCK_MS     1000
+
+/* Bitrate control interval, and how long an RTCP loss report stays current */
+#define RTSP_RATE_INTERVAL_US   (1000 * 1000)
+#define RTSP_RATE_RR_MAX_AGE_US (10 * 1000 * 1000)
+
+/* How far back the RTP history reaches at the configured bitrate (SDP rtx-time) */
+#define RTSP_RTX_TIME_MS        ((int)((int64_t)CONFIG_RTSP_RTX_HISTORY_KB * 1024 * 8 * 1000 / \
+                                       CONFIG_RTSP_H264_BITRATE))
+
+/* Control URL of the FEC m-line in the SDP (the video is track1) */
+#define RTSP_FEC_TRACK          "track2"
+
+/* Send queue statistics log period (when frames were dropped) */
+#define RTSP_TXQ_REPORT_US      (10 * 1000 * 1000)
+
+/* Frames the RTP sender may have queued on the frame bus.  Each one pins
+ * an encoder CAPTURE buffer, so keep this at 1. */
+#define RTSP_BUS_DEPTH      1
 
 /* RTSP session state */
 typedef enum {
@@ -51,17 +86,42 @@ typedef enum {
     RTSP_STATE_PLAYING,
 } rtsp_state_t;
 
-static struct {
-    rtp_session_t rtp;
+typedef struct {
+    int           fd;             /* Control connection, -1 if the slot is free */
+    struct sockaddr_in addr;
     rtsp_state_t  state;
     uint32_t      session_id;
-    int           client_fd;
+    int           rtp_dest;       /* Destination in s_rtsp.rtp, -1 before SETUP */
+    TickType_t    last_rx;        /* For the idle timeout */
+    SemaphoreHandle_t tx_lock;    /* Replies vs. interleaved RTP on fd */
+    bool          interleaved;    /* RTP/AVP/TCP transport */
+    uint8_t       channel;        /* Interleaved RTP channel; RTCP is channel + 1 */
+    bool          multicast;      /* Joined the multicast group (no rtp_dest) */
+    rtsp_parser_t parser;         /* Progress on the message at the front of rx_buf */
+    size_t        rx_len;         /* Received bytes not yet consumed */
+    uint32_t      discard;        /* Bytes left of a "$" frame too large for rx_buf */
+    char          rx_buf[RTSP_BUF_SIZE];
+} rtsp_client_t;
 
-    /* H.264 frame double-buffer for decoupling UVC and RTP paths */
-    uint8_t      *frame_buf;
-    size_t        frame_len;
-    SemaphoreHandle_t frame_ready;
-    SemaphoreHandle_t frame_mutex;
+static struct {
+    rtp_session_t rtp;            /* Shared by all clients (fan-out) */
+    rtp_txq_t txq;                /* Frames waiting for the RTP tx task */
+    rtsp_client_t clients[RTSP_MAX_CLIENTS];
+
+    /* UVC H.264 frames (feed mode) */
+    frame_bus_sub_t *bus_sub;
+    SemaphoreHandle_t feed_lock;  /* Sender's push vs. a flush of the send queue */
+    volatile uint32_t feed_epoch; /* Bumped by every flush, under feed_lock */
+
+#if CONFIG_RTSP_RATE_CONTROL
+    bitrate_ctrl_t rate;          /* Adaptive RTSP bitrate (sender task) */
+    int64_t rate_last_us;
+    uint32_t rate_queue_drops;    /* Send queue drop total at the last interval */
+#endif
+
+    /* Encoder whose parameter sets the RTP session holds (tx task) */
+    encoder_ctx_t *volatile param_enc;
+    uint32_t param_gen;
 } s_rtsp;
 
 /* Self-capture: borrow UVC's camera + H.264 encoder when UVC is idle */
@@ -69,27 +129,6 @@ static uvc_stream_ctx_t *s_uvc_ctx;
 static volatile bool      s_uvc_streaming;       /* true when UVC owns camera */
 static volatile bool      s_self_capture_active;  /* true while self-capture loop runs */
 
-/* ---- H.264 frame feeding (from UVC pipeline) ---------------------------- */
-
-void rtsp_server_feed_h264(const uint8_t *data, size_t len)
-{
-    if (s_rtsp.state != RTSP_STATE_PLAYING || !s_rtsp.frame_buf) {
-        return;
-    }
-
-    /* Copy frame under mutex -- drop if mutex busy (non-blocking) */
-    if (xSemaphoreTake(s_rtsp.frame_mutex, 0) == pdTRUE) {
-        size_t copy_len = (len > RTSP_FRAME_BUF_SIZE) ? RTSP_FRAME_BUF_SIZE : len;
-        memcpy(s_rtsp.frame_buf, data, copy_len);
-        s_rtsp.frame_len = copy_len;
-        xSemaphoreGive(s_rtsp.frame_mutex);
-
-        /* Signal RTP sender that a new frame is available */
-        xSemaphoreGive(s_rtsp.frame_ready);
-    }
-    /* else: RTP sender is busy with previous frame, drop this one */
-}
-
 /* ---- UVC coordination --------------------------------------------------- */
 
 void rtsp_server_notify_uvc_start(void)
@@ -107,22 +146,12 @@ void rtsp_server_notify_uvc_start(void)
 void rtsp_server_notify_uvc_stop(void)
 {
     s_uvc_streaming = false;
-    /* Wake RTP sender so it can start self-capture if PLAYING */
-    if (s_rtsp.state == RTSP_STATE_PLAYING) {
-        xSemaphoreGive(s_rtsp.frame_ready);
-    }
+    /* RTP sender notices within one bus receive timeout and resumes
+     * self-capture if PLAYING */
 }
 
 /* ---- RTSP protocol helpers ---------------------------------------------- */
 
-static int rtsp_get_cseq(const char *request)
-{
-    const char *p = strstr(request, "CSeq:");
-    if (!p) p = strstr(request, "cseq:");
-    if (!p) return 0;
-    return atoi(p + 5);
-}
-
 /*
  * Get the local IP address of the Ethernet interface.
  * Returns "0.0.0.0" if not available.
@@ -142,12 +171,22 @@ static void get_local_ip(char *buf, size_t buflen)
     }
 }
 
-static int send_response(int fd, const char *resp)
+/*
+ * Replies share the connection with interleaved RTP, so they are written
+ * whole under the client's tx lock and never split an RTP packet.
+ */
+static int send_response(rtsp_client_t *c, const char *resp)
 {
-    return send(fd, resp, strlen(resp), 0);
+    if (xSemaphoreTake(c->tx_lock, pdMS_TO_TICKS(RTSP_TX_LOCK_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "Reply dropped: connection busy");
+        return -1;
+    }
+    int ret = send(c->fd, resp, strlen(resp), 0);
+    xSemaphoreGive(c->tx_lock);
+    return ret;
 }
 
-static void handle_options(int fd, int cseq)
+static void handle_options(rtsp_client_t *c, int cseq)
 {
     char resp[256];
     snprintf(resp, sizeof(resp),
@@ -156,28 +195,102 @@ static void handle_options(int fd, int cseq)
              "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN\r\n"
              "\r\n",
              cseq);
-    send_response(fd, resp);
+    send_response(c, resp);
+}
+
+/*
+ * "profile-level-id=...;sprop-parameter-sets=...;" for the SDP, from the
+ * encoder that last fed RTP (or the shared one before any stream ran).
+ * Empty if no SPS/PPS has been encoded yet; clients then wait for in-band
+ * sets.
+ */
+static void format_param_sets(char *buf, size_t buflen)
+{
+    buf[0] = '\0';
+    encoder_ctx_t *enc = s_rtsp.param_enc;
+    if (!enc && s_uvc_ctx) {
+        enc = &s_uvc_ctx->h264_enc;
+    }
+    if (!enc) {
+        return;
+    }
+
+    uint8_t sps[ENCODER_H264_PARAM_MAX], pps[ENCODER_H264_PARAM_MAX];
+    size_t sps_len, pps_len;
+    if (!encoder_get_h264_param_sets(enc, sps, &sps_len, pps, &pps_len, NULL) ||
+        sps_len < 4) {
+        return;
+    }
+
+    unsigned char sps_b64[ENCODER_H264_PARAM_MAX * 4 / 3 + 4];
+    unsigned char pps_b64[ENCODER_H264_PARAM_MAX * 4 / 3 + 4];
+    size_t sps_b64_len, pps_b64_len;
+    if (mbedtls_base64_encode(sps_b64, sizeof(sps_b64), &sps_b64_len, sps, sps_len) != 0 ||
+        mbedtls_base64_encode(pps_b64, sizeof(pps_b64), &pps_b64_len, pps, pps_len) != 0) {
+        return;
+    }
+    snprintf(buf, buflen, "profile-level-id=%02x%02x%02x;sprop-parameter-sets=%.*s,%.*s;",
+             sps[1], sps[2], sps[3], (int)sps_b64_len, sps_b64, (int)pps_b64_len, pps_b64);
 }
 
-static void handle_describe(int fd, int cseq)
+static void handle_describe(rtsp_client_t *c, int cseq)
 {
     char local_ip[32];
     get_local_ip(local_ip, sizeof(local_ip));
 
-    char sdp[512];
+    char fmtp[256];
+    format_param_sets(fmtp, sizeof(fmtp));
+
+    /* RFC 4588 retransmission (with NACK feedback) on its own payload type */
+    char rtx_pt[8] = "";
+    char rtx[128] = "";
+#if CONFIG_RTSP_RTX
+    snprintf(rtx_pt, sizeof(rtx_pt), " %d", RTP_RTX_PT);
+    snprintf(rtx, sizeof(rtx),
+             "a=rtcp-fb:96 nack\r\n"
+             "a=rtpmap:%d rtx/90000\r\n"
+             "a=fmtp:%d apt=96;rtx-time=%d\r\n",
+             RTP_RTX_PT, RTP_RTX_PT, RTSP_RTX_TIME_MS);
+#endif
+
+    /*
+     * RFC 5109 ULPFEC as a separate RTP session (section 14.1): its own
+     * m-line, tied to the video by the FEC grouping (RFC 5888, 5956).
+     * Receivers without FEC support play the video m-line alone.
+     */
+    const char *fec_group = "";
+    const char *fec_mid = "";
+    char fec[160] = "";
+#if CONFIG_RTSP_FEC
+    fec_group = "a=group:FEC 1 2\r\n";
+    fec_mid = "a=mid:1\r\n";
+    snprintf(fec, sizeof(fec),
+             "m=video 0 RTP/AVP %d\r\n"
+             "c=IN IP4 0.0.0.0\r\n"
+             "a=rtpmap:%d ulpfec/90000\r\n"
+             "a=control:" RTSP_FEC_TRACK "\r\n"
+             "a=mid:2\r\n",
+             RTP_FEC_PT, RTP_FEC_PT);
+#endif
+
+    char sdp[1024];
     int sdp_len = snprintf(sdp, sizeof(sdp),
         "v=0\r\n"
         "o=- 0 0 IN IP4 %s\r\n"
         "s=ESP32-P4 Camera\r\n"
         "t=0 0\r\n"
-        "m=video 0 RTP/AVP 96\r\n"
+        "%s"
+        "m=video 0 RTP/AVP 96%s\r\n"
         "c=IN IP4 0.0.0.0\r\n"
         "a=rtpmap:96 H264/90000\r\n"
-        "a=fmtp:96 packetization-mode=1\r\n"
-        "a=control:track1\r\n",
-        local_ip);
-
-    char resp[1024];
+        "a=fmtp:96 %spacketization-mode=1\r\n"
+        "%s"
+        "a=control:track1\r\n"
+        "%s"
+        "%s",
+        local_ip, fec_group, rtx_pt, fmtp, rtx, fec_mid, fec);
+
+    char resp[1536];
     snprintf(resp, sizeof(resp),
              "RTSP/1.0 200 OK\r\n"
              "CSeq: %d\r\n"
@@ -186,44 +299,231 @@ static void handle_describe(int fd, int cseq)
              "\r\n"
              "%s",
              cseq, sdp_len, sdp);
-    send_response(fd, resp);
+    send_response(c, resp);
 }
 
 /*
- * Parse "Transport:" header to extract client_port.
+ * Parse the Transport header value to extract client_port.
  * Example: Transport: RTP/AVP;unicast;client_port=5000-5001
  */
-static uint16_t parse_client_port(const char *request)
+static uint16_t parse_client_port(rtsp_str_t transport)
 {
-    const char *p = strstr(request, "client_port=");
-    if (!p) return 0;
-    return (uint16_t)atoi(p + 12);
+    long port = rtsp_str_param(transport, "client_port=");
+    return (port > 0 && port < 65535) ? (uint16_t)port : 0;
 }
 
-static void handle_setup(int fd, int cseq, const char *request,
-                          struct sockaddr_in *client_addr)
+/*
+ * Parse an interleaved transport request.
+ * Example: Transport: RTP/AVP/TCP;unicast;interleaved=0-1
+ * Returns the RTP channel, or -1 if the client did not ask for TCP.
+ */
+static int parse_interleaved(rtsp_str_t transport)
 {
-    uint16_t client_port = parse_client_port(request);
-    if (client_port == 0) {
+    if (!rtsp_str_find(transport, "RTP/AVP/TCP")) return -1;
+    if (!rtsp_str_find(transport, "interleaved=")) return 0;
+    long ch = rtsp_str_param(transport, "interleaved=");
+    return (ch >= 0 && ch <= 254) ? (int)ch : -1;
+}
+
+/* Drop whatever RTP transport an earlier SETUP gave this client */
+static void release_transport(rtsp_client_t *c)
+{
+    rtp_session_remove_dest(&s_rtsp.rtp, c->rtp_dest);
+    c->rtp_dest = -1;
+    if (c->multicast && c->state == RTSP_STATE_PLAYING) {
+        rtp_session_play_multicast(&s_rtsp.rtp, false);
+    }
+    c->multicast = false;
+}
+
+static void handle_setup_multicast(rtsp_client_t *c, int cseq)
+{
+    char resp[512];
+#if CONFIG_RTSP_MULTICAST
+    release_transport(c);
+    c->multicast = true;
+    c->interleaved = false;
+    c->session_id = esp_random();
+    c->state = RTSP_STATE_READY;
+
+    snprintf(resp, sizeof(resp),
+             "RTSP/1.0 200 OK\r\n"
+             "CSeq: %d\r\n"
+             "Transport: RTP/AVP;multicast;destination=%s;port=%d-%d;ttl=%d\r\n"
+             "Session: %08lx\r\n"
+             "\r\n",
+             cseq, CONFIG_RTSP_MULTICAST_GROUP,
+             CONFIG_RTSP_MULTICAST_PORT, CONFIG_RTSP_MULTICAST_PORT + 1,
+             CONFIG_RTSP_MULTICAST_TTL, (unsigned long)c->session_id);
+    send_response(c, resp);
+
+    ESP_LOGI(TAG, "SETUP: multicast %s:%d, session=%08lx",
+             CONFIG_RTSP_MULTICAST_GROUP, CONFIG_RTSP_MULTICAST_PORT,
+             (unsigned long)c->session_id);
+#else
+    snprintf(resp, sizeof(resp),
+             "RTSP/1.0 461 Unsupported Transport\r\n"
+             "CSeq: %d\r\n\r\n", cseq);
+    send_response(c, resp);
+#endif
+}
+
+static void handle_setup_tcp(rtsp_client_t *c, int cseq, int channel)
+{
+    release_transport(c);
+    c->rtp_dest = rtp_session_add_tcp_dest(&s_rtsp.rtp, c->fd, (uint8_t)channel, c->tx_lock);
+    if (c->rtp_dest < 0) {
         char resp[256];
         snprintf(resp, sizeof(resp),
-                 "RTSP/1.0 461 Unsupported Transport\r\n"
+                 "RTSP/1.0 453 Not Enough Bandwidth\r\n"
                  "CSeq: %d\r\n\r\n", cseq);
-        send_response(fd, resp);
+        send_response(c, resp);
+        c->state = RTSP_STATE_INIT;
         return;
     }
 
-    /* Configure RTP destination */
-    rtp_session_set_dest(&s_rtsp.rtp, client_addr->sin_addr.s_addr, client_port);
+    /* RTP packets must not wait for ACKs of the previous segment */
+    int opt = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
 
-    s_rtsp.session_id = esp_random();
-    s_rtsp.state = RTSP_STATE_READY;
+    c->interleaved = true;
+    c->channel = (uint8_t)channel;
+    c->session_id = esp_random();
+    c->state = RTSP_STATE_READY;
 
-    /* Get the local RTP port (ephemeral, assigned by OS) */
+    char resp[512];
+    snprintf(resp, sizeof(resp),
+             "RTSP/1.0 200 OK\r\n"
+             "CSeq: %d\r\n"
+             "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
+             "Session: %08lx\r\n"
+             "\r\n",
+             cseq, channel, channel + 1,
+             (unsigned long)c->session_id);
+    send_response(c, resp);
+
+    ESP_LOGI(TAG, "SETUP: interleaved=%d-%d, session=%08lx",
+             channel, channel + 1, (unsigned long)c->session_id);
+}
+
+/* Even local port of the RTP socket pair (RTCP on +1) */
+static uint16_t local_rtp_port(void)
+{
     struct sockaddr_in local;
     socklen_t local_len = sizeof(local);
     getsockname(s_rtsp.rtp.sock_fd, (struct sockaddr *)&local, &local_len);
-    uint16_t server_port = ntohs(local.sin_port);
+    return ntohs(local.sin_port);
+}
+
+#if CONFIG_RTSP_FEC
+/*
+ * SETUP of the FEC m-line, after the video's, in the same RTSP session.
+ * UDP clients get the parity packets on the ports they name, multicast
+ * viewers on the group's next port pair.  Interleaved clients are answered
+ * with the channels they ask for but get no FEC: over TCP nothing is lost.
+ */
+static void handle_setup_fec(rtsp_client_t *c, int cseq, rtsp_str_t transport)
+{
+    char resp[512];
+    char reply[128] = "";
+
+    if (c->state == RTSP_STATE_INIT) {
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 455 Method Not Valid in This State\r\n"
+                 "CSeq: %d\r\n\r\n", cseq);
+        send_response(c, resp);
+        return;
+    }
+
+    if (c->multicast) {
+#if CONFIG_RTSP_MULTICAST
+        int port = CONFIG_RTSP_MULTICAST_PORT + RTP_FEC_MCAST_PORT_OFFSET;
+        snprintf(reply, sizeof(reply), "RTP/AVP;multicast;destination=%s;port=%d-%d;ttl=%d",
+                 CONFIG_RTSP_MULTICAST_GROUP, port, port + 1, CONFIG_RTSP_MULTICAST_TTL);
+#endif
+    } else if (c->interleaved) {
+        int channel = parse_interleaved(transport);
+        if (channel < 0 || channel == c->channel) {
+            channel = (uint8_t)(c->channel + 2);
+        }
+        snprintf(reply, sizeof(reply), "RTP/AVP/TCP;unicast;interleaved=%d-%d",
+                 channel, channel + 1);
+    } else {
+        uint16_t client_port = parse_client_port(transport);
+        if (client_port == 0 ||
+            rtp_session_set_fec_port(&s_rtsp.rtp, c->rtp_dest, client_port) != ESP_OK) {
+            snprintf(resp, sizeof(resp),
+                     "RTSP/1.0 461 Unsupported Transport\r\n"
+                     "CSeq: %d\r\n\r\n", cseq);
+            send_response(c, resp);
+            return;
+        }
+        uint16_t server_port = local_rtp_port();
+        snprintf(reply, sizeof(reply), "RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d",
+                 client_port, client_port + 1, server_port, server_port + 1);
+    }
+
+    snprintf(resp, sizeof(resp),
+             "RTSP/1.0 200 OK\r\n"
+             "CSeq: %d\r\n"
+             "Transport: %s\r\n"
+             "Session: %08lx\r\n"
+             "\r\n",
+             cseq, reply, (unsigned long)c->session_id);
+    send_response(c, resp);
+    ESP_LOGI(TAG, "SETUP: FEC %s, session=%08lx", reply, (unsigned long)c->session_id);
+}
+#endif
+
+static void handle_setup(rtsp_client_t *c, int cseq, rtsp_str_t uri, rtsp_str_t transport)
+{
+#if CONFIG_RTSP_FEC
+    if (rtsp_str_find(uri, RTSP_FEC_TRACK)) {
+        handle_setup_fec(c, cseq, transport);
+        return;
+    }
+#endif
+
+    if (rtsp_str_find(transport, "multicast")) {
+        handle_setup_multicast(c, cseq);
+        return;
+    }
+
+    int channel = parse_interleaved(transport);
+    if (channel >= 0) {
+        handle_setup_tcp(c, cseq, channel);
+        return;
+    }
+
+    uint16_t client_port = parse_client_port(transport);
+    if (client_port == 0) {
+        char resp[256];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 461 Unsupported Transport\r\n"
+                 "CSeq: %d\r\n\r\n", cseq);
+        send_response(c, resp);
+        return;
+    }
+
+    /* Configure this client's RTP destination (re-SETUP replaces it) */
+    release_transport(c);
+    c->rtp_dest = rtp_session_add_dest(&s_rtsp.rtp, c->addr.sin_addr.s_addr, client_port);
+    if (c->rtp_dest < 0) {
+        char resp[256];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 453 Not Enough Bandwidth\r\n"
+                 "CSeq: %d\r\n\r\n", cseq);
+        send_response(c, resp);
+        c->state = RTSP_STATE_INIT;
+        return;
+    }
+
+    c->interleaved = false;
+    c->session_id = esp_random();
+    c->state = RTSP_STATE_READY;
+
+    /* Local RTP port: first free even port from 6970, RTCP on +1 */
+    uint16_t server_port = local_rtp_port();
 
     char resp[512];
     snprintf(resp, sizeof(resp),
@@ -234,26 +534,30 @@ static void handle_setup(int fd, int cseq, const char *request,
              "\r\n",
              cseq, client_port, client_port + 1,
              server_port, server_port + 1,
-             (unsigned long)s_rtsp.session_id);
-    send_response(fd, resp);
+             (unsigned long)c->session_id);
+    send_response(c, resp);
 
     ESP_LOGI(TAG, "SETUP: client_port=%d, session=%08lx",
-             client_port, (unsigned long)s_rtsp.session_id);
+             client_port, (unsigned long)c->session_id);
 }
 
-static void handle_play(int fd, int cseq)
+static void handle_play(rtsp_client_t *c, int cseq)
 {
-    if (s_rtsp.state != RTSP_STATE_READY && s_rtsp.state != RTSP_STATE_PLAYING) {
+    if (c->state != RTSP_STATE_READY && c->state != RTSP_STATE_PLAYING) {
         char resp[256];
         snprintf(resp, sizeof(resp),
                  "RTSP/1.0 455 Method Not Valid in This State\r\n"
                  "CSeq: %d\r\n\r\n", cseq);
-        send_response(fd, resp);
+        send_response(c, resp);
         return;
     }
 
-    rtp_session_start(&s_rtsp.rtp);
-    s_rtsp.state = RTSP_STATE_PLAYING;
+    if (!c->multicast) {
+        rtp_session_play_dest(&s_rtsp.rtp, c->rtp_dest, true);
+    } else if (c->state != RTSP_STATE_PLAYING) {
+        rtp_session_play_multicast(&s_rtsp.rtp, true);
+    }
+    c->state = RTSP_STATE_PLAYING;
 
     char resp[256];
     snprintf(resp, sizeof(resp),
@@ -261,34 +565,159 @@ static void handle_play(int fd, int cseq)
              "CSeq: %d\r\n"
              "Session: %08lx\r\n"
              "\r\n",
-             cseq, (unsigned long)s_rtsp.session_id);
-    send_response(fd, resp);
+             cseq, (unsigned long)c->session_id);
+    send_response(c, resp);
 
-    /* Wake RTP sender to check for self-capture */
-    xSemaphoreGive(s_rtsp.frame_ready);
-
-    ESP_LOGI(TAG, "PLAY: RTP streaming started");
+    ESP_LOGI(TAG, "PLAY: RTP streaming started (session %08lx)", (unsigned long)c->session_id);
 }
 
-static void handle_teardown(int fd, int cseq)
+static void handle_teardown(rtsp_client_t *c, int cseq)
 {
-    rtp_session_stop(&s_rtsp.rtp);
-    s_rtsp.state = RTSP_STATE_INIT;
+    release_transport(c);
+    c->state = RTSP_STATE_INIT;
 
     char resp[256];
     snprintf(resp, sizeof(resp),
              "RTSP/1.0 200 OK\r\n"
              "CSeq: %d\r\n\r\n",
              cseq);
-    send_response(fd, resp);
+    send_response(c, resp);
 
     ESP_LOGI(TAG, "TEARDOWN: session ended");
 }
 
+/* ---- H.264 encoder parameters ------------------------------------------ */
+
+/*
+ * UVC uses defaults (all-IDR), RTSP uses its own Kconfig values tuned for
+ * Ethernet streaming quality/latency.
+ */
+void rtsp_server_config_encoder(encoder_ctx_t *enc)
+{
+    enc->h264_i_period = CONFIG_RTSP_H264_I_PERIOD;
+    enc->h264_bitrate  = CONFIG_RTSP_H264_BITRATE;
+#if CONFIG_RTSP_RATE_CONTROL
+    /* Resume at the rate the network last sustained */
+    if (s_rtsp.rate.target_bps > 0) {
+        enc->h264_bitrate = s_rtsp.rate.target_bps;
+    }
+#endif
+    enc->h264_min_qp   = CONFIG_RTSP_H264_MIN_QP;
+    enc->h264_max_qp   = CONFIG_RTSP_H264_MAX_QP;
+}
+
+/* Reset H.264 params so UVC's next encoder_start uses defaults (all-IDR) */
+void rtsp_server_reset_encoder(encoder_ctx_t *enc)
+{
+    enc->h264_i_period = 0;
+    enc->h264_bitrate  = 0;
+    enc->h264_min_qp   = 0;
+    enc->h264_max_qp   = 0;
+}
+
+/*
+ * Fit the send queue to the encoder its frames come from: each queued
+ * frame and each one on the frame bus pins one of enc's CAPTURE buffers,
+ * and the encoder needs one more to encode into.  With fewer buffers than
+ * RTSP_TX_QUEUE_FRAMES calls for, the queue gets shallower.
+ */
+static void fit_txq(const encoder_ctx_t *enc, uint32_t bus_frames)
+{
+    uint32_t pinned = bus_frames + 1;
+    rtp_txq_set_limit(&s_rtsp.txq, enc->capture_buf_count > pinned ?
+                                   enc->capture_buf_count - pinned : 1);
+}
+
+/* ---- Congestion-adaptive bitrate ---------------------------------------- */
+
+/*
+ * Once per interval, feed the RTP session's congestion signals to the
+ * bitrate controller and hand a changed target to enc, whose producer
+ * applies it on its next encode.  Only called with an encoder whose output
+ * goes to RTSP alone.
+ */
+static void rate_control_tick(encoder_ctx_t *enc)
+{
+#if CONFIG_RTSP_RATE_CONTROL
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - s_rtsp.rate_last_us < RTSP_RATE_INTERVAL_US) {
+        return;
+    }
+    s_rtsp.rate_last_us = now_us;
+
+    rtp_congestion_t cong;
+    rtp_session_get_congestion(&s_rtsp.rtp, RTSP_RATE_RR_MAX_AGE_US, &cong);
+    rtp_txq_stats_t q;
+    rtp_txq_get_stats(&s_rtsp.txq, &q, false);
+    /* Frames the send queue had no room for since the last interval */
+    uint32_t queue_drops = q.dropped_nonref + q.dropped_ref + q.dropped_idr;
+    bitrate_ctrl_input_t in = {
+        .send_errors = cong.send_errors,
+        .tcp_drops = cong.tcp_drops,
+        .queue_drops = queue_drops - s_rtsp.rate_queue_drops,
+        .loss_256 = cong.worst_loss_256,
+    };
+    s_rtsp.rate_queue_drops = queue_drops;
+    if (!bitrate_ctrl_update(&s_rtsp.rate, &in)) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Rate control: %d kbps (send errors %lu, TCP drops %lu, queue drops %lu, "
+             "loss %d/256)",
+             s_rtsp.rate.target_bps / 1000, (unsigned long)cong.send_errors,
+             (unsigned long)cong.tcp_drops, (unsigned long)in.queue_drops,
+             cong.worst_loss_256);
+    encoder_set_h264_bitrate(enc, s_rtsp.rate.target_bps);
+#endif
+}
+
+/* ---- H.264 parameter sets ----------------------------------------------- */
+
+/*
+ * Hand enc's SPS/PPS to the RTP session when they are new: another
+ * encoder took over, it restarted, or it changed them.  The session sends
+ * them ahead of the next IDR.
+ */
+static void sync_param_sets(encoder_ctx_t *enc)
+{
+    uint32_t gen = enc->param_gen;
+    if (enc == s_rtsp.param_enc && gen == s_rtsp.param_gen) {
+        return;
+    }
+
+    uint8_t sps[ENCODER_H264_PARAM_MAX], pps[ENCODER_H264_PARAM_MAX];
+    size_t sps_len, pps_len;
+    if (!encoder_get_h264_param_sets(enc, sps, &sps_len, pps, &pps_len, &gen)) {
+        return;
+    }
+    if (rtp_session_set_param_sets(&s_rtsp.rtp, sps, sps_len, pps, pps_len) == ESP_OK) {
+        ESP_LOGD(TAG, "H.264 parameter sets updated (SPS %u, PPS %u bytes)",
+                 (unsigned)sps_len, (unsigned)pps_len);
+    }
+    s_rtsp.param_enc = enc;
+    s_rtsp.param_gen = gen;
+}
+
 /* ---- Self-capture: independent camera -> H.264 -> RTP loop -------------- */
 
 /*
- * Runs when RTSP is PLAYING and no UVC stream is active.
+ * Drop every frame RTSP holds before their encoder stops: the frame being
+ * sent is cut short at its next batch, and this returns once the tx task
+ * has let go of it.  Also the frame bus flush callback, run by UVC.
+ */
+static void flush_txq(void *arg)
+{
+    (void)arg;
+    xSemaphoreTake(s_rtsp.feed_lock, portMAX_DELAY);
+    s_rtsp.feed_epoch++;
+    rtp_session_abort_frame(&s_rtsp.rtp, true);
+    rtp_txq_flush(&s_rtsp.txq);
+    rtp_session_abort_frame(&s_rtsp.rtp, false);
+    xSemaphoreGive(s_rtsp.feed_lock);
+}
+
+/*
+ * Runs while any client is PLAYING and no UVC stream is active.
  * Borrows the shared camera and H.264 encoder from the UVC context.
  * Exits when state changes or UVC claims the hardware.
  */
@@ -298,7 +727,7 @@ static void self_capture_loop(void)
     encoder_ctx_t *enc = &s_uvc_ctx->h264_enc;
 
     /* Start camera in YUV420 mode (H.264 encoder input format) */
-    if (camera_start(cam, CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT,
+    if (camera_start(cam, RTSP_STREAM_WIDTH, RTSP_STREAM_HEIGHT,
                      V4L2_PIX_FMT_YUV420) != ESP_OK) {
         ESP_LOGE(TAG, "Self-capture: camera start failed");
         vTaskDelay(pdMS_TO_TICKS(1000));
@@ -306,14 +735,10 @@ static void self_capture_loop(void)
     }
 
     /* Set RTSP-appropriate H.264 params BEFORE encoder_start (which sets
-     * them before STREAMON). UVC uses defaults (all-IDR), RTSP uses its own
-     * Kconfig values tuned for Ethernet streaming quality/latency. */
-    enc->h264_i_period = CONFIG_RTSP_H264_I_PERIOD;
-    enc->h264_bitrate  = CONFIG_RTSP_H264_BITRATE;
-    enc->h264_min_qp   = CONFIG_RTSP_H264_MIN_QP;
-    enc->h264_max_qp   = CONFIG_RTSP_H264_MAX_QP;
+     * them before STREAMON). */
+    rtsp_server_config_encoder(enc);
 
-    if (encoder_start(enc, CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT,
+    if (encoder_start(enc, RTSP_STREAM_WIDTH, RTSP_STREAM_HEIGHT,
                       V4L2_PIX_FMT_YUV420) != ESP_OK) {
         ESP_LOGE(TAG, "Self-capture: H.264 encoder start failed");
         camera_stop(cam);
@@ -321,43 +746,49 @@ static void self_capture_loop(void)
         return;
     }
 
+    fit_txq(enc, 0);
     s_self_capture_active = true;
     ESP_LOGI(TAG, "Self-capture: 1080p H.264 streaming to RTP");
 
-    while (s_rtsp.state == RTSP_STATE_PLAYING && !s_uvc_streaming) {
+    while (s_rtsp.rtp.active && !s_uvc_streaming) {
         uint32_t buf_idx, bytesused;
-        if (camera_dequeue(cam, &buf_idx, &bytesused) != ESP_OK) {
+        int64_t capture_us;
+        if (camera_dequeue(cam, &buf_idx, &bytesused, &capture_us) != ESP_OK) {
             vTaskDelay(pdMS_TO_TICKS(10));
             continue;
         }
 
         uint8_t *enc_buf;
-        uint32_t enc_len;
+        uint32_t enc_len, enc_idx;
         esp_err_t ret = encoder_encode(enc, cam->cap_buffer[buf_idx],
-                                       bytesused, &enc_buf, &enc_len);
+                                       bytesused, &enc_buf, &enc_len, &enc_idx);
         camera_enqueue(cam, buf_idx);
 
-        if (ret == ESP_OK && enc_len > 0) {
-            rtp_send_h264_frame(&s_rtsp.rtp, enc_buf, enc_len);
-
-            /* Re-queue encoder capture buffer for next encode */
-            struct v4l2_buffer qbuf = {
-                .index  = 0,
-                .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-                .memory = V4L2_MEMORY_MMAP,
-            };
-            ioctl(enc->m2m_fd, VIDIOC_QBUF, &qbuf);
+        if (ret != ESP_OK) {
+            continue;
+        }
+        /* Queued by reference: the CAPTURE buffer goes back to the
+         * encoder's ring when the frame has been sent or dropped */
+        frame_buf_t *fb = frame_buf_wrap(enc_buf, enc_len, capture_us,
+                                         frame_buf_release_encoder, enc, enc_idx,
+                                         enc->generation);
+        if (!fb) {
+            encoder_release(enc, enc_idx);
+            continue;
         }
+        if (enc_len > 0) {
+            rtp_txq_push(&s_rtsp.txq, fb);
+            rate_control_tick(enc);
+        }
+        frame_buf_unref(fb);
     }
 
+    /* Queued frames point into the encoder's buffers */
+    flush_txq(NULL);
     encoder_stop(enc);
     camera_stop(cam);
 
-    /* Reset H.264 params so UVC's next encoder_start uses defaults (all-IDR) */
-    enc->h264_i_period = 0;
-    enc->h264_bitrate  = 0;
-    enc->h264_min_qp   = 0;
-    enc->h264_max_qp   = 0;
+    rtsp_server_reset_encoder(enc);
 
     s_self_capture_active = false;
     ESP_LOGI(TAG, "Self-capture stopped");
@@ -365,21 +796,21 @@ static void self_capture_loop(void)
 
 /* ---- RTP sender task ---------------------------------------------------- */
 
+/*
+ * Produces frames for RTP: runs self-capture, or takes UVC's frames off the
+ * frame bus.  Frames go into the send queue, so neither the encoder nor
+ * the frame bus ever waits for the network.
+ */
 static void rtp_sender_task(void *arg)
 {
     ESP_LOGI(TAG, "RTP sender task started");
 
-    /* Temporary buffer for feed mode (avoid holding mutex during sendto) */
-    uint8_t *send_buf = heap_caps_malloc(RTSP_FRAME_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    if (!send_buf) {
-        ESP_LOGE(TAG, "Failed to allocate RTP send buffer");
-        vTaskDelete(NULL);
-        return;
-    }
-
     while (1) {
-        /* Wait until PLAY is active */
-        if (s_rtsp.state != RTSP_STATE_PLAYING) {
+        /* Only take frames from the bus while they can be sent */
+        frame_bus_sub_enable(s_rtsp.bus_sub, s_rtsp.rtp.active && s_uvc_streaming);
+
+        /* Wait until at least one client is playing */
+        if (!s_rtsp.rtp.active) {
             vTaskDelay(pdMS_TO_TICKS(100));
             continue;
         }
@@ -394,92 +825,252 @@ static void rtp_sender_task(void *arg)
         }
 
         /*
-         * Feed mode: UVC is streaming H.264, frames arrive via feed_h264().
-         * Wait for the next frame or timeout to re-check state.
+         * Feed mode: UVC is streaming H.264, frames arrive on the frame bus.
+         * The send queue takes its own reference, so the frame stays in
+         * the encoder's buffer until it has been sent or dropped.  Short
+         * timeout so state changes are picked up.
          */
-        if (xSemaphoreTake(s_rtsp.frame_ready, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        uint32_t epoch = s_rtsp.feed_epoch;
+        frame_buf_t *fb = frame_bus_receive(s_rtsp.bus_sub, pdMS_TO_TICKS(100));
+        if (!fb) {
             continue;
         }
-
-        if (s_rtsp.state != RTSP_STATE_PLAYING) {
-            continue;
+        /* A flush since the receive means UVC is stopping this frame's
+         * encoder: drop it rather than queue it behind the flush */
+        xSemaphoreTake(s_rtsp.feed_lock, portMAX_DELAY);
+        if (epoch == s_rtsp.feed_epoch) {
+            fit_txq(fb->owner, RTSP_BUS_DEPTH);
+            rtp_txq_push(&s_rtsp.txq, fb);
         }
-
-        /* Copy frame out under mutex */
-        size_t len = 0;
-        if (xSemaphoreTake(s_rtsp.frame_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-            len = s_rtsp.frame_len;
-            if (len > 0) {
-                memcpy(send_buf, s_rtsp.frame_buf, len);
-            }
-            s_rtsp.frame_len = 0;
-            xSemaphoreGive(s_rtsp.frame_mutex);
+        xSemaphoreGive(s_rtsp.feed_lock);
+#if CONFIG_UVC_RTSP_CONCURRENT
+        /* Only adapt an encoder that does not also feed a USB session */
+        if (s_uvc_ctx && fb->owner == s_uvc_ctx->rtsp_encoder) {
+            rate_control_tick(fb->owner);
         }
+#endif
+        frame_buf_unref(fb);
+    }
+}
+
+/* ---- RTP tx task -------------------------------------------------------- */
 
-        if (len > 0) {
-            rtp_send_h264_frame(&s_rtsp.rtp, send_buf, len);
+
+/* Log the send queue counters when frames were dropped since last time */
+static void report_txq(void)
+{
+    static int64_t last_us;
+    static uint32_t last_drops;
+
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - last_us < RTSP_TXQ_REPORT_US) {
+        return;
+    }
+    last_us = now_us;
+
+    rtp_txq_stats_t q;
+    rtp_txq_get_stats(&s_rtsp.txq, &q, false);
+    uint32_t drops = q.dropped_nonref + q.dropped_ref + q.dropped_gop +
+                     q.evicted + q.dropped_idr;
+    if (drops == last_drops) {
+        return;
+    }
+    last_drops = drops;
+    ESP_LOGW(TAG, "RTP queue: depth %lu (max %lu), dropped %lu non-ref, %lu P, %lu to next IDR, "
+             "%lu evicted by IDR, %lu IDR",
+             (unsigned long)q.depth, (unsigned long)q.depth_max,
+             (unsigned long)q.dropped_nonref, (unsigned long)q.dropped_ref,
+             (unsigned long)q.dropped_gop, (unsigned long)q.evicted,
+             (unsigned long)q.dropped_idr);
+}
+
+/*
+ * Packetizes and sends queued frames, one packetization for every
+ * playing client.  The only task that writes RTP to the network.
+ */
+static void rtp_tx_task(void *arg)
+{
+    ESP_LOGI(TAG, "RTP tx task started");
+
+    while (1) {
+        /* lwIP just ran out of buffers: the next frame waits in the queue,
+         * where a full queue drops frames whole, rather than going out in
+         * part */
+        if (!rtp_session_tx_ready(&s_rtsp.rtp)) {
+            vTaskDelay(1);
+            continue;
+        }
+        const rtp_txq_frame_t *f = rtp_txq_peek(&s_rtsp.txq, pdMS_TO_TICKS(100));
+        if (!f) {
+            continue;
         }
+        sync_param_sets(f->fb->owner);
+        rtp_send_h264_frame(&s_rtsp.rtp, f->fb->data, f->fb->len, f->fb->capture_us);
+        rtp_txq_pop(&s_rtsp.txq);
+        report_txq();
     }
 }
 
 /* ---- RTSP control task -------------------------------------------------- */
 
-static void handle_client(int client_fd, struct sockaddr_in *client_addr)
+static void close_client(rtsp_client_t *c)
 {
-    char buf[RTSP_BUF_SIZE];
-    s_rtsp.client_fd = client_fd;
-    s_rtsp.state = RTSP_STATE_INIT;
+    /* Holding the tx lock keeps the RTP sender off the fd while it closes */
+    xSemaphoreTake(c->tx_lock, portMAX_DELAY);
+    release_transport(c);
+    close(c->fd);
+    c->fd = -1;
+    xSemaphoreGive(c->tx_lock);
+    c->state = RTSP_STATE_INIT;
+}
 
-    ESP_LOGI(TAG, "Client connected from %d.%d.%d.%d:%d",
-             ((uint8_t *)&client_addr->sin_addr.s_addr)[0],
-             ((uint8_t *)&client_addr->sin_addr.s_addr)[1],
-             ((uint8_t *)&client_addr->sin_addr.s_addr)[2],
-             ((uint8_t *)&client_addr->sin_addr.s_addr)[3],
-             ntohs(client_addr->sin_port));
+static void accept_client(int listen_fd)
+{
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    int client_fd = accept(listen_fd, (struct sockaddr *)&client_addr, &addr_len);
+    if (client_fd < 0) {
+        ESP_LOGW(TAG, "Accept failed: errno %d", errno);
+        return;
+    }
 
-    /* Set TCP receive timeout */
-    struct timeval tv = { .tv_sec = 60, .tv_usec = 0 };
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    rtsp_client_t *c = NULL;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        if (s_rtsp.clients[i].fd < 0) {
+            c = &s_rtsp.clients[i];
+            break;
+        }
+    }
+    if (!c) {
+        ESP_LOGW(TAG, "Client limit (%d) reached, refusing connection", RTSP_MAX_CLIENTS);
+        close(client_fd);
+        return;
+    }
 
-    while (1) {
-        int n = recv(client_fd, buf, sizeof(buf) - 1, 0);
-        if (n <= 0) {
-            if (n == 0) {
-                ESP_LOGI(TAG, "Client disconnected");
-            } else {
-                ESP_LOGW(TAG, "recv error: %d", errno);
+    c->fd = client_fd;
+    c->addr = client_addr;
+    c->state = RTSP_STATE_INIT;
+    c->session_id = 0;
+    c->rtp_dest = -1;
+    c->last_rx = xTaskGetTickCount();
+    c->interleaved = false;
+    c->multicast = false;
+    rtsp_parser_reset(&c->parser);
+    c->rx_len = 0;
+    c->discard = 0;
+
+    ESP_LOGI(TAG, "Client %d connected from %d.%d.%d.%d:%d",
+             (int)(c - s_rtsp.clients),
+             ((uint8_t *)&client_addr.sin_addr.s_addr)[0],
+             ((uint8_t *)&client_addr.sin_addr.s_addr)[1],
+             ((uint8_t *)&client_addr.sin_addr.s_addr)[2],
+             ((uint8_t *)&client_addr.sin_addr.s_addr)[3],
+             ntohs(client_addr.sin_port));
+}
+
+/*
+ * Answer one parsed request.
+ * Returns false when the connection should be closed.
+ */
+static bool dispatch_request(rtsp_client_t *c, const rtsp_request_t *req)
+{
+    int cseq = req->cseq;
+
+    if (rtsp_str_eq(req->method, "OPTIONS")) {
+        handle_options(c, cseq);
+    } else if (rtsp_str_eq(req->method, "DESCRIBE")) {
+        handle_describe(c, cseq);
+    } else if (rtsp_str_eq(req->method, "SETUP")) {
+        handle_setup(c, cseq, req->uri, rtsp_request_header(req, "Transport"));
+    } else if (rtsp_str_eq(req->method, "PLAY")) {
+        handle_play(c, cseq);
+    } else if (rtsp_str_eq(req->method, "TEARDOWN")) {
+        handle_teardown(c, cseq);
+        return false;
+    } else {
+        char resp[256];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 405 Method Not Allowed\r\n"
+                 "CSeq: %d\r\n\r\n", cseq);
+        send_response(c, resp);
+    }
+    return true;
+}
+
+/*
+ * Read from a client whose socket is readable and answer every request
+ * that is now complete.  Requests may be split across reads or pipelined
+ * several to a read; the rest of an incomplete one stays in rx_buf.
+ * Returns false when the connection should be closed.
+ */
+static bool handle_client_request(rtsp_client_t *c)
+{
+    int n = recv(c->fd, c->rx_buf + c->rx_len, sizeof(c->rx_buf) - c->rx_len, 0);
+    if (n <= 0) {
+        if (n == 0) {
+            ESP_LOGI(TAG, "Client %d disconnected", (int)(c - s_rtsp.clients));
+        } else {
+            ESP_LOGW(TAG, "recv error: %d", errno);
+        }
+        return false;
+    }
+    c->rx_len += n;
+    c->last_rx = xTaskGetTickCount();
+
+    size_t off = 0;
+    bool keep = true;
+    while (keep && off < c->rx_len) {
+        /* The rest of a "$" frame that did not fit rx_buf */
+        if (c->discard > 0) {
+            uint32_t skip = c->rx_len - off < c->discard ? c->rx_len - off : c->discard;
+            off += skip;
+            c->discard -= skip;
+            continue;
+        }
+
+        rtsp_request_t req;
+        rtsp_frame_t frame;
+        size_t used = 0;
+        rtsp_parse_result_t res = rtsp_parse(&c->parser, c->rx_buf + off, c->rx_len - off,
+                                             &req, &frame, &used);
+        if (res == RTSP_PARSE_NEED_MORE) {
+            if (c->parser.needed > sizeof(c->rx_buf) &&
+                c->rx_buf[off + c->parser.start] == '$') {
+                c->discard = c->parser.needed - (c->rx_len - off);
+                off = c->rx_len;
+                rtsp_parser_reset(&c->parser);
+            } else if (c->parser.needed > sizeof(c->rx_buf) ||
+                       (off == 0 && c->rx_len == sizeof(c->rx_buf))) {
+                ESP_LOGW(TAG, "Client %d: request larger than %d bytes",
+                         (int)(c - s_rtsp.clients), RTSP_BUF_SIZE);
+                keep = false;
             }
             break;
         }
-        buf[n] = '\0';
-
-        int cseq = rtsp_get_cseq(buf);
-
-        if (strncmp(buf, "OPTIONS", 7) == 0) {
-            handle_options(client_fd, cseq);
-        } else if (strncmp(buf, "DESCRIBE", 8) == 0) {
-            handle_describe(client_fd, cseq);
-        } else if (strncmp(buf, "SETUP", 5) == 0) {
-            handle_setup(client_fd, cseq, buf, client_addr);
-        } else if (strncmp(buf, "PLAY", 4) == 0) {
-            handle_play(client_fd, cseq);
-        } else if (strncmp(buf, "TEARDOWN", 8) == 0) {
-            handle_teardown(client_fd, cseq);
+        if (res == RTSP_PARSE_ERROR) {
+            ESP_LOGW(TAG, "Client %d: malformed request", (int)(c - s_rtsp.clients));
+            send_response(c, "RTSP/1.0 400 Bad Request\r\n\r\n");
+            keep = false;
             break;
-        } else {
-            char resp[256];
-            snprintf(resp, sizeof(resp),
-                     "RTSP/1.0 405 Method Not Allowed\r\n"
-                     "CSeq: %d\r\n\r\n", cseq);
-            send_response(client_fd, resp);
         }
+        off += used;
+
+        if (res == RTSP_PARSE_FRAME) {
+            /* Interleaved clients send RTCP receiver reports on the control connection */
+            if (c->interleaved && c->rtp_dest >= 0 && frame.channel == c->channel + 1) {
+                rtp_session_rtcp_input(&s_rtsp.rtp, c->rtp_dest, frame.data, frame.len);
+            }
+            continue;
+        }
+        keep = dispatch_request(c, &req);
     }
 
-    /* Clean up on disconnect */
-    rtp_session_stop(&s_rtsp.rtp);
-    s_rtsp.state = RTSP_STATE_INIT;
-    close(client_fd);
-    s_rtsp.client_fd = -1;
+    /* Keep the unconsumed tail at the front for the next read */
+    if (off > 0) {
+        memmove(c->rx_buf, c->rx_buf + off, c->rx_len - off);
+        c->rx_len -= off;
+    }
+    return keep;
 }
 
 static void rtsp_server_task(void *arg)
@@ -507,26 +1098,70 @@ static void rtsp_server_task(void *arg)
         return;
     }
 
-    if (listen(listen_fd, 1) < 0) {
+    if (listen(listen_fd, RTSP_MAX_CLIENTS) < 0) {
         ESP_LOGE(TAG, "Listen failed: errno %d", errno);
         close(listen_fd);
         vTaskDelete(NULL);
         return;
     }
 
-    ESP_LOGI(TAG, "RTSP server listening on port %d", RTSP_PORT);
+    ESP_LOGI(TAG, "RTSP server listening on port %d (max %d clients)",
+             RTSP_PORT, RTSP_MAX_CLIENTS);
 
+    /*
+     * One loop serves the listening socket and every control connection.
+     * The 1 s timeout bounds how late idle clients are expired.
+     */
     while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        int client_fd = accept(listen_fd, (struct sockaddr *)&client_addr, &addr_len);
-        if (client_fd < 0) {
-            ESP_LOGW(TAG, "Accept failed: errno %d", errno);
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(listen_fd, &rfds);
+        FD_SET(s_rtsp.rtp.rtcp_fd, &rfds);
+        int max_fd = listen_fd > s_rtsp.rtp.rtcp_fd ? listen_fd : s_rtsp.rtp.rtcp_fd;
+        for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+            if (s_rtsp.clients[i].fd >= 0) {
+                FD_SET(s_rtsp.clients[i].fd, &rfds);
+                if (s_rtsp.clients[i].fd > max_fd) {
+                    max_fd = s_rtsp.clients[i].fd;
+                }
+            }
+        }
+
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+        int n = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        if (n < 0) {
+            ESP_LOGW(TAG, "select failed: errno %d", errno);
             vTaskDelay(pdMS_TO_TICKS(1000));
             continue;
         }
 
-        handle_client(client_fd, &client_addr);
+        for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+            rtsp_client_t *c = &s_rtsp.clients[i];
+            if (c->fd < 0) {
+                continue;
+            }
+            if (n > 0 && FD_ISSET(c->fd, &rfds)) {
+                if (!handle_client_request(c)) {
+                    close_client(c);
+                }
+            } else if (c->interleaved && rtp_session_dest_failed(&s_rtsp.rtp, c->rtp_dest)) {
+                /* A packet was cut off: the "$" stream cannot be resynced */
+                ESP_LOGW(TAG, "Client %d: interleaved stream broken, closing", i);
+                close_client(c);
+            } else if (xTaskGetTickCount() - c->last_rx > pdMS_TO_TICKS(RTSP_CLIENT_TIMEOUT_MS)) {
+                ESP_LOGW(TAG, "Client %d timed out", i);
+                close_client(c);
+            }
+        }
+
+        if (n > 0 && FD_ISSET(listen_fd, &rfds)) {
+            accept_client(listen_fd);
+        }
+
+        /* Receiver reports from UDP and multicast clients */
+        if (n > 0 && FD_ISSET(s_rtsp.rtp.rtcp_fd, &rfds)) {
+            rtp_session_rtcp_receive(&s_rtsp.rtp);
+        }
     }
 }
 
@@ -535,8 +1170,13 @@ static void rtsp_server_task(void *arg)
 esp_err_t rtsp_server_start(void *uvc_ctx)
 {
     memset(&s_rtsp, 0, sizeof(s_rtsp));
-    s_rtsp.client_fd = -1;
-    s_rtsp.state = RTSP_STATE_INIT;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        s_rtsp.clients[i].fd = -1;
+        s_rtsp.clients[i].rtp_dest = -1;
+        s_rtsp.clients[i].tx_lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(s_rtsp.clients[i].tx_lock, ESP_ERR_NO_MEM, TAG,
+                            "Client lock create failed");
+    }
 
     s_uvc_ctx = (uvc_stream_ctx_t *)uvc_ctx;
     s_uvc_streaming = false;
@@ -545,16 +1185,43 @@ esp_err_t rtsp_server_start(void *uvc_ctx)
     /* Initialize RTP session */
     ESP_RETURN_ON_ERROR(rtp_session_init(&s_rtsp.rtp), TAG, "RTP init failed");
 
-    /* Allocate frame buffer in PSRAM (used in feed mode) */
-    s_rtsp.frame_buf = heap_caps_malloc(RTSP_FRAME_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    ESP_RETURN_ON_FALSE(s_rtsp.frame_buf, ESP_ERR_NO_MEM, TAG,
-                        "Frame buffer alloc failed (%d bytes)", RTSP_FRAME_BUF_SIZE);
-
-    /* Create synchronization primitives */
-    s_rtsp.frame_ready = xSemaphoreCreateBinary();
-    s_rtsp.frame_mutex = xSemaphoreCreateMutex();
-    ESP_RETURN_ON_FALSE(s_rtsp.frame_ready && s_rtsp.frame_mutex,
-                        ESP_ERR_NO_MEM, TAG, "Semaphore create failed");
+#if CONFIG_RTSP_RATE_CONTROL
+    bitrate_ctrl_config_t rate_cfg = {
+        .min_bps = CONFIG_RTSP_RATE_MIN_BITRATE,
+        .max_bps = CONFIG_RTSP_H264_BITRATE,
+    };
+    bitrate_ctrl_init(&s_rtsp.rate, &rate_cfg);
+#endif
+
+#if CONFIG_RTSP_MULTICAST
+#if CONFIG_RTSP_MULTICAST_LOOP
+    const bool mcast_loop = true;
+#else
+    const bool mcast_loop = false;
+#endif
+    struct in_addr group;
+    ESP_RETURN_ON_FALSE(inet_aton(CONFIG_RTSP_MULTICAST_GROUP, &group), ESP_ERR_INVALID_ARG,
+                        TAG, "Invalid multicast group %s", CONFIG_RTSP_MULTICAST_GROUP);
+    ESP_RETURN_ON_ERROR(rtp_session_set_multicast(&s_rtsp.rtp, group.s_addr,
+                                                  CONFIG_RTSP_MULTICAST_PORT,
+                                                  CONFIG_RTSP_MULTICAST_TTL,
+                                                  mcast_loop),
+                        TAG, "RTP multicast setup failed");
+#endif
+
+    /* Subscribe to UVC's encoded frames (used in feed mode) */
+    s_rtsp.bus_sub = frame_bus_subscribe(RTSP_BUS_DEPTH);
+    ESP_RETURN_ON_FALSE(s_rtsp.bus_sub, ESP_ERR_NO_MEM, TAG,
+                        "Frame bus subscribe failed");
+    s_rtsp.feed_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(s_rtsp.feed_lock, ESP_ERR_NO_MEM, TAG,
+                        "Feed lock create failed");
+
+    ESP_RETURN_ON_ERROR(rtp_txq_init(&s_rtsp.txq, CONFIG_RTSP_TX_QUEUE_KB * 1024,
+                                     CONFIG_RTSP_TX_QUEUE_FRAMES),
+                        TAG, "RTP send queue init failed");
+    /* UVC flushing the bus before it stops an encoder empties the queue too */
+    frame_bus_sub_set_flush_cb(s_rtsp.bus_sub, flush_txq, NULL);
 
     /* Start RTP sender task (increased stack for self-capture) */
     BaseType_t ret = xTaskCreate(rtp_sender_task, "rtp_sender",
@@ -562,6 +1229,11 @@ esp_err_t rtsp_server_start(void *uvc_ctx)
     ESP_RETURN_ON_FALSE(ret == pdPASS, ESP_ERR_NO_MEM, TAG,
                         "RTP sender task create failed");
 
+    ret = xTaskCreate(rtp_tx_task, "rtp_tx",
+                      RTSP_STACK_SIZE, NULL, RTSP_TASK_PRIO, NULL);
+    ESP_RETURN_ON_FALSE(ret == pdPASS, ESP_ERR_NO_MEM, TAG,
+                        "RTP tx task create failed");
+
     /* Start RTSP control task */
     ret = xTaskCreate(rtsp_server_task, "rtsp_server",
                       RTSP_STACK_SIZE, NULL, RTSP_TASK_PRIO, NULL);
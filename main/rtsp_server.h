@@ -7,6 +7,8 @@
 #pragma once
 
 #include "esp_err.h"
+#include "encoder_manager.h"
+#include "uvc_frame_config.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -14,6 +16,10 @@
 extern "C" {
 #endif
 
+/* Resolution of the RTSP H.264 stream, whichever task drives the encoder */
+#define RTSP_STREAM_WIDTH   CAMERA_CAPTURE_WIDTH
+#define RTSP_STREAM_HEIGHT  CAMERA_CAPTURE_HEIGHT
+
 /**
  * @brief Start the RTSP server
  *
@@ -23,26 +29,17 @@ extern "C" {
  *
  * When no UVC stream is active, the RTSP server self-captures:
  * it drives the camera and H.264 encoder directly. When UVC starts
- * streaming, RTSP yields the hardware and relies on feed_h264().
+ * streaming, RTSP yields the hardware and sends UVC's H.264 frames,
+ * which it receives by reference from the frame bus.
  *
- * Supports one active client at a time.
+ * Serves up to CONFIG_RTSP_MAX_CLIENTS clients; each frame is packetized
+ * once and sent to every playing client.
  *
  * @param uvc_ctx  Pointer to uvc_stream_ctx_t (camera + encoder contexts)
  * @return ESP_OK on success
  */
 esp_err_t rtsp_server_start(void *uvc_ctx);
 
-/**
- * @brief Feed an H.264 frame to the RTSP server for RTP streaming
- *
- * Called from the UVC streaming pipeline after H.264 encoding.
- * Copies the frame and signals the RTP sender. Non-blocking.
- *
- * @param data  H.264 Annex-B frame data
- * @param len   Frame length in bytes
- */
-void rtsp_server_feed_h264(const uint8_t *data, size_t len);
-
 /**
  * @brief Notify RTSP that UVC is about to start using the camera/encoder
  *
@@ -57,6 +54,18 @@ void rtsp_server_notify_uvc_start(void);
  */
 void rtsp_server_notify_uvc_stop(void);
 
+/**
+ * @brief Apply the RTSP H.264 parameters (Kconfig) to an encoder
+ *
+ * Call before encoder_start() on an H.264 encoder whose output goes to RTSP.
+ */
+void rtsp_server_config_encoder(encoder_ctx_t *enc);
+
+/**
+ * @brief Restore UVC default H.264 parameters after an RTSP encode session
+ */
+void rtsp_server_reset_encoder(encoder_ctx_t *enc);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * OV5647 mode table and smallest-covering-mode selection.
+ */
+
+#include "sdkconfig.h"
+#include "sensor_modes.h"
+
+/*
+ * Modes exposed by esp_cam_sensor's OV5647 driver.  Only the modes enabled
+ * in sdkconfig are compiled into the driver, so only those are listed.
+ */
+static const sensor_mode_t s_ov5647_modes[] = {
+#if CONFIG_CAMERA_OV5647_MIPI_RAW10_1920X1080_30FPS
+    { 1920, 1080, 30, false, "RAW10 1920x1080 30fps" },
+#endif
+#if CONFIG_CAMERA_OV5647_MIPI_RAW10_1280X960_BINNING_45FPS
+    { 1280,  960, 45, true,  "RAW10 1280x960 binning 45fps" },
+#endif
+#if CONFIG_CAMERA_OV5647_MIPI_RAW8_800X800_50FPS
+    {  800,  800, 50, true,  "RAW8 800x800 50fps" },
+#endif
+#if CONFIG_CAMERA_OV5647_MIPI_RAW8_800X640_50FPS
+    {  800,  640, 50, true,  "RAW8 800x640 50fps" },
+#endif
+#if CONFIG_CAMERA_OV5647_MIPI_RAW8_800X1280_50FPS
+    {  800, 1280, 50, true,  "RAW8 800x1280 50fps" },
+#endif
+};
+
+const sensor_mode_t *sensor_modes_get(size_t *count)
+{
+    *count = sizeof(s_ov5647_modes) / sizeof(s_ov5647_modes[0]);
+    return s_ov5647_modes;
+}
+
+static const sensor_mode_t *select_covering(const sensor_mode_t *modes, size_t count,
+                                            uint32_t dst_w, uint32_t dst_h, uint32_t fps)
+{
+    const sensor_mode_t *best = NULL;
+    uint32_t best_area = UINT32_MAX;
+
+    for (size_t i = 0; i < count; i++) {
+        const sensor_mode_t *m = &modes[i];
+        if (m->width < dst_w || m->height < dst_h || m->fps < fps) {
+            continue;
+        }
+        uint32_t area = (uint32_t)m->width * m->height;
+        if (area < best_area || (area == best_area && m->fps > best->fps)) {
+            best = m;
+            best_area = area;
+        }
+    }
+    return best;
+}
+
+const sensor_mode_t *sensor_mode_select(const sensor_mode_t *modes, size_t count,
+                                        uint32_t dst_w, uint32_t dst_h, uint32_t fps)
+{
+    const sensor_mode_t *m = select_covering(modes, count, dst_w, dst_h, fps);
+    if (!m && fps) {
+        m = select_covering(modes, count, dst_w, dst_h, 0);
+    }
+    return m;
+}
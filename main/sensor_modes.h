@@ -0,0 +1,59 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Sensor mode table and selection.
+ *
+ * The selector is pure (no driver or sdkconfig access) so it can be built
+ * and exercised on a host; the OV5647 table itself lists only the modes
+ * compiled into esp_cam_sensor.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint8_t  fps;               /* Maximum frame rate of the mode */
+    bool     binned;            /* 2x2 binned readout (wider field of view) */
+    const char *name;
+} sensor_mode_t;
+
+/**
+ * @brief Pick the smallest mode that covers a negotiated frame
+ *
+ * A mode covers the frame if it is at least dst_w x dst_h and runs at
+ * fps or faster.  Among covering modes the one with the fewest pixels
+ * wins (least CSI/ISP/PSRAM bandwidth); ties go to the higher frame rate.
+ * If no mode reaches the frame rate, the frame-rate requirement is
+ * dropped rather than failing.
+ *
+ * @param modes   Mode table
+ * @param count   Entries in modes
+ * @param dst_w   Negotiated width
+ * @param dst_h   Negotiated height
+ * @param fps     Negotiated frame rate (0 = don't care)
+ * @return Selected mode, or NULL if no mode is large enough
+ */
+const sensor_mode_t *sensor_mode_select(const sensor_mode_t *modes, size_t count,
+                                        uint32_t dst_w, uint32_t dst_h, uint32_t fps);
+
+/**
+ * @brief Modes available on the camera sensor in this build
+ *
+ * @param[out] count  Number of entries
+ */
+const sensor_mode_t *sensor_modes_get(size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
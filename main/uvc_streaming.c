@@ -10,79 +10,37 @@
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
 #include "esp_cache.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "linux/videodev2.h"
 #include <sys/ioctl.h>
 #include "usb_device_uvc.h"
 #include "uvc_streaming.h"
 #include "uvc_frame_config.h"
 #include "rtsp_server.h"
+#include "frame_bus.h"
+#include "frame_scaler.h"
+#include "sensor_modes.h"
 
 static const char *TAG = "uvc_stream";
 
 /* Largest uncompressed frame: UYVY 1920x1080 = 2 bytes/pixel = 4,147,200 bytes */
 #define UVC_MAX_FRAME_BUFFER_SIZE  (CAMERA_CAPTURE_WIDTH * CAMERA_CAPTURE_HEIGHT * 2)
 
-/* ---- Software center-crop functions ------------------------------------ */
+#if CONFIG_UVC_FRAME_FIT_CROP
+#define UVC_FRAME_KEEP_FOV      false
+#else
+#define UVC_FRAME_KEEP_FOV      true
+#endif
 
-/*
- * Center-crop a UYVY frame (2 bytes/pixel, packed YUV422).
- * Each 4-byte macro-pixel covers 2 horizontal pixels (U0 Y0 V0 Y1),
- * so x_off is forced even to avoid splitting a macro-pixel.
- */
-static void center_crop_uyvy(const uint8_t *src, uint32_t src_w, uint32_t src_h,
-                              uint8_t *dst, uint32_t dst_w, uint32_t dst_h)
-{
-    uint32_t x_off = ((src_w - dst_w) / 2) & ~1u;
-    uint32_t y_off = (src_h - dst_h) / 2;
-    uint32_t src_stride = src_w * 2;
-    uint32_t dst_stride = dst_w * 2;
+/* Encoder DMA reads the window straight from PSRAM: keep it cache-line aligned */
+#define ENC_STRIDED_ALIGN       64
 
-    const uint8_t *src_row = src + (y_off * src_stride) + (x_off * 2);
-    for (uint32_t y = 0; y < dst_h; y++) {
-        memcpy(dst + y * dst_stride, src_row + y * src_stride, dst_stride);
-    }
-}
-
-/*
- * Center-crop a YUV420 planar (I420) frame.
- * Y plane: full resolution, U and V planes: half in each dimension.
- * Offsets forced even to align with chroma subsampling.
- */
-static void center_crop_yuv420(const uint8_t *src, uint32_t src_w, uint32_t src_h,
-                                uint8_t *dst, uint32_t dst_w, uint32_t dst_h)
-{
-    uint32_t x_off = ((src_w - dst_w) / 2) & ~1u;
-    uint32_t y_off = ((src_h - dst_h) / 2) & ~1u;
-
-    /* Y plane */
-    const uint8_t *src_y = src + y_off * src_w + x_off;
-    uint8_t *dst_y = dst;
-    for (uint32_t y = 0; y < dst_h; y++) {
-        memcpy(dst_y + y * dst_w, src_y + y * src_w, dst_w);
-    }
-
-    /* U plane (quarter resolution) */
-    uint32_t src_uv_stride = src_w / 2;
-    uint32_t dst_uv_w = dst_w / 2;
-    uint32_t dst_uv_h = dst_h / 2;
-    uint32_t uv_x_off = x_off / 2;
-    uint32_t uv_y_off = y_off / 2;
-
-    const uint8_t *src_u = src + (src_w * src_h) + uv_y_off * src_uv_stride + uv_x_off;
-    uint8_t *dst_u = dst + (dst_w * dst_h);
-    for (uint32_t y = 0; y < dst_uv_h; y++) {
-        memcpy(dst_u + y * dst_uv_w, src_u + y * src_uv_stride, dst_uv_w);
-    }
-
-    /* V plane (quarter resolution) */
-    uint32_t src_uv_plane_size = (src_w / 2) * (src_h / 2);
-    const uint8_t *src_v = src + (src_w * src_h) + src_uv_plane_size
-                         + uv_y_off * src_uv_stride + uv_x_off;
-    uint8_t *dst_v = dst + (dst_w * dst_h) + (dst_uv_w * dst_uv_h);
-    for (uint32_t y = 0; y < dst_uv_h; y++) {
-        memcpy(dst_v + y * dst_uv_w, src_v + y * src_uv_stride, dst_uv_w);
-    }
-}
+#if CONFIG_UVC_SCALE_FILTER_BOX
+#define UVC_FRAME_SCALE_FILTER  FRAME_SCALE_BOX
+#else
+#define UVC_FRAME_SCALE_FILTER  FRAME_SCALE_BILINEAR
+#endif
 
 /* ---- Format mapping ---------------------------------------------------- */
 
@@ -93,9 +51,17 @@ static void center_crop_yuv420(const uint8_t *src, uint32_t src_w, uint32_t src_
  *   UYVY  -> ISP outputs UYVY directly (no encoder needed)
  *   MJPEG -> ISP outputs UYVY (JPEG HW encoder input)
  *   H.264 -> ISP outputs YUV420 (H.264 HW encoder input)
+ *
+ * With CONFIG_UVC_RTSP_CONCURRENT the ISP always outputs YUV420, which both
+ * HW encoders accept, so every frame can also feed the RTSP H.264 encoder.
+ * UYVY sessions then convert YUV420 -> UYVY in the crop/scale step.
  */
 static uint32_t get_camera_pixfmt_for_format(stream_format_t fmt)
 {
+#if CONFIG_UVC_RTSP_CONCURRENT
+    (void)fmt;
+    return V4L2_PIX_FMT_YUV420;
+#else
     switch (fmt) {
     case STREAM_FORMAT_YUY2:
         return V4L2_PIX_FMT_UYVY;   /* ISP outputs UYVY, sent raw to host */
@@ -106,6 +72,7 @@ static uint32_t get_camera_pixfmt_for_format(stream_format_t fmt)
     default:
         return V4L2_PIX_FMT_UYVY;
     }
+#endif
 }
 
 static stream_format_t uvc_format_to_stream_format(uvc_format_t uvc_fmt)
@@ -121,8 +88,314 @@ static stream_format_t uvc_format_to_stream_format(uvc_format_t uvc_fmt)
     }
 }
 
+/* ---- Frame production -------------------------------------------------- */
+
+/*
+ * Give back every hardware buffer a frame holds.  Called from fb_return
+ * (USB task), from the frame ring when it drops a frame (producer or USB
+ * task), and when flushing the ring at stream stop.
+ */
+static void release_frame(uvc_stream_ctx_t *ctx, stream_frame_t *frame)
+{
+    if (frame->enc_frame) {
+        frame_buf_unref(frame->enc_frame);
+    }
+    if (frame->cam_buf_idx != STREAM_BUF_NONE) {
+        camera_enqueue(&ctx->camera, frame->cam_buf_idx);
+    }
+    if (frame->crop_buf_idx != STREAM_BUF_NONE) {
+        ctx->crop_buf_busy[frame->crop_buf_idx] = false;
+    }
+    frame->enc_frame = NULL;
+    frame->cam_buf_idx = STREAM_BUF_NONE;
+    frame->crop_buf_idx = STREAM_BUF_NONE;
+}
+
+#if CONFIG_UVC_RTSP_CONCURRENT
+/*
+ * Concurrent mode: encode the full capture-resolution frame with the
+ * H.264 encoder and publish it to the frame bus for RTSP, while the UVC
+ * session uses the JPEG encoder or raw UYVY.  Skipped when nobody is
+ * subscribed or every H.264 CAPTURE buffer is still being sent.
+ */
+static void encode_for_rtsp(uvc_stream_ctx_t *ctx, uint8_t *raw_data, uint32_t raw_len,
+                            int64_t capture_us)
+{
+    encoder_ctx_t *enc = ctx->rtsp_encoder;
+    if (!enc || !frame_bus_has_subscribers()) {
+        return;
+    }
+
+    uint8_t *enc_buf;
+    uint32_t enc_len, enc_idx;
+    if (encoder_encode(enc, raw_data, raw_len, &enc_buf, &enc_len, &enc_idx) != ESP_OK) {
+        return;
+    }
+    frame_buf_t *fb = frame_buf_wrap(enc_buf, enc_len, capture_us,
+                                     frame_buf_release_encoder, enc, enc_idx,
+                                     enc->generation);
+    if (!fb) {
+        encoder_release(enc, enc_idx);
+        return;
+    }
+    if (enc_len > 0) {
+        frame_bus_publish(fb);
+    }
+    /* Only subscriber references remain */
+    frame_buf_unref(fb);
+}
+#endif
+
+static void ring_release_cb(void *item, void *cb_ctx)
+{
+    release_frame((uvc_stream_ctx_t *)cb_ctx, (stream_frame_t *)item);
+}
+
+/*
+ * Produce one frame:
+ *   1. Dequeue raw frame from camera (sensor mode resolution, >= negotiated)
+ *   2. If negotiated resolution < capture: crop and/or scale into a
+ *      staging buffer (frame_scaler)
+ *   3. If encoded format: feed through HW encoder, get compressed output
+ *      If UYVY raw: use frame directly (or staging buffer)
+ *   4. Fill the frame's uvc_fb_t
+ *
+ * Returns ESP_FAIL if the camera failed, or another error if the frame had
+ * to be dropped (no free crop/encoder buffer, encode error).
+ */
+static esp_err_t capture_frame(uvc_stream_ctx_t *ctx, stream_frame_t *frame)
+{
+    uint32_t buf_idx, bytesused;
+
+    frame->cam_buf_idx = STREAM_BUF_NONE;
+    frame->enc_frame = NULL;
+    frame->crop_buf_idx = STREAM_BUF_NONE;
+
+    /* 1. Capture a frame from camera */
+    int64_t capture_us;
+    if (camera_dequeue(&ctx->camera, &buf_idx, &bytesused, &capture_us) != ESP_OK) {
+        ESP_LOGE(TAG, "Camera dequeue failed");
+        return ESP_FAIL;
+    }
+
+    uint8_t *raw_data = ctx->camera.cap_buffer[buf_idx];
+    uint32_t raw_len = bytesused;
+
+#if CONFIG_UVC_RTSP_CONCURRENT
+    encode_for_rtsp(ctx, raw_data, raw_len, capture_us);
+#endif
+
+    /* 2. Crop/scale if negotiated resolution < capture resolution */
+    if (ctx->enc_in_strided) {
+        /* Encoder reads the crop window in place: no copy, no cache flush */
+        raw_data += ctx->enc_in_offset;
+        raw_len = ctx->camera.cap_buf_size[buf_idx] - ctx->enc_in_offset;
+    } else if (ctx->crop_buf_count) {
+        uint32_t crop_idx = 0;
+        if (!ctx->active_encoder) {
+            /* Raw frames keep their crop buffer until USB is done with it */
+            for (crop_idx = 0; crop_idx < ctx->crop_buf_count; crop_idx++) {
+                if (!ctx->crop_buf_busy[crop_idx]) {
+                    break;
+                }
+            }
+            if (crop_idx == ctx->crop_buf_count) {
+                ESP_LOGD(TAG, "No free crop buffer, dropping frame");
+                camera_enqueue(&ctx->camera, buf_idx);
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        uint8_t *crop_buf = ctx->crop_buf[crop_idx];
+
+        frame_scaler_run(&ctx->scaler, raw_data, crop_buf);
+        raw_len = ctx->crop_buf_size;
+        raw_data = crop_buf;
+        /* Flush CPU cache to PSRAM so encoder/USB DMA sees the cropped data */
+        esp_cache_msync(crop_buf, (raw_len + 63) & ~63,
+                        ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+        /* Camera buffer can be re-queued immediately since we copied data */
+        camera_enqueue(&ctx->camera, buf_idx);
+        buf_idx = STREAM_BUF_NONE;
+
+        if (!ctx->active_encoder) {
+            ctx->crop_buf_busy[crop_idx] = true;
+            frame->crop_buf_idx = crop_idx;
+        }
+    }
+
+    /* 3. Encode if needed */
+    uint8_t *frame_data = raw_data;
+    uint32_t frame_len = raw_len;
+
+    if (ctx->active_encoder) {
+        uint8_t *enc_buf;
+        uint32_t enc_len, enc_idx;
+        esp_err_t ret = encoder_encode(ctx->active_encoder, raw_data, raw_len,
+                                       &enc_buf, &enc_len, &enc_idx);
+        /* Re-queue camera buffer since encoder has consumed it */
+        if (buf_idx != STREAM_BUF_NONE) {
+            camera_enqueue(&ctx->camera, buf_idx);
+        }
+        if (ret != ESP_OK) {
+            if (ret != ESP_ERR_INVALID_STATE) {
+                ESP_LOGE(TAG, "Encode failed");
+            }
+            return ret;
+        }
+        frame->enc_frame = frame_buf_wrap(enc_buf, enc_len, capture_us,
+                                          frame_buf_release_encoder, ctx->active_encoder,
+                                          enc_idx, ctx->active_encoder->generation);
+        if (!frame->enc_frame) {
+            encoder_release(ctx->active_encoder, enc_idx);
+            return ESP_ERR_NO_MEM;
+        }
+        frame_data = enc_buf;
+        frame_len = enc_len;
+    } else {
+        /* UYVY raw, no crop: hold camera buffer until the frame is released */
+        frame->cam_buf_idx = buf_idx;
+    }
+
+    /* 3b. Share H.264 frame with RTP and other bus subscribers (by reference) */
+    if (ctx->active_format == STREAM_FORMAT_H264 && frame_len > 0) {
+        frame_bus_publish(frame->enc_frame);
+    }
+
+    /* 4. Fill the UVC frame buffer */
+    frame->fb.buf    = frame_data;
+    frame->fb.len    = frame_len;
+    frame->fb.width  = ctx->negotiated_width;
+    frame->fb.height = ctx->negotiated_height;
+
+    switch (ctx->active_format) {
+    case STREAM_FORMAT_MJPEG:
+        frame->fb.format = UVC_FORMAT_JPEG;
+        break;
+    case STREAM_FORMAT_H264:
+        frame->fb.format = UVC_FORMAT_H264;
+        break;
+    case STREAM_FORMAT_YUY2:
+        frame->fb.format = UVC_FORMAT_UNCOMPR;
+        break;
+    }
+
+    frame->fb.timestamp.tv_sec  = capture_us / 1000000UL;
+    frame->fb.timestamp.tv_usec = capture_us % 1000000UL;
+    return ESP_OK;
+}
+
+#if CONFIG_UVC_PRODUCER_TASK
+/*
+ * Runs camera -> crop -> encode at sensor rate, independent of USB
+ * scheduling, and pushes finished frames into the SPSC ring.  Frames the
+ * ring cannot take are released by the ring and counted as drops.
+ */
+static void producer_task(void *arg)
+{
+    uvc_stream_ctx_t *ctx = (uvc_stream_ctx_t *)arg;
+    stream_frame_t frame;
+
+    while (ctx->producer_run) {
+        esp_err_t ret = capture_frame(ctx, &frame);
+        if (ret != ESP_OK) {
+            if (ret == ESP_FAIL) {
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+        frame_ring_push(&ctx->ring, &frame);
+        xSemaphoreGive(ctx->frame_avail);
+    }
+
+    xSemaphoreGive(ctx->producer_done);
+    vTaskDelete(NULL);
+}
+#endif
+
 /* ---- Stream lifecycle -------------------------------------------------- */
 
+static void free_crop_bufs(uvc_stream_ctx_t *ctx)
+{
+    for (uint32_t i = 0; i < STREAM_CROP_BUF_COUNT; i++) {
+        if (ctx->crop_buf[i]) {
+            free(ctx->crop_buf[i]);
+            ctx->crop_buf[i] = NULL;
+        }
+        ctx->crop_buf_busy[i] = false;
+    }
+    ctx->crop_buf_count = 0;
+    ctx->crop_buf_size = 0;
+    ctx->enc_in_strided = false;
+    ctx->enc_in_offset = 0;
+    frame_scaler_deinit(&ctx->scaler);
+}
+
+static esp_err_t alloc_crop_bufs(uvc_stream_ctx_t *ctx, uint32_t count)
+{
+    ctx->crop_buf_size = frame_scaler_out_size(&ctx->scaler);
+    for (uint32_t i = 0; i < count; i++) {
+        ctx->crop_buf[i] = heap_caps_aligned_alloc(64, ctx->crop_buf_size,
+                                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!ctx->crop_buf[i]) {
+            ESP_LOGE(TAG, "Failed to allocate crop buffer (%lu bytes)",
+                     (unsigned long)ctx->crop_buf_size);
+            return ESP_ERR_NO_MEM;
+        }
+        ctx->crop_buf_count++;
+    }
+    ESP_LOGI(TAG, "Crop buffers: %lu x %lu bytes (%s from %lux%lu to %lux%lu)",
+             (unsigned long)ctx->crop_buf_count, (unsigned long)ctx->crop_buf_size,
+             frame_fit_name(ctx->scaler.fit),
+             (unsigned long)ctx->scaler.src_w, (unsigned long)ctx->scaler.src_h,
+             (unsigned long)ctx->scaler.dst_w, (unsigned long)ctx->scaler.dst_h);
+    return ESP_OK;
+}
+
+/*
+ * Input stride to request from the encoder if the stream is a pure crop of
+ * a packed capture that the encoder can read in place, else 0.  Sets
+ * ctx->enc_in_offset to the window's first byte.
+ */
+static uint32_t strided_crop_stride(uvc_stream_ctx_t *ctx)
+{
+#if CONFIG_UVC_ENCODER_STRIDED_CROP
+    const frame_scaler_t *s = &ctx->scaler;
+    if (s->fit != FRAME_FIT_CROP || s->in_fmt != V4L2_PIX_FMT_UYVY || s->out_fmt != s->in_fmt) {
+        return 0;
+    }
+
+    uint32_t stride = s->src_w * 2;
+    uint32_t offset = s->roi_y * stride + s->roi_x * 2;
+    if ((offset % ENC_STRIDED_ALIGN) || (stride % ENC_STRIDED_ALIGN)) {
+        return 0;
+    }
+    /* The last row of the window must lie inside every camera buffer */
+    for (uint32_t i = 0; i < CAM_BUFFER_COUNT; i++) {
+        if (offset + stride * s->roi_h > ctx->camera.cap_buf_size[i]) {
+            return 0;
+        }
+    }
+    ctx->enc_in_offset = offset;
+    return stride;
+#else
+    (void)ctx;
+    return 0;
+#endif
+}
+
+static void stop_rtsp_encoder(uvc_stream_ctx_t *ctx)
+{
+#if CONFIG_UVC_RTSP_CONCURRENT
+    if (ctx->rtsp_encoder) {
+        encoder_stop(ctx->rtsp_encoder);
+        rtsp_server_reset_encoder(ctx->rtsp_encoder);
+        ctx->rtsp_encoder = NULL;
+    }
+#else
+    (void)ctx;
+#endif
+}
+
 /* Forward declaration — on_stream_start may call on_stream_stop for seamless
  * format/resolution switches without an explicit host stop. */
 static void on_stream_stop(void *cb_ctx);
@@ -131,9 +404,12 @@ static void on_stream_stop(void *cb_ctx);
  * Called when the USB host starts video streaming.
  * The host has already negotiated format/frame/fps via VS Probe/Commit.
  *
- * Camera always captures at CAMERA_CAPTURE_WIDTH x CAMERA_CAPTURE_HEIGHT
- * (sensor is fixed). If the negotiated resolution is smaller, we allocate
- * a crop staging buffer and center-crop each frame before encoding/sending.
+ * The camera captures in the smallest sensor mode that covers the
+ * negotiated frame (CONFIG_UVC_SENSOR_MODE_SELECT), falling back to
+ * CAMERA_CAPTURE_WIDTH x CAMERA_CAPTURE_HEIGHT. If the capture is still
+ * larger than the negotiated resolution, we allocate staging buffers and
+ * crop and/or scale each frame before encoding/sending (UVC_FRAME_FIT_*
+ * picks center-crop or full field of view).
  */
 static esp_err_t on_stream_start(uvc_format_t uvc_format, int width, int height, int rate, void *cb_ctx)
 {
@@ -151,48 +427,86 @@ static esp_err_t on_stream_start(uvc_format_t uvc_format, int width, int height,
     ctx->active_format = uvc_format_to_stream_format(uvc_format);
     ctx->negotiated_width = width;
     ctx->negotiated_height = height;
+    ctx->negotiated_fps = rate;
     uint32_t cam_pixfmt = get_camera_pixfmt_for_format(ctx->active_format);
 
-    ESP_LOGI(TAG, "Stream start: %dx%d @%dfps format=%d (capture %dx%d)",
+    uint32_t cap_w = CAMERA_CAPTURE_WIDTH;
+    uint32_t cap_h = CAMERA_CAPTURE_HEIGHT;
+#if CONFIG_UVC_SENSOR_MODE_SELECT
+    uint32_t need_w = width;
+    uint32_t need_h = height;
+#if CONFIG_UVC_RTSP_CONCURRENT
+    /* The RTSP encoder takes whole capture frames at the RTSP resolution,
+     * so the capture must cover it whatever the USB host negotiated */
+    need_w = need_w > RTSP_STREAM_WIDTH ? need_w : RTSP_STREAM_WIDTH;
+    need_h = need_h > RTSP_STREAM_HEIGHT ? need_h : RTSP_STREAM_HEIGHT;
+#endif
+    size_t mode_count;
+    const sensor_mode_t *modes = sensor_modes_get(&mode_count);
+    const sensor_mode_t *mode = sensor_mode_select(modes, mode_count, need_w, need_h, rate);
+    if (mode) {
+        cap_w = mode->width;
+        cap_h = mode->height;
+        ESP_LOGI(TAG, "Sensor mode: %s", mode->name);
+    }
+#endif
+
+    ESP_LOGI(TAG, "Stream start: %dx%d @%dfps format=%d (capture %lux%lu)",
              width, height, rate, ctx->active_format,
-             CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT);
+             (unsigned long)cap_w, (unsigned long)cap_h);
 
     /* Tell RTSP to yield camera/encoder if self-capturing */
     rtsp_server_notify_uvc_start();
 
-    /* Camera always captures at native sensor resolution */
-    esp_err_t ret = camera_start(&ctx->camera, CAMERA_CAPTURE_WIDTH,
-                                  CAMERA_CAPTURE_HEIGHT, cam_pixfmt);
+    esp_err_t ret = camera_start(&ctx->camera, cap_w, cap_h, cam_pixfmt);
+    if (ret != ESP_OK && (cap_w != CAMERA_CAPTURE_WIDTH || cap_h != CAMERA_CAPTURE_HEIGHT)) {
+        /* Mode not switchable at runtime: native resolution always works */
+        ESP_LOGW(TAG, "Capture at %lux%lu failed, falling back to %dx%d",
+                 (unsigned long)cap_w, (unsigned long)cap_h,
+                 CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT);
+        camera_stop(&ctx->camera);
+        ret = camera_start(&ctx->camera, CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT, cam_pixfmt);
+    }
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Camera start failed");
         return ret;
     }
+    /* The driver may adjust the size; everything below uses what it chose */
+    cap_w = ctx->camera.width;
+    cap_h = ctx->camera.height;
+
+    /* Plan crop/scale; raw UYVY may also need conversion from a shared
+     * YUV420 capture */
+    uint32_t out_pixfmt = (ctx->active_format == STREAM_FORMAT_YUY2) ?
+                          V4L2_PIX_FMT_UYVY : cam_pixfmt;
+    ret = frame_scaler_init(&ctx->scaler, cam_pixfmt, cap_w, cap_h,
+                            out_pixfmt, width, height, UVC_FRAME_KEEP_FOV, UVC_FRAME_SCALE_FILTER);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Frame scaler init failed");
+        camera_stop(&ctx->camera);
+        return ret;
+    }
 
-    /* Allocate crop buffer if negotiated resolution differs from capture */
-    bool needs_crop = (width != CAMERA_CAPTURE_WIDTH || height != CAMERA_CAPTURE_HEIGHT);
-    if (needs_crop) {
-        if (cam_pixfmt == V4L2_PIX_FMT_YUV420) {
-            ctx->crop_buf_size = width * height * 3 / 2;
-        } else {
-            ctx->crop_buf_size = width * height * 2;
-        }
-        ctx->crop_buf = heap_caps_aligned_alloc(64, ctx->crop_buf_size,
-                                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (!ctx->crop_buf) {
-            ESP_LOGE(TAG, "Failed to allocate crop buffer (%lu bytes)",
-                     (unsigned long)ctx->crop_buf_size);
-            camera_stop(&ctx->camera);
-            return ESP_ERR_NO_MEM;
+    /*
+     * Allocate staging buffers unless capture frames can be used as-is, or
+     * the encoder can read a pure crop window in place (decided once the
+     * encoder has accepted the stride).
+     */
+    uint32_t enc_stride = (ctx->active_format == STREAM_FORMAT_YUY2) ? 0 : strided_crop_stride(ctx);
+    /* Encoders consume the staging buffer synchronously, so one suffices */
+    uint32_t crop_count = (ctx->active_format == STREAM_FORMAT_YUY2) ? STREAM_CROP_BUF_COUNT : 1;
+    if (!frame_scaler_is_passthrough(&ctx->scaler) && !enc_stride) {
+        ret = alloc_crop_bufs(ctx, crop_count);
+        if (ret != ESP_OK) {
+            goto err_encoder;
         }
-        ESP_LOGI(TAG, "Crop buffer: %lu bytes (center-crop from %dx%d to %dx%d)",
-                 (unsigned long)ctx->crop_buf_size,
-                 CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT, width, height);
     }
 
     /* Start the appropriate encoder (skip for UYVY - no encoding) */
     ctx->active_encoder = NULL;
     switch (ctx->active_format) {
     case STREAM_FORMAT_MJPEG:
+        ctx->jpeg_enc.input_bytesperline = enc_stride;
         ret = encoder_start(&ctx->jpeg_enc, width, height, cam_pixfmt);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "JPEG encoder start failed");
@@ -201,6 +515,7 @@ static esp_err_t on_stream_start(uvc_format_t uvc_format, int width, int height,
         ctx->active_encoder = &ctx->jpeg_enc;
         break;
     case STREAM_FORMAT_H264:
+        ctx->h264_enc.input_bytesperline = enc_stride;
         ret = encoder_start(&ctx->h264_enc, width, height, cam_pixfmt);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "H.264 encoder start failed");
@@ -213,15 +528,73 @@ static esp_err_t on_stream_start(uvc_format_t uvc_format, int width, int height,
         break;
     }
 
+    if (enc_stride) {
+        if (ctx->active_encoder->input_bytesperline == enc_stride) {
+            ctx->enc_in_strided = true;
+            ESP_LOGI(TAG, "Strided crop: %lux%lu window at +%lu, no staging copy",
+                     (unsigned long)ctx->scaler.roi_w, (unsigned long)ctx->scaler.roi_h,
+                     (unsigned long)ctx->enc_in_offset);
+        } else {
+            /* Driver kept packed input: crop through a staging buffer */
+            ctx->enc_in_offset = 0;
+            ret = alloc_crop_bufs(ctx, crop_count);
+            if (ret != ESP_OK) {
+                encoder_stop(ctx->active_encoder);
+                ctx->active_encoder = NULL;
+                goto err_encoder;
+            }
+        }
+    }
+
+#if CONFIG_UVC_RTSP_CONCURRENT
+    /*
+     * Second encoder: H.264 for RTSP alongside MJPEG/UYVY, at the RTSP
+     * resolution regardless of the USB format.  It reads capture frames
+     * as-is, so it only runs when the capture matches that resolution.
+     */
+    ctx->rtsp_encoder = NULL;
+    if (ctx->active_format != STREAM_FORMAT_H264 &&
+        (cap_w != RTSP_STREAM_WIDTH || cap_h != RTSP_STREAM_HEIGHT)) {
+        ESP_LOGW(TAG, "Capture %lux%lu is not the RTSP resolution %dx%d, USB only",
+                 (unsigned long)cap_w, (unsigned long)cap_h,
+                 RTSP_STREAM_WIDTH, RTSP_STREAM_HEIGHT);
+    } else if (ctx->active_format != STREAM_FORMAT_H264) {
+        rtsp_server_config_encoder(&ctx->h264_enc);
+        if (encoder_start(&ctx->h264_enc, RTSP_STREAM_WIDTH, RTSP_STREAM_HEIGHT,
+                          cam_pixfmt) == ESP_OK) {
+            ctx->rtsp_encoder = &ctx->h264_enc;
+        } else {
+            /* USB keeps streaming; RTSP just gets no frames */
+            ESP_LOGW(TAG, "RTSP H.264 encoder start failed, USB only");
+        }
+    }
+#endif
+
     ctx->streaming = true;
+
+#if CONFIG_UVC_PRODUCER_TASK
+    ctx->producer_run = true;
+    xSemaphoreTake(ctx->producer_done, 0);
+    BaseType_t core_id = (CONFIG_UVC_PRODUCER_TASK_CORE < 0) ?
+                         tskNO_AFFINITY : CONFIG_UVC_PRODUCER_TASK_CORE;
+    if (xTaskCreatePinnedToCore(producer_task, "uvc_producer", 4096, ctx,
+                                CONFIG_UVC_PRODUCER_TASK_PRIORITY, NULL, core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Producer task create failed");
+        ctx->producer_run = false;
+        ctx->streaming = false;
+        ret = ESP_ERR_NO_MEM;
+        if (ctx->active_encoder) {
+            encoder_stop(ctx->active_encoder);
+            ctx->active_encoder = NULL;
+        }
+        stop_rtsp_encoder(ctx);
+        goto err_encoder;
+    }
+#endif
     return ESP_OK;
 
 err_encoder:
-    if (ctx->crop_buf) {
-        free(ctx->crop_buf);
-        ctx->crop_buf = NULL;
-        ctx->crop_buf_size = 0;
-    }
+    free_crop_bufs(ctx);
     camera_stop(&ctx->camera);
     return ret;
 }
@@ -233,17 +606,33 @@ static void on_stream_stop(void *cb_ctx)
     ESP_LOGI(TAG, "Stream stop");
     ctx->streaming = false;
 
+#if CONFIG_UVC_PRODUCER_TASK
+    /* Producer finishes its current frame (at most one sensor period) */
+    if (ctx->producer_run) {
+        ctx->producer_run = false;
+        if (xSemaphoreTake(ctx->producer_done, pdMS_TO_TICKS(1000)) != pdTRUE) {
+            ESP_LOGW(TAG, "Producer task did not stop in time");
+        }
+    }
+    /* Queued frames still hold camera/encoder/crop buffers.  The UVC
+     * component runs stop_cb in the task that calls fb_get (or after that
+     * task has exited), so this flush never races on_fb_get's pop. */
+    frame_ring_flush(&ctx->ring);
+#endif
+
+    /* RTP may still be sending from an encoder buffer: the flush returns
+     * once it has let go of every frame, so the buffers can be unmapped.
+     * Late releases are ignored by generation. */
+    frame_bus_flush();
+
     if (ctx->active_encoder) {
         encoder_stop(ctx->active_encoder);
         ctx->active_encoder = NULL;
     }
+    stop_rtsp_encoder(ctx);
     camera_stop(&ctx->camera);
 
-    if (ctx->crop_buf) {
-        free(ctx->crop_buf);
-        ctx->crop_buf = NULL;
-        ctx->crop_buf_size = 0;
-    }
+    free_crop_bufs(ctx);
 
     /* Tell RTSP it can resume self-capture */
     rtsp_server_notify_uvc_stop();
@@ -253,134 +642,55 @@ static void on_stream_stop(void *cb_ctx)
  * Called by TinyUSB when the host wants the next frame.
  * This is the hot path - called at frame rate.
  *
- * Pipeline:
- *   1. Dequeue raw frame from camera (always CAMERA_CAPTURE_* resolution)
- *   2. If negotiated resolution < capture: center-crop into staging buffer
- *   3. If encoded format: feed through HW encoder, get compressed output
- *      If UYVY raw: use frame directly (or cropped buffer)
- *   4. Fill uvc_fb_t and return it
+ * With the producer task this is only a pop from the frame ring; without
+ * it the whole capture/crop/encode pipeline runs here, in the USB task.
  */
 static uvc_fb_t *on_fb_get(void *cb_ctx)
 {
     uvc_stream_ctx_t *ctx = (uvc_stream_ctx_t *)cb_ctx;
-    uint32_t buf_idx, bytesused;
-
-    /* 1. Capture a frame from camera */
-    if (camera_dequeue(&ctx->camera, &buf_idx, &bytesused) != ESP_OK) {
-        ESP_LOGE(TAG, "Camera dequeue failed");
-        return NULL;
-    }
-
-    uint8_t *raw_data = ctx->camera.cap_buffer[buf_idx];
-    uint32_t raw_len = bytesused;
-
-    /* 2. Center-crop if negotiated resolution < capture resolution */
-    if (ctx->crop_buf) {
-        if (ctx->active_format == STREAM_FORMAT_H264) {
-            center_crop_yuv420(raw_data, CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT,
-                               ctx->crop_buf, ctx->negotiated_width, ctx->negotiated_height);
-            raw_len = ctx->negotiated_width * ctx->negotiated_height * 3 / 2;
-        } else {
-            center_crop_uyvy(raw_data, CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT,
-                             ctx->crop_buf, ctx->negotiated_width, ctx->negotiated_height);
-            raw_len = ctx->negotiated_width * ctx->negotiated_height * 2;
-        }
-        raw_data = ctx->crop_buf;
-        /* Flush CPU cache to PSRAM so encoder/USB DMA sees the cropped data */
-        esp_cache_msync(ctx->crop_buf, (raw_len + 63) & ~63,
-                        ESP_CACHE_MSYNC_FLAG_DIR_C2M);
-        /* Camera buffer can be re-queued immediately since we copied data */
-        camera_enqueue(&ctx->camera, buf_idx);
-        buf_idx = UINT32_MAX;  /* Sentinel: already re-queued */
-    }
-
-    /* 3. Encode if needed */
-    uint8_t *frame_data = raw_data;
-    uint32_t frame_len = raw_len;
+    stream_frame_t *frame = &ctx->out_frame[ctx->out_frame_next];
 
-    if (ctx->active_encoder) {
-        uint8_t *enc_buf;
-        uint32_t enc_len;
-        if (encoder_encode(ctx->active_encoder, raw_data, raw_len,
-                           &enc_buf, &enc_len) != ESP_OK) {
-            ESP_LOGE(TAG, "Encode failed");
-            if (buf_idx != UINT32_MAX) {
-                camera_enqueue(&ctx->camera, buf_idx);
-            }
+#if CONFIG_UVC_PRODUCER_TASK
+    /* Two frame periods cover normal producer jitter */
+    TickType_t wait = pdMS_TO_TICKS(2000 / (ctx->negotiated_fps ? ctx->negotiated_fps : 30));
+    while (!frame_ring_pop(&ctx->ring, frame)) {
+        if (xSemaphoreTake(ctx->frame_avail, wait) != pdTRUE) {
             return NULL;
         }
-        /* Re-queue camera buffer since encoder has consumed it */
-        if (buf_idx != UINT32_MAX) {
-            camera_enqueue(&ctx->camera, buf_idx);
-        }
-        frame_data = enc_buf;
-        frame_len = enc_len;
-    } else if (buf_idx != UINT32_MAX) {
-        /*
-         * UYVY raw, no crop: hold camera buffer until fb_return.
-         * Store the index so fb_return knows which buffer to release.
-         */
-        ctx->pending_cam_buf_idx = buf_idx;
-    }
-    /* else: UYVY raw with crop — data is in crop_buf, camera already re-queued */
-
-    /* 3b. Feed H.264 frame to RTSP/RTP server (non-blocking copy) */
-    if (ctx->active_format == STREAM_FORMAT_H264 && frame_len > 0) {
-        rtsp_server_feed_h264(frame_data, frame_len);
     }
-
-    /* 4. Fill the UVC frame buffer */
-    ctx->fb.buf    = frame_data;
-    ctx->fb.len    = frame_len;
-    ctx->fb.width  = ctx->negotiated_width;
-    ctx->fb.height = ctx->negotiated_height;
-
-    switch (ctx->active_format) {
-    case STREAM_FORMAT_MJPEG:
-        ctx->fb.format = UVC_FORMAT_JPEG;
-        break;
-    case STREAM_FORMAT_H264:
-        ctx->fb.format = UVC_FORMAT_H264;
-        break;
-    case STREAM_FORMAT_YUY2:
-        ctx->fb.format = UVC_FORMAT_UNCOMPR;
-        break;
+#else
+    if (capture_frame(ctx, frame) != ESP_OK) {
+        return NULL;
     }
+#endif
 
-    int64_t us = esp_timer_get_time();
-    ctx->fb.timestamp.tv_sec  = us / 1000000UL;
-    ctx->fb.timestamp.tv_usec = us % 1000000UL;
+    ctx->out_frame_next = (ctx->out_frame_next + 1) % UVC_XFER_BUFFER_COUNT;
 
     /* Update performance counters */
     ctx->perf_frame_count++;
-    ctx->perf_byte_count += frame_len;
+    ctx->perf_byte_count += frame->fb.len;
 
-    return &ctx->fb;
+    return &frame->fb;
 }
 
 /*
- * Called after the USB stack has transmitted the frame.
- * For encoded formats, re-queue the encoder's capture buffer.
- * For UYVY raw without crop, re-queue the camera buffer we held.
- * For UYVY raw with crop, nothing to do (camera buffer already re-queued).
+ * Called after the USB stack has transmitted the frame (zero-copy), or
+ * right after it was copied into the UVC transfer buffer (copy path).
+ * Releases whatever the frame holds: encoder capture buffer, camera buffer
+ * (raw UYVY without crop) or crop buffer (raw UYVY with crop).
  */
 static void on_fb_return(uvc_fb_t *fb, void *cb_ctx)
 {
     uvc_stream_ctx_t *ctx = (uvc_stream_ctx_t *)cb_ctx;
+    stream_frame_t *frame = (stream_frame_t *)fb;
 
-    if (ctx->active_encoder) {
-        /* Re-queue encoder capture buffer for next encode */
-        struct v4l2_buffer buf = {
-            .index  = 0,
-            .type   = V4L2_BUF_TYPE_VIDEO_CAPTURE,
-            .memory = V4L2_MEMORY_MMAP,
-        };
-        ioctl(ctx->active_encoder->m2m_fd, VIDIOC_QBUF, &buf);
-    } else if (!ctx->crop_buf) {
-        /* UYVY raw without crop: release the held camera buffer */
-        camera_enqueue(&ctx->camera, ctx->pending_cam_buf_idx);
-    }
-    /* UYVY raw with crop: camera buffer was already re-queued in on_fb_get */
+    /* After stream stop the camera/crop buffers have been reclaimed, but the
+     * encoded-frame reference must still be dropped */
+    if (!ctx->streaming) {
+        frame->cam_buf_idx = STREAM_BUF_NONE;
+        frame->crop_buf_idx = STREAM_BUF_NONE;
+    }
+    release_frame(ctx, frame);
 }
 
 /* ---- Initialization ---------------------------------------------------- */
@@ -398,6 +708,25 @@ esp_err_t uvc_stream_init(uvc_stream_ctx_t *ctx)
     ESP_RETURN_ON_ERROR(encoder_open(&ctx->h264_enc, ENCODER_TYPE_H264),
                         TAG, "H.264 encoder open failed");
 
+    /* Encoded frames are shared with RTP by reference */
+    ESP_RETURN_ON_ERROR(frame_bus_init(), TAG, "Frame bus init failed");
+
+#if CONFIG_UVC_PRODUCER_TASK
+    /* Frame ring between the producer task and fb_get */
+    ESP_RETURN_ON_ERROR(frame_ring_init(&ctx->ring, UVC_FRAME_RING_DEPTH, sizeof(stream_frame_t),
+#if CONFIG_UVC_FRAME_RING_FIFO
+                                        FRAME_RING_POLICY_FIFO,
+#else
+                                        FRAME_RING_POLICY_LATEST,
+#endif
+                                        ring_release_cb, ctx),
+                        TAG, "Frame ring init failed");
+    ctx->frame_avail = xSemaphoreCreateBinary();
+    ctx->producer_done = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(ctx->frame_avail && ctx->producer_done, ESP_ERR_NO_MEM, TAG,
+                        "Semaphore create failed");
+#endif
+
     /* Configure UVC device with our callbacks */
     uvc_device_config_t uvc_config = {
         .start_cb     = on_stream_start,
@@ -408,12 +737,21 @@ esp_err_t uvc_stream_init(uvc_stream_ctx_t *ctx)
     };
 
     /*
-     * UVC transfer buffer — must hold the largest possible frame.
+     * UVC transfer buffers — each must hold the largest possible frame.
      * UYVY 800x800 = 1,280,000 bytes. Compressed frames are always smaller.
+     * With CONFIG_UVC_ZERO_COPY a single slot is only the fallback for
+     * frames that are not DMA-capable; camera/encoder/crop buffers are sent
+     * in place. The copy path needs one slot per in-flight/staged frame.
      */
     uvc_config.uvc_buffer_size = UVC_MAX_FRAME_BUFFER_SIZE;
+#if CONFIG_UVC_ZERO_COPY
+    uvc_config.uvc_buffer_count = 1;
+#else
+    uvc_config.uvc_buffer_count = UVC_XFER_BUFFER_COUNT;
+#endif
     /* 64-byte alignment for L1 cache-line coherency with DWC2 DMA */
-    uvc_config.uvc_buffer = heap_caps_aligned_alloc(64, uvc_config.uvc_buffer_size,
+    uvc_config.uvc_buffer = heap_caps_aligned_alloc(64, (size_t)uvc_config.uvc_buffer_size *
+                                                     uvc_config.uvc_buffer_count,
                                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     ESP_RETURN_ON_FALSE(uvc_config.uvc_buffer, ESP_ERR_NO_MEM, TAG,
                         "Failed to allocate UVC buffer");
@@ -424,7 +762,9 @@ esp_err_t uvc_stream_init(uvc_stream_ctx_t *ctx)
     ESP_LOGI(TAG, "UVC streaming pipeline initialized");
     ESP_LOGI(TAG, "  Formats: UYVY (%d frames), MJPEG (%d frames), H.264 (%d frames)",
              UYVY_FRAME_COUNT, MJPEG_FRAME_COUNT, H264_FRAME_COUNT);
-    ESP_LOGI(TAG, "  UVC buffer: %d bytes", UVC_MAX_FRAME_BUFFER_SIZE);
+    ESP_LOGI(TAG, "  UVC buffer: %lu x %d bytes, %d transfer buffers",
+             (unsigned long)uvc_config.uvc_buffer_count, UVC_MAX_FRAME_BUFFER_SIZE,
+             UVC_XFER_BUFFER_COUNT);
 
     return ESP_OK;
 }
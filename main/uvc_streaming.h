@@ -7,8 +7,14 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "camera_pipeline.h"
 #include "encoder_manager.h"
+#include "frame_ring.h"
+#include "frame_bus.h"
+#include "frame_scaler.h"
 #include "usb_device_uvc.h"
 
 #ifdef __cplusplus
@@ -21,6 +27,31 @@ typedef enum {
     STREAM_FORMAT_H264,
 } stream_format_t;
 
+#if CONFIG_UVC_PRODUCER_TASK
+#define UVC_FRAME_RING_DEPTH    CONFIG_UVC_FRAME_RING_DEPTH
+#else
+#define UVC_FRAME_RING_DEPTH    0
+#endif
+
+/* Frames the UVC device may hold at once (on the wire + staged) */
+#define UVC_XFER_BUFFER_COUNT   CONFIG_UVC_XFER_BUFFER_COUNT
+
+/* Raw cropped frames each own a crop buffer: ring + USB + one being filled */
+#define STREAM_CROP_BUF_COUNT   (UVC_FRAME_RING_DEPTH + UVC_XFER_BUFFER_COUNT + 1)
+
+#define STREAM_BUF_NONE         UINT32_MAX
+
+/*
+ * One produced frame and the hardware buffers it keeps alive until
+ * released (by fb_return, or by the frame ring when it is dropped).
+ */
+typedef struct {
+    uvc_fb_t fb;                /* Must stay first: fb_return hands back &fb */
+    uint32_t cam_buf_idx;       /* Camera buffer held (raw, uncropped), or STREAM_BUF_NONE */
+    frame_buf_t *enc_frame;     /* Reference to the encoded frame, or NULL */
+    uint32_t crop_buf_idx;      /* Crop buffer held (raw, cropped), or STREAM_BUF_NONE */
+} stream_frame_t;
+
 typedef struct {
     /* Camera */
     camera_ctx_t camera;
@@ -37,14 +68,35 @@ typedef struct {
     /* Negotiated resolution (may differ from camera capture resolution) */
     uint16_t negotiated_width;
     uint16_t negotiated_height;
+    uint8_t  negotiated_fps;
 
-    /* Crop staging buffer (allocated when negotiated res < capture res) */
-    uint8_t *crop_buf;
+    /* Crop/scale staging buffers (allocated when negotiated res < capture res).
+     * Encoded formats use only [0] transiently; raw UYVY frames hold one each. */
+    frame_scaler_t scaler;
+    uint8_t *crop_buf[STREAM_CROP_BUF_COUNT];
+    volatile bool crop_buf_busy[STREAM_CROP_BUF_COUNT];
+    uint32_t crop_buf_count;
     uint32_t crop_buf_size;
 
-    /* UVC frame buffer */
-    uvc_fb_t fb;
-    uint32_t pending_cam_buf_idx;  /* Camera buffer held during raw UYVY (no crop) */
+    /* Strided crop: the encoder reads the crop window in place, starting
+     * enc_in_offset bytes into the camera buffer */
+    bool enc_in_strided;
+    uint32_t enc_in_offset;
+
+#if CONFIG_UVC_RTSP_CONCURRENT
+    /* H.264 encoder feeding RTSP while USB streams MJPEG/UYVY, or NULL */
+    encoder_ctx_t *rtsp_encoder;
+#endif
+
+    /* Frames handed to the UVC device, reused in order (returned in order) */
+    stream_frame_t out_frame[UVC_XFER_BUFFER_COUNT];
+    uint32_t out_frame_next;
+
+    /* Producer task: camera -> crop -> encode at sensor rate, into the ring */
+    frame_ring_t ring;
+    SemaphoreHandle_t frame_avail;      /* Given by producer after each push */
+    SemaphoreHandle_t producer_done;    /* Given by producer on exit */
+    volatile bool producer_run;
 
     /* Performance counters (written in hot path, read by perf monitor) */
     volatile uint32_t perf_frame_count;
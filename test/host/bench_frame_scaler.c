@@ -0,0 +1,105 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * ms/frame of frame_scaler_run() from the 1920x1080 capture to every UVC
+ * frame size, per layout, fit and filter.  Built with and without the
+ * SWAR 2:1 pre-pass (bench_frame_scaler_noswar).
+ *
+ *   bench_frame_scaler [--quick]
+ */
+
+#include "sdkconfig.h"
+#include "host_test.h"
+#include "frame_scaler.h"
+#include "linux/videodev2.h"
+#include "uvc_frame_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+static void bench(uint32_t in_fmt, uint32_t out_fmt, uint32_t dw, uint32_t dh,
+                  bool keep_fov, frame_scale_filter_t filter, int iters,
+                  const uint8_t *src, uint8_t *dst)
+{
+    frame_scaler_t s;
+    if (frame_scaler_init(&s, in_fmt, CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT,
+                          out_fmt, dw, dh, keep_fov, filter) != ESP_OK) {
+        return;
+    }
+    if (keep_fov && s.fit < FRAME_FIT_SCALE) {
+        frame_scaler_deinit(&s);        /* Same as the crop-only run */
+        return;
+    }
+    frame_scaler_run(&s, src, dst);     /* Warm caches */
+
+    double t0 = host_now_ms();
+    for (int i = 0; i < iters; i++) {
+        frame_scaler_run(&s, src, dst);
+    }
+    double ms = (host_now_ms() - t0) / iters;
+
+    printf("%-4s -> %-4s %4lux%-4lu  %-10s %-8s %s %8.3f ms/frame\n",
+           in_fmt == V4L2_PIX_FMT_UYVY ? "UYVY" : "I420",
+           out_fmt == V4L2_PIX_FMT_UYVY ? "UYVY" : "I420",
+           (unsigned long)dw, (unsigned long)dh, frame_fit_name(s.fit),
+           s.fit >= FRAME_FIT_SCALE ? (filter == FRAME_SCALE_BOX ? "box" : "bilinear") : "-",
+           s.scratch ? "swar" : "    ", ms);
+    frame_scaler_deinit(&s);
+}
+
+int main(int argc, char **argv)
+{
+    int iters = (argc > 1 && strcmp(argv[1], "--quick") == 0) ? 1 : 20;
+
+    size_t cap = CAMERA_CAPTURE_WIDTH * CAMERA_CAPTURE_HEIGHT * 2;
+    uint8_t *src = malloc(cap);
+    uint8_t *dst = malloc(cap);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < cap; i++) {
+        src[i] = (uint8_t)host_rand(&seed);
+    }
+
+    printf("capture %dx%d, SWAR pre-pass %s, %d iteration(s)\n",
+           CAMERA_CAPTURE_WIDTH, CAMERA_CAPTURE_HEIGHT,
+           CONFIG_UVC_SCALE_SWAR ? "on" : "off", iters);
+
+    /* Raw UYVY sessions, from UYVY or (concurrent RTSP) YUV420 capture */
+    for (int f = 0; f < UYVY_FRAME_COUNT; f++) {
+        const uvc_frame_info_t *fi = &uvc_uyvy_frames[f];
+        bench(V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_UYVY, fi->width, fi->height, false,
+              FRAME_SCALE_BOX, iters, src, dst);
+        for (int filter = FRAME_SCALE_BOX; filter <= FRAME_SCALE_BILINEAR; filter++) {
+            bench(V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_UYVY, fi->width, fi->height, true,
+                  (frame_scale_filter_t)filter, iters, src, dst);
+            bench(V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_UYVY, fi->width, fi->height, true,
+                  (frame_scale_filter_t)filter, iters, src, dst);
+        }
+    }
+
+    /* Encoder input (MJPEG from UYVY, H.264 from I420) */
+    for (int f = 0; f < MJPEG_FRAME_COUNT; f++) {
+        const uvc_frame_info_t *fi = &uvc_mjpeg_frames[f];
+        bench(V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_UYVY, fi->width, fi->height, false,
+              FRAME_SCALE_BOX, iters, src, dst);
+        for (int filter = FRAME_SCALE_BOX; filter <= FRAME_SCALE_BILINEAR; filter++) {
+            bench(V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_UYVY, fi->width, fi->height, true,
+                  (frame_scale_filter_t)filter, iters, src, dst);
+        }
+    }
+    for (int f = 0; f < H264_FRAME_COUNT; f++) {
+        const uvc_frame_info_t *fi = &uvc_h264_frames[f];
+        bench(V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, fi->width, fi->height, false,
+              FRAME_SCALE_BOX, iters, src, dst);
+        for (int filter = FRAME_SCALE_BOX; filter <= FRAME_SCALE_BILINEAR; filter++) {
+            bench(V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_YUV420, fi->width, fi->height, true,
+                  (frame_scale_filter_t)filter, iters, src, dst);
+        }
+    }
+
+    free(src);
+    free(dst);
+    return 0;
+}
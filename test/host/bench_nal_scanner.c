@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Throughput of nal_index_build() against the byte-by-byte reference on
+ * synthetic 1080p IDR / P frames and, when given, real encoder output.
+ *
+ *   bench_nal_scanner [--quick] [capture.h264 ...]
+ */
+
+#include "nal_reference.h"
+
+static nal_index_t s_idx;
+static ref_index_t s_ref;
+
+static void bench(const char *what, const uint8_t *data, size_t len, int iters)
+{
+    double t0 = host_now_ms();
+    for (int i = 0; i < iters; i++) {
+        nal_index_build(&s_idx, data, len);
+    }
+    double word_ms = (host_now_ms() - t0) / iters;
+
+    t0 = host_now_ms();
+    for (int i = 0; i < iters; i++) {
+        ref_index_build(&s_ref, data, len);
+    }
+    double ref_ms = (host_now_ms() - t0) / iters;
+
+    printf("%-22s %8zu bytes %4zu NALs  word %8.1f MB/s  bytewise %8.1f MB/s  x%.1f\n",
+           what, len, s_idx.count,
+           len / 1e3 / (word_ms > 0 ? word_ms : 1e-9),
+           len / 1e3 / (ref_ms > 0 ? ref_ms : 1e-9),
+           word_ms > 0 ? ref_ms / word_ms : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    int iters = 200;
+    int first_file = 1;
+    if (argc > 1 && strcmp(argv[1], "--quick") == 0) {
+        iters = 2;
+        first_file = 2;
+    }
+
+    static uint8_t frame[1024 * 1024];
+    static const struct {
+        const char *name;
+        bool idr;
+        size_t bytes;
+        int slices;
+        int zero_bias;
+    } cases[] = {
+        { "IDR 250 KB",          true,  250000, 1, 2 },
+        { "IDR 250 KB 4 slices", true,  250000, 4, 2 },
+        { "P 30 KB",             false,  30000, 1, 2 },
+        { "P 30 KB zero-heavy",  false,  30000, 1, 25 },
+        { "P 2 KB",              false,   2000, 1, 2 },
+    };
+
+    uint32_t seed = 1;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        size_t len = gen_frame(frame, sizeof(frame), cases[c].idr, cases[c].bytes,
+                               cases[c].slices, cases[c].zero_bias, &seed);
+        bench(cases[c].name, frame, len, iters);
+    }
+
+    for (int i = first_file; i < argc; i++) {
+        size_t len;
+        uint8_t *data = load_file(argv[i], &len);
+        if (!data) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            continue;
+        }
+        bench(argv[i], data, len, iters / 10 + 1);
+        free(data);
+    }
+    nal_index_free(&s_idx);
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Throughput of rtsp_parse() on a pipelined control stream: typical
+ * requests, and interleaved RTCP reports among them as a TCP client sends
+ * them.  The stream is parsed as one read and in small reads, where the
+ * parser resumes its search instead of rescanning.
+ *
+ *   bench_rtsp_parser [--quick]
+ */
+
+#include "host_test.h"
+#include "rtsp_parser.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+static const char s_play[] =
+    "PLAY rtsp://192.168.1.10:554/stream RTSP/1.0\r\n"
+    "CSeq: 5\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Session: 1A2B3C4D\r\n"
+    "Range: npt=0.000-\r\n"
+    "\r\n";
+
+static const char s_setup[] =
+    "SETUP rtsp://192.168.1.10:554/stream/track1 RTSP/1.0\r\n"
+    "CSeq: 3\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+    "\r\n";
+
+/* Receiver report with a generic NACK, interleaved on channel 1 */
+static const uint8_t s_rtcp[] = {
+    '$', 0x01, 0x00, 0x30,
+    0x81, 0xc9, 0x00, 0x07, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0,
+    0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x12, 0x34, 0x00, 0x00, 0x00, 0x10,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x81, 0xcd, 0x00, 0x03, 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0,
+    0x12, 0x30, 0x00, 0x05,
+};
+
+/* Fill out with the chosen messages in turn; *msgs counts them */
+static size_t build(char *out, size_t cap, bool requests, bool frames, int *msgs)
+{
+    size_t len = 0;
+    *msgs = 0;
+    for (int i = 0; ; i++) {
+        const void *m;
+        size_t n;
+        if (requests && (!frames || i % 4 == 0)) {
+            m = (i / 4) % 2 ? s_play : s_setup;
+            n = strlen(m);
+        } else {
+            m = s_rtcp;
+            n = sizeof(s_rtcp);
+        }
+        if (len + n > cap) {
+            return len;
+        }
+        memcpy(out + len, m, n);
+        len += n;
+        (*msgs)++;
+    }
+}
+
+/* Parse the stream in reads of chunk bytes (0 = all at once); messages parsed */
+static int parse_stream(const char *data, size_t len, size_t chunk)
+{
+    rtsp_parser_t p;
+    rtsp_parser_reset(&p);
+    rtsp_request_t req;
+    rtsp_frame_t frame;
+    size_t head = 0, avail = 0, used;
+    int msgs = 0;
+
+    while (avail < len) {
+        avail = chunk && avail + chunk < len ? avail + chunk : len;
+        for (;;) {
+            rtsp_parse_result_t res = rtsp_parse(&p, data + head, avail - head,
+                                                 &req, &frame, &used);
+            if (res == RTSP_PARSE_NEED_MORE) {
+                break;
+            }
+            if (res == RTSP_PARSE_ERROR) {
+                return -1;
+            }
+            head += used;
+            msgs++;
+        }
+    }
+    return msgs;
+}
+
+static bool bench(const char *what, const char *data, size_t len, int want, size_t chunk,
+                  int iters)
+{
+    int got = 0;
+    double t0 = host_now_ms();
+    for (int i = 0; i < iters; i++) {
+        got = parse_stream(data, len, chunk);
+    }
+    double ms = (host_now_ms() - t0) / iters;
+    if (got != want) {
+        fprintf(stderr, "%s: parsed %d of %d messages\n", what, got, want);
+        return false;
+    }
+    if (ms <= 0) {
+        ms = 1e-9;
+    }
+    printf("%-30s %7zu bytes %5d msgs  %8.1f MB/s  %6.2f M msgs/s\n",
+           what, len, want, len / 1e3 / ms, want / 1e3 / ms);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int iters = 500;
+    if (argc > 1 && strcmp(argv[1], "--quick") == 0) {
+        iters = 2;
+    }
+
+    static char stream[256 * 1024];
+    bool ok = true;
+    static const struct {
+        const char *name;
+        bool requests;
+        bool frames;
+        size_t chunk;
+    } cases[] = {
+        { "requests, one read",         true,  false, 0 },
+        { "requests, 64-byte reads",    true,  false, 64 },
+        { "requests, 8-byte reads",     true,  false, 8 },
+        { "RTCP frames, one read",      false, true,  0 },
+        { "mixed, one read",            true,  true,  0 },
+        { "mixed, 1460-byte reads",     true,  true,  1460 },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        int msgs;
+        size_t len = build(stream, sizeof(stream), cases[c].requests, cases[c].frames, &msgs);
+        ok &= bench(cases[c].name, stream, len, msgs, cases[c].chunk, iters);
+    }
+    return ok ? 0 : 1;
+}
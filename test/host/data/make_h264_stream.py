@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+# SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+"""Write the H.264 Annex-B stream test_nal_scanner replays in CI.
+
+A real encoder is not at hand on a CI host, so this builds a short
+Baseline-profile stream laid out the way encoder output is: SPS and PPS
+ahead of every IDR, IDR pictures in two slices, P pictures with skipped
+and coded macroblocks, four-byte start codes at access unit starts and
+three-byte ones between slices, a trailing zero byte after each access
+unit.  Macroblocks are coded as I_PCM, whose raw samples include runs of
+zeros, so the payload carries emulation prevention bytes the way CAVLC
+and CABAC output does.
+
+To replay a capture from the device instead, see "Host Tests" in
+README.md.
+
+    make_h264_stream.py [output]    (default: stream_96x64.h264 here)
+"""
+
+import os
+import sys
+
+WIDTH_MBS = 6       # 96 x 64
+HEIGHT_MBS = 4
+GOP = 8
+GOPS = 2
+LOG2_MAX_FRAME_NUM = 4
+
+NAL_SLICE = 1
+NAL_IDR = 5
+NAL_SPS = 7
+NAL_PPS = 8
+
+SLICE_P = 5         # slice_type values meaning "all slices of the picture"
+SLICE_I = 7
+MB_I_PCM_IN_I = 25
+MB_I_PCM_IN_P = 5 + 25
+
+
+class BitWriter:
+    def __init__(self):
+        self.bits = []
+
+    def u(self, n, value):
+        for i in range(n - 1, -1, -1):
+            self.bits.append((value >> i) & 1)
+
+    def ue(self, value):
+        v = value + 1
+        n = v.bit_length()
+        self.u(n - 1, 0)
+        self.u(n, v)
+
+    def se(self, value):
+        self.ue(2 * value - 1 if value > 0 else -2 * value)
+
+    def align_zero(self):
+        while len(self.bits) % 8:
+            self.bits.append(0)
+
+    def trailing(self):
+        self.bits.append(1)
+        self.align_zero()
+
+    def raw(self, data):
+        assert len(self.bits) % 8 == 0
+        for byte in data:
+            self.u(8, byte)
+
+    def rbsp(self):
+        assert len(self.bits) % 8 == 0
+        out = bytearray()
+        for i in range(0, len(self.bits), 8):
+            byte = 0
+            for bit in self.bits[i:i + 8]:
+                byte = byte << 1 | bit
+            out.append(byte)
+        return bytes(out)
+
+
+def escape(rbsp):
+    """RBSP to NAL payload: 0x03 after two zeros ahead of a byte <= 3."""
+    out = bytearray()
+    zeros = 0
+    for byte in rbsp:
+        if zeros >= 2 and byte <= 3:
+            out.append(3)
+            zeros = 0
+        out.append(byte)
+        zeros = zeros + 1 if byte == 0 else 0
+    return bytes(out)
+
+
+def nal(ref_idc, nal_type, bw):
+    return bytes([ref_idc << 5 | nal_type]) + escape(bw.rbsp())
+
+
+def sps():
+    bw = BitWriter()
+    bw.u(8, 66)                 # profile_idc: Baseline
+    bw.u(8, 0xC0)               # constraint_set0/1
+    bw.u(8, 30)                 # level_idc 3.0
+    bw.ue(0)                    # seq_parameter_set_id
+    bw.ue(LOG2_MAX_FRAME_NUM - 4)
+    bw.ue(2)                    # pic_order_cnt_type
+    bw.ue(1)                    # max_num_ref_frames
+    bw.u(1, 0)                  # gaps_in_frame_num_value_allowed_flag
+    bw.ue(WIDTH_MBS - 1)
+    bw.ue(HEIGHT_MBS - 1)
+    bw.u(1, 1)                  # frame_mbs_only_flag
+    bw.u(1, 1)                  # direct_8x8_inference_flag
+    bw.u(1, 0)                  # frame_cropping_flag
+    bw.u(1, 0)                  # vui_parameters_present_flag
+    bw.trailing()
+    return nal(3, NAL_SPS, bw)
+
+
+def pps():
+    bw = BitWriter()
+    bw.ue(0)                    # pic_parameter_set_id
+    bw.ue(0)                    # seq_parameter_set_id
+    bw.u(1, 0)                  # entropy_coding_mode_flag: CAVLC
+    bw.u(1, 0)                  # bottom_field_pic_order_in_frame_present_flag
+    bw.ue(0)                    # num_slice_groups_minus1
+    bw.ue(0)                    # num_ref_idx_l0_default_active_minus1
+    bw.ue(0)                    # num_ref_idx_l1_default_active_minus1
+    bw.u(1, 0)                  # weighted_pred_flag
+    bw.u(2, 0)                  # weighted_bipred_idc
+    bw.se(0)                    # pic_init_qp_minus26
+    bw.se(0)                    # pic_init_qs_minus26
+    bw.se(0)                    # chroma_qp_index_offset
+    bw.u(1, 1)                  # deblocking_filter_control_present_flag
+    bw.u(1, 0)                  # constrained_intra_pred_flag
+    bw.u(1, 0)                  # redundant_pic_cnt_present_flag
+    bw.trailing()
+    return nal(3, NAL_PPS, bw)
+
+
+def pcm_samples(frame, mb):
+    """A moving gradient with a black bar sweeping across: zero runs."""
+    mb_x, mb_y = mb % WIDTH_MBS, mb // WIDTH_MBS
+    dark = mb_x == frame % WIDTH_MBS
+    luma = bytearray()
+    for y in range(16):
+        for x in range(16):
+            px, py = mb_x * 16 + x, mb_y * 16 + y
+            luma.append(0 if dark and 6 <= y < 9 else (px * 2 + py * 3 + frame * 5) & 0xFF)
+    return bytes(luma) + bytes([128]) * 128
+
+
+def pcm_macroblock(bw, mb_type, frame, mb):
+    bw.ue(mb_type)
+    bw.align_zero()             # pcm_alignment_zero_bit
+    bw.raw(pcm_samples(frame, mb))
+
+
+def idr_slice(idr_id, first_mb, last_mb, frame):
+    bw = BitWriter()
+    bw.ue(first_mb)
+    bw.ue(SLICE_I)
+    bw.ue(0)                    # pic_parameter_set_id
+    bw.u(LOG2_MAX_FRAME_NUM, 0)  # frame_num
+    bw.ue(idr_id)
+    bw.u(1, 0)                  # no_output_of_prior_pics_flag
+    bw.u(1, 0)                  # long_term_reference_flag
+    bw.se(0)                    # slice_qp_delta
+    bw.ue(1)                    # disable_deblocking_filter_idc
+    for mb in range(first_mb, last_mb):
+        pcm_macroblock(bw, MB_I_PCM_IN_I, frame, mb)
+    bw.trailing()
+    return nal(3, NAL_IDR, bw)
+
+
+def p_slice(frame_num, frame, coded):
+    bw = BitWriter()
+    bw.ue(0)                    # first_mb_in_slice
+    bw.ue(SLICE_P)
+    bw.ue(0)                    # pic_parameter_set_id
+    bw.u(LOG2_MAX_FRAME_NUM, frame_num)
+    bw.u(1, 0)                  # num_ref_idx_active_override_flag
+    bw.u(1, 0)                  # ref_pic_list_modification_flag_l0
+    bw.u(1, 0)                  # adaptive_ref_pic_marking_mode_flag
+    bw.se(0)                    # slice_qp_delta
+    bw.ue(1)                    # disable_deblocking_filter_idc
+    next_mb = 0
+    for mb in coded:
+        bw.ue(mb - next_mb)     # mb_skip_run
+        pcm_macroblock(bw, MB_I_PCM_IN_P, frame, mb)
+        next_mb = mb + 1
+    if next_mb < WIDTH_MBS * HEIGHT_MBS:
+        bw.ue(WIDTH_MBS * HEIGHT_MBS - next_mb)
+    bw.trailing()
+    return nal(2, NAL_SLICE, bw)
+
+
+def stream():
+    sc4 = b"\x00\x00\x00\x01"
+    sc3 = b"\x00\x00\x01"
+    mbs = WIDTH_MBS * HEIGHT_MBS
+    out = bytearray()
+    frame = 0
+    for gop in range(GOPS):
+        half = mbs // 2
+        out += sc4 + sps() + sc4 + pps()
+        out += sc4 + idr_slice(gop, 0, half, frame)
+        out += sc3 + idr_slice(gop, half, mbs, frame)
+        out += b"\x00"          # trailing_zero_8bits
+        frame += 1
+        for n in range(1, GOP):
+            # The column the black bar moved to
+            coded = [y * WIDTH_MBS + frame % WIDTH_MBS for y in range(HEIGHT_MBS)]
+            out += sc4 + p_slice(n % (1 << LOG2_MAX_FRAME_NUM), frame, coded)
+            out += b"\x00"
+            frame += 1
+    return bytes(out)
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else \
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), "stream_96x64.h264")
+    data = stream()
+    with open(path, "wb") as f:
+        f.write(data)
+    print(f"{path}: {len(data)} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Byte-at-a-time Annex-B reference scanner and a synthetic encoder-output
+ * generator, shared by the nal_scanner test and benchmark.
+ */
+
+#pragma once
+
+#include "host_test.h"
+#include "nal_scanner.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REF_MAX_NALS    4096
+
+typedef struct {
+    size_t off[REF_MAX_NALS];   /* NAL header offset in the buffer */
+    size_t len[REF_MAX_NALS];
+    size_t count;
+} ref_index_t;
+
+static size_t ref_find_start_code(const uint8_t *data, size_t pos, size_t len)
+{
+    for (size_t i = pos; i + 3 <= len; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            return i;
+        }
+    }
+    return len;
+}
+
+/* Same NAL boundaries and trailing-zero rule as nal_index_build() */
+static void ref_index_build(ref_index_t *idx, const uint8_t *data, size_t len)
+{
+    idx->count = 0;
+    size_t sc = ref_find_start_code(data, 0, len);
+    while (sc < len) {
+        size_t start = sc + 3;
+        size_t next = ref_find_start_code(data, start, len);
+        size_t end = next;
+        while (end > start && data[end - 1] == 0) {
+            end--;
+        }
+        if (end > start && idx->count < REF_MAX_NALS) {
+            idx->off[idx->count] = start;
+            idx->len[idx->count] = end - start;
+            idx->count++;
+        }
+        sc = next;
+    }
+}
+
+/*
+ * Append one NAL unit with random payload, emulation prevention applied
+ * the way an encoder does (03 inserted after 00 00 ahead of 00..03).
+ * zero_bias makes zero bytes common, as in flat or low-bitrate slices.
+ */
+static size_t gen_nal(uint8_t *out, size_t cap, uint8_t header, size_t payload,
+                      bool long_start_code, int zero_bias, uint32_t *seed)
+{
+    size_t n = 0;
+    if (cap < 5) {
+        return 0;
+    }
+    if (long_start_code) {
+        out[n++] = 0;
+    }
+    out[n++] = 0;
+    out[n++] = 0;
+    out[n++] = 1;
+    out[n++] = header;
+
+    int zeros = 0;
+    for (size_t i = 0; i < payload && n + 2 < cap; i++) {
+        uint32_t r = host_rand(seed);
+        uint8_t b = (int)(r % 100) < zero_bias ? 0 : (uint8_t)(r >> 8);
+        if (zeros >= 2 && b <= 3) {
+            out[n++] = 3;
+            zeros = 0;
+        }
+        out[n++] = b;
+        zeros = b == 0 ? zeros + 1 : 0;
+    }
+    /* A NAL cannot end in 00: rbsp_trailing_bits */
+    if (out[n - 1] == 0) {
+        out[n++] = 0x80;
+    }
+    return n;
+}
+
+/* One access unit: optional AUD/SPS/PPS/SEI, then slices */
+static size_t gen_frame(uint8_t *out, size_t cap, bool idr, size_t bytes, int slices,
+                        int zero_bias, uint32_t *seed)
+{
+    size_t n = 0;
+    n += gen_nal(out + n, cap - n, 0x09, 1, true, 0, seed);               /* AUD */
+    if (idr) {
+        n += gen_nal(out + n, cap - n, 0x67, 12, true, 10, seed);         /* SPS */
+        n += gen_nal(out + n, cap - n, 0x68, 4, true, 10, seed);          /* PPS */
+        n += gen_nal(out + n, cap - n, 0x06, 24, false, 20, seed);        /* SEI */
+    }
+    for (int s = 0; s < slices; s++) {
+        n += gen_nal(out + n, cap - n, idr ? 0x65 : 0x41, bytes / slices, s == 0,
+                     zero_bias, seed);
+    }
+    return n;
+}
+
+/* Read a whole file (an Annex-B capture), or NULL */
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (buf && fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = buf ? (size_t)size : 0;
+    return buf;
+}
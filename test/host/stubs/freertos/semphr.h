@@ -0,0 +1,63 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Host build stand-in for FreeRTOS semaphores: a count, with no waiting.
+ * A take that would block fails at once, since in a single-threaded test
+ * no other task could give.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+#include <stdlib.h>
+
+typedef struct {
+    int count;
+} host_semaphore_t;
+
+typedef host_semaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t host_semaphore_create(int count)
+{
+    SemaphoreHandle_t sem = malloc(sizeof(*sem));
+    if (sem) {
+        sem->count = count;
+    }
+    return sem;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_semaphore_create(1);
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_semaphore_create(0);
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t timeout)
+{
+    (void)timeout;
+    if (sem->count == 0) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem->count > 0) {
+        return pdFALSE;
+    }
+    sem->count++;
+    return pdTRUE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    free(sem);
+}
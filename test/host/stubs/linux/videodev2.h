@@ -0,0 +1,17 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Host build stand-in for the V4L2 pixel format codes.
+ */
+
+#pragma once
+
+#define v4l2_fourcc(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define V4L2_PIX_FMT_UYVY       v4l2_fourcc('U', 'Y', 'V', 'Y')
+#define V4L2_PIX_FMT_YUV420     v4l2_fourcc('Y', 'U', '1', '2')
+#define V4L2_PIX_FMT_JPEG       v4l2_fourcc('J', 'P', 'E', 'G')
+#define V4L2_PIX_FMT_H264       v4l2_fourcc('H', '2', '6', '4')
@@ -0,0 +1,29 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Host build configuration: the project defaults from Kconfig.projbuild
+ * for the options the host-built modules read.  A target may override any
+ * of them with a compile definition.
+ */
+
+#pragma once
+
+#ifndef CONFIG_UVC_SCALE_SWAR
+#define CONFIG_UVC_SCALE_SWAR   1
+#endif
+
+/* OV5647 modes enabled in sdkconfig.defaults */
+#define CONFIG_CAMERA_OV5647_MIPI_RAW10_1920X1080_30FPS         1
+#define CONFIG_CAMERA_OV5647_MIPI_RAW10_1280X960_BINNING_45FPS  1
+#define CONFIG_CAMERA_OV5647_MIPI_RAW8_800X640_50FPS            1
+
+/* RTSP streaming defaults */
+#define CONFIG_RTSP_MAX_CLIENTS             4
+#define CONFIG_RTSP_RTX                     1
+#define CONFIG_RTSP_RTX_HISTORY_KB          512
+#define CONFIG_RTSP_PACER                   1
+#define CONFIG_RTSP_PACER_SPREAD_PERCENT    50
+#define CONFIG_RTSP_PACER_MAX_DELAY_MS      15
+#define CONFIG_RTSP_PACER_MIN_RATE_KBPS     20000
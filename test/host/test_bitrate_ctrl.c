@@ -0,0 +1,354 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * bitrate_ctrl: the controller driven by loss, send-error and drop traces,
+ * and by a simulated link of fixed capacity, checking the AIMD steps,
+ * hysteresis, floor and ceiling, and convergence onto the link rate.
+ */
+
+#include "host_test.h"
+#include "bitrate_ctrl.h"
+
+#define MIN_BPS     1000000
+#define MAX_BPS     10000000
+#define STEP_BPS    (MAX_BPS / 20)      /* Increase step for this ceiling */
+#define HOLD        3                   /* Intervals after a cut with no increase */
+#define CLEAR       3                   /* Clear intervals per increase */
+
+static void init(bitrate_ctrl_t *bc)
+{
+    bitrate_ctrl_config_t cfg = { .min_bps = MIN_BPS, .max_bps = MAX_BPS };
+    bitrate_ctrl_init(bc, &cfg);
+}
+
+static bool step(bitrate_ctrl_t *bc, uint32_t errors, uint32_t drops, int loss_256)
+{
+    bitrate_ctrl_input_t in = {
+        .send_errors = errors,
+        .tcp_drops = drops,
+        .loss_256 = loss_256,
+    };
+    return bitrate_ctrl_update(bc, &in);
+}
+
+/* Clear intervals until the next increase; -1 if none within limit */
+static int intervals_to_increase(bitrate_ctrl_t *bc, int limit)
+{
+    for (int i = 1; i <= limit; i++) {
+        if (step(bc, bc->last_send_errors, bc->last_tcp_drops, -1)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void test_clean_link(void)
+{
+    bitrate_ctrl_t bc;
+    init(&bc);
+    CHECK_EQ(bc.target_bps, MAX_BPS);
+
+    /* Clear intervals at the ceiling never change it */
+    for (int i = 0; i < 100; i++) {
+        CHECK(!step(&bc, 0, 0, i % 2 ? -1 : 2));
+    }
+    CHECK_EQ(bc.target_bps, MAX_BPS);
+    CHECK_EQ(bc.decreases, 0);
+    CHECK_EQ(bc.increases, 0);
+}
+
+static void test_multiplicative_decrease(void)
+{
+    bitrate_ctrl_t bc;
+    init(&bc);
+
+    /* Loss above ~5% cuts by 15% each interval */
+    int expect = MAX_BPS;
+    for (int i = 0; i < 5; i++) {
+        CHECK(step(&bc, 0, 0, 40));
+        expect = (int)((int64_t)expect * 85 / 100);
+        CHECK_EQ(bc.target_bps, expect);
+    }
+    CHECK_EQ(bc.decreases, 5);
+
+    /* 13/256 is the threshold itself: not congested */
+    int before = bc.target_bps;
+    CHECK(!step(&bc, 0, 0, 13));
+    CHECK_EQ(bc.target_bps, before);
+    CHECK(step(&bc, 0, 0, 14));
+    CHECK(bc.target_bps < before);
+}
+
+/* Counters are cumulative: only growth since the last interval counts */
+static void test_send_error_trace(void)
+{
+    static const uint32_t trace[] = { 0, 0, 4, 4, 4, 4, 4, 4, 4, 9, 9, 9, 9, 9, 9, 9, 9 };
+    static const bool cut[]       = { 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 };
+    bitrate_ctrl_t bc;
+    init(&bc);
+
+    for (size_t i = 0; i < sizeof(trace) / sizeof(trace[0]); i++) {
+        int before = bc.target_bps;
+        step(&bc, trace[i], 0, -1);
+        if (cut[i]) {
+            CHECK(bc.target_bps < before);
+        } else {
+            CHECK(bc.target_bps >= before);
+        }
+    }
+    CHECK_EQ(bc.decreases, 2);
+
+    /* A stale total repeated forever is not congestion: back to the ceiling */
+    for (int i = 0; i < 200; i++) {
+        step(&bc, 9, 0, -1);
+    }
+    CHECK_EQ(bc.target_bps, MAX_BPS);
+    CHECK_EQ(bc.decreases, 2);
+
+    /* Counter reset (new session) reads as no events, and the next growth
+     * from the new base counts again */
+    CHECK(!step(&bc, 0, 0, -1));
+    CHECK(!step(&bc, 0, 0, -1));
+    CHECK(step(&bc, 1, 0, -1));
+    CHECK_EQ(bc.decreases, 3);
+}
+
+static void test_drop_trace(void)
+{
+    bitrate_ctrl_t bc;
+    init(&bc);
+
+    /* Ten intervals of TCP drops, then none */
+    uint32_t drops = 0;
+    for (int i = 0; i < 10; i++) {
+        drops += 3;
+        step(&bc, 0, drops, -1);
+    }
+    CHECK_EQ(bc.decreases, 10);
+    CHECK(bc.target_bps < MAX_BPS / 4);
+    CHECK(bc.target_bps >= MIN_BPS);
+    for (int i = 0; i < 10; i++) {
+        step(&bc, 0, drops, -1);
+    }
+    CHECK_EQ(bc.decreases, 10);
+
+    /* Send errors and drops in the same interval are one cut, not two */
+    init(&bc);
+    CHECK(step(&bc, 5, 5, 100));
+    CHECK_EQ(bc.target_bps, MAX_BPS * 85 / 100);
+    CHECK_EQ(bc.decreases, 1);
+}
+
+/* Send queue drops are per interval, not a running total */
+static void test_queue_drops(void)
+{
+    static const uint32_t trace[] = { 0, 2, 0, 0, 0, 0, 0, 1, 1, 0 };
+    static const bool cut[]       = { 0, 1, 0, 0, 0, 0, 0, 1, 1, 0 };
+    bitrate_ctrl_t bc;
+    init(&bc);
+
+    for (size_t i = 0; i < sizeof(trace) / sizeof(trace[0]); i++) {
+        bitrate_ctrl_input_t in = { .queue_drops = trace[i], .loss_256 = -1 };
+        int before = bc.target_bps;
+        bitrate_ctrl_update(&bc, &in);
+        if (cut[i]) {
+            CHECK(bc.target_bps < before);
+        } else {
+            CHECK(bc.target_bps >= before);
+        }
+    }
+    CHECK_EQ(bc.decreases, 3);
+
+    /* With no new drops the cumulative counters alone decide */
+    for (int i = 0; i < 200; i++) {
+        step(&bc, 7, 7, -1);
+    }
+    CHECK_EQ(bc.target_bps, MAX_BPS);
+    CHECK_EQ(bc.decreases, 4);
+}
+
+static void test_floor_and_ceiling(void)
+{
+    bitrate_ctrl_t bc;
+    init(&bc);
+
+    /* Sustained heavy loss: down to the floor and no further */
+    for (int i = 0; i < 100; i++) {
+        step(&bc, 0, 0, 255);
+        CHECK(bc.target_bps >= MIN_BPS);
+    }
+    CHECK_EQ(bc.target_bps, MIN_BPS);
+    uint32_t cuts = bc.decreases;
+    CHECK(!step(&bc, 0, 0, 255));
+    CHECK_EQ(bc.decreases, cuts);       /* Clamped: not counted as a change */
+
+    /* Clean again: back up to the ceiling and no further */
+    for (int i = 0; i < 1000; i++) {
+        step(&bc, 0, 0, 0);
+        CHECK(bc.target_bps <= MAX_BPS);
+    }
+    CHECK_EQ(bc.target_bps, MAX_BPS);
+    CHECK_EQ(bc.increases, (MAX_BPS - MIN_BPS + STEP_BPS - 1) / STEP_BPS);
+
+    /* Inverted limits collapse onto the ceiling */
+    bitrate_ctrl_config_t cfg = { .min_bps = 8000000, .max_bps = 2000000 };
+    bitrate_ctrl_init(&bc, &cfg);
+    step(&bc, 0, 0, 255);
+    CHECK_EQ(bc.target_bps, 2000000);
+
+    /* Small ceiling: the step does not drop below 100 kbit/s */
+    cfg = (bitrate_ctrl_config_t){ .min_bps = 200000, .max_bps = 1000000 };
+    bitrate_ctrl_init(&bc, &cfg);
+    step(&bc, 0, 0, 255);
+    int cut = bc.target_bps;
+    CHECK_EQ(intervals_to_increase(&bc, 20), HOLD + CLEAR);
+    CHECK_EQ(bc.target_bps, cut + 100000);
+}
+
+static void test_hysteresis(void)
+{
+    bitrate_ctrl_t bc;
+    init(&bc);
+
+    /* After a cut: the hold-off, then one step per CLEAR clear intervals */
+    step(&bc, 0, 0, 100);
+    int cut = bc.target_bps;
+    CHECK_EQ(intervals_to_increase(&bc, 50), HOLD + CLEAR);
+    CHECK_EQ(bc.target_bps, cut + STEP_BPS);
+    CHECK_EQ(intervals_to_increase(&bc, 50), CLEAR);
+    CHECK_EQ(bc.target_bps, cut + 2 * STEP_BPS);
+
+    /* Loss in the 1-5% band holds the target and restarts the count */
+    int held = bc.target_bps;
+    step(&bc, 0, 0, -1);
+    step(&bc, 0, 0, -1);
+    for (int i = 0; i < 50; i++) {
+        CHECK(!step(&bc, 0, 0, 4 + i % 9));     /* 4..12 / 256 */
+    }
+    CHECK_EQ(bc.target_bps, held);
+    CHECK_EQ(intervals_to_increase(&bc, 50), CLEAR);
+
+    /* Alternating clean and marginal intervals never climb */
+    held = bc.target_bps;
+    for (int i = 0; i < 100; i++) {
+        CHECK(!step(&bc, 0, 0, i % 3 == 2 ? 8 : 0));
+    }
+    CHECK_EQ(bc.target_bps, held);
+}
+
+/*
+ * Link of fixed capacity: what the encoder sends above it is lost (as the
+ * receiver reports it), with a few send errors once the excess outgrows
+ * lwIP's buffers, and occasional 1/256 noise below it.
+ */
+typedef struct {
+    int capacity_bps;
+    uint32_t send_errors;
+    uint32_t seed;
+} link_t;
+
+static bitrate_ctrl_input_t link_interval(link_t *l, int rate_bps)
+{
+    bitrate_ctrl_input_t in = { .loss_256 = host_rand(&l->seed) % 3 };
+    if (rate_bps > l->capacity_bps) {
+        in.loss_256 = (int)((int64_t)(rate_bps - l->capacity_bps) * 256 / rate_bps);
+        if (rate_bps > l->capacity_bps + l->capacity_bps / 10) {
+            l->send_errors += 1 + host_rand(&l->seed) % 4;
+        }
+    }
+    in.send_errors = l->send_errors;
+    return in;
+}
+
+/* Run n intervals; mean target and range over the last `tail` of them */
+static void run_link(bitrate_ctrl_t *bc, link_t *l, int n, int tail,
+                     double *mean, int *lo, int *hi)
+{
+    double sum = 0;
+    *lo = MAX_BPS;
+    *hi = 0;
+    for (int i = 0; i < n; i++) {
+        bitrate_ctrl_input_t in = link_interval(l, bc->target_bps);
+        bitrate_ctrl_update(bc, &in);
+        if (i >= n - tail) {
+            sum += bc->target_bps;
+            *lo = bc->target_bps < *lo ? bc->target_bps : *lo;
+            *hi = bc->target_bps > *hi ? bc->target_bps : *hi;
+        }
+    }
+    *mean = sum / tail;
+}
+
+static void test_convergence(void)
+{
+    static const int capacities[] = { 1500000, 3000000, 4200000, 6500000, 9000000 };
+
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        int cap = capacities[c];
+        link_t link = { .capacity_bps = cap, .seed = 0x1234567u + c };
+        bitrate_ctrl_t bc;
+        init(&bc);
+
+        double mean;
+        int lo, hi;
+        run_link(&bc, &link, 400, 200, &mean, &lo, &hi);
+
+        /* Settles in a band around the capacity: never more than a step
+         * above it, never collapsing far below it, and using most of it.
+         * Loss up to 13/256 is the hold band, so the target may rest just
+         * above the capacity, below the rate at which 14/256 is lost */
+        CHECK(hi <= cap + STEP_BPS);
+        CHECK(lo >= cap * 85 / 100 - STEP_BPS);
+        CHECK(mean >= cap * 0.75);
+        CHECK(mean < cap * 256.0 / 242);
+        printf("  capacity %5d kbit/s: target %5d..%5d kbit/s, mean %5.0f\n",
+               cap / 1000, lo / 1000, hi / 1000, mean / 1000);
+    }
+}
+
+static void test_capacity_change(void)
+{
+    link_t link = { .capacity_bps = 8000000, .seed = 42 };
+    bitrate_ctrl_t bc;
+    init(&bc);
+    double mean;
+    int lo, hi;
+    run_link(&bc, &link, 100, 1, &mean, &lo, &hi);
+
+    /* Capacity falls to a quarter: below it within ~log(1/4)/log(0.85) cuts */
+    link.capacity_bps = 2000000;
+    int n = 0;
+    while (bc.target_bps > link.capacity_bps && n < 100) {
+        bitrate_ctrl_input_t in = link_interval(&link, bc.target_bps);
+        bitrate_ctrl_update(&bc, &in);
+        n++;
+    }
+    CHECK(n <= 10);
+
+    /* Capacity returns: back to the ceiling at one step per CLEAR intervals */
+    link.capacity_bps = 20000000;
+    n = 0;
+    while (bc.target_bps < MAX_BPS && n < 1000) {
+        bitrate_ctrl_input_t in = link_interval(&link, bc.target_bps);
+        bitrate_ctrl_update(&bc, &in);
+        n++;
+    }
+    CHECK(bc.target_bps == MAX_BPS);
+    CHECK(n <= HOLD + CLEAR * ((MAX_BPS - MIN_BPS) / STEP_BPS + 1));
+}
+
+int main(void)
+{
+    test_clean_link();
+    test_multiplicative_decrease();
+    test_send_error_trace();
+    test_drop_trace();
+    test_queue_drops();
+    test_floor_and_ceiling();
+    test_hysteresis();
+    test_convergence();
+    test_capacity_change();
+    return host_test_result("test_bitrate_ctrl");
+}
@@ -0,0 +1,227 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * frame_ring: FIFO and latest-frame-wins consumption, what the ring hands
+ * to the release callback on a full push, a stale skip and a flush, the
+ * statistics, and the free-running counters wrapping around 2^32.
+ */
+
+#include "host_test.h"
+#include "frame_ring.h"
+
+#include <stdint.h>
+
+#define RELEASED_MAX    64
+
+typedef struct {
+    int items[RELEASED_MAX];
+    int count;
+} released_t;
+
+static void release_cb(void *item, void *cb_ctx)
+{
+    released_t *r = cb_ctx;
+    if (r->count < RELEASED_MAX) {
+        r->items[r->count] = *(int *)item;
+    }
+    r->count++;
+}
+
+static bool push(frame_ring_t *ring, int v)
+{
+    return frame_ring_push(ring, &v);
+}
+
+/* Popped value, or -1 if the ring was empty */
+static int pop(frame_ring_t *ring)
+{
+    int v;
+    return frame_ring_pop(ring, &v) ? v : -1;
+}
+
+/* Move both counters, as if start entries had already passed through */
+static void set_counters(frame_ring_t *ring, uint32_t start)
+{
+    atomic_store(&ring->head, start);
+    atomic_store(&ring->tail, start);
+}
+
+static void test_init(void)
+{
+    frame_ring_t ring;
+    CHECK_EQ(frame_ring_init(&ring, 0, sizeof(int), FRAME_RING_POLICY_FIFO, NULL, NULL),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(frame_ring_init(&ring, 2, 0, FRAME_RING_POLICY_FIFO, NULL, NULL),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(frame_ring_init(&ring, 3, sizeof(int), FRAME_RING_POLICY_FIFO, NULL, NULL), ESP_OK);
+    CHECK_EQ(frame_ring_count(&ring), 0);
+    CHECK_EQ(pop(&ring), -1);
+    frame_ring_deinit(&ring);
+}
+
+static void test_fifo(void)
+{
+    released_t rel = { .count = 0 };
+    frame_ring_t ring;
+    CHECK_EQ(frame_ring_init(&ring, 3, sizeof(int), FRAME_RING_POLICY_FIFO, release_cb, &rel),
+             ESP_OK);
+
+    CHECK(push(&ring, 1));
+    CHECK(push(&ring, 2));
+    CHECK(push(&ring, 3));
+    CHECK_EQ(frame_ring_count(&ring), 3);
+
+    /* Full: the newcomer goes to the release callback, the queue is kept */
+    CHECK(!push(&ring, 4));
+    CHECK_EQ(rel.count, 1);
+    CHECK_EQ(rel.items[0], 4);
+
+    CHECK_EQ(pop(&ring), 1);
+    CHECK(push(&ring, 5));
+    CHECK_EQ(pop(&ring), 2);
+    CHECK_EQ(pop(&ring), 3);
+    CHECK_EQ(pop(&ring), 5);
+    CHECK_EQ(pop(&ring), -1);
+    CHECK_EQ(rel.count, 1);         /* Popped entries are never released */
+
+    frame_ring_stats_t st;
+    frame_ring_get_stats(&ring, &st);
+    CHECK_EQ(st.pushed, 4);
+    CHECK_EQ(st.popped, 4);
+    CHECK_EQ(st.dropped_full, 1);
+    CHECK_EQ(st.dropped_stale, 0);
+    CHECK_EQ(st.occupancy, 0);
+    CHECK_EQ(st.peak_occupancy, 3);
+    frame_ring_deinit(&ring);
+}
+
+static void test_latest(void)
+{
+    released_t rel = { .count = 0 };
+    frame_ring_t ring;
+    CHECK_EQ(frame_ring_init(&ring, 4, sizeof(int), FRAME_RING_POLICY_LATEST, release_cb, &rel),
+             ESP_OK);
+
+    /* One queued entry is simply returned */
+    CHECK(push(&ring, 1));
+    CHECK_EQ(pop(&ring), 1);
+    CHECK_EQ(rel.count, 0);
+
+    /* Older entries are released oldest first, the newest is returned */
+    CHECK(push(&ring, 2));
+    CHECK(push(&ring, 3));
+    CHECK(push(&ring, 4));
+    CHECK_EQ(pop(&ring), 4);
+    CHECK_EQ(rel.count, 2);
+    CHECK_EQ(rel.items[0], 2);
+    CHECK_EQ(rel.items[1], 3);
+    CHECK_EQ(frame_ring_count(&ring), 0);
+
+    /* A full ring still drops the newcomer; the next pop skips to the
+     * newest entry that made it in */
+    for (int v = 10; v < 14; v++) {
+        CHECK(push(&ring, v));
+    }
+    CHECK(!push(&ring, 14));
+    CHECK_EQ(rel.items[2], 14);
+    CHECK_EQ(pop(&ring), 13);
+    CHECK_EQ(rel.count, 6);
+
+    frame_ring_stats_t st;
+    frame_ring_get_stats(&ring, &st);
+    CHECK_EQ(st.pushed, 8);
+    CHECK_EQ(st.popped, 3);
+    CHECK_EQ(st.dropped_full, 1);
+    CHECK_EQ(st.dropped_stale, 5);
+    CHECK_EQ(st.peak_occupancy, 4);
+    frame_ring_deinit(&ring);
+}
+
+static void test_flush(void)
+{
+    released_t rel = { .count = 0 };
+    frame_ring_t ring;
+    CHECK_EQ(frame_ring_init(&ring, 3, sizeof(int), FRAME_RING_POLICY_FIFO, release_cb, &rel),
+             ESP_OK);
+
+    frame_ring_flush(&ring);
+    CHECK_EQ(rel.count, 0);
+
+    CHECK(push(&ring, 1));
+    CHECK(push(&ring, 2));
+    CHECK(push(&ring, 3));
+    CHECK_EQ(pop(&ring), 1);
+    frame_ring_flush(&ring);
+    CHECK_EQ(rel.count, 2);
+    CHECK_EQ(rel.items[0], 2);
+    CHECK_EQ(rel.items[1], 3);
+    CHECK_EQ(frame_ring_count(&ring), 0);
+    CHECK_EQ(pop(&ring), -1);
+
+    /* The ring is usable again after a flush */
+    CHECK(push(&ring, 4));
+    CHECK_EQ(pop(&ring), 4);
+    frame_ring_deinit(&ring);
+}
+
+/*
+ * Every capacity, both policies, with the counters starting at each point
+ * just below 2^32: a full ring straddling the wrap keeps its entries in
+ * order and in their own slots, and the full/empty checks hold on either
+ * side of it.
+ */
+static void test_counter_wrap(void)
+{
+    for (uint32_t cap = 1; cap <= 5; cap++) {
+        for (int p = 0; p < 2; p++) {
+            frame_ring_policy_t policy = p ? FRAME_RING_POLICY_LATEST : FRAME_RING_POLICY_FIFO;
+            for (uint32_t back = 0; back <= cap; back++) {
+                released_t rel = { .count = 0 };
+                frame_ring_t ring;
+                CHECK_EQ(frame_ring_init(&ring, cap, sizeof(int), policy, release_cb, &rel), ESP_OK);
+                set_counters(&ring, UINT32_MAX - back);
+
+                int next = 0;
+                for (int round = 0; round < 3; round++) {
+                    /* Fill the ring, one more than fits */
+                    int first = next;
+                    for (uint32_t i = 0; i < cap; i++) {
+                        CHECK(push(&ring, next++));
+                    }
+                    CHECK_EQ(frame_ring_count(&ring), cap);
+                    rel.count = 0;
+                    CHECK(!push(&ring, -2));
+                    CHECK_EQ(rel.count, 1);
+
+                    if (policy == FRAME_RING_POLICY_FIFO) {
+                        for (uint32_t i = 0; i < cap; i++) {
+                            CHECK_EQ(pop(&ring), first + (int)i);
+                        }
+                    } else {
+                        rel.count = 0;
+                        CHECK_EQ(pop(&ring), next - 1);
+                        CHECK_EQ(rel.count, (int)cap - 1);
+                        for (int i = 0; i < rel.count && i < RELEASED_MAX; i++) {
+                            CHECK_EQ(rel.items[i], first + i);
+                        }
+                    }
+                    CHECK_EQ(frame_ring_count(&ring), 0);
+                    CHECK_EQ(pop(&ring), -1);
+                }
+                frame_ring_deinit(&ring);
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    test_init();
+    test_fifo();
+    test_latest();
+    test_flush();
+    test_counter_wrap();
+    return host_test_result("test_frame_ring");
+}
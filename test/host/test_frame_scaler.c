@@ -0,0 +1,260 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * frame_scaler: crop/scale planning, exact crops, flat-field preservation,
+ * the SWAR 2:1 pre-pass against a plain 2x2 average, and YUV420 -> UYVY.
+ */
+
+#include "sdkconfig.h"
+#include "host_test.h"
+#include "frame_scaler.h"
+#include "linux/videodev2.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define UYVY    V4L2_PIX_FMT_UYVY
+#define I420    V4L2_PIX_FMT_YUV420
+
+static uint32_t frame_bytes(uint32_t fmt, uint32_t w, uint32_t h)
+{
+    return fmt == UYVY ? w * h * 2 : w * h * 3 / 2;
+}
+
+static uint8_t *random_frame(uint32_t fmt, uint32_t w, uint32_t h, uint32_t seed)
+{
+    uint32_t n = frame_bytes(fmt, w, h);
+    uint8_t *f = malloc(n);
+    for (uint32_t i = 0; i < n; i++) {
+        f[i] = (uint8_t)host_rand(&seed);
+    }
+    return f;
+}
+
+static void test_planning(void)
+{
+    frame_scaler_t s;
+
+    CHECK_EQ(frame_scaler_init(&s, UYVY, 1920, 1080, UYVY, 640, 480, false, FRAME_SCALE_BOX), ESP_OK);
+    CHECK_EQ(s.fit, FRAME_FIT_CROP);
+    CHECK_EQ(s.roi_w, 640);
+    CHECK_EQ(s.roi_h, 480);
+    CHECK_EQ(s.roi_x, 640);
+    CHECK_EQ(s.roi_y, 300);
+    frame_scaler_deinit(&s);
+
+    /* 4:3 out of 16:9: crop the sides to 1440x1080, then scale */
+    CHECK_EQ(frame_scaler_init(&s, UYVY, 1920, 1080, UYVY, 640, 480, true, FRAME_SCALE_BOX), ESP_OK);
+    CHECK_EQ(s.fit, FRAME_FIT_CROP_SCALE);
+    CHECK_EQ(s.roi_w, 1440);
+    CHECK_EQ(s.roi_h, 1080);
+    CHECK_EQ(s.roi_x, 240);
+    CHECK_EQ(s.roi_y, 0);
+    CHECK(!CONFIG_UVC_SCALE_SWAR || s.scratch != NULL);
+    frame_scaler_deinit(&s);
+
+    CHECK_EQ(frame_scaler_init(&s, I420, 1920, 1080, I420, 1280, 720, true, FRAME_SCALE_BILINEAR), ESP_OK);
+    CHECK_EQ(s.fit, FRAME_FIT_SCALE);
+    CHECK(s.scratch == NULL);       /* Less than 2:1 */
+    frame_scaler_deinit(&s);
+
+    CHECK_EQ(frame_scaler_init(&s, I420, 1920, 1080, I420, 1920, 1080, true, FRAME_SCALE_BOX), ESP_OK);
+    CHECK(frame_scaler_is_passthrough(&s));
+    frame_scaler_deinit(&s);
+
+    CHECK_EQ(frame_scaler_init(&s, I420, 1920, 1080, UYVY, 1920, 1080, true, FRAME_SCALE_BOX), ESP_OK);
+    CHECK_EQ(s.fit, FRAME_FIT_NONE);
+    CHECK(!frame_scaler_is_passthrough(&s));
+    CHECK_EQ(frame_scaler_out_size(&s), 1920 * 1080 * 2);
+    frame_scaler_deinit(&s);
+
+    CHECK_EQ(frame_scaler_init(&s, I420, 640, 480, I420, 1280, 720, true, FRAME_SCALE_BOX),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(frame_scaler_init(&s, UYVY, 640, 480, I420, 320, 240, true, FRAME_SCALE_BOX),
+             ESP_ERR_NOT_SUPPORTED);
+}
+
+static void test_crop_exact(void)
+{
+    const uint32_t sw = 64, sh = 48, dw = 32, dh = 16;
+    frame_scaler_t s;
+
+    uint8_t *src = random_frame(I420, sw, sh, 1);
+    uint8_t *dst = malloc(frame_bytes(I420, dw, dh));
+    CHECK_EQ(frame_scaler_init(&s, I420, sw, sh, I420, dw, dh, false, FRAME_SCALE_BOX), ESP_OK);
+    frame_scaler_run(&s, src, dst);
+    for (uint32_t y = 0; y < dh; y++) {
+        CHECK(memcmp(dst + y * dw, src + (s.roi_y + y) * sw + s.roi_x, dw) == 0);
+    }
+    const uint8_t *su = src + sw * sh, *du = dst + dw * dh;
+    const uint8_t *sv = su + sw * sh / 4, *dv = du + dw * dh / 4;
+    for (uint32_t y = 0; y < dh / 2; y++) {
+        uint32_t off = (s.roi_y / 2 + y) * (sw / 2) + s.roi_x / 2;
+        CHECK(memcmp(du + y * dw / 2, su + off, dw / 2) == 0);
+        CHECK(memcmp(dv + y * dw / 2, sv + off, dw / 2) == 0);
+    }
+    frame_scaler_deinit(&s);
+    free(src);
+    free(dst);
+
+    src = random_frame(UYVY, sw, sh, 2);
+    dst = malloc(frame_bytes(UYVY, dw, dh));
+    CHECK_EQ(frame_scaler_init(&s, UYVY, sw, sh, UYVY, dw, dh, false, FRAME_SCALE_BOX), ESP_OK);
+    frame_scaler_run(&s, src, dst);
+    for (uint32_t y = 0; y < dh; y++) {
+        CHECK(memcmp(dst + y * dw * 2, src + (s.roi_y + y) * sw * 2 + s.roi_x * 2, dw * 2) == 0);
+    }
+    frame_scaler_deinit(&s);
+    free(src);
+    free(dst);
+}
+
+/* A flat frame must stay flat through every filter and layout */
+static void test_flat_field(void)
+{
+    static const struct { uint32_t in, out, sw, sh, dw, dh; } cases[] = {
+        { UYVY, UYVY, 1920, 1080, 640, 480 },
+        { UYVY, UYVY, 1920, 1080, 1280, 720 },
+        { UYVY, UYVY, 640, 480, 320, 240 },
+        { I420, I420, 1920, 1080, 640, 480 },
+        { I420, I420, 1920, 1080, 1280, 720 },
+        { I420, UYVY, 1920, 1080, 640, 480 },
+        { I420, UYVY, 1920, 1080, 320, 240 },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (int filter = FRAME_SCALE_BOX; filter <= FRAME_SCALE_BILINEAR; filter++) {
+            uint32_t sw = cases[c].sw, sh = cases[c].sh, dw = cases[c].dw, dh = cases[c].dh;
+            uint8_t *src = malloc(frame_bytes(cases[c].in, sw, sh));
+            uint8_t *dst = malloc(frame_bytes(cases[c].out, dw, dh));
+
+            if (cases[c].in == UYVY) {
+                for (uint32_t i = 0; i < sw * sh * 2; i += 4) {
+                    src[i] = 50; src[i + 1] = 100; src[i + 2] = 200; src[i + 3] = 100;
+                }
+            } else {
+                memset(src, 100, sw * sh);
+                memset(src + sw * sh, 50, sw * sh / 4);
+                memset(src + sw * sh * 5 / 4, 200, sw * sh / 4);
+            }
+
+            frame_scaler_t s;
+            CHECK_EQ(frame_scaler_init(&s, cases[c].in, sw, sh, cases[c].out, dw, dh, true,
+                                       (frame_scale_filter_t)filter), ESP_OK);
+            frame_scaler_run(&s, src, dst);
+
+            int bad = 0;
+            if (cases[c].out == UYVY) {
+                for (uint32_t i = 0; i < dw * dh * 2; i += 4) {
+                    bad += dst[i] != 50 || dst[i + 1] != 100 || dst[i + 2] != 200 || dst[i + 3] != 100;
+                }
+            } else {
+                for (uint32_t i = 0; i < dw * dh; i++) bad += dst[i] != 100;
+                for (uint32_t i = 0; i < dw * dh / 4; i++) {
+                    bad += dst[dw * dh + i] != 50 || dst[dw * dh * 5 / 4 + i] != 200;
+                }
+            }
+            if (bad) {
+                fprintf(stderr, "flat field case %zu filter %d: %d bad samples\n", c, filter, bad);
+            }
+            CHECK_EQ(bad, 0);
+            frame_scaler_deinit(&s);
+            free(src);
+            free(dst);
+        }
+    }
+}
+
+/* Exact 2:1 box scale against a rounded 2x2 mean; the SWAR pre-pass
+ * truncates twice, so it may sit one below */
+static void test_half_scale(void)
+{
+    const uint32_t sw = 128, sh = 64, dw = 64, dh = 32;
+    uint8_t *src = random_frame(I420, sw, sh, 3);
+    uint8_t *dst = malloc(frame_bytes(I420, dw, dh));
+
+    frame_scaler_t s;
+    CHECK_EQ(frame_scaler_init(&s, I420, sw, sh, I420, dw, dh, true, FRAME_SCALE_BOX), ESP_OK);
+    CHECK_EQ(s.fit, FRAME_FIT_SCALE);
+    frame_scaler_run(&s, src, dst);
+
+    int worst = 0;
+    for (uint32_t y = 0; y < dh; y++) {
+        for (uint32_t x = 0; x < dw; x++) {
+            const uint8_t *p = src + 2 * y * sw + 2 * x;
+            int mean = (p[0] + p[1] + p[sw] + p[sw + 1] + 2) / 4;
+            int d = mean - dst[y * dw + x];
+            if (d < 0) d = -d;
+            if (d > worst) worst = d;
+        }
+    }
+    CHECK(worst <= (s.scratch ? 1 : 0));
+    frame_scaler_deinit(&s);
+    free(src);
+    free(dst);
+
+    /* UYVY: each output macro-pixel from a 4x2 block (U/V) and 2x2 blocks (Y) */
+    src = random_frame(UYVY, sw, sh, 4);
+    dst = malloc(frame_bytes(UYVY, dw, dh));
+    CHECK_EQ(frame_scaler_init(&s, UYVY, sw, sh, UYVY, dw, dh, true, FRAME_SCALE_BOX), ESP_OK);
+    frame_scaler_run(&s, src, dst);
+    worst = 0;
+    for (uint32_t y = 0; y < dh; y++) {
+        for (uint32_t x = 0; x < dw; x++) {
+            const uint8_t *r0 = src + 2 * y * sw * 2, *r1 = r0 + sw * 2;
+            uint32_t sx = 2 * x;
+            int ys = r0[sx * 2 + 1] + r0[sx * 2 + 3] + r1[sx * 2 + 1] + r1[sx * 2 + 3];
+            int d = (ys + 2) / 4 - dst[y * dw * 2 + x * 2 + 1];
+            if (d < 0) d = -d;
+            if (d > worst) worst = d;
+        }
+    }
+    CHECK(worst <= (s.scratch ? 1 : 0));
+    frame_scaler_deinit(&s);
+    free(src);
+    free(dst);
+}
+
+/* Same-size YUV420 -> UYVY: luma copied, chroma repeated on both rows */
+static void test_convert(void)
+{
+    const uint32_t w = 16, h = 8;
+    uint8_t *src = random_frame(I420, w, h, 5);
+    uint8_t *dst = malloc(frame_bytes(UYVY, w, h));
+
+    for (int filter = FRAME_SCALE_BOX; filter <= FRAME_SCALE_BILINEAR; filter++) {
+        frame_scaler_t s;
+        CHECK_EQ(frame_scaler_init(&s, I420, w, h, UYVY, w, h, true,
+                                   (frame_scale_filter_t)filter), ESP_OK);
+        frame_scaler_run(&s, src, dst);
+
+        const uint8_t *u = src + w * h, *v = u + w * h / 4;
+        int bad = 0;
+        for (uint32_t y = 0; y < h; y++) {
+            for (uint32_t x = 0; x < w; x += 2) {
+                const uint8_t *m = dst + y * w * 2 + x * 2;
+                bad += m[1] != src[y * w + x] || m[3] != src[y * w + x + 1];
+                if (filter == FRAME_SCALE_BOX) {
+                    bad += m[0] != u[(y / 2) * (w / 2) + x / 2];
+                    bad += m[2] != v[(y / 2) * (w / 2) + x / 2];
+                }
+            }
+        }
+        CHECK_EQ(bad, 0);
+        frame_scaler_deinit(&s);
+    }
+    free(src);
+    free(dst);
+}
+
+int main(void)
+{
+    test_planning();
+    test_crop_exact();
+    test_flat_field();
+    test_half_scale();
+    test_convert();
+    return host_test_result("test_frame_scaler");
+}
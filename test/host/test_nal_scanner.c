@@ -0,0 +1,199 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Differential test of the word-at-a-time start-code scanner against a
+ * byte-by-byte reference: every start position, every buffer alignment,
+ * start codes straddling word and buffer ends, dense zero runs, synthetic
+ * encoder frames and, when given, real encoder output.
+ *
+ *   test_nal_scanner [capture.h264 ...]
+ */
+
+#include "nal_reference.h"
+
+static nal_index_t s_idx;
+static ref_index_t s_ref;
+
+/* Buffers up to this size are checked from every start position */
+#define ALL_POSITIONS_MAX   4096
+
+static int check_position(const uint8_t *data, size_t pos, size_t len)
+{
+    return nal_find_start_code(data, pos, len) != ref_find_start_code(data, pos, len);
+}
+
+/*
+ * Compare both scanners on data[0..len), copied to its own allocation so a
+ * sanitizer catches any read past the end.  Large buffers are checked from
+ * the bytes around each start code and from random positions.
+ */
+static void check_buffer(const uint8_t *src, size_t len, const char *what)
+{
+    uint8_t *data = malloc(len ? len : 1);
+    memcpy(data, src, len);
+
+    int bad = 0;
+    if (len <= ALL_POSITIONS_MAX) {
+        for (size_t pos = 0; pos <= len; pos++) {
+            bad += check_position(data, pos, len);
+        }
+    } else {
+        uint32_t seed = (uint32_t)len;
+        for (size_t sc = ref_find_start_code(data, 0, len); sc < len;
+             sc = ref_find_start_code(data, sc + 1, len)) {
+            for (size_t pos = sc > 8 ? sc - 8 : 0; pos <= sc + 1; pos++) {
+                bad += check_position(data, pos, len);
+            }
+        }
+        for (int i = 0; i < 64; i++) {
+            bad += check_position(data, host_rand(&seed) % (len + 1), len);
+        }
+        for (size_t pos = len > 8 ? len - 8 : 0; pos <= len; pos++) {
+            bad += check_position(data, pos, len);
+        }
+    }
+
+    CHECK_EQ(nal_index_build(&s_idx, data, len), ESP_OK);
+    ref_index_build(&s_ref, data, len);
+    if (s_idx.count != s_ref.count) {
+        bad++;
+    } else {
+        for (size_t i = 0; i < s_ref.count; i++) {
+            bad += s_idx.nals[i].ptr != data + s_ref.off[i] || s_idx.nals[i].len != s_ref.len[i];
+        }
+    }
+    if (bad) {
+        fprintf(stderr, "%s (len %zu): %d mismatches\n", what, len, bad);
+    }
+    CHECK_EQ(bad, 0);
+    free(data);
+}
+
+/* A start code (3 and 4 bytes) at every offset, at every alignment */
+static void test_straddle(void)
+{
+    uint8_t buf[64];
+    for (int lead = 0; lead < 8; lead++) {
+        for (int at = 0; at + 4 <= 24; at++) {
+            for (int four = 0; four < 2; four++) {
+                memset(buf, 0xAA, sizeof(buf));
+                size_t p = at;
+                if (four) buf[p++] = 0;
+                buf[p++] = 0;
+                buf[p++] = 0;
+                buf[p++] = 1;
+                buf[p++] = 0x65;
+                /* Offset the whole buffer so the code crosses word boundaries */
+                uint8_t shifted[80];
+                memset(shifted, 0xAA, lead);
+                memcpy(shifted + lead, buf, 24);
+                check_buffer(shifted, lead + 24, "straddle");
+            }
+        }
+    }
+}
+
+/* Start codes cut off by the end of the buffer must not be found */
+static void test_buffer_end(void)
+{
+    static const uint8_t tails[][4] = {
+        { 0xAA, 0xAA, 0x00, 0x00 },
+        { 0xAA, 0x00, 0x00, 0x00 },
+        { 0xAA, 0xAA, 0xAA, 0x00 },
+        { 0x00, 0x00, 0x01, 0x65 },
+        { 0xAA, 0x00, 0x00, 0x01 },
+    };
+    uint8_t buf[32];
+    for (size_t t = 0; t < sizeof(tails) / sizeof(tails[0]); t++) {
+        for (size_t len = 4; len <= 12; len++) {
+            memset(buf, 0xAA, sizeof(buf));
+            memcpy(buf + len - 4, tails[t], 4);
+            check_buffer(buf, len, "buffer end");
+        }
+    }
+    check_buffer(buf, 0, "empty");
+    check_buffer((const uint8_t *)"\0\0", 2, "short");
+    check_buffer((const uint8_t *)"\0\0\1", 3, "bare start code");
+}
+
+/* Random bytes from a small alphabet: start codes and zero runs everywhere */
+static void test_dense_random(void)
+{
+    uint32_t seed = 0x1234;
+    uint8_t buf[300];
+    for (int iter = 0; iter < 2000; iter++) {
+        size_t len = host_rand(&seed) % sizeof(buf);
+        for (size_t i = 0; i < len; i++) {
+            uint32_t r = host_rand(&seed) % 8;
+            buf[i] = r < 4 ? 0 : r < 6 ? 1 : (uint8_t)(host_rand(&seed) | 4);
+        }
+        check_buffer(buf, len, "dense random");
+    }
+}
+
+/* Encoder-like frames: AUD/SPS/PPS/SEI + multi-slice, emulation-prevented */
+static void test_synthetic_frames(void)
+{
+    static uint8_t frame[512 * 1024];
+    uint32_t seed = 0xC0FFEE;
+    for (int i = 0; i < 40; i++) {
+        bool idr = (i % 10) == 0;
+        size_t bytes = idr ? 200000 : 2000 + host_rand(&seed) % 40000;
+        int slices = 1 + (int)(host_rand(&seed) % 4);
+        int zero_bias = (int)(host_rand(&seed) % 30);
+        size_t len = gen_frame(frame, sizeof(frame), idr, bytes, slices, zero_bias, &seed);
+        check_buffer(frame, len, idr ? "synthetic IDR" : "synthetic P");
+
+        /* Every indexed NAL is one of the generated ones */
+        nal_index_build(&s_idx, frame, len);
+        CHECK_EQ(s_idx.count, (idr ? 4 : 1) + (size_t)slices);
+    }
+
+    /* More NAL units than the initial index capacity: no cap */
+    size_t len = 0;
+    for (int i = 0; i < 300; i++) {
+        len += gen_nal(frame + len, sizeof(frame) - len, 0x41, 50, false, 5, &seed);
+    }
+    CHECK_EQ(nal_index_build(&s_idx, frame, len), ESP_OK);
+    CHECK_EQ(s_idx.count, 300);
+}
+
+/* Real encoder output, e.g. an RTSP capture saved with ffmpeg -c copy -f h264 */
+static void test_capture(const char *path)
+{
+    size_t len;
+    uint8_t *data = load_file(path, &len);
+    CHECK(data != NULL);
+    if (!data) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return;
+    }
+    CHECK_EQ(nal_index_build(&s_idx, data, len), ESP_OK);
+
+    /* Windows of any alignment and cut point, each checked as a buffer */
+    uint32_t seed = 7;
+    for (size_t off = 0; off < len; ) {
+        size_t n = 1 + host_rand(&seed) % (256 * 1024);
+        n = len - off < n ? len - off : n;
+        check_buffer(data + off, n, path);
+        off += n;
+    }
+    nal_index_build(&s_idx, data, len);
+    printf("%s: %zu bytes, %zu NAL units\n", path, len, s_idx.count);
+    free(data);
+}
+
+int main(int argc, char **argv)
+{
+    test_straddle();
+    test_buffer_end();
+    test_dense_random();
+    test_synthetic_frames();
+    for (int i = 1; i < argc; i++) {
+        test_capture(argv[i]);
+    }
+    nal_index_free(&s_idx);
+    return host_test_result("test_nal_scanner");
+}
@@ -0,0 +1,193 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * STAP-A packetization, checked bit for bit against hand-assembled
+ * RFC 6184 payloads: SPS+PPS+IDR aggregation, the exact-MTU boundary,
+ * the single-NAL fallback, and how the F and NRI bits combine.
+ */
+
+#include "host_test.h"
+#include "rtp_h264.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+/* RTP_MTU in rtp_sender.h: the payload limit the sender passes in */
+#define MTU     1400
+
+#define NAL(bytes) { (bytes), sizeof(bytes) }
+
+static bool payload_is(const nal_unit_t *nals, size_t count,
+                       const uint8_t *want, size_t want_len)
+{
+    uint8_t buf[MTU];
+    size_t len = rtp_h264_stap_a_build(buf, nals, count);
+    if (len != want_len || memcmp(buf, want, len) != 0) {
+        fprintf(stderr, "  got ");
+        for (size_t i = 0; i < len; i++) {
+            fprintf(stderr, "%02x ", buf[i]);
+        }
+        fprintf(stderr, "\n");
+        return false;
+    }
+    return true;
+}
+
+/* Parameter sets and a small IDR slice, as the encoder emits them */
+static void test_sps_pps_idr(void)
+{
+    static const uint8_t frame[] = {
+        0x00, 0x00, 0x00, 0x01,
+        0x67, 0x42, 0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08, 0x9f, 0x96,     /* SPS */
+        0x00, 0x00, 0x00, 0x01,
+        0x68, 0xce, 0x3c, 0x80,                                         /* PPS */
+        0x00, 0x00, 0x01,
+        0x65, 0x88, 0x84, 0x00, 0x33, 0xff, 0xfe, 0xf6,                 /* IDR */
+    };
+    static const uint8_t want[] = {
+        0x78,                                                   /* F=0 NRI=3 type 24 */
+        0x00, 0x0a,
+        0x67, 0x42, 0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08, 0x9f, 0x96,
+        0x00, 0x04,
+        0x68, 0xce, 0x3c, 0x80,
+        0x00, 0x08,
+        0x65, 0x88, 0x84, 0x00, 0x33, 0xff, 0xfe, 0xf6,
+    };
+
+    nal_index_t idx = { 0 };
+    CHECK_EQ(nal_index_build(&idx, frame, sizeof(frame)), ESP_OK);
+    CHECK_EQ(idx.count, 3);
+    CHECK_EQ(rtp_h264_stap_a_span(idx.nals, idx.count, MTU), 3);
+    CHECK(payload_is(idx.nals, idx.count, want, sizeof(want)));
+    nal_index_free(&idx);
+}
+
+/* The payload may be exactly the MTU, not one byte more */
+static void test_mtu_boundary(void)
+{
+    static const uint8_t a[] = { 0x06, 0x05, 0x01, 0xaa, 0xbb, 0x80 };    /* SEI */
+    static const uint8_t b[] = { 0x41, 0x9a, 0x00, 0x11, 0x22 };          /* P slice */
+    static const uint8_t c[] = { 0x01, 0x9e };
+    const nal_unit_t nals[] = { NAL(a), NAL(b), NAL(c) };
+
+    /* 1 + (2 + 6) + (2 + 5) = 16 */
+    CHECK_EQ(rtp_h264_stap_a_span(nals, 3, 16), 2);
+    CHECK_EQ(rtp_h264_stap_a_span(nals, 3, 15), 1);
+    CHECK_EQ(rtp_h264_stap_a_span(nals, 3, 20), 3);     /* 16 + 2 + 2 */
+    CHECK_EQ(rtp_h264_stap_a_span(nals, 3, 19), 2);
+    CHECK_EQ(rtp_h264_stap_a_span(nals, 2, 1000), 2);   /* Stops at count */
+
+    static const uint8_t want[16] = {
+        0x58,                                           /* F=0 NRI=2 type 24 */
+        0x00, 0x06, 0x06, 0x05, 0x01, 0xaa, 0xbb, 0x80,
+        0x00, 0x05, 0x41, 0x9a, 0x00, 0x11, 0x22,
+    };
+    CHECK(payload_is(nals, 2, want, sizeof(want)));
+
+    /* The same at the real MTU: two NAL units filling it exactly */
+    static uint8_t big1[700], big2[MTU - 1 - 2 - 700 - 2];
+    memset(big1, 0x5a, sizeof(big1));
+    memset(big2, 0xa5, sizeof(big2));
+    big1[0] = 0x41;
+    big2[0] = 0x01;
+    nal_unit_t full[] = { NAL(big1), NAL(big2) };
+    CHECK_EQ(rtp_h264_stap_a_span(full, 2, MTU), 2);
+
+    uint8_t buf[MTU];
+    CHECK_EQ(rtp_h264_stap_a_build(buf, full, 2), MTU);
+    CHECK_EQ(buf[0], 0x58);
+    CHECK_EQ(buf[1], 700 >> 8);
+    CHECK_EQ(buf[2], 700 & 0xff);
+    CHECK(memcmp(buf + 3, big1, sizeof(big1)) == 0);
+    CHECK_EQ(buf[3 + 700], sizeof(big2) >> 8);
+    CHECK_EQ(buf[4 + 700], sizeof(big2) & 0xff);
+    CHECK(memcmp(buf + 5 + 700, big2, sizeof(big2)) == 0);
+
+    full[1].len++;
+    CHECK_EQ(rtp_h264_stap_a_span(full, 2, MTU), 1);
+}
+
+/* Spans below 2: the sender falls back to a single NAL unit or FU-A */
+static void test_single_nal_fallback(void)
+{
+    static uint8_t slice[MTU + 1];
+    static const uint8_t sps[] = { 0x67, 0x42, 0xc0, 0x28 };
+    static const uint8_t pps[] = { 0x68, 0xce, 0x3c, 0x80 };
+    memset(slice, 0x11, sizeof(slice));
+    slice[0] = 0x65;
+
+    /* Alone: nothing to aggregate with */
+    nal_unit_t one[] = { NAL(sps) };
+    CHECK_EQ(rtp_h264_stap_a_span(one, 1, MTU), 1);
+
+    /* Largest NAL unit a STAP-A can carry alone: MTU - 3 */
+    nal_unit_t s[] = { { slice, MTU - 3 } };
+    CHECK_EQ(rtp_h264_stap_a_span(s, 1, MTU), 1);
+    s[0].len = MTU - 2;                 /* Still a single NAL packet, no STAP-A */
+    CHECK_EQ(rtp_h264_stap_a_span(s, 1, MTU), 0);
+    s[0].len = MTU + 1;                 /* FU-A */
+    CHECK_EQ(rtp_h264_stap_a_span(s, 1, MTU), 0);
+
+    /* A large slice after small units ends the aggregate before it, and
+     * a large slice first is never aggregated with what follows */
+    nal_unit_t frame[] = { NAL(sps), NAL(pps), { slice, 1395 }, NAL(sps) };
+    CHECK_EQ(rtp_h264_stap_a_span(frame, 4, MTU), 2);
+    CHECK_EQ(rtp_h264_stap_a_span(frame + 2, 2, MTU), 1);
+
+    /* Zero count */
+    CHECK_EQ(rtp_h264_stap_a_span(frame, 0, MTU), 0);
+}
+
+/* F is the OR of the units' F bits, NRI the highest NRI */
+static void test_f_nri(void)
+{
+    static const uint8_t sei[] = { 0x06, 0xf0 };            /* F=0 NRI=0 */
+    static const uint8_t p1[] = { 0x21, 0xe1 };             /* F=0 NRI=1 */
+    static const uint8_t p2[] = { 0x41, 0xe2 };             /* F=0 NRI=2 */
+    static const uint8_t bad[] = { 0x86, 0xf3 };            /* F=1 NRI=0 */
+    static const uint8_t idr[] = { 0x65, 0xe4 };            /* F=0 NRI=3 */
+
+    struct {
+        nal_unit_t nals[3];
+        size_t count;
+        uint8_t header;
+    } cases[] = {
+        { { NAL(sei), NAL(sei) },           2, 0x18 },
+        { { NAL(sei), NAL(p1) },            2, 0x38 },
+        { { NAL(p1), NAL(sei) },            2, 0x38 },
+        { { NAL(p1), NAL(p2), NAL(sei) },   3, 0x58 },
+        { { NAL(p2), NAL(idr) },            2, 0x78 },
+        { { NAL(bad), NAL(sei) },           2, 0x98 },
+        { { NAL(sei), NAL(bad), NAL(p2) },  3, 0xd8 },
+        { { NAL(idr), NAL(bad) },           2, 0xf8 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint8_t want[1 + 3 * 4];
+        size_t len = 1;
+        want[0] = cases[i].header;
+        for (size_t n = 0; n < cases[i].count; n++) {
+            want[len++] = 0x00;
+            want[len++] = 0x02;
+            memcpy(want + len, cases[i].nals[n].ptr, 2);
+            len += 2;
+        }
+        CHECK(payload_is(cases[i].nals, cases[i].count, want, len));
+    }
+
+    /* The units themselves are copied unchanged, F bit included */
+    static const uint8_t want[] = { 0x98, 0x00, 0x02, 0x86, 0xf3, 0x00, 0x02, 0x06, 0xf0 };
+    const nal_unit_t nals[] = { NAL(bad), NAL(sei) };
+    CHECK(payload_is(nals, 2, want, sizeof(want)));
+}
+
+int main(void)
+{
+    test_sps_pps_idr();
+    test_mtu_boundary();
+    test_single_nal_fallback();
+    test_f_nri();
+    return host_test_result("test_rtp_h264");
+}
@@ -0,0 +1,310 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Multicast distribution end to end: an RTP session configured with
+ * IP_MULTICAST_LOOP sends frames to a group that a receiver on this host
+ * has joined.  The receiver checks the RTP headers, reassembles the NAL
+ * units from single NAL, STAP-A and FU-A packets, and compares them with
+ * the frame; sending follows the multicast viewer count.
+ *
+ * Everything stays on the loopback interface with TTL 0.  Where the host
+ * cannot loop multicast back at all, the test reports itself skipped.
+ */
+
+#include "host_test.h"
+#include "rtp_sender.h"
+#include "esp_timer.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SKIPPED         77      /* ctest SKIP_RETURN_CODE */
+
+#define GROUP           "239.255.42.98"
+#define PORT_BASE       25004
+#define PORT_TRIES      16
+
+#define RECV_WAIT_MS    500
+#define MAX_PKTS        64
+#define MAX_NALS        8
+
+#define NAL_SPS         7
+#define NAL_PPS         8
+#define NAL_IDR         5
+#define NAL_SLICE       1
+#define NAL_STAP_A      24
+#define NAL_FU_A        28
+
+typedef struct {
+    uint8_t data[2048];
+    size_t len;
+} packet_t;
+
+typedef struct {
+    uint8_t data[16384];
+    size_t len;
+} nal_t;
+
+static int s_recv_fd = -1;
+static uint16_t s_port;
+static struct in_addr s_group;
+static struct in_addr s_lo;
+
+/* Receiver joined to the group on loopback, bound to the first free even port */
+static bool open_receiver(void)
+{
+    inet_aton(GROUP, &s_group);
+    inet_aton("127.0.0.1", &s_lo);
+
+    for (int i = 0; i < PORT_TRIES; i++) {
+        int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (fd < 0) {
+            return false;
+        }
+        int rcvbuf = 1 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(PORT_BASE + 2 * i),
+            .sin_addr = s_group,
+        };
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            continue;
+        }
+        struct ip_mreq mreq = { .imr_multiaddr = s_group, .imr_interface = s_lo };
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+            close(fd);
+            return false;
+        }
+        s_recv_fd = fd;
+        s_port = PORT_BASE + 2 * i;
+        return true;
+    }
+    return false;
+}
+
+/* Packets that arrive until one carries the marker, or RECV_WAIT_MS passes */
+static int receive_frame(packet_t *pkts, int max)
+{
+    int n = 0;
+    while (n < max) {
+        struct pollfd pfd = { .fd = s_recv_fd, .events = POLLIN };
+        if (poll(&pfd, 1, RECV_WAIT_MS) <= 0) {
+            break;
+        }
+        ssize_t len = recv(s_recv_fd, pkts[n].data, sizeof(pkts[n].data), 0);
+        if (len < 0) {
+            break;
+        }
+        pkts[n].len = (size_t)len;
+        if (len >= 2 && (pkts[n++].data[1] & 0x80)) {
+            break;
+        }
+    }
+    return n;
+}
+
+/* Anything left on the socket, without waiting for it */
+static int drain(void)
+{
+    uint8_t buf[2048];
+    int n = 0;
+    while (recv(s_recv_fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0) {
+        n++;
+    }
+    return n;
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static bool add_nal(nal_t *nals, int *count, const uint8_t *data, size_t len)
+{
+    if (*count >= MAX_NALS || len > sizeof(nals[0].data)) {
+        return false;
+    }
+    memcpy(nals[*count].data, data, len);
+    nals[(*count)++].len = len;
+    return true;
+}
+
+/*
+ * Check the RTP headers of one frame's packets (one SSRC and timestamp,
+ * consecutive sequence numbers, marker on the last) and depacketize them.
+ * Returns the number of NAL units, or -1 on a malformed payload.
+ */
+static int depacketize(const packet_t *pkts, int n, nal_t *nals)
+{
+    int count = 0;
+    bool in_fu = false;
+
+    for (int i = 0; i < n; i++) {
+        const uint8_t *p = pkts[i].data;
+        size_t len = pkts[i].len;
+        CHECK(len > 13);
+        if (len <= 13) {
+            return -1;
+        }
+        CHECK_EQ(p[0], 0x80);                       /* V=2, no padding, extension, CSRC */
+        CHECK_EQ(p[1] & 0x7F, 96);
+        CHECK_EQ(!!(p[1] & 0x80), i == n - 1);
+        CHECK_EQ(be16(p + 2), (uint16_t)(be16(pkts[0].data + 2) + i));
+        CHECK_EQ(be32(p + 4), be32(pkts[0].data + 4));
+        CHECK_EQ(be32(p + 8), be32(pkts[0].data + 8));
+
+        const uint8_t *pl = p + 12;
+        size_t pl_len = len - 12;
+        uint8_t type = pl[0] & 0x1F;
+        if (type == NAL_STAP_A) {
+            for (size_t off = 1; off + 2 <= pl_len; ) {
+                size_t size = be16(pl + off);
+                off += 2;
+                if (size == 0 || off + size > pl_len || !add_nal(nals, &count, pl + off, size)) {
+                    return -1;
+                }
+                off += size;
+            }
+        } else if (type == NAL_FU_A) {
+            bool start = pl[1] & 0x80, end = pl[1] & 0x40;
+            if (start) {
+                uint8_t hdr = (pl[0] & 0xE0) | (pl[1] & 0x1F);
+                if (in_fu || !add_nal(nals, &count, &hdr, 1)) {
+                    return -1;
+                }
+                in_fu = true;
+            }
+            if (!in_fu) {
+                return -1;
+            }
+            nal_t *nal = &nals[count - 1];
+            if (nal->len + pl_len - 2 > sizeof(nal->data)) {
+                return -1;
+            }
+            memcpy(nal->data + nal->len, pl + 2, pl_len - 2);
+            nal->len += pl_len - 2;
+            in_fu = !end;
+        } else if (type >= 1 && type <= 23) {
+            if (in_fu || !add_nal(nals, &count, pl, pl_len)) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return in_fu ? -1 : count;
+}
+
+/* NAL unit of the given header byte and length, body from a seed */
+static void make_nal(nal_t *nal, uint8_t hdr, size_t len, uint32_t seed)
+{
+    nal->data[0] = hdr;
+    for (size_t i = 1; i < len; i++) {
+        /* Keep clear of start code emulation: no zero bytes */
+        nal->data[i] = (uint8_t)(host_rand(&seed) | 1);
+    }
+    nal->len = len;
+}
+
+/* Annex-B frame of the NAL units */
+static size_t make_frame(uint8_t *frame, const nal_t *nals, int count)
+{
+    static const uint8_t sc[4] = { 0, 0, 0, 1 };
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(frame + len, sc, sizeof(sc));
+        memcpy(frame + len + sizeof(sc), nals[i].data, nals[i].len);
+        len += sizeof(sc) + nals[i].len;
+    }
+    return len;
+}
+
+/* Send the frame and check the group gets exactly its NAL units */
+static void check_frame_arrives(rtp_session_t *session, const nal_t *nals, int count,
+                                int64_t capture_us)
+{
+    static uint8_t frame[32768];
+    static packet_t pkts[MAX_PKTS];
+    static nal_t got[MAX_NALS];
+
+    size_t len = make_frame(frame, nals, count);
+    CHECK_EQ(rtp_send_h264_frame(session, frame, len, capture_us), ESP_OK);
+
+    int n = receive_frame(pkts, MAX_PKTS);
+    CHECK(n > 0);
+    CHECK_EQ(drain(), 0);
+    int got_count = depacketize(pkts, n, got);
+    CHECK_EQ(got_count, count);
+    for (int i = 0; i < count && i < got_count; i++) {
+        CHECK_EQ(got[i].len, nals[i].len);
+        CHECK(got[i].len == nals[i].len && memcmp(got[i].data, nals[i].data, nals[i].len) == 0);
+    }
+}
+
+int main(void)
+{
+    if (!open_receiver()) {
+        printf("test_rtp_multicast: skipped, cannot join %s on loopback\n", GROUP);
+        return SKIPPED;
+    }
+
+    rtp_session_t session;
+    CHECK_EQ(rtp_session_init(&session), ESP_OK);
+    /* The device has one interface; here the group is kept on loopback */
+    setsockopt(session.sock_fd, IPPROTO_IP, IP_MULTICAST_IF, &s_lo, sizeof(s_lo));
+
+    /* Odd ports and unicast addresses are refused */
+    CHECK_EQ(rtp_session_set_multicast(&session, s_group.s_addr, s_port + 1, 0, true),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(rtp_session_set_multicast(&session, s_lo.s_addr, s_port, 0, true),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(rtp_session_set_multicast(&session, s_group.s_addr, s_port, 0, true), ESP_OK);
+
+    /* IDR access unit: SPS and PPS aggregated in a STAP-A, the slice in FU-A */
+    nal_t idr[3];
+    make_nal(&idr[0], 0x60 | NAL_SPS, 12, 1);
+    make_nal(&idr[1], 0x60 | NAL_PPS, 4, 2);
+    make_nal(&idr[2], 0x60 | NAL_IDR, 9000, 3);
+    /* P frame: one slice in a single NAL unit packet */
+    nal_t p_frame[1];
+    make_nal(&p_frame[0], 0x40 | NAL_SLICE, 700, 4);
+
+    /* Configured but nobody playing: nothing is sent */
+    static uint8_t frame[32768];
+    size_t len = make_frame(frame, idr, 3);
+    CHECK_EQ(rtp_send_h264_frame(&session, frame, len, 0), ESP_ERR_INVALID_STATE);
+
+    /* A viewer joins: the group gets every frame */
+    rtp_session_play_multicast(&session, true);
+    CHECK(session.active);
+    int64_t t0 = esp_timer_get_time();
+    check_frame_arrives(&session, idr, 3, t0);
+    check_frame_arrives(&session, p_frame, 1, t0 + 33333);
+
+    /* A second viewer leaving keeps the first one's stream going */
+    rtp_session_play_multicast(&session, true);
+    rtp_session_play_multicast(&session, false);
+    check_frame_arrives(&session, p_frame, 1, t0 + 66666);
+
+    /* The last viewer leaving stops it */
+    rtp_session_play_multicast(&session, false);
+    CHECK(!session.active);
+    len = make_frame(frame, p_frame, 1);
+    CHECK_EQ(rtp_send_h264_frame(&session, frame, len, t0 + 99999), ESP_ERR_INVALID_STATE);
+    struct pollfd pfd = { .fd = s_recv_fd, .events = POLLIN };
+    CHECK_EQ(poll(&pfd, 1, 100), 0);
+
+    rtp_session_close(&session);
+    close(s_recv_fd);
+    return host_test_result("test_rtp_multicast");
+}
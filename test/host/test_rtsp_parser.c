@@ -0,0 +1,492 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * rtsp_parser: a corpus of client messages parsed whole, pipelined and
+ * split at every byte, the malformed cases, the start offset reported past
+ * stray line ends, and a mutation fuzzer that feeds damaged messages in
+ * random pieces.  Each call gets a buffer of exactly the pending bytes, so
+ * under ASan any read past them fails.
+ */
+
+#include "host_test.h"
+#include "rtsp_parser.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Messages as clients send them (VLC, ffmpeg, GStreamer) */
+static const char *const s_corpus[] = {
+    "OPTIONS rtsp://192.168.1.10:554/stream RTSP/1.0\r\n"
+    "CSeq: 1\r\n"
+    "User-Agent: LibVLC/3.0.20 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "\r\n",
+
+    "DESCRIBE rtsp://192.168.1.10:554/stream RTSP/1.0\r\n"
+    "CSeq: 2\r\n"
+    "Accept: application/sdp\r\n"
+    "\r\n",
+
+    "SETUP rtsp://192.168.1.10:554/stream/track1 RTSP/1.0\r\n"
+    "CSeq: 3\r\n"
+    "Transport: RTP/AVP;unicast;client_port=50000-50001\r\n"
+    "\r\n",
+
+    "SETUP rtsp://192.168.1.10:554/stream/track1 RTSP/1.0\r\n"
+    "CSeq: 4\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+    "\r\n",
+
+    "PLAY rtsp://192.168.1.10:554/stream RTSP/1.0\r\n"
+    "CSeq: 5\r\n"
+    "Session: 1A2B3C4D\r\n"
+    "Range: npt=0.000-\r\n"
+    "\r\n",
+
+    /* Keepalive with a body */
+    "SET_PARAMETER rtsp://192.168.1.10:554/stream RTSP/1.0\r\n"
+    "CSeq: 6\r\n"
+    "Content-Type: text/parameters\r\n"
+    "Content-Length: 12\r\n"
+    "\r\n"
+    "ping: 1234\r\n",
+
+    /* Bare LF line ends and lower-case header names */
+    "GET_PARAMETER rtsp://192.168.1.10/stream RTSP/1.0\n"
+    "cseq: 7\n"
+    "session: 1A2B3C4D\n"
+    "\n",
+
+    /* Folded header line, whitespace around values */
+    "TEARDOWN rtsp://192.168.1.10/stream RTSP/1.0\r\n"
+    "CSeq:   8  \r\n"
+    "X-Long: first part\r\n"
+    "\tsecond part\r\n"
+    "Session:\t1A2B3C4D\r\n"
+    "\r\n",
+
+    /* RTCP receiver report, interleaved */
+    "$\x01\x00\x08\x81\xc9\x00\x07\x12\x34\x56\x78",
+
+    /* Stray line ends between messages, then a zero-length frame */
+    "\r\n\r\n$\x00\x00\x00",
+};
+
+#define CORPUS_LEN  (sizeof(s_corpus) / sizeof(s_corpus[0]))
+
+static size_t corpus_item_len(size_t i)
+{
+    /* Frames contain NULs: their length is in their header */
+    const char *m = s_corpus[i];
+    size_t skip = 0;
+    while (m[skip] == '\r' || m[skip] == '\n') skip++;
+    if (m[skip] == '$') {
+        return skip + 4 + (((uint8_t)m[skip + 2] << 8) | (uint8_t)m[skip + 3]);
+    }
+    return strlen(m);
+}
+
+/* What one parsed message looked like, copied out of the buffer */
+typedef struct {
+    rtsp_parse_result_t res;
+    char method[16];
+    int cseq;
+    size_t header_count;
+    size_t body_len;
+    uint32_t body_sum;
+    int channel;
+    size_t frame_len;
+    size_t consumed;
+} parsed_t;
+
+#define MAX_PARSED  256
+
+typedef struct {
+    parsed_t items[MAX_PARSED];
+    size_t count;
+    bool error;
+} parse_log_t;
+
+static uint32_t sum_bytes(const void *p, size_t len)
+{
+    uint32_t s = 0;
+    for (size_t i = 0; i < len; i++) {
+        s = s * 31 + ((const uint8_t *)p)[i];
+    }
+    return s;
+}
+
+static bool within(const void *p, size_t len, const char *buf, size_t buf_len)
+{
+    const char *c = p;
+    return len == 0 || (c >= buf && c + len <= buf + buf_len);
+}
+
+/*
+ * The server's receive loop: bytes arrive in pieces of the given sizes
+ * (cycled; 0 = everything at once) and every complete message is taken
+ * off the front.  Stops at the first error.
+ */
+static void run_stream(const char *data, size_t len, const size_t *pieces, size_t n_pieces,
+                       parse_log_t *log)
+{
+    rtsp_parser_t p;
+    rtsp_parser_reset(&p);
+    memset(log, 0, sizeof(*log));
+
+    size_t head = 0;        /* First unconsumed byte */
+    size_t avail = 0;       /* Bytes received so far */
+    size_t piece = 0;
+    while (avail < len && !log->error) {
+        size_t step = n_pieces && pieces[piece % n_pieces] ? pieces[piece % n_pieces] : len;
+        piece++;
+        avail = avail + step < len ? avail + step : len;
+
+        while (!log->error && log->count < MAX_PARSED) {
+            size_t pending = avail - head;
+            char *buf = malloc(pending ? pending : 1);
+            memcpy(buf, data + head, pending);
+
+            rtsp_request_t req;
+            rtsp_frame_t frame;
+            size_t used = 0;
+            rtsp_parse_result_t res = rtsp_parse(&p, buf, pending, &req, &frame, &used);
+            if (res == RTSP_PARSE_NEED_MORE) {
+                free(buf);
+                break;
+            }
+
+            parsed_t *it = &log->items[log->count++];
+            memset(it, 0, sizeof(*it));
+            it->res = res;
+            if (res == RTSP_PARSE_ERROR) {
+                log->error = true;
+            } else if (res == RTSP_PARSE_REQUEST) {
+                CHECK(used > 0 && used <= pending);
+                CHECK(within(req.method.ptr, req.method.len, buf, used));
+                CHECK(within(req.uri.ptr, req.uri.len, buf, used));
+                CHECK(within(req.version.ptr, req.version.len, buf, used));
+                CHECK(within(req.body.ptr, req.body.len, buf, used));
+                CHECK(req.header_count <= RTSP_MAX_HEADERS);
+                for (size_t h = 0; h < req.header_count; h++) {
+                    CHECK(within(req.headers[h].name.ptr, req.headers[h].name.len, buf, used));
+                    CHECK(within(req.headers[h].value.ptr, req.headers[h].value.len, buf, used));
+                }
+                size_t m = req.method.len < sizeof(it->method) - 1 ?
+                           req.method.len : sizeof(it->method) - 1;
+                memcpy(it->method, req.method.ptr, m);
+                it->cseq = req.cseq;
+                it->header_count = req.header_count;
+                it->body_len = req.body.len;
+                it->body_sum = sum_bytes(req.body.ptr, req.body.len);
+            } else {
+                CHECK(used >= 4 && used <= pending);
+                CHECK(within(frame.data, frame.len, buf, used));
+                it->channel = frame.channel;
+                it->frame_len = frame.len;
+                it->body_sum = sum_bytes(frame.data, frame.len);
+            }
+            it->consumed = used;
+            free(buf);
+            head += used;
+        }
+    }
+}
+
+static bool logs_equal(const parse_log_t *a, const parse_log_t *b)
+{
+    if (a->count != b->count || a->error != b->error) {
+        return false;
+    }
+    for (size_t i = 0; i < a->count; i++) {
+        if (memcmp(&a->items[i], &b->items[i], sizeof(parsed_t)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t build_stream(char *out, size_t cap)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < CORPUS_LEN; i++) {
+        size_t n = corpus_item_len(i);
+        if (len + n > cap) {
+            break;
+        }
+        memcpy(out + len, s_corpus[i], n);
+        len += n;
+    }
+    return len;
+}
+
+/* Every corpus message alone, and the fields the server relies on */
+static void test_corpus(void)
+{
+    static const struct {
+        rtsp_parse_result_t res;
+        const char *method;
+        int cseq;
+        size_t body_len;
+    } want[CORPUS_LEN] = {
+        { RTSP_PARSE_REQUEST, "OPTIONS",       1, 0 },
+        { RTSP_PARSE_REQUEST, "DESCRIBE",      2, 0 },
+        { RTSP_PARSE_REQUEST, "SETUP",         3, 0 },
+        { RTSP_PARSE_REQUEST, "SETUP",         4, 0 },
+        { RTSP_PARSE_REQUEST, "PLAY",          5, 0 },
+        { RTSP_PARSE_REQUEST, "SET_PARAMETER", 6, 12 },
+        { RTSP_PARSE_REQUEST, "GET_PARAMETER", 7, 0 },
+        { RTSP_PARSE_REQUEST, "TEARDOWN",      8, 0 },
+        { RTSP_PARSE_FRAME,   "",              0, 0 },
+        { RTSP_PARSE_FRAME,   "",              0, 0 },
+    };
+
+    for (size_t i = 0; i < CORPUS_LEN; i++) {
+        parse_log_t log;
+        run_stream(s_corpus[i], corpus_item_len(i), NULL, 0, &log);
+        CHECK_EQ(log.count, 1);
+        CHECK(!log.error);
+        CHECK_EQ(log.items[0].res, want[i].res);
+        CHECK(strcmp(log.items[0].method, want[i].method) == 0);
+        CHECK_EQ(log.items[0].cseq, want[i].cseq);
+        CHECK_EQ(log.items[0].body_len, want[i].body_len);
+        CHECK_EQ(log.items[0].consumed, corpus_item_len(i));
+    }
+
+    /* Header lookups on one request */
+    const char *m = s_corpus[7];
+    rtsp_parser_t p;
+    rtsp_parser_reset(&p);
+    rtsp_request_t req;
+    rtsp_frame_t frame;
+    size_t used;
+    CHECK_EQ(rtsp_parse(&p, m, strlen(m), &req, &frame, &used), RTSP_PARSE_REQUEST);
+    CHECK(rtsp_str_eq(rtsp_request_header(&req, "session"), "1A2B3C4D"));
+    CHECK(rtsp_str_eq(rtsp_request_header(&req, "X-Long"), "first part"));
+    CHECK(rtsp_request_header(&req, "Transport").ptr == NULL);
+    CHECK_EQ(req.cseq, 8);
+
+    m = s_corpus[2];
+    CHECK_EQ(rtsp_parse(&p, m, strlen(m), &req, &frame, &used), RTSP_PARSE_REQUEST);
+    rtsp_str_t t = rtsp_request_header(&req, "Transport");
+    CHECK_EQ(rtsp_str_param(t, "client_port="), 50000);
+    CHECK_EQ(rtsp_str_param(t, "server_port="), -1);
+    CHECK(rtsp_str_find(t, "unicast") != NULL);
+
+    /* The frame's channel and payload */
+    parse_log_t log;
+    run_stream(s_corpus[8], corpus_item_len(8), NULL, 0, &log);
+    CHECK_EQ(log.items[0].channel, 1);
+    CHECK_EQ(log.items[0].frame_len, 8);
+}
+
+/* The whole corpus pipelined, then split at every possible point */
+static void test_pipelined_and_split(void)
+{
+    static char stream[4096];
+    size_t len = build_stream(stream, sizeof(stream));
+
+    static parse_log_t whole, split;
+    run_stream(stream, len, NULL, 0, &whole);
+    CHECK_EQ(whole.count, CORPUS_LEN);
+    CHECK(!whole.error);
+
+    /* One byte at a time */
+    static const size_t one[] = { 1 };
+    run_stream(stream, len, one, 1, &split);
+    CHECK(logs_equal(&whole, &split));
+
+    /* Two reads, split at every offset */
+    for (size_t cut = 1; cut < len; cut++) {
+        size_t pieces[] = { cut, len };
+        run_stream(stream, len, pieces, 2, &split);
+        if (!logs_equal(&whole, &split)) {
+            fprintf(stderr, "  split at %zu differs\n", cut);
+            CHECK(false);
+            break;
+        }
+    }
+
+    /* Odd read sizes */
+    static const size_t odd[] = { 7, 13, 1, 64, 3 };
+    run_stream(stream, len, odd, sizeof(odd) / sizeof(odd[0]), &split);
+    CHECK(logs_equal(&whole, &split));
+}
+
+static void test_malformed(void)
+{
+    static const char *const bad[] = {
+        "OPTIONS rtsp://x/ HTTP/1.1\r\nCSeq: 1\r\n\r\n",        /* Not RTSP */
+        "OPTIONS\r\nCSeq: 1\r\n\r\n",                           /* No URI */
+        " OPTIONS rtsp://x/ RTSP/1.0\r\n\r\n",                  /* Empty method */
+        "OPTIONS  RTSP/1.0\r\n\r\n",                            /* Empty URI */
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nCSeq 1\r\n\r\n",         /* No colon */
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nContent-Length: -1\r\n\r\n",
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nContent-Length: 12a\r\n\r\n",
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nContent-Length: 65536\r\n\r\n",
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nContent-Length: 9999999999\r\n\r\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        parse_log_t log;
+        run_stream(bad[i], strlen(bad[i]), NULL, 0, &log);
+        if (!log.error) {
+            fprintf(stderr, "  accepted: %s\n", bad[i]);
+        }
+        CHECK(log.error);
+    }
+
+    /* CSeq that is not a positive number reads as none */
+    static const char *const no_cseq[] = {
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nCSeq: abc\r\n\r\n",
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nCSeq: 0\r\n\r\n",
+        "OPTIONS rtsp://x/ RTSP/1.0\r\nCSeq:\r\n\r\n",
+    };
+    for (size_t i = 0; i < sizeof(no_cseq) / sizeof(no_cseq[0]); i++) {
+        parse_log_t log;
+        run_stream(no_cseq[i], strlen(no_cseq[i]), NULL, 0, &log);
+        CHECK_EQ(log.count, 1);
+        CHECK_EQ(log.items[0].res, RTSP_PARSE_REQUEST);
+        CHECK_EQ(log.items[0].cseq, 0);
+    }
+
+    /* More headers than kept: the rest are skipped, CSeq still found */
+    char many[2048];
+    size_t n = (size_t)snprintf(many, sizeof(many), "OPTIONS rtsp://x/ RTSP/1.0\r\n");
+    for (int i = 0; i < RTSP_MAX_HEADERS + 4; i++) {
+        n += (size_t)snprintf(many + n, sizeof(many) - n, "X-H%d: %d\r\n", i, i);
+    }
+    n += (size_t)snprintf(many + n, sizeof(many) - n, "CSeq: 42\r\n\r\n");
+    parse_log_t log;
+    run_stream(many, n, NULL, 0, &log);
+    CHECK_EQ(log.count, 1);
+    CHECK_EQ(log.items[0].cseq, 42);
+    CHECK_EQ(log.items[0].header_count, RTSP_MAX_HEADERS);
+
+    /* The size of a pending "$" frame is known from its 4-byte header */
+    rtsp_parser_t p;
+    rtsp_parser_reset(&p);
+    rtsp_request_t req;
+    rtsp_frame_t frame;
+    size_t used;
+    CHECK_EQ(rtsp_parse(&p, "$\x00\xff\xff", 4, &req, &frame, &used), RTSP_PARSE_NEED_MORE);
+    CHECK_EQ(p.needed, 4 + 0xffff);
+}
+
+/*
+ * Where the pending message starts, past stray line ends: the server
+ * tests that byte for '$' to discard a frame too large for its buffer
+ */
+static void test_start_offset(void)
+{
+    rtsp_parser_t p;
+    rtsp_parser_reset(&p);
+    rtsp_request_t req;
+    rtsp_frame_t frame;
+    size_t used;
+
+    static const char big[] = "\r\n\n$\x00\x40\x00";
+    CHECK_EQ(rtsp_parse(&p, big, sizeof(big) - 1, &req, &frame, &used), RTSP_PARSE_NEED_MORE);
+    CHECK_EQ(p.start, 3);
+    CHECK_EQ(big[p.start], '$');
+    CHECK_EQ(p.needed, 3 + 4 + 0x4000);
+
+    /* Still known on the next call, which returns before looking again */
+    CHECK_EQ(rtsp_parse(&p, big, sizeof(big) - 1, &req, &frame, &used), RTSP_PARSE_NEED_MORE);
+    CHECK_EQ(p.start, 3);
+
+    static const char partial[] = "\r\nOPTIONS rtsp://x/ RTSP/1.0\r\n";
+    rtsp_parser_reset(&p);
+    CHECK_EQ(rtsp_parse(&p, partial, sizeof(partial) - 1, &req, &frame, &used),
+             RTSP_PARSE_NEED_MORE);
+    CHECK_EQ(p.start, 2);
+    CHECK_EQ(partial[p.start], 'O');
+
+    /* Nothing but line ends: the start is past them all */
+    rtsp_parser_reset(&p);
+    CHECK_EQ(rtsp_parse(&p, "\r\n\r\n", 4, &req, &frame, &used), RTSP_PARSE_NEED_MORE);
+    CHECK_EQ(p.start, 4);
+
+    /* A parsed message resets it for the next one */
+    rtsp_parser_reset(&p);
+    CHECK_EQ(rtsp_parse(&p, "\n$\x01\x00\x00", 5, &req, &frame, &used), RTSP_PARSE_FRAME);
+    CHECK_EQ(used, 5);
+    CHECK_EQ(p.start, 0);
+}
+
+/* Damage a message: flip, insert or delete bytes, or cut it short */
+static size_t mutate(char *buf, size_t len, size_t cap, uint32_t *seed)
+{
+    static const char interesting[] = "\r\n$: \t0123456789";
+    int edits = 1 + host_rand(seed) % 4;
+    for (int e = 0; e < edits && len > 0; e++) {
+        size_t at = host_rand(seed) % len;
+        switch (host_rand(seed) % 5) {
+        case 0:
+            buf[at] ^= (char)(1u << (host_rand(seed) % 8));
+            break;
+        case 1:
+            buf[at] = interesting[host_rand(seed) % (sizeof(interesting) - 1)];
+            break;
+        case 2:
+            if (len < cap) {
+                memmove(buf + at + 1, buf + at, len - at);
+                buf[at] = interesting[host_rand(seed) % (sizeof(interesting) - 1)];
+                len++;
+            }
+            break;
+        case 3:
+            memmove(buf + at, buf + at + 1, len - at - 1);
+            len--;
+            break;
+        default:
+            len = at;
+            break;
+        }
+    }
+    return len;
+}
+
+/*
+ * Damaged pipelines: no crash or out-of-bounds read (ASan), every result
+ * inside the buffer (run_stream), and the same messages whatever the read
+ * sizes, since the parser's resume state must not change the outcome.
+ */
+static void test_fuzz(void)
+{
+    static char stream[4096];
+    static char damaged[4096 + 64];
+    size_t len = build_stream(stream, sizeof(stream));
+    uint32_t seed = 0xC0FFEEu;
+    int iterations = 3000;
+    int errors = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        memcpy(damaged, stream, len);
+        size_t n = mutate(damaged, len, sizeof(damaged), &seed);
+
+        static parse_log_t whole, split;
+        run_stream(damaged, n, NULL, 0, &whole);
+        size_t pieces[3] = { 1 + host_rand(&seed) % 97, 1 + host_rand(&seed) % 5, 0 };
+        run_stream(damaged, n, pieces, 2, &split);
+        if (!logs_equal(&whole, &split)) {
+            fprintf(stderr, "  iteration %d: read sizes change the result\n", i);
+            CHECK(false);
+            break;
+        }
+        errors += whole.error;
+    }
+    printf("  %d damaged pipelines, %d rejected as malformed\n", iterations, errors);
+    CHECK(errors > 0);
+}
+
+int main(void)
+{
+    test_corpus();
+    test_pipelined_and_split();
+    test_malformed();
+    test_start_offset();
+    test_fuzz();
+    return host_test_result("test_rtsp_parser");
+}
@@ -0,0 +1,323 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Retransmission path: rtp_history lookups across sequence wrap and
+ * eviction, rtcp_parse_nack PID/BLP expansion, and a loopback of both
+ * through a lossy receiver that NACKs what it misses.
+ */
+
+#include "host_test.h"
+#include "rtp_history.h"
+#include "rtcp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define MEDIA_SSRC  0x11223344u
+#define RECV_SSRC   0xCAFEF00Du
+
+/* RTP header for seq, then a payload derived from seq and len */
+static size_t make_packet(uint8_t *pkt, uint16_t seq, size_t payload_len)
+{
+    memset(pkt, 0, 12);
+    pkt[0] = 0x80;
+    pkt[1] = 96;
+    pkt[2] = seq >> 8;
+    pkt[3] = (uint8_t)seq;
+    pkt[8] = MEDIA_SSRC >> 24;
+    pkt[9] = (uint8_t)(MEDIA_SSRC >> 16);
+    pkt[10] = (uint8_t)(MEDIA_SSRC >> 8);
+    pkt[11] = (uint8_t)MEDIA_SSRC;
+    for (size_t i = 0; i < payload_len; i++) {
+        pkt[12 + i] = (uint8_t)(seq * 31 + i * 7);
+    }
+    return 12 + payload_len;
+}
+
+static void put(rtp_history_t *h, uint16_t seq, size_t payload_len)
+{
+    uint8_t pkt[1500];
+    make_packet(pkt, seq, payload_len);
+    /* Header and payload given apart, as the sender does */
+    rtp_history_put(h, seq, pkt, 12, pkt + 12, payload_len);
+}
+
+static bool has(const rtp_history_t *h, uint16_t seq, size_t payload_len)
+{
+    uint8_t want[1500];
+    size_t want_len = make_packet(want, seq, payload_len);
+    size_t len = 0;
+    const uint8_t *got = rtp_history_get(h, seq, &len);
+    return got && len == want_len && memcmp(got, want, len) == 0;
+}
+
+static void test_history_wrap(void)
+{
+    rtp_history_t h;
+    CHECK_EQ(rtp_history_init(&h, 64 * 1024, 256), ESP_OK);
+
+    /* Across 65535 -> 0 the ring keeps finding every recent packet */
+    uint16_t seq = 65500;
+    for (int i = 0; i < 100; i++) {
+        put(&h, seq++, 200 + i);
+    }
+    seq = 65500;
+    for (int i = 0; i < 100; i++) {
+        CHECK(has(&h, seq++, 200 + i));
+    }
+    CHECK(!has(&h, 65499, 200));                /* Never stored */
+    CHECK(!has(&h, 64, 200));                   /* Not yet stored */
+    rtp_history_deinit(&h);
+}
+
+static void test_history_eviction(void)
+{
+    rtp_history_t h;
+
+    /* Arena eviction: 4 KB hold the last few 1 KB packets only */
+    CHECK_EQ(rtp_history_init(&h, 4096, 64), ESP_OK);
+    for (uint16_t s = 0; s < 10; s++) {
+        put(&h, s, 1000);
+    }
+    for (uint16_t s = 0; s < 10; s++) {
+        CHECK_EQ(has(&h, s, 1000), s >= 6);     /* Last 4 KB, counting the wrap pad */
+    }
+
+    /* Packets that would straddle the arena end restart at its start;
+     * the bytes of the oldest ones are overwritten in the process */
+    for (uint16_t s = 10; s < 200; s++) {
+        put(&h, s, 100 + (s * 37) % 900);
+    }
+    size_t kept = 0;
+    for (uint16_t s = 10; s < 200; s++) {
+        size_t len;
+        const uint8_t *p = rtp_history_get(&h, s, &len);
+        if (p) {
+            CHECK(has(&h, s, 100 + (s * 37) % 900));
+            CHECK(p >= h.arena && p + len <= h.arena + h.arena_size);
+            kept++;
+        }
+    }
+    CHECK(kept >= 3);
+    CHECK(!has(&h, 10, 100 + 10 * 37 % 900));
+    rtp_history_deinit(&h);
+
+    /* Slot eviction: 16 slots, plenty of bytes; seq n and n+16 collide */
+    CHECK_EQ(rtp_history_init(&h, 64 * 1024, 16), ESP_OK);
+    for (uint16_t s = 0; s < 40; s++) {
+        put(&h, s, 50);
+    }
+    for (uint16_t s = 0; s < 40; s++) {
+        CHECK_EQ(has(&h, s, 50), s >= 24);
+    }
+    rtp_history_deinit(&h);
+
+    /* Too large for the arena: not stored, nothing else lost */
+    CHECK_EQ(rtp_history_init(&h, 1024, 16), ESP_OK);
+    put(&h, 1, 100);
+    put(&h, 2, 1200);
+    CHECK(has(&h, 1, 100));
+    CHECK(!has(&h, 2, 1200));
+    rtp_history_deinit(&h);
+
+    /* Disabled history never finds anything */
+    CHECK_EQ(rtp_history_init(&h, 1024, 12), ESP_ERR_INVALID_ARG);
+    size_t len;
+    CHECK(rtp_history_get(&h, 0, &len) == NULL);
+}
+
+/*
+ * Generic NACK (RFC 4585 6.2.1) for a sorted list of lost sequence numbers,
+ * built the straightforward way a receiver would: each FCI takes the first
+ * loss not yet covered as PID and the next 16 as BLP bits.
+ */
+static size_t build_nack(uint8_t *buf, uint32_t media_ssrc,
+                         const uint16_t *lost, size_t count)
+{
+    size_t len = 12;
+    for (size_t i = 0; i < count;) {
+        uint16_t pid = lost[i++];
+        uint16_t blp = 0;
+        while (i < count && (uint16_t)(lost[i] - pid - 1) < 16) {
+            blp |= 1u << (uint16_t)(lost[i] - pid - 1);
+            i++;
+        }
+        buf[len++] = pid >> 8;
+        buf[len++] = (uint8_t)pid;
+        buf[len++] = blp >> 8;
+        buf[len++] = (uint8_t)blp;
+    }
+    size_t words = len / 4 - 1;
+    buf[0] = 0x80 | RTCP_FMT_NACK;
+    buf[1] = RTCP_PT_RTPFB;
+    buf[2] = (uint8_t)(words >> 8);
+    buf[3] = (uint8_t)words;
+    for (int i = 0; i < 4; i++) {
+        buf[4 + i] = (uint8_t)(RECV_SSRC >> (24 - 8 * i));
+        buf[8 + i] = (uint8_t)(media_ssrc >> (24 - 8 * i));
+    }
+    return len;
+}
+
+static void test_nack_blp(void)
+{
+    uint8_t pkt[256];
+    uint16_t seqs[64];
+
+    /* PID alone, then every BLP bit: bit n is PID + n + 1 */
+    for (int bit = -1; bit < 16; bit++) {
+        uint16_t lost[2] = { 1000, (uint16_t)(1001 + bit) };
+        size_t len = build_nack(pkt, MEDIA_SSRC, lost, bit < 0 ? 1 : 2);
+        size_t n = rtcp_parse_nack(pkt, len, MEDIA_SSRC, seqs, 64);
+        CHECK_EQ(n, bit < 0 ? 1 : 2);
+        CHECK_EQ(seqs[0], 1000);
+        if (bit >= 0) {
+            CHECK_EQ(seqs[1], 1001 + bit);
+        }
+    }
+
+    /* Full mask: 17 packets from one FCI, in order */
+    static const uint8_t full[] = {
+        0x81, 205, 0, 3, 0xCA, 0xFE, 0xF0, 0x0D, 0x11, 0x22, 0x33, 0x44,
+        0x03, 0xE8, 0xFF, 0xFF,
+    };
+    CHECK_EQ(rtcp_parse_nack(full, sizeof(full), MEDIA_SSRC, seqs, 64), 17);
+    for (int i = 0; i < 17; i++) {
+        CHECK_EQ(seqs[i], 1000 + i);
+    }
+    /* Capped at max, keeping the first ones */
+    CHECK_EQ(rtcp_parse_nack(full, sizeof(full), MEDIA_SSRC, seqs, 5), 5);
+    CHECK_EQ(seqs[4], 1004);
+
+    /* BLP bits past 65535 wrap to 0 */
+    static const uint8_t wrap[] = {
+        0x81, 205, 0, 3, 0xCA, 0xFE, 0xF0, 0x0D, 0x11, 0x22, 0x33, 0x44,
+        0xFF, 0xFE, 0x00, 0x0B,        /* PID 65534, bits 0, 1, 3 */
+    };
+    CHECK_EQ(rtcp_parse_nack(wrap, sizeof(wrap), MEDIA_SSRC, seqs, 64), 4);
+    CHECK_EQ(seqs[0], 65534);
+    CHECK_EQ(seqs[1], 65535);
+    CHECK_EQ(seqs[2], 0);
+    CHECK_EQ(seqs[3], 2);
+
+    /* Another stream's NACK is ignored */
+    CHECK_EQ(rtcp_parse_nack(full, sizeof(full), MEDIA_SSRC + 1, seqs, 64), 0);
+
+    /* Compound packet: RR first, then two NACKs */
+    uint8_t compound[256] = {
+        0x80, RTCP_PT_RR, 0, 1, 0xCA, 0xFE, 0xF0, 0x0D,
+    };
+    size_t len = 8;
+    uint16_t a[] = { 7, 9 }, b[] = { 40000 };
+    len += build_nack(compound + len, MEDIA_SSRC, a, 2);
+    len += build_nack(compound + len, MEDIA_SSRC, b, 1);
+    CHECK_EQ(rtcp_parse_nack(compound, len, MEDIA_SSRC, seqs, 64), 3);
+    CHECK_EQ(seqs[0], 7);
+    CHECK_EQ(seqs[1], 9);
+    CHECK_EQ(seqs[2], 40000);
+
+    /* Truncated: a length past the end stops the parse, nothing is read
+     * beyond it (ASan) */
+    for (size_t cut = 0; cut < len; cut++) {
+        uint8_t *copy = malloc(cut ? cut : 1);
+        memcpy(copy, compound, cut);
+        size_t n = rtcp_parse_nack(copy, cut, MEDIA_SSRC, seqs, 64);
+        CHECK(n <= 3);
+        free(copy);
+    }
+
+    /* Not an RTCP version 2 packet */
+    uint8_t bad[sizeof(full)];
+    memcpy(bad, full, sizeof(full));
+    bad[0] = 0x41;
+    CHECK_EQ(rtcp_parse_nack(bad, sizeof(bad), MEDIA_SSRC, seqs, 64), 0);
+}
+
+/*
+ * Loopback: a sender keeps packets in the history, a channel drops a
+ * share of them, the receiver NACKs the gaps once per "frame", and the
+ * sender answers from the history.  Every packet still in the history
+ * when NACKed must come back bit-exact.
+ */
+static void test_lossy_loopback(uint32_t seed, int loss_pct, uint16_t first_seq)
+{
+    enum { PACKETS = 20000, FRAME = 40, PAYLOAD_MAX = 1200 };
+    rtp_history_t h;
+    CHECK_EQ(rtp_history_init(&h, 256 * 1024, 512), ESP_OK);
+
+    static bool received[PACKETS];
+    memset(received, 0, sizeof(received));
+    uint16_t lost[PACKETS];
+    size_t lost_count = 0;
+    size_t dropped = 0, repaired = 0;
+
+    uint16_t seq = first_seq;
+    for (int i = 0; i < PACKETS; i++, seq++) {
+        size_t payload_len = 1 + host_rand(&seed) % PAYLOAD_MAX;
+        uint8_t pkt[1500];
+        make_packet(pkt, seq, payload_len);
+        rtp_history_put(&h, seq, pkt, 12, pkt + 12, payload_len);
+
+        if ((int)(host_rand(&seed) % 100) < loss_pct) {
+            lost[lost_count++] = seq;
+            dropped++;
+        } else {
+            received[i] = true;
+        }
+
+        if ((i + 1) % FRAME != 0 || lost_count == 0) {
+            continue;
+        }
+
+        /* Receiver: NACK the gaps, in bursts of at most 64 */
+        uint8_t nack[12 + 4 * 64];
+        uint16_t seqs[64 * 17];
+        for (size_t off = 0; off < lost_count; off += 64) {
+            size_t n = lost_count - off < 64 ? lost_count - off : 64;
+            size_t len = build_nack(nack, MEDIA_SSRC, lost + off, n);
+            size_t got = rtcp_parse_nack(nack, len, MEDIA_SSRC, seqs, 64 * 17);
+            CHECK_EQ(got, n);
+
+            /* Sender: answer from the history */
+            for (size_t k = 0; k < got; k++) {
+                CHECK_EQ(seqs[k], lost[off + k]);
+                size_t rlen;
+                const uint8_t *r = rtp_history_get(&h, seqs[k], &rlen);
+                CHECK(r != NULL);
+                if (!r) {
+                    continue;
+                }
+                int idx = (uint16_t)(seqs[k] - first_seq);
+                uint8_t want[1500];
+                make_packet(want, seqs[k], rlen - 12);
+                CHECK(memcmp(r, want, rlen) == 0);
+                received[idx] = true;
+                repaired++;
+            }
+        }
+        lost_count = 0;
+    }
+
+    CHECK_EQ(repaired, dropped);
+    for (int i = 0; i < PACKETS; i++) {
+        CHECK(received[i]);
+        if (!received[i]) {
+            break;
+        }
+    }
+    rtp_history_deinit(&h);
+}
+
+int main(void)
+{
+    test_history_wrap();
+    test_history_eviction();
+    test_nack_blp();
+    test_lossy_loopback(0x9E3779B9u, 2, 0);
+    test_lossy_loopback(0x12345678u, 10, 65000);    /* Wraps three times */
+    test_lossy_loopback(0xDEADBEEFu, 30, 30000);
+    return host_test_result("test_rtx");
+}
@@ -0,0 +1,105 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * sensor_mode_select(): smallest covering mode, frame-rate preference and
+ * fallback, and the OV5647 table as configured in sdkconfig.defaults.
+ */
+
+#include "host_test.h"
+#include "sensor_modes.h"
+#include "uvc_frame_config.h"
+
+#include <string.h>
+
+static const sensor_mode_t s_table[] = {
+    { 1920, 1080, 30, false, "1080p30" },
+    { 1280,  960, 45, true,  "960p45" },
+    {  800,  800, 50, true,  "800x800" },
+    {  800,  640, 50, true,  "800x640" },
+    {  640,  480, 60, true,  "vga60" },
+    {  640,  480, 90, true,  "vga90" },
+};
+#define TABLE_COUNT (sizeof(s_table) / sizeof(s_table[0]))
+
+static const char *pick(uint32_t w, uint32_t h, uint32_t fps)
+{
+    const sensor_mode_t *m = sensor_mode_select(s_table, TABLE_COUNT, w, h, fps);
+    return m ? m->name : "none";
+}
+
+static void test_selection(void)
+{
+    /* Smallest area that covers both dimensions */
+    CHECK(strcmp(pick(640, 480, 30), "vga90") == 0);   /* Area tie: faster mode */
+    CHECK(strcmp(pick(320, 240, 30), "vga90") == 0);
+    CHECK(strcmp(pick(800, 600, 30), "800x640") == 0);
+    CHECK(strcmp(pick(800, 700, 30), "800x800") == 0);
+    CHECK(strcmp(pick(1280, 720, 30), "960p45") == 0);
+    CHECK(strcmp(pick(1920, 1080, 30), "1080p30") == 0);
+
+    /* Frame rate narrows the choice */
+    CHECK(strcmp(pick(640, 480, 70), "vga90") == 0);
+    CHECK(strcmp(pick(800, 600, 48), "800x640") == 0);
+    CHECK(strcmp(pick(1280, 720, 50), "1080p30") != 0);
+
+    /* No mode fast enough: the size alone decides */
+    CHECK(strcmp(pick(1280, 720, 60), "960p45") == 0);
+    CHECK(strcmp(pick(1920, 1080, 60), "1080p30") == 0);
+
+    /* fps 0 = don't care */
+    CHECK(strcmp(pick(1280, 960, 0), "960p45") == 0);
+
+    /* Nothing large enough */
+    CHECK(strcmp(pick(2592, 1944, 15), "none") == 0);
+    CHECK(strcmp(pick(1920, 1200, 30), "none") == 0);
+    CHECK(sensor_mode_select(s_table, 0, 640, 480, 30) == NULL);
+}
+
+/* Height alone can force a larger mode than the width needs */
+static void test_height_bound(void)
+{
+    CHECK(strcmp(pick(1280, 1024, 30), "1080p30") == 0);
+    CHECK(strcmp(pick(800, 1000, 30), "1080p30") == 0);
+}
+
+/* Every frame size the UVC descriptors offer resolves to a configured mode */
+static void test_configured_table(void)
+{
+    size_t count;
+    const sensor_mode_t *modes = sensor_modes_get(&count);
+    CHECK_EQ(count, 3);
+
+    static const struct { const uvc_frame_info_t *frames; int n; } formats[] = {
+        { uvc_uyvy_frames, UYVY_FRAME_COUNT },
+        { uvc_mjpeg_frames, MJPEG_FRAME_COUNT },
+        { uvc_h264_frames, H264_FRAME_COUNT },
+    };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (int i = 0; i < formats[f].n; i++) {
+            const uvc_frame_info_t *fi = &formats[f].frames[i];
+            const sensor_mode_t *m = sensor_mode_select(modes, count, fi->width, fi->height,
+                                                        fi->max_fps);
+            CHECK(m != NULL);
+            if (m) {
+                CHECK(m->width >= fi->width && m->height >= fi->height);
+            }
+        }
+    }
+
+    const sensor_mode_t *m = sensor_mode_select(modes, count, 640, 480, 30);
+    CHECK(m && m->width == 800 && m->height == 640);
+    m = sensor_mode_select(modes, count, 1280, 720, 30);
+    CHECK(m && m->width == 1280 && m->height == 960);
+    m = sensor_mode_select(modes, count, 1920, 1080, 30);
+    CHECK(m && m->width == 1920 && m->height == 1080);
+}
+
+int main(void)
+{
+    test_selection();
+    test_height_bound();
+    test_configured_table();
+    return host_test_result("test_sensor_modes");
+}